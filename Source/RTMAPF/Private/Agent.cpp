@@ -2,10 +2,13 @@
 #include "MAPF.h"
 #include "Segments.h"
 #include "MovesSegments.h"
+#include "PlannerStats.h"
 #include "Kismet/GameplayStatics.h"
 
 ArrayType<MoveDelta<Area>> MovesTestSegment::FindValidMoves(const Node<Area>& Node)
 {
+  PLANNER_PHASE_SCOPE(EPlannerPhase::SippExpansion);
+
   ArrayType<MoveDelta<Area>> Result;
   Area Origin = Node.Cell;
 
@@ -43,16 +46,16 @@ ArrayType<MoveDelta<Area>> MovesTestSegment::FindValidMoves(const Node<Area>& No
         break;
       }
 
-      SegmentHolder MovePointHolder = Space->GetSegments(MovePoint);
-      MovePointHolder -= MovementSegment.Start;
-      MovePointHolder.LowerSegments(MovementSegment.GetLength());
-      DestinationSegmentHolder = DestinationSegmentHolder & MovePointHolder;
+      DestinationSegmentHolder.IntersectWithLowered(Space->GetSegments(MovePoint), MovementSegment.Start, MovementSegment.GetLength());
     }
 
-    const auto OriginalDestinationSegments = Space->GetSegments(DestinationPoint);
+    const SegmentHolder& OriginalDestinationSegments = Space->GetSegments(DestinationPoint);
 
-    std::unordered_map<Segment, float> DestinationSegmentToMinTime;
-    for (auto& DestinationSegment : DestinationSegmentHolder)
+    SearchArenaScope ScratchScope(ScratchArena);
+    MapType<Segment, float, std::hash<Segment>, std::equal_to<Segment>, ArenaAllocator<std::pair<const Segment, float>>> DestinationSegmentToMinTime{
+      ArenaAllocator<std::pair<const Segment, float>>(ScratchArena)
+    };
+    for (const Segment DestinationSegment : DestinationSegmentHolder)
     {
       const float TimeOnDestination = DestinationSegment.Start + DestinationMoveSegment.Start;
       Segment OriginalSegment = OriginalDestinationSegments.Find(
@@ -192,6 +195,20 @@ FPathPoint UAgent::GetNextMove() const
   return MAPFSubsystem->GetNextMove(AgentID);
 }
 
+float UAgent::GetCurrentYaw() const
+{
+  if (!bIsConnected)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Calling GetCurrentYaw before connection to MAPF subsystem"));
+    return 0.f;
+  }
+
+  auto MAPFSubsystem = GetMAPF();
+  if (!MAPFSubsystem) return 0.f;
+
+  return MAPFSubsystem->GetCurrentYaw(AgentID);
+}
+
 void UAgent::ChangeGoal(FPoint NewGoal)
 {
   auto MAPFSubsystem = GetMAPF();
@@ -205,6 +222,21 @@ void UAgent::ChangeGoal(FPoint NewGoal)
   MAPFSubsystem->ForceReplan(AgentID);
 }
 
+void UAgent::AddGoals(const TArray<FPoint>& Goals)
+{
+  AppendGoalsSafe(Goals);
+  if (!bIsConnected || !Goals.Num())
+  {
+    // Goals of a new agent are recorded with it
+    return;
+  }
+
+  auto MAPFSubsystem = GetMAPF();
+  if (!MAPFSubsystem) return;
+
+  MAPFSubsystem->HandleGoalsAdded(AgentID, Goals);
+}
+
 void UAgent::GetPropertiesSafe(
   int& OuterID,
   FPoint& OuterStart,
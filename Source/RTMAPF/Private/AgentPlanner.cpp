@@ -1,23 +1,47 @@
 #include "AgentPlanner.h"
 #include "Async/Async.h"
 #include "Math/UnrealMathVectorCommon.h"
+#include "StaticMoves.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <limits>
 
+// Nodes reserved by every search of a planner context at its creation
+#define PLANNER_CONTEXT_RESERVED_NODES 1024
+
 FAdaptivePath::FAdaptivePath(
   UAgent* InAgent, 
-  std::shared_ptr<SpaceTime> InSpace, 
+  std::shared_ptr<ShardedSpace> InShards, 
   float InDepth, 
   float InCurrentTime, 
   float InInactivityDelay
 )
   : Agent(InAgent)
-  , Space(InSpace)
+  , Shards(InShards)
   , Depth(InDepth)
   , CurrentTime(InCurrentTime)
   , InactivityDelay(InInactivityDelay)
 {
   check(Depth > 0);
+  check(Shards);
+}
+
+FAdaptivePath::FAdaptivePath(
+  const FReplanInput& InProperties,
+  std::shared_ptr<ShardedSpace> InShards,
+  float InDepth,
+  float InCurrentTime
+)
+  : Agent(nullptr)
+  , Properties(InProperties)
+  , Shards(InShards)
+  , Depth(InDepth)
+  , CurrentTime(InCurrentTime)
+{
+  check(Depth > 0);
+  check(Shards);
 }
 
 FAdaptivePath::~FAdaptivePath()
@@ -27,20 +51,34 @@ FAdaptivePath::~FAdaptivePath()
     ReplanResult.Wait();
   }
 
-  ClearAreasWithPath(ReversedPath);
+  ClearAreasWithPath(ReversedPath, ReversedStates, Primitives.get());
 }
 
 FAdaptivePath::FAdaptivePath(FAdaptivePath&& Other)
   : Agent(Other.Agent)
+  , Properties(std::move(Other.Properties))
+  , Shards(Other.Shards)
   , Space(Other.Space)
+  , SearchShard(Other.SearchShard)
+  , PathShard(Other.PathShard)
+  , DistanceTables(Other.DistanceTables)
   , ReversedPath(Other.ReversedPath)
+  , ReversedStates(Other.ReversedStates)
+  , Primitives(Other.Primitives)
   , NextNodeIndex(Other.NextNodeIndex)
+  , bShortcuts(Other.bShortcuts)
+  , bBidirectionalHeuristic(Other.bBidirectionalHeuristic)
+  , FilledAreas(std::move(Other.FilledAreas))
   , Depth(Other.Depth)
   , CurrentTime(Other.CurrentTime)
   , InactivityDelay(Other.InactivityDelay)
+  , GoalCheckTime(Other.GoalCheckTime)
+  , ReachedGoal(Other.ReachedGoal)
   , AgentShapeCapture(Other.AgentShapeCapture)
+  , PathInput(Other.PathInput)
 {
   Other.ReversedPath.clear();
+  Other.ReversedStates.clear();
 }
 
 const Node<Area>& FAdaptivePath::GetNextNode() const
@@ -53,6 +91,11 @@ const Node<Area>& FAdaptivePath::GetPreviousNode() const
   return ReversedPath.at(ReversedPath.size() - NextNodeIndex);
 }
 
+FPoint FAdaptivePath::GetStart() const
+{
+  return Agent ? Agent->GetStartSafe() : Properties.Point;
+}
+
 void FAdaptivePath::MoveTimeBy(float DeltaTime)
 {
   check(DeltaTime >= 0);
@@ -60,8 +103,39 @@ void FAdaptivePath::MoveTimeBy(float DeltaTime)
 
   FScopeLock PathLock(&PathSync);
   CurrentTime += DeltaTime;
+  AdvanceAlongPath(ReversedPath, CurrentTime, NextNodeIndex);
+}
+
+bool FAdaptivePath::CheckGoalReached(FPoint Goal)
+{
+  FScopeLock PathLock(&PathSync);
+
+  if (ReachedGoal && !(ReachedGoal.GetValue() == Goal))
+  {
+    ReachedGoal.Reset();
+  }
 
-  while (ReversedPath.size() > NextNodeIndex && GetNextNode().MinTime < CurrentTime)
+  if (!ReachedGoal)
+  {
+    // Nodes are checked from the earliest one
+    for (auto PathNode = ReversedPath.rbegin(); PathNode != ReversedPath.rend() && PathNode->MinTime <= CurrentTime; ++PathNode)
+    {
+      if (PathNode->MinTime > GoalCheckTime && PathNode->Cell.Point == Goal)
+      {
+        GoalCheckTime = PathNode->MinTime;
+        ReachedGoal = Goal;
+        return true;
+      }
+    }
+  }
+
+  GoalCheckTime = CurrentTime;
+  return false;
+}
+
+void AdvanceAlongPath(const std::vector<Node<Area>>& ReversedPath, float Time, size_t& NextNodeIndex)
+{
+  while (ReversedPath.size() > NextNodeIndex && ReversedPath.at(ReversedPath.size() - NextNodeIndex - 1).MinTime < Time)
   {
     ++NextNodeIndex;
   }
@@ -97,7 +171,15 @@ FPathPoint FAdaptivePath::GetNextMove(ASpace* SpaceWrapper) const
     }
     return  { CurrentTime + InactivityDelay, SpaceWrapper->Translate(NextNode.Cell.Point) };
   }
-  return  { CurrentTime + InactivityDelay, SpaceWrapper->Translate(Agent->GetStartSafe()) };
+  return  { CurrentTime + InactivityDelay, SpaceWrapper->Translate(GetStart()) };
+}
+
+void FAdaptivePath::WaitForReplan() const
+{
+  if (ReplanResult.IsValid())
+  {
+    ReplanResult.Wait();
+  }
 }
 
 bool FAdaptivePath::CheckForUpdate()
@@ -109,6 +191,11 @@ bool FAdaptivePath::CheckForUpdate()
 
   ReplanChanges Changes = ReplanResult.Get();
   ReplanResult.Reset();
+  // Depth is changed only when async task is empty or done
+  Depth = Changes.Depth;
+  bLastReplanFailed = !Changes.ReplanSeccess;
+  PendingStats += Changes.Stats;
+  PendingEvents.insert(PendingEvents.end(), Changes.Events.begin(), Changes.Events.end());
   if (!Changes.ReplanSeccess)
   {
     // Replanning failed and the path is updated with itself
@@ -117,12 +204,27 @@ bool FAdaptivePath::CheckForUpdate()
 
   // No sync lock
   ReversedPath = std::move(Changes.ReversedPath);
+  ReversedStates = std::move(Changes.ReversedStates);
+  Primitives = Changes.Primitives;
+  FilledAreas = std::move(Changes.FilledAreas);
   NextNodeIndex = 1;
   MoveTimeBy(0);
 
   return true;
 }
 
+FPoint FAdaptivePath::GetCurrentPoint() const
+{
+  FScopeLock PathLock(&PathSync);
+
+  if (ReversedPath.size() < NextNodeIndex)
+  {
+    return GetStart();
+  }
+
+  return GetPreviousNode().Cell.Point;
+}
+
 FVector FAdaptivePath::GetCurrentLocation(ASpace* SpaceWrapper) const
 {
   check(SpaceWrapper);
@@ -130,7 +232,7 @@ FVector FAdaptivePath::GetCurrentLocation(ASpace* SpaceWrapper) const
 
   if (ReversedPath.size() < NextNodeIndex)
   {
-    return SpaceWrapper->Translate(Agent->GetStartSafe());
+    return SpaceWrapper->Translate(GetStart());
   }
 
   const auto& NextNode = GetNextNode();
@@ -146,150 +248,1178 @@ FVector FAdaptivePath::GetCurrentLocation(ASpace* SpaceWrapper) const
   }
   if (CurrentTime < NextNode.MinTime)
   {
-    return FMath::Lerp(PrevNodeLocation, NextNodeLocation, (CurrentTime - MovementStartTime) / NextNode.ArrivalCost);
+    float MoveShare = (CurrentTime - MovementStartTime) / NextNode.ArrivalCost;
+
+    // Steps of kinodynamic paths follow their speed profiles
+    const int Heading = FindHeading(NextNode.Cell.Point - PrevNode.Cell.Point);
+    if (IsKinodynamic() && Heading >= 0)
+    {
+      const size_t PrevIndex = ReversedPath.size() - NextNodeIndex;
+      MoveShare = Primitives->GetDistanceShare(Heading, ReversedStates[PrevIndex].bMoving, ReversedStates[PrevIndex - 1].bMoving, MoveShare);
+    }
+
+    return FMath::Lerp(PrevNodeLocation, NextNodeLocation, MoveShare);
   }
 
   return NextNodeLocation;
 }
 
-struct RepairDetails
+float FAdaptivePath::GetCurrentYaw() const
 {
-  Node<Area> PrevNode;
-  float NextNodeArrivalCost;
+  FScopeLock PathLock(&PathSync);
 
-  RepairDetails(const Node<Area>& InPrevNode, float InNextNodeArrivalCost)
+  if (!IsKinodynamic() || ReversedPath.size() <= NextNodeIndex)
   {
-    PrevNode = InPrevNode;
-    PrevNode.ArrivalCost = 0;
-    PrevNode.Parent = nullptr;
-    NextNodeArrivalCost = InNextNodeArrivalCost;
+    return 0.f;
   }
-};
 
-bool FAdaptivePath::Replan(float InDepth)
+  const auto& NextNode = GetNextNode();
+  const auto& PrevNode = GetPreviousNode();
+  const size_t PrevIndex = ReversedPath.size() - NextNodeIndex;
+  const float PrevYaw = 45.f * ReversedStates[PrevIndex].Heading;
+
+  const float TurnStartTime = NextNode.MinTime - NextNode.ArrivalCost;
+  if (!(PrevNode.Cell.Point == NextNode.Cell.Point) || CurrentTime <= TurnStartTime)
+  {
+    return PrevYaw;
+  }
+
+  // Turns in place go the shorter way
+  float Turn = 45.f * ((int) ReversedStates[PrevIndex - 1].Heading - (int) ReversedStates[PrevIndex].Heading);
+  if (Turn > 180.f)
+  {
+    Turn -= 360.f;
+  }
+  else if (Turn < -180.f)
+  {
+    Turn += 360.f;
+  }
+
+  if (CurrentTime >= NextNode.MinTime)
+  {
+    return PrevYaw + Turn;
+  }
+
+  return PrevYaw + Turn * (CurrentTime - TurnStartTime) / NextNode.ArrivalCost;
+}
+
+float FAdaptivePath::ChooseDepth(const FHorizonSettings& Settings, const FReplanInput& Input) const
 {
-  check(Agent);
-  if (ReplanResult.IsValid())
+  check(Settings.MinDepth > 0 && Settings.MinDepth <= Settings.MaxDepth);
+
+  const FPoint Center = Input.Point;
+  const int Radius = Settings.NeighbourhoodRadius;
+
+  int BlockedCells = 0;
+  int ReservedCells = 0;
+  int AllCells = 0;
+  for (int X = Center.X - Radius; X <= Center.X + Radius; ++X)
   {
-    return false;
+    for (int Y = Center.Y - Radius; Y <= Center.Y + Radius; ++Y)
+    {
+      ++AllCells;
+      const FPoint Point = { X, Y };
+      if (!Space->ContainsSegmentsIn(Point))
+      {
+        ++BlockedCells;
+        continue;
+      }
+
+      // A cell without reservations holds exactly one unbounded segment
+      const SegmentHolder& Segments = Space->GetSegments(Point);
+      auto FirstSegment = Segments.begin();
+      if (FirstSegment == Segments.end() || std::next(FirstSegment) != Segments.end() || FirstSegment->End < Space->GetDepth())
+      {
+        ++ReservedCells;
+      }
+    }
   }
 
-  // Depth is changed only when async task is empty or done
-  Depth = InDepth;
+  const int FreeCells = AllCells - BlockedCells;
+  const float Narrowness = (float) BlockedCells / AllCells;
+  const float Congestion = FreeCells ? (float) ReservedCells / FreeCells : 1.f;
+  const float Difficulty = std::max(Narrowness, Congestion);
 
-  ReplanResult = Async(EAsyncExecution::ThreadPool, [this]() -> ReplanChanges {
-    ReplanChanges Changes = { false };
-    float AgentTimeCapture;
-    
+  float ChosenDepth = Settings.MinDepth + (Settings.MaxDepth - Settings.MinDepth) * Difficulty;
+
+  // In the lifelong mode the window continues after the goal
+  if (Input.NextGoals.empty())
+  {
+    const FPoint ToGoal = Input.Goal - Center;
+    const float GoalCost = std::sqrt((float) (ToGoal.X * ToGoal.X + ToGoal.Y * ToGoal.Y)) / Input.Speed;
+    ChosenDepth = std::min(ChosenDepth, std::max(Settings.MinDepth, GoalCost * Settings.GoalDistanceSlack));
+  }
+
+  return ChosenDepth;
+}
+
+void FAdaptivePath::SetDistanceTables(std::shared_ptr<const StaticDistanceTables> InDistanceTables)
+{
+  DistanceTables = InDistanceTables;
+}
+
+void FAdaptivePath::SetShortcuts(bool bEnable)
+{
+  FScopeLock PathLock(&PathSync);
+  bShortcuts = bEnable;
+}
+
+void FAdaptivePath::SetBidirectionalHeuristic(bool bEnable)
+{
+  FScopeLock PathLock(&PathSync);
+  bBidirectionalHeuristic = bEnable;
+}
+
+void FAdaptivePath::SetProperties(const FReplanInput& InProperties)
+{
+  FScopeLock PathLock(&PathSync);
+  Properties = InProperties;
+}
+
+void FAdaptivePath::SetSearchShard(int Shard)
+{
+  check(!ReplanResult.IsValid());
+  SearchShard = Shard;
+  Space = Shards->GetShardSpace(Shard);
+}
+
+RepairDetails::RepairDetails(const Node<Area>& InPrevNode, float InNextNodeArrivalCost)
+{
+  PrevNode = InPrevNode;
+  PrevNode.ArrivalCost = 0;
+  PrevNode.Parent = nullptr;
+  NextNodeArrivalCost = InNextNodeArrivalCost;
+}
+
+void FAdaptivePath::CaptureReplanInput(FReplanInput& Input) const
+{
+  size_t CapturedNextNodeIndex;
+  {
+    FScopeLock PathLock(&PathSync);
+    Input.Time = CurrentTime;
+    Input.Depth = Depth;
+    Input.bShortcuts = bShortcuts;
+    Input.bBidirectionalHeuristic = bBidirectionalHeuristic;
+    CapturedNextNodeIndex = NextNodeIndex;
+  }
+
+  // Gather Agent properties
+  ArrayType<FPoint> NextGoals;
+  Input.Moves.clear();
+  if (Agent)
+  {
+    Agent->GetPropertiesSafe(Input.AgentID, Input.Point, Input.Goal, Input.Shape, Input.Moves, Input.Speed);
+    // The tick may advance the goal meanwhile, so the goal is read again with the next goals
+    Agent->GetGoalsSafe(Input.Goal, NextGoals, REPLAN_MAX_NEXT_GOALS);
+    Input.Kinodynamics = Agent->GetKinodynamicsSafe();
+  }
+  else
+  {
+    FScopeLock PathLock(&PathSync);
+    Input.AgentID = Properties.AgentID;
+    Input.Point = Properties.Point;
+    Input.Goal = Properties.Goal;
+    Input.Shape = Properties.Shape;
+    Input.Moves = Properties.Moves;
+    Input.Speed = Properties.Speed;
+    Input.Kinodynamics = Properties.Kinodynamics;
+    const size_t NextGoalsNum = std::min(Properties.NextGoals.size(), (size_t) REPLAN_MAX_NEXT_GOALS);
+    NextGoals.assign(Properties.NextGoals.begin(), Properties.NextGoals.begin() + NextGoalsNum);
+  }
+  Input.Distances = DistanceTables ? DistanceTables->Find(Input.Goal, Input.Shape, Input.Moves, Input.Speed) : nullptr;
+
+  // Primitives of the current path are reused while the model of the agent is the same
+  Input.Primitives.reset();
+  if (Input.Kinodynamics.bEnabled)
+  {
+    Input.Primitives = Primitives && Primitives->GetModel() == Input.Kinodynamics
+      ? Primitives
+      : std::make_shared<const KinodynamicPrimitives>(Input.Kinodynamics);
+  }
+
+  // Without a distance table the window is searched towards the border of the region nearest to the goal
+  if (Shards->IsSharded() && !Input.Distances)
+  {
+    Input.Goal = Shards->FindRegionGoal(SearchShard, Input.Goal, Input.Shape);
+  }
+
+  // Windows of sharded spaces end in the region of the search, so they don't pass through goals
+  Input.NextGoals.clear();
+  Input.NextDistances.clear();
+  if (!Shards->IsSharded())
+  {
+    Input.NextGoals = std::move(NextGoals);
+    for (const FPoint& NextGoal : Input.NextGoals)
+    {
+      Input.NextDistances.push_back(DistanceTables ? DistanceTables->Find(NextGoal, Input.Shape, Input.Moves, Input.Speed) : nullptr);
+    }
+  }
+
+  CapturePathPosition(ReversedPath, CapturedNextNodeIndex, Input);
+
+  if (Input.Primitives)
+  {
+    // A path that isn't kinodynamic is continued standing with the start heading
+    Input.StartState = { (uint8) Input.Primitives->GetStartHeading(), false };
+    if (ReversedStates.size() && ReversedStates.size() == ReversedPath.size())
+    {
+      const size_t PrevIndex = ReversedPath.size() - CapturedNextNodeIndex;
+      Input.StartState = ReversedStates[Input.Repair ? PrevIndex - 1 : PrevIndex];
+      if (Input.Repair)
+      {
+        Input.Repair.GetValue().PrevState = ReversedStates[PrevIndex];
+      }
+    }
+  }
+}
+
+void CapturePathPosition(const std::vector<Node<Area>>& ReversedPath, size_t NextNodeIndex, FReplanInput& Input)
+{
+  Input.Repair.Reset();
+  if (ReversedPath.size())
+  {
+    const auto& PrevNode = ReversedPath.at(ReversedPath.size() - NextNodeIndex);
+    const auto& NextNode = ReversedPath.at(ReversedPath.size() - NextNodeIndex - 1);
+    Input.Point = PrevNode.Cell.Point;
+
+    float MovementStartTime = NextNode.MinTime - NextNode.ArrivalCost;
+    if (MovementStartTime < Input.Time)
+    {
+      Input.Time = NextNode.MinTime;
+      Input.Point = NextNode.Cell.Point;
+      Input.Repair = RepairDetails(PrevNode, NextNode.ArrivalCost);
+    }
+  }
+}
+
+namespace
+{
+  /**
+   * Returns false if the destination isn't reached, the path is collected otherwise.
+   */
+  template<typename PathfinderType, typename CellType>
+  bool SearchWindow(PathfinderType& Pathfinder, CellType Destination, std::vector<Node<CellType>>& OutReversedPath)
+  {
+    Pathfinder.FindCost(Destination);
+    PlannerStats::AddSearch(Pathfinder.GetStats().GetStepsCount(), Pathfinder.GetStats().GetNodesCount());
+    if (!Pathfinder.IsCostFound(Destination))
+    {
+      return false;
+    }
+
+    // Gather Results
+    Pathfinder.CollectPath(Destination, OutReversedPath, true);
+    return true;
+  }
+
+  /**
+   * Search structures of one move set, created by the first replan of a worker thread
+   * and reset by the next ones, so their containers keep the allocated memory.
+   * Nodes of the searches are allocated from the arena of the replan.
+   */
+  template<typename MovesType>
+  struct WindowSearchContext
+  {
+    using PlaneSearchType = Pathfinder<FPoint, MovesType, EuclideanHeuristic>;
+    using PlaneAdapterType = StaticSpaceAdapter<FPoint, Area, PlaneSearchType>;
+    using TableAdapterType = StaticSpaceAdapter<FPoint, Area, DistanceTableHeuristic>;
+    using BidirectionalAdapterType = StaticSpaceAdapter<FPoint, Area, BidirectionalPathfinder<MovesType>>;
+
+    SearchArena* Arena = nullptr;
+    SearchArena* ScratchArena = nullptr;
+
+    std::shared_ptr<MovesType> Moves;
+
+    std::shared_ptr<EuclideanHeuristic> PlaneHeuristic;
+    std::shared_ptr<PlaneSearchType> PlaneSearch;
+    std::shared_ptr<WindowedPathfinder<Area, MovesType, PlaneAdapterType>> PlaneWindowSearch;
+
+    std::shared_ptr<BidirectionalPathfinder<MovesType>> BidirectionalSearch;
+    std::shared_ptr<WindowedPathfinder<Area, MovesType, BidirectionalAdapterType>> BidirectionalWindowSearch;
+
+    std::shared_ptr<DistanceTableHeuristic> TableHeuristic;
+    std::shared_ptr<WindowedPathfinder<Area, MovesType, TableAdapterType>> TableWindowSearch;
+
+    std::shared_ptr<OneCellHeuristic<FPoint>> FallbackHeuristic;
+    std::shared_ptr<WindowedPathfinder<Area, MovesType>> FallbackWindowSearch;
+
+    void ResetMoves(const FReplanInput& Input, std::shared_ptr<ShapeSpace> AgentSpace, float WindowEnd)
+    {
+      if (!Moves)
+      {
+        ArrayType<MoveDelta<FPoint>> InputMoves = Input.Moves;
+        Moves = std::make_shared<MovesType>(InputMoves, AgentSpace, WindowEnd);
+        Moves->SetScratchArena(ScratchArena);
+        return;
+      }
+
+      Moves->Reset(Input.Moves, WindowEnd);
+    }
+
+    WindowedPathfinder<Area, MovesType, PlaneAdapterType>& ResetPlaneWindowSearch(const FReplanInput& Input, Area OriginalArea, float WindowEnd)
+    {
+      if (!PlaneWindowSearch)
+      {
+        PlaneHeuristic = std::make_shared<EuclideanHeuristic>(Input.Point, Input.Speed);
+        PlaneSearch = std::make_shared<PlaneSearchType>(Moves, Input.Goal, PlaneHeuristic);
+        PlaneSearch->Reserve(PLANNER_CONTEXT_RESERVED_NODES);
+        PlaneWindowSearch = std::make_shared<WindowedPathfinder<Area, MovesType, PlaneAdapterType>>(
+          Moves, OriginalArea, std::make_shared<PlaneAdapterType>(PlaneSearch), WindowEnd, Input.Time
+        );
+        PlaneWindowSearch->Reserve(PLANNER_CONTEXT_RESERVED_NODES);
+      }
+
+      // Searches created above are reset as well, so their nodes are allocated from the arena
+      *PlaneHeuristic = EuclideanHeuristic(Input.Point, Input.Speed);
+      PlaneSearch->Reset(Input.Goal, 0.f, Arena);
+      PlaneWindowSearch->Reset(OriginalArea, WindowEnd, Input.Time, Arena);
+      return *PlaneWindowSearch;
+    }
+
+    WindowedPathfinder<Area, MovesType, BidirectionalAdapterType>& ResetBidirectionalWindowSearch(const FReplanInput& Input, Area OriginalArea, float WindowEnd)
+    {
+      if (!BidirectionalWindowSearch)
+      {
+        BidirectionalSearch = std::make_shared<BidirectionalPathfinder<MovesType>>(Moves, Input.Goal, Input.Point, Input.Speed);
+        BidirectionalSearch->Reserve(PLANNER_CONTEXT_RESERVED_NODES);
+        BidirectionalWindowSearch = std::make_shared<WindowedPathfinder<Area, MovesType, BidirectionalAdapterType>>(
+          Moves, OriginalArea, std::make_shared<BidirectionalAdapterType>(BidirectionalSearch), WindowEnd, Input.Time
+        );
+        BidirectionalWindowSearch->Reserve(PLANNER_CONTEXT_RESERVED_NODES);
+      }
+
+      BidirectionalSearch->Reset(Input.Goal, Input.Point, Input.Speed, Arena);
+      BidirectionalWindowSearch->Reset(OriginalArea, WindowEnd, Input.Time, Arena);
+      return *BidirectionalWindowSearch;
+    }
+
+    WindowedPathfinder<Area, MovesType, TableAdapterType>& ResetTableWindowSearch(const FReplanInput& Input, Area OriginalArea, float WindowEnd)
+    {
+      if (!TableWindowSearch)
+      {
+        TableHeuristic = std::make_shared<DistanceTableHeuristic>(Input.Distances, Input.Speed);
+        TableWindowSearch = std::make_shared<WindowedPathfinder<Area, MovesType, TableAdapterType>>(
+          Moves, OriginalArea, std::make_shared<TableAdapterType>(TableHeuristic), WindowEnd, Input.Time
+        );
+        TableWindowSearch->Reserve(PLANNER_CONTEXT_RESERVED_NODES);
+      }
+
+      TableHeuristic->SetTable(Input.Distances, Input.Speed);
+      TableWindowSearch->Reset(OriginalArea, WindowEnd, Input.Time, Arena);
+      return *TableWindowSearch;
+    }
+
+    WindowedPathfinder<Area, MovesType>& ResetFallbackWindowSearch(const FReplanInput& Input, Area OriginalArea, float WindowEnd)
+    {
+      if (!FallbackWindowSearch)
+      {
+        FallbackHeuristic = std::make_shared<OneCellHeuristic<FPoint>>(Input.Point);
+        FallbackWindowSearch = std::make_shared<WindowedPathfinder<Area, MovesType>>(
+          Moves, OriginalArea, std::make_shared<SpaceAdapter<FPoint, Area>>(FallbackHeuristic), WindowEnd, Input.Time
+        );
+      }
+
+      *FallbackHeuristic = OneCellHeuristic<FPoint>(Input.Point);
+      FallbackWindowSearch->Reset(OriginalArea, WindowEnd, Input.Time, Arena);
+      return *FallbackWindowSearch;
+    }
+
+    // Tables may be rebuilt while the context is idle, nodes are emptied before their arena is released
+    void Release()
+    {
+      if (TableHeuristic)
+      {
+        TableHeuristic->SetTable(nullptr, 1.f);
+      }
+
+      if (PlaneWindowSearch)
+      {
+        PlaneSearch->ReleaseNodes();
+        PlaneWindowSearch->ReleaseNodes();
+      }
+      if (BidirectionalWindowSearch)
+      {
+        BidirectionalSearch->ReleaseNodes();
+        BidirectionalWindowSearch->ReleaseNodes();
+      }
+      if (TableWindowSearch)
+      {
+        TableWindowSearch->ReleaseNodes();
+      }
+      if (FallbackWindowSearch)
+      {
+        FallbackWindowSearch->ReleaseNodes();
+      }
+    }
+  };
+
+  /**
+   * Kinodynamic search structures of a worker thread, reset by every replan as WindowSearchContext.
+   * The plane heuristic is searched by eight connected moves at the cruise speed,
+   * which is a lower bound of the step durations for both heading sets.
+   */
+  struct KinodynamicSearchContext
+  {
+    using PlaneMovesType = StaticMovesTestSegment<EStaticMoveSet::EightConnected>;
+    using PlaneSearchType = Pathfinder<FPoint, PlaneMovesType, EuclideanHeuristic>;
+    using PlaneAdapterType = StaticSpaceAdapter<FPoint, OrientedArea, PlaneSearchType>;
+
+    SearchArena* Arena = nullptr;
+    SearchArena* ScratchArena = nullptr;
+
+    std::shared_ptr<KinodynamicMovesSegment> Moves;
+    std::shared_ptr<PlaneMovesType> PlaneMoves;
+
+    std::shared_ptr<EuclideanHeuristic> PlaneHeuristic;
+    std::shared_ptr<PlaneSearchType> PlaneSearch;
+    std::shared_ptr<WindowedPathfinder<OrientedArea, KinodynamicMovesSegment, PlaneAdapterType>> PlaneWindowSearch;
+
+    std::shared_ptr<WindowedPathfinder<OrientedArea, KinodynamicMovesSegment>> FallbackWindowSearch;
+
+    WindowedPathfinder<OrientedArea, KinodynamicMovesSegment, PlaneAdapterType>& ResetPlaneWindowSearch(
+      const FReplanInput& Input,
+      std::shared_ptr<ShapeSpace> AgentSpace,
+      OrientedArea OriginalArea,
+      float WindowEnd
+    )
+    {
+      const float CruiseSpeed = Input.Primitives->GetCruiseSpeed() * Input.Speed;
+      ArrayType<MoveDelta<FPoint>> PlaneMovesAtCruiseSpeed;
+      for (int MoveIndex = 0; MoveIndex < StaticMoveTable<EStaticMoveSet::EightConnected>::Num; ++MoveIndex)
+      {
+        const FPoint Delta = UnitMoves[MoveIndex].Delta.ToPoint();
+        PlaneMovesAtCruiseSpeed.push_back({ std::sqrt((float) (Delta.X * Delta.X + Delta.Y * Delta.Y)) / CruiseSpeed, Delta });
+      }
+
+      if (!PlaneWindowSearch)
+      {
+        Moves = std::make_shared<KinodynamicMovesSegment>(Input.Primitives, Input.Speed, AgentSpace, WindowEnd);
+        Moves->SetScratchArena(ScratchArena);
+        PlaneMoves = std::make_shared<PlaneMovesType>(PlaneMovesAtCruiseSpeed, AgentSpace, WindowEnd);
+        PlaneMoves->SetScratchArena(ScratchArena);
+
+        PlaneHeuristic = std::make_shared<EuclideanHeuristic>(Input.Point, CruiseSpeed);
+        PlaneSearch = std::make_shared<PlaneSearchType>(PlaneMoves, Input.Goal, PlaneHeuristic);
+        PlaneSearch->Reserve(PLANNER_CONTEXT_RESERVED_NODES);
+        PlaneWindowSearch = std::make_shared<WindowedPathfinder<OrientedArea, KinodynamicMovesSegment, PlaneAdapterType>>(
+          Moves, OriginalArea, std::make_shared<PlaneAdapterType>(PlaneSearch), WindowEnd, Input.Time
+        );
+        PlaneWindowSearch->Reserve(PLANNER_CONTEXT_RESERVED_NODES);
+      }
+
+      // Searches created above are reset as well, so their nodes are allocated from the arena
+      Moves->Reset(Input.Primitives, Input.Speed, WindowEnd);
+      PlaneMoves->Reset(PlaneMovesAtCruiseSpeed, WindowEnd);
+      *PlaneHeuristic = EuclideanHeuristic(Input.Point, CruiseSpeed);
+      PlaneSearch->Reset(Input.Goal, 0.f, Arena);
+      PlaneWindowSearch->Reset(OriginalArea, WindowEnd, Input.Time, Arena);
+      return *PlaneWindowSearch;
+    }
+
+    // Should be called after ResetPlaneWindowSearch, which resets the moves
+    WindowedPathfinder<OrientedArea, KinodynamicMovesSegment>& ResetFallbackWindowSearch(const FReplanInput& Input, OrientedArea OriginalArea, float WindowEnd)
+    {
+      if (!FallbackWindowSearch)
+      {
+        FallbackWindowSearch = std::make_shared<WindowedPathfinder<OrientedArea, KinodynamicMovesSegment>>(
+          Moves, OriginalArea, std::make_shared<Heuristic<OrientedArea>>(OriginalArea), WindowEnd, Input.Time
+        );
+      }
+
+      FallbackWindowSearch->Reset(OriginalArea, WindowEnd, Input.Time, Arena);
+      return *FallbackWindowSearch;
+    }
+
+    void Release()
+    {
+      if (PlaneWindowSearch)
+      {
+        PlaneSearch->ReleaseNodes();
+        PlaneWindowSearch->ReleaseNodes();
+      }
+      if (FallbackWindowSearch)
+      {
+        FallbackWindowSearch->ReleaseNodes();
+      }
+    }
+  };
+
+  /**
+   * Planner structures of one worker thread. Replans of all agents running on the thread
+   * reuse them instead of allocating new searches, spaces and move components.
+   */
+  struct PlannerContext
+  {
+    // Nodes and cached cells of the current replan, released in bulk at its end
+    SearchArena Arena;
+    // Temporary containers of the move tests, rewound after every move
+    SearchArena ScratchArena;
+
+    std::shared_ptr<ShapeSpace> AgentSpace;
+
+    WindowSearchContext<StaticMovesTestSegment<EStaticMoveSet::FourConnected>> FourConnected;
+    WindowSearchContext<StaticMovesTestSegment<EStaticMoveSet::EightConnected>> EightConnected;
+    WindowSearchContext<MovesTestSegment> Custom;
+    KinodynamicSearchContext Kinodynamic;
+
+    PlannerContext()
+    {
+      FourConnected.Arena = EightConnected.Arena = Custom.Arena = Kinodynamic.Arena = &Arena;
+      FourConnected.ScratchArena = EightConnected.ScratchArena = Custom.ScratchArena = Kinodynamic.ScratchArena = &ScratchArena;
+    }
+
+    void Release()
     {
-      FScopeLock PathLock(&PathSync);
-      AgentTimeCapture = CurrentTime;
-      Changes.ReversedPath = ReversedPath;
+      // The space may be destroyed by the pathfinder while the context is idle
+      AgentSpace->ReleaseSpace();
+      FourConnected.Release();
+      EightConnected.Release();
+      Custom.Release();
+      Kinodynamic.Release();
+
+      Arena.Release();
+      ScratchArena.Release();
     }
+  };
 
-    ClearAreasWithPath(Changes.ReversedPath);
+  thread_local PlannerContext WorkerContext;
 
-    // Gather Agent properties
-    int AgentID;
-    float AgentSpeed;
-    FPoint AgentGoal, AgentPoint;
-    std::vector<MoveDelta<FPoint>> Moves;
-    Agent->GetPropertiesSafe(AgentID, AgentPoint, AgentGoal, AgentShapeCapture, Moves, AgentSpeed);
-    float bestSpeed = 1.f;
+  /**
+   * Searches the window with the given plane heuristic of the agent, which is called without virtual dispatch.
+   */
+  template<typename MovesType, typename WindowSearchType>
+  bool FindWindowPathFrom(
+    const FReplanInput& Input,
+    Area OriginalArea,
+    WindowSearchContext<MovesType>& Context,
+    WindowSearchType& WindowSearch,
+    std::vector<Node<Area>>& OutReversedPath,
+    bool bLogFailures
+  )
+  {
+    const float WindowEnd = Input.Time + Input.Depth;
 
-    TOptional<RepairDetails> Repair;
-    if (Changes.ReversedPath.size())
+    // Execute pathfinding
+    Area Destination = Area::FromDepth(Input.Goal, WindowEnd);
+    if (!SearchWindow(WindowSearch, Destination, OutReversedPath))
     {
-      AgentPoint = GetPreviousNode().Cell.Point;
-      const auto& NextNode = GetNextNode();
-      float MovementStartTime = NextNode.MinTime - NextNode.ArrivalCost;
-      if (MovementStartTime < AgentTimeCapture)
+      WindowedPathfinder<Area, MovesType>& FallbackWindowSearch = Context.ResetFallbackWindowSearch(Input, OriginalArea, WindowEnd);
+      if (!SearchWindow(FallbackWindowSearch, Destination, OutReversedPath))
       {
-        AgentTimeCapture = NextNode.MinTime;
-        AgentPoint = NextNode.Cell.Point;
-        Repair = RepairDetails(GetPreviousNode(), NextNode.ArrivalCost);
+        if (bLogFailures)
+        {
+          UE_LOG(LogTemp, Warning, TEXT("Failed to find path for an agent with id = %d"), Input.AgentID);
+        }
+        return false;
       }
     }
 
-    // Prepare Agent Space and Movement Component
-    std::shared_ptr<ShapeSpace> AgentSpace = std::make_shared<ShapeSpace>(std::numeric_limits<float>::infinity(), Space, AgentShapeCapture);
-    std::shared_ptr<MovesTestSegment> MovesComponent(new MovesTestSegment(Moves, AgentSpace, AgentTimeCapture + Depth));
-    AgentSpace->UpdateShape(AgentPoint);
-    AgentSpace->UpdateShape(AgentGoal);
+    if (Input.Repair)
+    {
+      OutReversedPath.back().ArrivalCost = Input.Repair.GetValue().NextNodeArrivalCost;
+      OutReversedPath.push_back(Input.Repair.GetValue().PrevNode);
+    }
+
+    return true;
+  }
+
+  template<typename MovesType>
+  bool FindWindowPathWith(
+    const FReplanInput& Input,
+    std::shared_ptr<ShapeSpace> AgentSpace,
+    WindowSearchContext<MovesType>& Context,
+    std::vector<Node<Area>>& OutReversedPath,
+    bool bLogFailures
+  )
+  {
+    const float WindowEnd = Input.Time + Input.Depth;
+    Context.ResetMoves(Input, AgentSpace, WindowEnd);
+
+    AgentSpace->UpdateShape(Input.Point);
+    AgentSpace->UpdateShape(Input.Goal);
 
-    if (!AgentSpace->ContainsSegmentsIn(AgentPoint))
+    if (!AgentSpace->ContainsSegmentsIn(Input.Point))
     {
-      UE_LOG(LogTemp, Warning, TEXT("Failed to init agent with id = %d (probably, initial location is occupied)"), AgentID);
-      FillAreasWithPath(Changes.ReversedPath);
-      return Changes;
+      if (bLogFailures)
+      {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to init agent with id = %d (probably, initial location is occupied)"), Input.AgentID);
+      }
+      return false;
     }
 
-    TOptional<Area> OriginalAreaOpt = AgentSpace->FindArea(AgentPoint, AgentTimeCapture);
+    TOptional<Area> OriginalAreaOpt = AgentSpace->FindArea(Input.Point, Input.Time);
     if (!OriginalAreaOpt)
     {
-      UE_LOG(LogTemp, Warning, TEXT("Failed to find suitable initial safe interval for an agent with id = %d"), AgentID);
-      FillAreasWithPath(Changes.ReversedPath);
-      return Changes;
+      if (bLogFailures)
+      {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to find suitable initial safe interval for an agent with id = %d"), Input.AgentID);
+      }
+      return false;
     }
 
-    // Prepare pathfinding
     Area OriginalArea = OriginalAreaOpt.GetValue();
-    std::shared_ptr<EuclideanHeuristic> SimpleHeurisitc(new EuclideanHeuristic(AgentPoint, AgentSpeed));
-    std::shared_ptr<Pathfinder<FPoint>> PlaneSearch(new Pathfinder<FPoint>(MovesComponent, AgentGoal, SimpleHeurisitc));
-    std::shared_ptr<Heuristic<Area>> Adapter(new SpaceAdapter<FPoint, Area>(PlaneSearch));
-    WindowedPathfinder<Area> Pathfinder(MovesComponent, OriginalArea, Adapter, AgentTimeCapture + Depth, AgentTimeCapture);
+    if (Input.Distances)
+    {
+      auto& TableWindowSearch = Context.ResetTableWindowSearch(Input, OriginalArea, WindowEnd);
+      return FindWindowPathFrom(Input, OriginalArea, Context, TableWindowSearch, OutReversedPath, bLogFailures);
+    }
 
-    // Execute pathfinding
-    Area Destination = Area::FromDepth(AgentGoal, AgentTimeCapture + Depth);
-    Pathfinder.FindCost(Destination);
-    if (!Pathfinder.IsCostFound(Destination))
+    if (Input.bBidirectionalHeuristic)
+    {
+      auto& BidirectionalWindowSearch = Context.ResetBidirectionalWindowSearch(Input, OriginalArea, WindowEnd);
+      if (!FindWindowPathFrom(Input, OriginalArea, Context, BidirectionalWindowSearch, OutReversedPath, bLogFailures))
+      {
+        return false;
+      }
+
+      PlannerStats::AddSearch(Context.BidirectionalSearch->GetStepsCount(), Context.BidirectionalSearch->GetNodesCount());
+      return true;
+    }
+
+    auto& PlaneWindowSearch = Context.ResetPlaneWindowSearch(Input, OriginalArea, WindowEnd);
+    if (!FindWindowPathFrom(Input, OriginalArea, Context, PlaneWindowSearch, OutReversedPath, bLogFailures))
     {
-      std::shared_ptr<OneCellHeuristic<FPoint>> OnePointHeuristic(new OneCellHeuristic<FPoint>(AgentPoint));
-      std::shared_ptr<Heuristic<Area>> NewAdapter(new SpaceAdapter<FPoint, Area>(OnePointHeuristic));
-      Pathfinder = WindowedPathfinder<Area>(MovesComponent, OriginalArea, NewAdapter, AgentTimeCapture + Depth, AgentTimeCapture);
+      return false;
+    }
+
+    PlannerStats::AddSearch(Context.PlaneSearch->GetStats().GetStepsCount(), Context.PlaneSearch->GetStats().GetNodesCount());
+    return true;
+  }
+
+  template<typename MovesType>
+  bool FindWindowPathInContext(
+    const FReplanInput& Input,
+    WindowSearchContext<MovesType>& Context,
+    std::vector<Node<Area>>& OutReversedPath,
+    bool bLogFailures
+  )
+  {
+    const bool bFound = FindWindowPathWith(Input, WorkerContext.AgentSpace, Context, OutReversedPath, bLogFailures);
+    WorkerContext.Release();
+    return bFound;
+  }
 
-      Pathfinder.FindCost(Destination);
-      if (!Pathfinder.IsCostFound(Destination))
+  bool FindKinodynamicWindowPathWith(
+    const FReplanInput& Input,
+    std::shared_ptr<ShapeSpace> AgentSpace,
+    KinodynamicSearchContext& Context,
+    std::vector<Node<Area>>& OutReversedPath,
+    std::vector<KinodynamicState>& OutReversedStates,
+    bool bLogFailures
+  )
+  {
+    const float WindowEnd = Input.Time + Input.Depth;
+
+    AgentSpace->UpdateShape(Input.Point);
+    AgentSpace->UpdateShape(Input.Goal);
+
+    if (!AgentSpace->ContainsSegmentsIn(Input.Point))
+    {
+      if (bLogFailures)
       {
-        UE_LOG(LogTemp, Warning, TEXT("Failed to find path for an agent with id = %d"), AgentID);
-        FillAreasWithPath(Changes.ReversedPath);
-        return Changes;
+        UE_LOG(LogTemp, Warning, TEXT("Failed to init agent with id = %d (probably, initial location is occupied)"), Input.AgentID);
       }
+      return false;
     }
 
-    // Gather Results
-    Pathfinder.CollectPath(Destination, Changes.ReversedPath, true);
-    Changes.ReplanSeccess = true;
+    TOptional<Area> OriginalAreaOpt = AgentSpace->FindArea(Input.Point, Input.Time);
+    if (!OriginalAreaOpt)
+    {
+      if (bLogFailures)
+      {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to find suitable initial safe interval for an agent with id = %d"), Input.AgentID);
+      }
+      return false;
+    }
+
+    const OrientedArea OriginalArea(OriginalAreaOpt.GetValue(), Input.StartState);
+    const OrientedArea Destination(Area::FromDepth(Input.Goal, WindowEnd), KinodynamicState());
+
+    std::vector<Node<OrientedArea>> OrientedReversedPath;
+    auto& PlaneWindowSearch = Context.ResetPlaneWindowSearch(Input, AgentSpace, OriginalArea, WindowEnd);
+    const bool bFound = SearchWindow(PlaneWindowSearch, Destination, OrientedReversedPath)
+      || SearchWindow(Context.ResetFallbackWindowSearch(Input, OriginalArea, WindowEnd), Destination, OrientedReversedPath);
+    PlannerStats::AddSearch(Context.PlaneSearch->GetStats().GetStepsCount(), Context.PlaneSearch->GetStats().GetNodesCount());
+    if (!bFound)
+    {
+      if (bLogFailures)
+      {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to find kinodynamic path for an agent with id = %d"), Input.AgentID);
+      }
+      return false;
+    }
+
+    OutReversedPath.clear();
+    OutReversedStates.clear();
+    for (const Node<OrientedArea>& PathNode : OrientedReversedPath)
+    {
+      OutReversedPath.push_back(Node<Area>(PathNode.Cell, PathNode.MinTime, PathNode.HeursticToGoal, PathNode.ArrivalCost));
+      OutReversedStates.push_back(PathNode.Cell.GetState());
+    }
+
+    if (Input.Repair)
+    {
+      OutReversedPath.back().ArrivalCost = Input.Repair.GetValue().NextNodeArrivalCost;
+      OutReversedPath.push_back(Input.Repair.GetValue().PrevNode);
+      OutReversedStates.push_back(Input.Repair.GetValue().PrevState);
+    }
+
+    return true;
+  }
+
+  void ResetAgentSpace(const FReplanInput& Input, std::shared_ptr<SegmentSpace> InSpace)
+  {
+    if (!WorkerContext.AgentSpace)
+    {
+      WorkerContext.AgentSpace = std::make_shared<ShapeSpace>(std::numeric_limits<float>::infinity(), InSpace, Input.Shape);
+    }
+    WorkerContext.AgentSpace->Reset(InSpace, Input.Shape, &WorkerContext.Arena);
+  }
+}
+
+bool FindWindowPath(const FReplanInput& Input, std::shared_ptr<SegmentSpace> InSpace, std::vector<Node<Area>>& OutReversedPath, bool bLogFailures)
+{
+  // Prepare Agent Space, Movement Components are prepared by the context of their move set
+  ResetAgentSpace(Input, InSpace);
+
+  // Common move sets are searched by instantiations without virtual calls of the moves
+  switch (ClassifyMoves(Input.Moves))
+  {
+  case EStaticMoveSet::FourConnected:
+    return FindWindowPathInContext(Input, WorkerContext.FourConnected, OutReversedPath, bLogFailures);
+  case EStaticMoveSet::EightConnected:
+    return FindWindowPathInContext(Input, WorkerContext.EightConnected, OutReversedPath, bLogFailures);
+  default:
+    return FindWindowPathInContext(Input, WorkerContext.Custom, OutReversedPath, bLogFailures);
+  }
+}
+
+bool FindKinodynamicWindowPath(
+  const FReplanInput& Input,
+  std::shared_ptr<SegmentSpace> InSpace,
+  std::vector<Node<Area>>& OutReversedPath,
+  std::vector<KinodynamicState>& OutReversedStates,
+  bool bLogFailures
+)
+{
+  check(Input.Primitives);
+  ResetAgentSpace(Input, InSpace);
+
+  const bool bFound = FindKinodynamicWindowPathWith(Input, WorkerContext.AgentSpace, WorkerContext.Kinodynamic, OutReversedPath, OutReversedStates, bLogFailures);
+  WorkerContext.Release();
+  return bFound;
+}
+
+int ContinueToNextGoals(const FReplanInput& Input, std::shared_ptr<SegmentSpace> InSpace, std::vector<Node<Area>>& InOutReversedPath)
+{
+  const float WindowEnd = Input.Time + Input.Depth;
+  FReplanInput GoalInput = Input;
+  GoalInput.Repair.Reset();
+
+  int PassedGoals = 0;
+  for (size_t GoalIndex = 0; GoalIndex < Input.NextGoals.size(); ++GoalIndex)
+  {
+    // The path ends by waiting at the goal, the wait starts at the arrival
+    size_t ArrivalIndex = 0;
+    if (InOutReversedPath.empty() || !(InOutReversedPath.front().Cell.Point == GoalInput.Goal))
+    {
+      break;
+    }
+    while (ArrivalIndex + 1 < InOutReversedPath.size()
+      && InOutReversedPath[ArrivalIndex + 1].Cell.Point == GoalInput.Goal
+      && InOutReversedPath[ArrivalIndex + 1].MinTime >= Input.Time)
+    {
+      ++ArrivalIndex;
+    }
+
+    const Node<Area> Arrival = InOutReversedPath[ArrivalIndex];
+    if (Arrival.MinTime >= WindowEnd - EPSILON)
+    {
+      break;
+    }
+
+    GoalInput.Point = GoalInput.Goal;
+    GoalInput.Time = Arrival.MinTime;
+    GoalInput.Depth = WindowEnd - Arrival.MinTime;
+    GoalInput.Goal = Input.NextGoals[GoalIndex];
+    GoalInput.Distances = Input.NextDistances[GoalIndex];
+
+    std::vector<Node<Area>> TailReversedPath;
+    if (!FindWindowPath(GoalInput, InSpace, TailReversedPath, false))
+    {
+      break;
+    }
+
+    TailReversedPath.back().ArrivalCost = Arrival.ArrivalCost;
+    TailReversedPath.insert(TailReversedPath.end(), InOutReversedPath.begin() + ArrivalIndex + 1, InOutReversedPath.end());
+    InOutReversedPath = std::move(TailReversedPath);
+    ++PassedGoals;
+  }
+
+  return PassedGoals;
+}
+
+bool IsSameAgentClass(const FReplanInput& First, const FReplanInput& Second)
+{
+  if (!(First.Goal == Second.Goal) || First.NextGoals != Second.NextGoals || First.Speed != Second.Speed || First.Moves.size() != Second.Moves.size())
+  {
+    return false;
+  }
+
+  for (size_t MoveIndex = 0; MoveIndex < First.Moves.size(); ++MoveIndex)
+  {
+    if (!(First.Moves[MoveIndex].Destination == Second.Moves[MoveIndex].Destination)
+      || First.Moves[MoveIndex].MoveCost != Second.Moves[MoveIndex].MoveCost)
+    {
+      return false;
+    }
+  }
+
+  return First.Shape.Points == Second.Shape.Points;
+}
+
+bool IsPathFree(const std::vector<Node<Area>>& ReversedPath, const FShape& Shape, const SegmentSpace& Space, float StartTime, float EndTime)
+{
+  ArrayType<Area> PathAreas;
+  FromReversedPathToFilledAreas(ReversedPath, Shape, PathAreas);
+  for (const Area& PathArea : PathAreas)
+  {
+    const Segment Checked{ std::max(PathArea.Interval.Start, StartTime), std::min(PathArea.Interval.End, EndTime) };
+    if (Checked.Start >= Checked.End)
+    {
+      continue;
+    }
+
+    if (!Space.ContainsSegmentsIn(PathArea.Point))
+    {
+      return false;
+    }
 
-    if (Repair)
+    const Segment FreeSegment = Space.GetSegments(PathArea.Point).Find(Checked.Start);
+    if (!FreeSegment.IsValid() || FreeSegment.Start > Checked.Start + EPSILON || FreeSegment.End < Checked.End - EPSILON)
     {
-      Changes.ReversedPath.back().ArrivalCost = Repair.GetValue().NextNodeArrivalCost;
-      Changes.ReversedPath.push_back(Repair.GetValue().PrevNode);
+      return false;
     }
+  }
+
+  return true;
+}
+
+bool ExtendWindowPath(const FReplanInput& Input, std::shared_ptr<SegmentSpace> InSpace, const std::vector<Node<Area>>& PreviousReversedPath, std::vector<Node<Area>>& OutReversedPath)
+{
+  if (PreviousReversedPath.size() < 2)
+  {
+    return false;
+  }
+
+  // The previous path is kept till the end of its window, which should be inside the new one
+  const Node<Area>& PreviousEnd = PreviousReversedPath.front();
+  const float WindowEnd = Input.Time + Input.Depth;
+  if (PreviousEnd.MinTime <= Input.Time || PreviousEnd.MinTime >= WindowEnd)
+  {
+    return false;
+  }
+
+  // The latest node reached by the replan start is the start of the new path
+  size_t StartIndex = 0;
+  while (StartIndex < PreviousReversedPath.size() && PreviousReversedPath[StartIndex].MinTime > Input.Time + EPSILON)
+  {
+    ++StartIndex;
+  }
+  if (StartIndex == PreviousReversedPath.size() || !(PreviousReversedPath[StartIndex].Cell.Point == Input.Point))
+  {
+    return false;
+  }
+
+  std::vector<Node<Area>> KeptReversedPath(PreviousReversedPath.begin(), PreviousReversedPath.begin() + StartIndex + 1);
+  if (Input.Repair)
+  {
+    KeptReversedPath.back().ArrivalCost = Input.Repair.GetValue().NextNodeArrivalCost;
+    KeptReversedPath.push_back(Input.Repair.GetValue().PrevNode);
+  }
+  else
+  {
+    // As the origin of a search
+    KeptReversedPath.back().MinTime = Input.Time;
+    KeptReversedPath.back().ArrivalCost = 0;
+  }
+
+  if (!IsPathFree(KeptReversedPath, Input.Shape, *InSpace, Input.Time, PreviousEnd.MinTime))
+  {
+    return false;
+  }
+
+  // The new tail starts where the agent waits at the end of the kept path
+  FReplanInput TailInput = Input;
+  TailInput.Point = PreviousEnd.Cell.Point;
+  TailInput.Time = PreviousEnd.MinTime;
+  TailInput.Depth = WindowEnd - PreviousEnd.MinTime;
+  TailInput.Repair.Reset();
+
+  std::vector<Node<Area>> TailReversedPath;
+  if (!FindWindowPath(TailInput, InSpace, TailReversedPath, false))
+  {
+    return false;
+  }
+
+  OutReversedPath = std::move(TailReversedPath);
+  OutReversedPath.back().ArrivalCost = PreviousEnd.ArrivalCost;
+  OutReversedPath.insert(OutReversedPath.end(), KeptReversedPath.begin() + 1, KeptReversedPath.end());
+  return true;
+}
+
+int ShortcutWindowPath(const FReplanInput& Input, const SegmentSpace& Space, std::vector<Node<Area>>& InOutReversedPath)
+{
+  // Straight moves of any direction take the time per cell of the fastest move
+  float CellCost = std::numeric_limits<float>::infinity();
+  for (const MoveDelta<FPoint>& Move : Input.Moves)
+  {
+    const FPoint& Delta = Move.Destination;
+    const float Length = std::sqrt((float) (Delta.X * Delta.X + Delta.Y * Delta.Y));
+    if (Length > 0)
+    {
+      CellCost = std::min(CellCost, Move.MoveCost / Length);
+    }
+  }
+  if (InOutReversedPath.size() < 3 || CellCost == std::numeric_limits<float>::infinity())
+  {
+    return 0;
+  }
+
+  // Goals are found by the nodes at them, so they are never skipped
+  auto IsKeptPoint = [&Input](const FPoint& Point) {
+    return Point == Input.Goal || std::find(Input.NextGoals.begin(), Input.NextGoals.end(), Point) != Input.NextGoals.end();
+  };
+
+  const std::vector<Node<Area>> Path(InOutReversedPath.rbegin(), InOutReversedPath.rend());
+
+  // The move from PrevNode of a repair is already started
+  size_t Anchor = Input.Repair ? 1 : 0;
+  std::vector<Node<Area>> ShortPath(Path.begin(), Path.begin() + Anchor + 1);
+  std::vector<Node<Area>> Move(2);
+  while (Anchor + 1 < Path.size())
+  {
+    Node<Area> Next = Path[Anchor + 1];
+    const size_t LastCandidate = std::min(Path.size() - 1, Anchor + PATH_SHORTCUT_MAX_NODES);
+    size_t Target = Anchor + 1;
+    for (size_t Candidate = Anchor + 2; Candidate <= LastCandidate && !IsKeptPoint(Path[Candidate - 1].Cell.Point); ++Candidate)
+    {
+      // Only nodes ending moves are targets, waits at them are reserved as they are
+      const FPoint Delta = Path[Candidate].Cell.Point - Path[Anchor].Cell.Point;
+      if (Path[Candidate].Cell.Point == Path[Candidate - 1].Cell.Point || Delta == FPoint(0, 0))
+      {
+        continue;
+      }
+
+      const float Cost = CellCost * std::sqrt((float) (Delta.X * Delta.X + Delta.Y * Delta.Y));
+      if (Path[Candidate].MinTime - Cost < Path[Anchor].MinTime - EPSILON)
+      {
+        continue;
+      }
+
+      Move[0] = Path[Candidate];
+      Move[0].ArrivalCost = Cost;
+      Move[1] = Path[Anchor];
+      if (IsPathFree(Move, Input.Shape, Space, Path[Anchor].MinTime, Path[Candidate].MinTime))
+      {
+        Next = Move[0];
+        Target = Candidate;
+      }
+    }
+
+    ShortPath.push_back(Next);
+    Anchor = Target;
+  }
 
-    FillAreasWithPath(Changes.ReversedPath);
+  const int RemovedNodes = (int) (Path.size() - ShortPath.size());
+  InOutReversedPath.assign(ShortPath.rbegin(), ShortPath.rend());
+  return RemovedNodes;
+}
+
+bool FAdaptivePath::Replan(const FHorizonSettings& Settings, bool bCaptureNow)
+{
+  if (ReplanResult.IsValid())
+  {
+    return false;
+  }
+
+  // Deterministic sessions don't depend on when the pool starts the task
+  TOptional<FReplanInput> CapturedInput;
+  if (bCaptureNow)
+  {
+    FReplanInput Input;
+    CaptureReplanInput(Input);
+    CapturedInput = std::move(Input);
+  }
+
+  ReplanResult = Async(EAsyncExecution::ThreadPool, [this, Settings, CapturedInput = std::move(CapturedInput)]() mutable -> ReplanChanges {
+    ReplanChanges Changes = { false };
+
+    // The current path is replaced only when no replanning task is running, so it is read without a copy
+    FReplanInput Input;
+    if (CapturedInput)
+    {
+      Input = std::move(CapturedInput.GetValue());
+    }
+    else
+    {
+      CaptureReplanInput(Input);
+    }
+
+    // The shard space is written only by this task now, so the window is chosen here and not by the game thread
+    Input.Depth = ChooseDepth(Settings, Input);
+    Changes.Depth = Input.Depth;
+
+    PlannerStatsCapture StatsCapture(Input.AgentID);
+    bool bPathReused = false;
+    int ShortcutNodes = 0;
+    {
+      PLANNER_PHASE_SCOPE(EPlannerPhase::ReplanTask);
+
+      ClearAreasWithPath(ReversedPath, ReversedStates, Primitives.get());
+      AgentShapeCapture = Input.Shape;
+
+      // If nothing near the previous path has changed, only the new part of the window is searched.
+      // Paths through queued goals aren't extended, their tails lead to other goals.
+      // Kinodynamic paths are always searched whole from the captured state
+      std::vector<Node<Area>> NewReversedPath;
+      std::vector<KinodynamicState> NewReversedStates;
+      const bool bKinodynamic = (bool) Input.Primitives;
+      bPathReused = !bKinodynamic && Input.NextGoals.empty() && PathInput && PathShard == SearchShard && IsSameAgentClass(PathInput.GetValue(), Input)
+        && ExtendWindowPath(Input, Space, ReversedPath, NewReversedPath);
+      const bool bFound = bKinodynamic
+        ? FindKinodynamicWindowPath(Input, Space, NewReversedPath, NewReversedStates)
+        : bPathReused || FindWindowPath(Input, Space, NewReversedPath);
+      if (bFound)
+      {
+        if (!bKinodynamic)
+        {
+          ContinueToNextGoals(Input, Space, NewReversedPath);
+          if (Input.bShortcuts)
+          {
+            ShortcutNodes = ShortcutWindowPath(Input, *Space, NewReversedPath);
+          }
+        }
+        Changes.ReversedPath = std::move(NewReversedPath);
+        Changes.ReversedStates = std::move(NewReversedStates);
+        Changes.Primitives = Input.Primitives;
+        Changes.ReplanSeccess = true;
+        PathInput = Input;
+        PathShard = SearchShard;
+        FillAreasWithPath(Changes.ReversedPath, Changes.ReversedStates, Changes.Primitives.get(), Changes.FilledAreas);
+      }
+      else
+      {
+        FillAreasWithPath(ReversedPath, ReversedStates, Primitives.get());
+      }
+    }
+
+    StatsCapture.Finish(Changes.Stats, Changes.Events);
+    Changes.Stats.Successes = Changes.ReplanSeccess ? 1 : 0;
+    Changes.Stats.Failures = Changes.ReplanSeccess ? 0 : 1;
+    Changes.Stats.PathReuses = bPathReused ? 1 : 0;
+    Changes.Stats.ShortcutNodes = ShortcutNodes;
     return Changes;
   });
 
   return true;
 }
 
-void FAdaptivePath::ClearAreasWithPath(const std::vector<Node<Area>>& InReversedPath) const
+void FAdaptivePath::TakeStats(PlannerCounters& OutStats, ArrayType<TraceEvent>& OutEvents)
 {
+  OutStats = PendingStats;
+  OutEvents = std::move(PendingEvents);
+  PendingStats = PlannerCounters();
+  PendingEvents.clear();
+}
+
+void FAdaptivePath::ReleaseReservations()
+{
+  ClearAreasWithPath(ReversedPath, ReversedStates, Primitives.get());
+  FilledAreas.clear();
+  PathInput.Reset();
+}
+
+void FAdaptivePath::RestoreReservations()
+{
+  FillAreasWithPath(ReversedPath, ReversedStates, Primitives.get(), FilledAreas);
+}
+
+void FAdaptivePath::SetResolvedPath(std::vector<Node<Area>>&& InReversedPath, const FShape& InShape, int Shard)
+{
+  check(!ReplanResult.IsValid());
+
+  SetSearchShard(Shard);
+  PathShard = Shard;
+
+  AgentShapeCapture = InShape;
+  // The resolved path may be planned with another window
+  PathInput.Reset();
+  // Resolved paths are planned without kinodynamics
+  FillAreasWithPath(InReversedPath, {}, nullptr, FilledAreas);
+
+  {
+    FScopeLock PathLock(&PathSync);
+    ReversedPath = std::move(InReversedPath);
+    ReversedStates.clear();
+    Primitives.reset();
+    NextNodeIndex = 1;
+  }
+  bLastReplanFailed = false;
+  MoveTimeBy(0);
+}
+
+void FAdaptivePath::CollectPathAreas(
+  const std::vector<Node<Area>>& InReversedPath,
+  const std::vector<KinodynamicState>& InReversedStates,
+  const KinodynamicPrimitives* InPrimitives,
+  ArrayType<Area>& OutAreas
+) const
+{
+  if (InReversedStates.size())
+  {
+    check(InPrimitives);
+    FromReversedKinodynamicPathToFilledAreas(InReversedPath, InReversedStates, *InPrimitives, AgentShapeCapture, OutAreas);
+    return;
+  }
+
+  FromReversedPathToFilledAreas(InReversedPath, AgentShapeCapture, OutAreas);
+}
+
+void FAdaptivePath::ClearAreasWithPath(const std::vector<Node<Area>>& InReversedPath, const std::vector<KinodynamicState>& InReversedStates, const KinodynamicPrimitives* InPrimitives) const
+{
+  PLANNER_PHASE_SCOPE(EPlannerPhase::ReservationClear);
   if (InReversedPath.size())
   {
     ArrayType<Area> InaccessableParts;
-    FromReversedPathToFilledAreas(InReversedPath, AgentShapeCapture, InaccessableParts);
-    Space->MakeAreasAccessable(InaccessableParts);
+    CollectPathAreas(InReversedPath, InReversedStates, InPrimitives, InaccessableParts);
+    Shards->ReleaseAreas(InaccessableParts);
+  }
+}
+
+void FAdaptivePath::FillAreasWithPath(
+  const std::vector<Node<Area>>& InReversedPath,
+  const std::vector<KinodynamicState>& InReversedStates,
+  const KinodynamicPrimitives* InPrimitives,
+  ArrayType<Area>& OutFilledAreas
+) const
+{
+  PLANNER_PHASE_SCOPE(EPlannerPhase::ReservationFill);
+  OutFilledAreas.clear();
+  if (InReversedPath.size())
+  {
+    CollectPathAreas(InReversedPath, InReversedStates, InPrimitives, OutFilledAreas);
+    Shards->ReserveAreas(OutFilledAreas);
   }
 }
 
-void FAdaptivePath::FillAreasWithPath(const std::vector<Node<Area>>& InReversedPath) const
+void FAdaptivePath::FillAreasWithPath(const std::vector<Node<Area>>& InReversedPath, const std::vector<KinodynamicState>& InReversedStates, const KinodynamicPrimitives* InPrimitives) const
 {
+  PLANNER_PHASE_SCOPE(EPlannerPhase::ReservationFill);
   if (InReversedPath.size())
   {
     ArrayType<Area> InaccessableParts;
-    FromReversedPathToFilledAreas(InReversedPath, AgentShapeCapture, InaccessableParts);
-    Space->MakeAreasInaccessable(InaccessableParts);
+    CollectPathAreas(InReversedPath, InReversedStates, InPrimitives, InaccessableParts);
+    Shards->ReserveAreas(InaccessableParts);
   }
 }
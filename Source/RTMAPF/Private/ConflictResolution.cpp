@@ -0,0 +1,202 @@
+#include "ConflictResolution.h"
+#include "Async/ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <set>
+
+GroupConflictResolver::GroupConflictResolver(const FConflictResolutionSettings& InSettings)
+  : Settings(InSettings)
+{ }
+
+void GroupConflictResolver::AddAgent(const FReplanInput& Input, const ArrayType<Area>& FilledAreas)
+{
+  Inputs.push_back(Input);
+  GroupAreas.push_back(FilledAreas);
+}
+
+bool GroupConflictResolver::IsInRegion(FPoint Point) const
+{
+  return Point.X >= RegionMin.X && Point.X <= RegionMax.X && Point.Y >= RegionMin.Y && Point.Y <= RegionMax.Y;
+}
+
+FPoint GroupConflictResolver::FindLocalGoal(FPoint Goal) const
+{
+  // The closest free cell of the region replaces a goal outside of it
+  FPoint LocalGoal = Goal;
+  float MinDistance = std::numeric_limits<float>::infinity();
+  for (int X = RegionMin.X; X <= RegionMax.X; ++X)
+  {
+    for (int Y = RegionMin.Y; Y <= RegionMax.Y; ++Y)
+    {
+      const FPoint Point = { X, Y };
+      if (!LocalSpace->ContainsSegmentsIn(Point))
+      {
+        continue;
+      }
+
+      const FPoint Delta = Goal - Point;
+      const float Distance = (float) Delta.X * Delta.X + (float) Delta.Y * Delta.Y;
+      if (Distance < MinDistance)
+      {
+        MinDistance = Distance;
+        LocalGoal = Point;
+      }
+    }
+  }
+
+  return LocalGoal;
+}
+
+void GroupConflictResolver::TakeSnapshot(const SegmentSpace& Space)
+{
+  check(Inputs.size() > 0);
+
+  RegionMin = Inputs[0].Point;
+  RegionMax = Inputs[0].Point;
+  auto ExtendRegion = [this](FPoint Point) {
+    RegionMin = { std::min(RegionMin.X, Point.X), std::min(RegionMin.Y, Point.Y) };
+    RegionMax = { std::max(RegionMax.X, Point.X), std::max(RegionMax.Y, Point.Y) };
+  };
+
+  for (size_t AgentIndex = 0; AgentIndex < Inputs.size(); ++AgentIndex)
+  {
+    ExtendRegion(Inputs[AgentIndex].Point);
+    for (const Area& FilledArea : GroupAreas[AgentIndex])
+    {
+      ExtendRegion(FilledArea.Point);
+    }
+  }
+
+  const FPoint Margin = { Settings.RegionMargin, Settings.RegionMargin };
+  RegionMin = RegionMin - Margin;
+  RegionMax = RegionMax + Margin;
+
+  LocalSpace = std::make_shared<SegmentSpace>();
+  for (int X = RegionMin.X; X <= RegionMax.X; ++X)
+  {
+    for (int Y = RegionMin.Y; Y <= RegionMax.Y; ++Y)
+    {
+      // Reservations are copied, so releasing the group keeps overlapping obstacles and agents
+      LocalSpace->CopyCellFrom(Space, { X, Y });
+    }
+  }
+
+  for (const ArrayType<Area>& Areas : GroupAreas)
+  {
+    LocalSpace->MakeAreasAccessable(Areas);
+  }
+
+  for (FReplanInput& Input : Inputs)
+  {
+    if (!IsInRegion(Input.Goal))
+    {
+      Input.Goal = FindLocalGoal(Input.Goal);
+    }
+  }
+}
+
+GroupConflictResolver::BranchResult GroupConflictResolver::EvaluateBranch(const ArrayType<size_t>& Order) const
+{
+  BranchResult Result;
+  Result.ReversedPaths.resize(Inputs.size());
+
+  PlannerStatsCapture StatsCapture(Inputs[0].AgentID);
+
+  std::shared_ptr<SegmentSpace> BranchSpace = std::make_shared<SegmentSpace>(*LocalSpace);
+  for (size_t Position = 0; Position < Order.size(); ++Position)
+  {
+    const FReplanInput& Input = Inputs[Order[Position]];
+    std::vector<Node<Area>>& ReversedPath = Result.ReversedPaths[Order[Position]];
+
+    if (!FindWindowPath(Input, BranchSpace, ReversedPath, false))
+    {
+      Result.FailedPosition = Position;
+      StatsCapture.Finish(Result.Stats, Result.Events);
+      return Result;
+    }
+
+    // Agents with lower priority avoid this one
+    ArrayType<Area> Areas;
+    FromReversedPathToFilledAreas(ReversedPath, Input.Shape, Areas);
+    BranchSpace->MakeAreasInaccessable(Areas);
+
+    const Node<Area>& WindowEnd = ReversedPath.front();
+    const FPoint ToGoal = Input.Goal - WindowEnd.Cell.Point;
+    Result.Cost += WindowEnd.MinTime + std::sqrt((float) (ToGoal.X * ToGoal.X + ToGoal.Y * ToGoal.Y)) / Input.Speed;
+  }
+
+  Result.bSuccess = true;
+  StatsCapture.Finish(Result.Stats, Result.Events);
+  return Result;
+}
+
+GroupResolution GroupConflictResolver::Resolve() const
+{
+  check(LocalSpace);
+
+  GroupResolution Resolution;
+  for (const FReplanInput& Input : Inputs)
+  {
+    Resolution.AgentIDs.push_back(Input.AgentID);
+    Resolution.Shapes.push_back(Input.Shape);
+  }
+
+  // The failing agent gets the highest priority first
+  ArrayType<size_t> InitialOrder(Inputs.size());
+  std::iota(InitialOrder.begin(), InitialOrder.end(), 0);
+
+  ArrayType<ArrayType<size_t>> Generation = { InitialOrder };
+  std::set<ArrayType<size_t>> SeenOrders = { InitialOrder };
+
+  for (int GenerationIndex = 0; GenerationIndex < Settings.MaxGenerations && Generation.size(); ++GenerationIndex)
+  {
+    ArrayType<BranchResult> Results(Generation.size());
+    ParallelFor((int32) Generation.size(), [&](int32 BranchIndex) {
+      Results[BranchIndex] = EvaluateBranch(Generation[BranchIndex]);
+    });
+
+    TOptional<size_t> BestBranch;
+    for (size_t BranchIndex = 0; BranchIndex < Results.size(); ++BranchIndex)
+    {
+      Resolution.Stats += Results[BranchIndex].Stats;
+      Resolution.Events.insert(Resolution.Events.end(), Results[BranchIndex].Events.begin(), Results[BranchIndex].Events.end());
+
+      if (Results[BranchIndex].bSuccess && (!BestBranch || Results[BranchIndex].Cost < Results[BestBranch.GetValue()].Cost))
+      {
+        BestBranch = BranchIndex;
+      }
+    }
+
+    if (BestBranch)
+    {
+      Resolution.bSuccess = true;
+      Resolution.Stats.Successes++;
+      Resolution.ReversedPaths = std::move(Results[BestBranch.GetValue()].ReversedPaths);
+      return Resolution;
+    }
+
+    // Swap priorities: the failed agent is planned before one of the agents it had to avoid
+    ArrayType<ArrayType<size_t>> Children;
+    for (size_t BranchIndex = 0; BranchIndex < Results.size() && (int) Children.size() < Settings.MaxBranches; ++BranchIndex)
+    {
+      const size_t FailedPosition = Results[BranchIndex].FailedPosition;
+      for (size_t NewPosition = FailedPosition; NewPosition > 0 && (int) Children.size() < Settings.MaxBranches; --NewPosition)
+      {
+        ArrayType<size_t> Child = Generation[BranchIndex];
+        std::rotate(Child.begin() + NewPosition - 1, Child.begin() + FailedPosition, Child.begin() + FailedPosition + 1);
+        if (SeenOrders.insert(Child).second)
+        {
+          Children.push_back(std::move(Child));
+        }
+      }
+    }
+
+    Generation = std::move(Children);
+  }
+
+  Resolution.Stats.Failures++;
+  return Resolution;
+}
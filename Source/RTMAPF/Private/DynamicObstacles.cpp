@@ -0,0 +1,187 @@
+#include "DynamicObstacles.h"
+#include "MovesSegments.h"
+
+#include <algorithm>
+
+DynamicObstacleLayer::DynamicObstacleLayer(std::shared_ptr<SegmentSpace> InSpace)
+  : Space(InSpace)
+{
+  check(Space);
+}
+
+int DynamicObstacleLayer::Add(const FObstacleTrajectory& Trajectory)
+{
+  FScopeLock StagingLock(&StagingSync);
+
+  const int ObstacleID = MaxObstacleID++;
+  StagedChanges[ObstacleID] = Trajectory;
+  return ObstacleID;
+}
+
+bool DynamicObstacleLayer::Update(int ObstacleID, const FObstacleTrajectory& Trajectory)
+{
+  FScopeLock StagingLock(&StagingSync);
+
+  if (!ObstacleAreas.count(ObstacleID) && !StagedChanges.count(ObstacleID))
+  {
+    return false;
+  }
+
+  StagedChanges[ObstacleID] = Trajectory;
+  return true;
+}
+
+void DynamicObstacleLayer::Remove(int ObstacleID)
+{
+  FScopeLock StagingLock(&StagingSync);
+
+  StagedChanges[ObstacleID] = TOptional<FObstacleTrajectory>();
+}
+
+bool DynamicObstacleLayer::HasStagedChanges() const
+{
+  FScopeLock StagingLock(&StagingSync);
+
+  return StagedChanges.size() > 0;
+}
+
+void DynamicObstacleLayer::Commit(std::unordered_set<FPoint>& ChangedPoints)
+{
+  ArrayType<Area> ReleasedAreas;
+  ArrayType<Area> ReservedAreas;
+  Commit(ChangedPoints, ReleasedAreas, ReservedAreas);
+}
+
+void DynamicObstacleLayer::Commit(std::unordered_set<FPoint>& ChangedPoints, ArrayType<Area>& ReleasedAreas, ArrayType<Area>& ReservedAreas)
+{
+  FScopeLock StagingLock(&StagingSync);
+
+  for (auto& IDAndTrajectory : StagedChanges)
+  {
+    ArrayType<Area> NewAreas;
+    if (IDAndTrajectory.second)
+    {
+      FromTrajectoryToFilledAreas(IDAndTrajectory.second.GetValue(), NewAreas);
+    }
+
+    ArrayType<Area>& OldAreas = ObstacleAreas[IDAndTrajectory.first];
+
+    // Parts of a trajectory that didn't change produce exactly the same areas
+    const std::unordered_set<Area> OldSet(OldAreas.begin(), OldAreas.end());
+    const std::unordered_set<Area> NewSet(NewAreas.begin(), NewAreas.end());
+
+    for (const Area& OldArea : OldSet)
+    {
+      if (!NewSet.count(OldArea))
+      {
+        ReleasedAreas.push_back(OldArea);
+        ChangedPoints.insert(OldArea.Point);
+      }
+    }
+
+    for (const Area& NewArea : NewSet)
+    {
+      if (!OldSet.count(NewArea))
+      {
+        ReservedAreas.push_back(NewArea);
+        ChangedPoints.insert(NewArea.Point);
+      }
+    }
+
+    if (IDAndTrajectory.second)
+    {
+      OldAreas = std::move(NewAreas);
+    }
+    else
+    {
+      ObstacleAreas.erase(IDAndTrajectory.first);
+    }
+  }
+
+  StagedChanges.clear();
+
+  // Space counts reservations, so a released hole doesn't reopen
+  // holes of other obstacles or reservations of agents under it
+  Space->MakeAreasAccessable(ReleasedAreas);
+  Space->MakeAreasInaccessable(ReservedAreas);
+}
+
+void DynamicObstacleLayer::SetSpace(std::shared_ptr<SegmentSpace> NewSpace)
+{
+  check(NewSpace);
+
+  Space = NewSpace;
+  for (const auto& IDAndAreas : ObstacleAreas)
+  {
+    Space->MakeAreasInaccessable(IDAndAreas.second);
+  }
+}
+
+namespace
+{
+  // A hole shorter than EPSILON isn't cut from free segments, so moments are widened
+  Segment ToMoment(float Start, float End)
+  {
+    const float Middle = (Start + End) / 2;
+    const float HalfLength = std::max(End - Start, OBSTACLE_MOMENT_DURATION) / 2;
+    return { Middle - HalfLength, Middle + HalfLength };
+  }
+}
+
+void FromTrajectoryToFilledAreas(const FObstacleTrajectory& Trajectory, ArrayType<Area>& Areas)
+{
+  const TArray<FObstacleWaypoint>& Waypoints = Trajectory.Waypoints;
+  if (Waypoints.Num() == 1)
+  {
+    const Segment Moment = ToMoment(Waypoints[0].Time, Waypoints[0].Time);
+    for (const FPoint& ShapePoint : Trajectory.Shape.Points)
+    {
+      Areas.push_back(Area(Waypoints[0].Point + ShapePoint, Moment));
+    }
+    return;
+  }
+
+  for (int WaypointIndex = 1; WaypointIndex < Waypoints.Num(); ++WaypointIndex)
+  {
+    const FObstacleWaypoint& Prev = Waypoints[WaypointIndex - 1];
+    const FObstacleWaypoint& Next = Waypoints[WaypointIndex];
+    check(Next.Time >= Prev.Time);
+
+    const FPoint Delta = Next.Point - Prev.Point;
+    if (Delta == FPoint(0, 0))
+    {
+      // Standing still, the same as waiting of an agent
+      const Segment StayOnPlace = { Prev.Time, Next.Time };
+      for (const FPoint& ShapePoint : Trajectory.Shape.Points)
+      {
+        Areas.push_back(Area(Prev.Point + ShapePoint, StayOnPlace));
+      }
+      continue;
+    }
+
+    if (Next.Time - Prev.Time < EPSILON)
+    {
+      // Teleportation, the obstacle is in both places at the same moment
+      const Segment Moment = ToMoment(Prev.Time, Next.Time);
+      for (const FPoint& ShapePoint : Trajectory.Shape.Points)
+      {
+        Areas.push_back(Area(Prev.Point + ShapePoint, Moment));
+        Areas.push_back(Area(Next.Point + ShapePoint, Moment));
+      }
+      continue;
+    }
+
+    // Swept cells are the same as for agent moves, see FromReversedPathToFilledAreas
+    const auto RelationalPointToSegment = GetTouchedSegments({ Next.Time - Prev.Time, Delta });
+    for (const auto& PointAndSegment : RelationalPointToSegment)
+    {
+      const FPoint MovePoint = Prev.Point + PointAndSegment.first;
+      const Segment MovementSegment = { PointAndSegment.second.Start + Prev.Time, PointAndSegment.second.End + Prev.Time };
+
+      for (const FPoint& ShapePoint : Trajectory.Shape.Points)
+      {
+        Areas.push_back(Area(MovePoint + ShapePoint, MovementSegment));
+      }
+    }
+  }
+}
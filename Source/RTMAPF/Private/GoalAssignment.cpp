@@ -0,0 +1,525 @@
+#include "GoalAssignment.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+  /**
+   * Hungarian method with potentials, matches every row to a distinct column
+   * with the minimal sum of costs. Needs RowsNum <= ColumnsNum.
+   */
+  template<typename CostFunction>
+  void MatchRows(size_t RowsNum, size_t ColumnsNum, const CostFunction& Cost, ArrayType<int>& OutRowColumns)
+  {
+    check(RowsNum <= ColumnsNum);
+    const double Infinity = std::numeric_limits<double>::infinity();
+
+    // Rows and columns are numbered from 1, column 0 holds the row being matched
+    ArrayType<double> RowPotentials(RowsNum + 1, 0);
+    ArrayType<double> ColumnPotentials(ColumnsNum + 1, 0);
+    ArrayType<size_t> ColumnRows(ColumnsNum + 1, 0);
+    ArrayType<size_t> PreviousColumns(ColumnsNum + 1, 0);
+    ArrayType<double> MinReducedCosts(ColumnsNum + 1);
+    ArrayType<bool> VisitedColumns(ColumnsNum + 1);
+
+    for (size_t Row = 1; Row <= RowsNum; ++Row)
+    {
+      ColumnRows[0] = Row;
+      size_t Column = 0;
+      std::fill(MinReducedCosts.begin(), MinReducedCosts.end(), Infinity);
+      std::fill(VisitedColumns.begin(), VisitedColumns.end(), false);
+
+      // Shortest augmenting path from the row to a free column in reduced costs
+      do
+      {
+        VisitedColumns[Column] = true;
+        const size_t PathRow = ColumnRows[Column];
+        double Delta = Infinity;
+        size_t NextColumn = 0;
+        for (size_t Candidate = 1; Candidate <= ColumnsNum; ++Candidate)
+        {
+          if (VisitedColumns[Candidate])
+          {
+            continue;
+          }
+
+          const double ReducedCost = Cost(PathRow - 1, Candidate - 1) - RowPotentials[PathRow] - ColumnPotentials[Candidate];
+          if (ReducedCost < MinReducedCosts[Candidate])
+          {
+            MinReducedCosts[Candidate] = ReducedCost;
+            PreviousColumns[Candidate] = Column;
+          }
+          if (MinReducedCosts[Candidate] < Delta)
+          {
+            Delta = MinReducedCosts[Candidate];
+            NextColumn = Candidate;
+          }
+        }
+
+        for (size_t Updated = 0; Updated <= ColumnsNum; ++Updated)
+        {
+          if (VisitedColumns[Updated])
+          {
+            RowPotentials[ColumnRows[Updated]] += Delta;
+            ColumnPotentials[Updated] -= Delta;
+          }
+          else
+          {
+            MinReducedCosts[Updated] -= Delta;
+          }
+        }
+        Column = NextColumn;
+      } while (ColumnRows[Column] != 0);
+
+      // Rows along the path move to the next columns
+      do
+      {
+        const size_t PreviousColumn = PreviousColumns[Column];
+        ColumnRows[Column] = ColumnRows[PreviousColumn];
+        Column = PreviousColumn;
+      } while (Column != 0);
+    }
+
+    OutRowColumns.assign(RowsNum, -1);
+    for (size_t Column = 1; Column <= ColumnsNum; ++Column)
+    {
+      if (ColumnRows[Column] != 0)
+      {
+        OutRowColumns[ColumnRows[Column] - 1] = (int) Column - 1;
+      }
+    }
+  }
+}
+
+void GoalAssignment::SetStaticSpace(std::shared_ptr<const RawSpace> InStatic, std::shared_ptr<const StaticDistanceTables> InRegisteredTables)
+{
+  Static = InStatic;
+  RegisteredTables = InRegisteredTables;
+  DropTables();
+}
+
+void GoalAssignment::DropTables()
+{
+  for (PendingTarget& Target : Targets)
+  {
+    Target.Tables.clear();
+  }
+  for (PendingAgent& Agent : Agents)
+  {
+    Agent.Costs.clear();
+  }
+
+  // The running solve read the previous space
+  ++Epoch;
+  ChangedDuringSolve.clear();
+  bChanged = true;
+}
+
+void GoalAssignment::MarkStale(FPoint ChangedPoint)
+{
+  for (PendingTarget& Target : Targets)
+  {
+    for (size_t ClassIndex = 0; ClassIndex < Target.Tables.size(); ++ClassIndex)
+    {
+      std::shared_ptr<const DistanceTable>& Table = Target.Tables[ClassIndex];
+      if (!Table || !Table->IsAffectedBy(ChangedPoint))
+      {
+        continue;
+      }
+
+      Table = nullptr;
+      bChanged = true;
+      for (PendingAgent& Agent : Agents)
+      {
+        if (Agent.ClassIndex == (int) ClassIndex)
+        {
+          Agent.Costs.erase(Target.TargetID);
+        }
+      }
+    }
+  }
+
+  if (RunningSolve.IsValid())
+  {
+    ChangedDuringSolve.push_back(ChangedPoint);
+  }
+}
+
+int GoalAssignment::FindClass(const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves, float Speed)
+{
+  for (size_t ClassIndex = 0; ClassIndex < Classes.size(); ++ClassIndex)
+  {
+    const AgentClass& Class = Classes[ClassIndex];
+    if (Class.Moves.size() != Moves.size() || !IsSameShape(Class.Shape, Shape))
+    {
+      continue;
+    }
+
+    bool bSameMoves = true;
+    for (size_t MoveIndex = 0; MoveIndex < Moves.size() && bSameMoves; ++MoveIndex)
+    {
+      const MoveDelta<FPoint>& Move = Class.Moves[MoveIndex];
+      bSameMoves = Moves[MoveIndex].Destination == Move.Destination
+        && std::abs(Moves[MoveIndex].MoveCost * Speed - Move.MoveCost) <= EPSILON * std::max(1.f, Move.MoveCost);
+    }
+
+    if (bSameMoves)
+    {
+      return (int) ClassIndex;
+    }
+  }
+
+  AgentClass NewClass;
+  NewClass.Shape = Shape;
+  for (const MoveDelta<FPoint>& Move : Moves)
+  {
+    NewClass.Moves.push_back({ Move.MoveCost * Speed, Move.Destination, Move.WaitCost * Speed });
+  }
+  Classes.push_back(NewClass);
+  return (int) Classes.size() - 1;
+}
+
+void GoalAssignment::AddAgent(int AgentID, FPoint Point, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves, float Speed)
+{
+  check(Speed > 0);
+  RemoveAgent(AgentID);
+
+  PendingAgent Agent;
+  Agent.AgentID = AgentID;
+  Agent.Point = Point;
+  Agent.Speed = Speed;
+  Agent.ClassIndex = FindClass(Shape, Moves, Speed);
+  Agents.push_back(Agent);
+  bChanged = true;
+}
+
+void GoalAssignment::RemoveAgent(int AgentID)
+{
+  Agents.erase(std::remove_if(Agents.begin(), Agents.end(), [AgentID](const PendingAgent& Agent) {
+    return Agent.AgentID == AgentID;
+  }), Agents.end());
+  bChanged = true;
+}
+
+int GoalAssignment::AddTarget(FPoint Goal)
+{
+  PendingTarget Target;
+  Target.TargetID = NextTargetID++;
+  Target.Goal = Goal;
+  Targets.push_back(Target);
+  bChanged = true;
+  return Target.TargetID;
+}
+
+void GoalAssignment::RemoveTarget(int TargetID)
+{
+  Targets.erase(std::remove_if(Targets.begin(), Targets.end(), [TargetID](const PendingTarget& Target) {
+    return Target.TargetID == TargetID;
+  }), Targets.end());
+
+  for (PendingAgent& Agent : Agents)
+  {
+    Agent.Costs.erase(TargetID);
+  }
+  bChanged = true;
+}
+
+float GoalAssignment::FindCost(const SolveState& State, const PendingAgent& Agent, const PendingTarget& Target)
+{
+  if (State.bStraightCosts)
+  {
+    const FPoint Delta = Target.Goal - Agent.Point;
+    return std::sqrt((float) Delta.X * Delta.X + (float) Delta.Y * Delta.Y) / Agent.Speed;
+  }
+
+  const std::shared_ptr<const DistanceTable>& Table = Target.Tables[Agent.ClassIndex];
+  const float Distance = Table ? Table->GetDistance(Agent.Point) : HEURISTIC_COST_NOT_FOUND;
+  return Distance >= 0 ? Distance / Agent.Speed : GOAL_ASSIGNMENT_FORBIDDEN_COST;
+}
+
+void GoalAssignment::FindCosts(SolveState& State)
+{
+  // Tables of the pairs of targets and classes that aren't registered are built in parallel
+  ParallelFor((int32) State.MissingTables.size(), [&State](int32 MissingIndex) {
+    const size_t TargetIndex = State.MissingTables[MissingIndex].first;
+    const int ClassIndex = State.MissingTables[MissingIndex].second;
+    const AgentClass& Class = State.Classes[ClassIndex];
+    State.Targets[TargetIndex].Tables[ClassIndex] = DistanceTable::Build(*State.Static, State.Targets[TargetIndex].Goal, Class.Shape, Class.Moves);
+  });
+
+  ParallelFor((int32) State.Agents.size(), [&State](int32 AgentIndex) {
+    PendingAgent& Agent = State.Agents[AgentIndex];
+    for (const PendingTarget& Target : State.Targets)
+    {
+      if (!Agent.Costs.count(Target.TargetID))
+      {
+        Agent.Costs[Target.TargetID] = FindCost(State, Agent, Target);
+      }
+    }
+  });
+}
+
+void GoalAssignment::Match(SolveState& State)
+{
+  FindCosts(State);
+
+  // Costs are read many times by the Hungarian method, so they are put into a matrix of agents by targets
+  const size_t TargetsNum = State.Targets.size();
+  ArrayType<float> Costs(State.Agents.size() * TargetsNum);
+  for (size_t AgentIndex = 0; AgentIndex < State.Agents.size(); ++AgentIndex)
+  {
+    for (size_t TargetIndex = 0; TargetIndex < TargetsNum; ++TargetIndex)
+    {
+      Costs[AgentIndex * TargetsNum + TargetIndex] = State.Agents[AgentIndex].Costs.at(State.Targets[TargetIndex].TargetID);
+    }
+  }
+
+  // The smaller side is matched to the larger one
+  const bool bAgentRows = State.Agents.size() <= TargetsNum;
+  ArrayType<int> RowColumns;
+  if (bAgentRows)
+  {
+    MatchRows(State.Agents.size(), TargetsNum, [&Costs, TargetsNum](size_t Row, size_t Column) {
+      return (double) Costs[Row * TargetsNum + Column];
+    }, RowColumns);
+  }
+  else
+  {
+    MatchRows(TargetsNum, State.Agents.size(), [&Costs, TargetsNum](size_t Row, size_t Column) {
+      return (double) Costs[Column * TargetsNum + Row];
+    }, RowColumns);
+  }
+
+  for (size_t Row = 0; Row < RowColumns.size(); ++Row)
+  {
+    if (RowColumns[Row] < 0)
+    {
+      continue;
+    }
+
+    const size_t AgentIndex = bAgentRows ? Row : RowColumns[Row];
+    const size_t TargetIndex = bAgentRows ? RowColumns[Row] : Row;
+    const float Cost = Costs[AgentIndex * TargetsNum + TargetIndex];
+    if (Cost < GOAL_ASSIGNMENT_FORBIDDEN_COST)
+    {
+      const PendingTarget& Target = State.Targets[TargetIndex];
+      State.Assignments.push_back({ State.Agents[AgentIndex].AgentID, Target.TargetID, Target.Goal, Cost });
+    }
+  }
+}
+
+bool GoalAssignment::StartSolve()
+{
+  bChanged = false;
+  if (Agents.empty() || Targets.empty())
+  {
+    return false;
+  }
+
+  SolveState State;
+  State.Epoch = Epoch;
+  State.bStraightCosts = !Static;
+  State.Classes = Classes;
+  State.Agents = Agents;
+  State.Targets = Targets;
+
+  if (Static)
+  {
+    SetType<int> UsedClasses;
+    for (const PendingAgent& Agent : Agents)
+    {
+      UsedClasses.insert(Agent.ClassIndex);
+    }
+
+    // Registered tables are found here, the rest is built by the task
+    for (size_t TargetIndex = 0; TargetIndex < State.Targets.size(); ++TargetIndex)
+    {
+      PendingTarget& Target = State.Targets[TargetIndex];
+      Target.Tables.resize(Classes.size());
+      for (int ClassIndex : UsedClasses)
+      {
+        if (Target.Tables[ClassIndex])
+        {
+          continue;
+        }
+
+        const AgentClass& Class = Classes[ClassIndex];
+        Target.Tables[ClassIndex] = RegisteredTables ? RegisteredTables->Find(Target.Goal, Class.Shape, Class.Moves, 1.f) : nullptr;
+        if (!Target.Tables[ClassIndex])
+        {
+          State.MissingTables.emplace_back(TargetIndex, ClassIndex);
+        }
+      }
+    }
+
+    // The static space is changed by the game thread while the tables are built
+    if (State.MissingTables.size())
+    {
+      State.Static = std::make_shared<const RawSpace>(*Static);
+    }
+  }
+
+  ChangedDuringSolve.clear();
+  RunningSolve = Async(EAsyncExecution::ThreadPool, [State = std::move(State)]() mutable -> SolveState {
+    Match(State);
+    return std::move(State);
+  });
+  return true;
+}
+
+void GoalAssignment::FinishSolve(bool bWait, ArrayType<GoalAssignmentResult>& OutAssignments)
+{
+  if (!RunningSolve.IsValid())
+  {
+    return;
+  }
+
+  if (bWait)
+  {
+    RunningSolve.Wait();
+  }
+  if (!RunningSolve.IsReady())
+  {
+    return;
+  }
+
+  const SolveState State = RunningSolve.Get();
+  RunningSolve.Reset();
+  if (State.Epoch != Epoch)
+  {
+    return;
+  }
+
+  MapType<int, size_t> TargetIndices;
+  for (size_t TargetIndex = 0; TargetIndex < Targets.size(); ++TargetIndex)
+  {
+    TargetIndices[Targets[TargetIndex].TargetID] = TargetIndex;
+  }
+  MapType<int, size_t> AgentIndices;
+  for (size_t AgentIndex = 0; AgentIndex < Agents.size(); ++AgentIndex)
+  {
+    AgentIndices[Agents[AgentIndex].AgentID] = AgentIndex;
+  }
+
+  // Tables of the solve reaching the cells changed since it started are dropped with their costs and pairs
+  SetType<std::pair<int, int>> StaleTables;
+  for (const PendingTarget& SolvedTarget : State.Targets)
+  {
+    const auto Found = TargetIndices.find(SolvedTarget.TargetID);
+    for (size_t ClassIndex = 0; ClassIndex < SolvedTarget.Tables.size(); ++ClassIndex)
+    {
+      const std::shared_ptr<const DistanceTable>& Table = SolvedTarget.Tables[ClassIndex];
+      if (!Table)
+      {
+        continue;
+      }
+
+      const bool bStale = std::any_of(ChangedDuringSolve.begin(), ChangedDuringSolve.end(), [&Table](FPoint Changed) {
+        return Table->IsAffectedBy(Changed);
+      });
+      if (bStale)
+      {
+        StaleTables.insert({ SolvedTarget.TargetID, (int) ClassIndex });
+        continue;
+      }
+
+      if (Found != TargetIndices.end())
+      {
+        PendingTarget& Target = Targets[Found->second];
+        Target.Tables.resize(Classes.size());
+        if (!Target.Tables[ClassIndex])
+        {
+          Target.Tables[ClassIndex] = Table;
+        }
+      }
+    }
+  }
+  ChangedDuringSolve.clear();
+
+  // Agents added again during the solve may have moved, their costs are found again
+  auto FindSameAgent = [this, &AgentIndices](const PendingAgent& SolvedAgent) -> PendingAgent* {
+    const auto Found = AgentIndices.find(SolvedAgent.AgentID);
+    if (Found == AgentIndices.end())
+    {
+      return nullptr;
+    }
+
+    PendingAgent& Agent = Agents[Found->second];
+    return Agent.Point == SolvedAgent.Point && Agent.ClassIndex == SolvedAgent.ClassIndex && Agent.Speed == SolvedAgent.Speed ? &Agent : nullptr;
+  };
+
+  MapType<int, const PendingAgent*> SolvedAgents;
+  for (const PendingAgent& SolvedAgent : State.Agents)
+  {
+    SolvedAgents[SolvedAgent.AgentID] = &SolvedAgent;
+    PendingAgent* Agent = FindSameAgent(SolvedAgent);
+    if (!Agent)
+    {
+      continue;
+    }
+
+    for (const auto& TargetAndCost : SolvedAgent.Costs)
+    {
+      if (TargetIndices.count(TargetAndCost.first) && !StaleTables.count({ TargetAndCost.first, SolvedAgent.ClassIndex }))
+      {
+        Agent->Costs.emplace(TargetAndCost.first, TargetAndCost.second);
+      }
+    }
+  }
+
+  SetType<int> AssignedAgents;
+  SetType<int> AssignedTargets;
+  for (const GoalAssignmentResult& Assigned : State.Assignments)
+  {
+    const PendingAgent& SolvedAgent = *SolvedAgents.at(Assigned.AgentID);
+    if (!FindSameAgent(SolvedAgent) || !TargetIndices.count(Assigned.TargetID) || StaleTables.count({ Assigned.TargetID, SolvedAgent.ClassIndex }))
+    {
+      continue;
+    }
+
+    AssignedAgents.insert(Assigned.AgentID);
+    AssignedTargets.insert(Assigned.TargetID);
+    OutAssignments.push_back(Assigned);
+  }
+
+  // Costs of the rest of the pairs are kept for the next Solve
+  Agents.erase(std::remove_if(Agents.begin(), Agents.end(), [&AssignedAgents](const PendingAgent& Agent) {
+    return AssignedAgents.count(Agent.AgentID) > 0;
+  }), Agents.end());
+  Targets.erase(std::remove_if(Targets.begin(), Targets.end(), [&AssignedTargets](const PendingTarget& Target) {
+    return AssignedTargets.count(Target.TargetID) > 0;
+  }), Targets.end());
+  for (PendingAgent& Agent : Agents)
+  {
+    for (int AssignedTarget : AssignedTargets)
+    {
+      Agent.Costs.erase(AssignedTarget);
+    }
+  }
+}
+
+void GoalAssignment::Solve(bool bWait, ArrayType<GoalAssignmentResult>& OutAssignments)
+{
+  FinishSolve(bWait, OutAssignments);
+  // Pairs of unchanged agents and targets are the same as the last solve found
+  if (!RunningSolve.IsValid() && bChanged && StartSolve() && bWait)
+  {
+    FinishSolve(true, OutAssignments);
+  }
+}
+
+void GoalAssignment::Clear()
+{
+  Classes.clear();
+  Agents.clear();
+  Targets.clear();
+  Static = nullptr;
+  RegisteredTables = nullptr;
+  ++Epoch;
+  ChangedDuringSolve.clear();
+  bChanged = false;
+}
@@ -23,3 +23,39 @@ void EuclideanHeuristic::FindCost(FPoint To)
 {
   return;
 }
+
+void EuclideanHeuristic::FindCosts(const FPoint* Cells, size_t Num, float* OutCosts)
+{
+  for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+  {
+    OutCosts[CellIndex] = GetCost(Cells[CellIndex]);
+  }
+}
+
+BalancedEuclideanHeuristic::BalancedEuclideanHeuristic(FPoint Source, FPoint Target, float Speed)
+  : Heuristic(Target)
+  , ToTarget(Target, Speed)
+  , ToSource(Source, Speed)
+  , SourceToTarget(ToTarget.GetCost(Source))
+{
+
+}
+
+float BalancedEuclideanHeuristic::GetCost(FPoint To) const
+{
+  // Shifted by half of SourceToTarget, so it is never negative
+  return std::max(0.f, (ToTarget.GetCost(To) - ToSource.GetCost(To) + SourceToTarget) * 0.5f);
+}
+
+void BalancedEuclideanHeuristic::FindCost(FPoint To)
+{
+  return;
+}
+
+void BalancedEuclideanHeuristic::FindCosts(const FPoint* Cells, size_t Num, float* OutCosts)
+{
+  for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+  {
+    OutCosts[CellIndex] = GetCost(Cells[CellIndex]);
+  }
+}
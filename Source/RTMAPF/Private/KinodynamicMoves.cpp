@@ -0,0 +1,318 @@
+#include "KinodynamicMoves.h"
+#include "MovesSegments.h"
+#include "PlannerStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  constexpr StaticDelta HeadingDeltas[KINODYNAMIC_HEADINGS_NUM] = {
+    { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 }
+  };
+
+  /**
+   * Trapezoidal speed profile of a straight step: the agent accelerates from zero if it starts standing,
+   * moves at the peak speed and brakes to zero if it ends standing. Without acceleration the speed changes instantly.
+   */
+  struct StepProfile
+  {
+    float Length;
+    float PeakSpeed;
+    float Acceleration;
+    float AccelerationDistance;
+    float BrakingDistance;
+
+    StepProfile(float InLength, float CruiseSpeed, float InAcceleration, bool bStartMoving, bool bEndMoving)
+      : Length(InLength)
+      , PeakSpeed(CruiseSpeed)
+      , Acceleration(InAcceleration)
+    {
+      // A short step from standing to standing may not reach the cruise speed
+      if (Acceleration > 0 && !bStartMoving && !bEndMoving)
+      {
+        PeakSpeed = std::min(CruiseSpeed, std::sqrt(Acceleration * Length));
+      }
+
+      const float ChangeDistance = Acceleration > 0 ? PeakSpeed * PeakSpeed / (2 * Acceleration) : 0;
+      AccelerationDistance = bStartMoving ? 0 : ChangeDistance;
+      BrakingDistance = bEndMoving ? 0 : ChangeDistance;
+    }
+
+    float GetAccelerationTime() const { return 2 * AccelerationDistance / PeakSpeed; }
+    float GetCruiseTime() const { return (Length - AccelerationDistance - BrakingDistance) / PeakSpeed; }
+    float GetBrakingTime() const { return 2 * BrakingDistance / PeakSpeed; }
+    float GetDuration() const { return GetAccelerationTime() + GetCruiseTime() + GetBrakingTime(); }
+
+    float GetTime(float Distance) const
+    {
+      if (Distance < AccelerationDistance)
+      {
+        return std::sqrt(2 * Distance / Acceleration);
+      }
+
+      const float BrakingStart = Length - BrakingDistance;
+      if (Distance <= BrakingStart)
+      {
+        return GetAccelerationTime() + (Distance - AccelerationDistance) / PeakSpeed;
+      }
+
+      const float Braked = Distance - BrakingStart;
+      const float BrakingTime = (PeakSpeed - std::sqrt(std::max(0.f, PeakSpeed * PeakSpeed - 2 * Acceleration * Braked))) / Acceleration;
+      return GetAccelerationTime() + GetCruiseTime() + BrakingTime;
+    }
+
+    float GetDistance(float Time) const
+    {
+      const float AccelerationTime = GetAccelerationTime();
+      if (Time < AccelerationTime)
+      {
+        return Acceleration * Time * Time / 2;
+      }
+
+      Time -= AccelerationTime;
+      if (Time <= GetCruiseTime())
+      {
+        return AccelerationDistance + PeakSpeed * Time;
+      }
+
+      Time = std::min(Time - GetCruiseTime(), GetBrakingTime());
+      return Length - BrakingDistance + PeakSpeed * Time - Acceleration * Time * Time / 2;
+    }
+  };
+
+  float GetHeadingLength(int Heading)
+  {
+    return Heading % 2 ? std::sqrt(2.f) : 1.f;
+  }
+}
+
+FPoint GetHeadingDelta(int Heading)
+{
+  check(Heading >= 0 && Heading < KINODYNAMIC_HEADINGS_NUM);
+  return HeadingDeltas[Heading].ToPoint();
+}
+
+int FindHeading(FPoint Delta)
+{
+  for (int Heading = 0; Heading < KINODYNAMIC_HEADINGS_NUM; ++Heading)
+  {
+    if (HeadingDeltas[Heading] == Delta)
+    {
+      return Heading;
+    }
+  }
+
+  return -1;
+}
+
+KinodynamicPrimitives::KinodynamicPrimitives(const FKinodynamicModel& InModel)
+  : Model(InModel)
+{
+  check(Model.MaxSpeed > 0);
+
+  // The cruise speed is reached within one straight step
+  CruiseSpeed = Model.Acceleration > 0 ? std::min(Model.MaxSpeed, std::sqrt(2 * Model.Acceleration)) : Model.MaxSpeed;
+
+  for (int Heading = 0; Heading < KINODYNAMIC_HEADINGS_NUM; ++Heading)
+  {
+    const FPoint Delta = GetHeadingDelta(Heading);
+    const float Length = GetHeadingLength(Heading);
+    // Shares of the step at the constant speed, which are the shares of its length
+    const auto RelationalPointToSegment = GetTouchedSegments({ 1.f, Delta });
+
+    for (int StartMoving = 0; StartMoving < 2; ++StartMoving)
+    {
+      for (int EndMoving = 0; EndMoving < 2; ++EndMoving)
+      {
+        const StepProfile Profile(Length, CruiseSpeed, Model.Acceleration, StartMoving, EndMoving);
+        const float Duration = Profile.GetDuration();
+        const auto ToTimeShare = [&Profile, Length, Duration](float LengthShare) {
+          return Profile.GetTime(LengthShare * Length) / Duration;
+        };
+
+        Step& Move = Steps[Heading][StartMoving][EndMoving];
+        Move.Delta = Delta;
+        Move.Duration = Duration;
+        Move.Touched.clear();
+        for (const FPoint& TouchedDelta : { FPoint(0, 0), Delta })
+        {
+          const Segment& LengthShares = RelationalPointToSegment.at(TouchedDelta);
+          Move.Touched.push_back({ TouchedDelta, ToTimeShare(LengthShares.Start), ToTimeShare(LengthShares.End) });
+        }
+        for (const auto& PointAndSegment : RelationalPointToSegment)
+        {
+          if (!(PointAndSegment.first == FPoint(0, 0)) && !(PointAndSegment.first == Delta))
+          {
+            Move.Touched.push_back({ PointAndSegment.first, ToTimeShare(PointAndSegment.second.Start), ToTimeShare(PointAndSegment.second.End) });
+          }
+        }
+      }
+    }
+  }
+}
+
+int KinodynamicPrimitives::GetStartHeading() const
+{
+  const float TurnAngle = 45.f * GetTurnStep();
+  const int Turns = (int) std::lround(Model.StartYaw / TurnAngle);
+  return ((Turns * GetTurnStep()) % KINODYNAMIC_HEADINGS_NUM + KINODYNAMIC_HEADINGS_NUM) % KINODYNAMIC_HEADINGS_NUM;
+}
+
+float KinodynamicPrimitives::GetDistanceShare(int Heading, bool bStartMoving, bool bEndMoving, float TimeShare) const
+{
+  const StepProfile Profile(GetHeadingLength(Heading), CruiseSpeed, Model.Acceleration, bStartMoving, bEndMoving);
+  const float Share = Profile.GetDistance(std::min(std::max(TimeShare, 0.f), 1.f) * Profile.GetDuration()) / Profile.Length;
+  return std::min(std::max(Share, 0.f), 1.f);
+}
+
+ArrayType<MoveDelta<OrientedArea>> KinodynamicMovesSegment::FindValidMoves(const Node<OrientedArea>& Node)
+{
+  PLANNER_PHASE_SCOPE(EPlannerPhase::SippExpansion);
+
+  ArrayType<MoveDelta<OrientedArea>> Result;
+  const OrientedArea& Origin = Node.Cell;
+
+  if (!Origin.bMoving)
+  {
+    if (Origin.Interval.End >= Depth)
+    {
+      // Fictive node
+      Result.push_back({ 0, OrientedArea(Area{ Origin.Point, { Depth, Origin.Interval.End } }, Origin.GetState()), Depth - Node.MinTime });
+    }
+
+    // Turns keep the safe interval of the origin
+    const float TurnDuration = Primitives->GetTurnDuration() / Speed;
+    if (Node.MinTime + TurnDuration <= Origin.Interval.End)
+    {
+      for (int Direction : { 1, -1 })
+      {
+        const int Heading = (Origin.Heading + Direction * Primitives->GetTurnStep() + KINODYNAMIC_HEADINGS_NUM) % KINODYNAMIC_HEADINGS_NUM;
+        Result.push_back({ TurnDuration, OrientedArea(Origin, { (uint8) Heading, false }) });
+      }
+    }
+  }
+
+  AddStep(Node, false, Result);
+  AddStep(Node, true, Result);
+  return Result;
+}
+
+void KinodynamicMovesSegment::AddStep(const Node<OrientedArea>& Node, bool bEndMoving, ArrayType<MoveDelta<OrientedArea>>& OutMoves)
+{
+  const OrientedArea& Origin = Node.Cell;
+  const KinodynamicPrimitives::Step& Move = Primitives->GetStep(Origin.Heading, Origin.bMoving, bEndMoving);
+  const float Duration = Move.Duration / Speed;
+
+  const FPoint DestinationPoint = Origin.Point + Move.Delta;
+  Space->UpdateShape(DestinationPoint);
+  if (!Space->ContainsSegmentsIn(DestinationPoint))
+  {
+    return;
+  }
+
+  // Departure times of the step, a moving agent can't wait
+  SegmentHolder DepartureHolder = Segment{ Node.MinTime, Origin.bMoving ? Node.MinTime : Origin.Interval.End };
+  for (const KinodynamicPrimitives::TouchedCell& Touched : Move.Touched)
+  {
+    const FPoint MovePoint = Origin.Point + Touched.Delta;
+    Space->UpdateShape(MovePoint);
+    if (!Space->ContainsSegmentsIn(MovePoint))
+    {
+      // Impossible Move
+      return;
+    }
+
+    DepartureHolder.IntersectWithLowered(Space->GetSegments(MovePoint), Touched.Start * Duration, (Touched.End - Touched.Start) * Duration);
+  }
+
+  const float DestinationEntry = Move.Touched[1].Start * Duration;
+  const SegmentHolder& OriginalDestinationSegments = Space->GetSegments(DestinationPoint);
+
+  SearchArenaScope ScratchScope(ScratchArena);
+  MapType<Segment, float, std::hash<Segment>, std::equal_to<Segment>, ArenaAllocator<std::pair<const Segment, float>>> DestinationSegmentToMinTime{
+    ArenaAllocator<std::pair<const Segment, float>>(ScratchArena)
+  };
+  for (const Segment Departures : DepartureHolder)
+  {
+    const Segment OriginalSegment = OriginalDestinationSegments.Find(Departures.Start + DestinationEntry);
+    if (OriginalSegment.IsValid() && !DestinationSegmentToMinTime.count(OriginalSegment))
+    {
+      DestinationSegmentToMinTime[OriginalSegment] = Departures.Start;
+    }
+  }
+
+  for (auto& SegmentAndTime : DestinationSegmentToMinTime)
+  {
+    const float MovementStartTime = SegmentAndTime.second;
+    check(MovementStartTime >= Node.MinTime);
+
+    // The agent stands at the window end
+    if (bEndMoving && MovementStartTime + Duration >= Depth)
+    {
+      continue;
+    }
+
+    const KinodynamicState DestinationState = { Origin.Heading, bEndMoving };
+    OutMoves.push_back({ Duration, OrientedArea(Area{ DestinationPoint, SegmentAndTime.first }, DestinationState), MovementStartTime - Node.MinTime });
+  }
+}
+
+void FromReversedKinodynamicPathToFilledAreas(
+  const ArrayType<Node<Area>>& Path,
+  const ArrayType<KinodynamicState>& States,
+  const KinodynamicPrimitives& Primitives,
+  const FShape& Shape,
+  ArrayType<Area>& Areas
+)
+{
+  check(Path.size() == States.size());
+
+  const auto& LastNode = Path.front();
+  Segment LastMovementOnPlace{ LastNode.MinTime, LastNode.Cell.Interval.End };
+  for (const FPoint& ShapePoint : Shape.Points)
+  {
+    Areas.push_back(Area(LastNode.Cell.Point + ShapePoint, LastMovementOnPlace));
+  }
+
+  for (size_t CellIndex = 1; CellIndex < Path.size(); ++CellIndex)
+  {
+    const auto& Prev = Path[CellIndex];
+    const auto& Next = Path[CellIndex - 1];
+    const float MovementStartTime = Next.MinTime - Next.ArrivalCost;
+
+    if (MovementStartTime > Prev.MinTime - EPSILON)
+    {
+      const Segment MoveOnPlace = { Prev.MinTime, MovementStartTime };
+      for (const FPoint& ShapePoint : Shape.Points)
+      {
+        Areas.push_back(Area(Prev.Cell.Point + ShapePoint, MoveOnPlace));
+      }
+    }
+
+    if (Next.Cell.Point == Prev.Cell.Point)
+    {
+      // Turn in place
+      const Segment Turn = { MovementStartTime, Next.MinTime };
+      for (const FPoint& ShapePoint : Shape.Points)
+      {
+        Areas.push_back(Area(Prev.Cell.Point + ShapePoint, Turn));
+      }
+      continue;
+    }
+
+    const int Heading = FindHeading(Next.Cell.Point - Prev.Cell.Point);
+    check(Heading >= 0);
+    const KinodynamicPrimitives::Step& Move = Primitives.GetStep(Heading, States[CellIndex].bMoving, States[CellIndex - 1].bMoving);
+    for (const KinodynamicPrimitives::TouchedCell& Touched : Move.Touched)
+    {
+      const FPoint MovePoint = Prev.Cell.Point + Touched.Delta;
+      const Segment MovementSegment = { MovementStartTime + Touched.Start * Next.ArrivalCost, MovementStartTime + Touched.End * Next.ArrivalCost };
+
+      for (const FPoint& ShapePoint : Shape.Points)
+      {
+        Areas.push_back(Area(MovePoint + ShapePoint, MovementSegment));
+      }
+    }
+  }
+}
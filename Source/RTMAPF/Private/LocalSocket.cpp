@@ -0,0 +1,218 @@
+#include "LocalSocket.h"
+
+#if !PLATFORM_WINDOWS
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define LOCAL_SOCKET_RECEIVE_SIZE 65536
+
+#if !PLATFORM_WINDOWS
+namespace
+{
+  bool ToAddress(const FString& Path, sockaddr_un& OutAddress)
+  {
+    const std::string PathString = TCHAR_TO_UTF8(*Path);
+    if (PathString.empty() || PathString.size() >= sizeof(OutAddress.sun_path))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Socket path %s is empty or too long"), *Path);
+      return false;
+    }
+
+    std::memset(&OutAddress, 0, sizeof(OutAddress));
+    OutAddress.sun_family = AF_UNIX;
+    std::memcpy(OutAddress.sun_path, PathString.c_str(), PathString.size());
+    return true;
+  }
+
+  // Returns false if the timeout is over
+  bool WaitForInput(int Handle, int TimeoutMs)
+  {
+    pollfd Poll = { Handle, POLLIN, 0 };
+    int Ready = 0;
+    do
+    {
+      Ready = poll(&Poll, 1, TimeoutMs);
+    } while (Ready < 0 && errno == EINTR);
+
+    return Ready > 0;
+  }
+}
+#endif
+
+LocalSocket::LocalSocket(int InHandle)
+  : Handle(InHandle)
+{ }
+
+LocalSocket::~LocalSocket()
+{
+  Close();
+}
+
+void LocalSocket::Close()
+{
+#if !PLATFORM_WINDOWS
+  if (Handle >= 0)
+  {
+    close(Handle);
+  }
+#endif
+  Handle = -1;
+}
+
+#if PLATFORM_WINDOWS
+
+bool LocalSocket::Listen(const FString& Path)
+{
+  UE_LOG(LogTemp, Error, TEXT("Local sockets are not supported on this platform"));
+  return false;
+}
+
+std::unique_ptr<LocalSocket> LocalSocket::Accept(int TimeoutMs)
+{
+  return nullptr;
+}
+
+bool LocalSocket::Connect(const FString& Path)
+{
+  UE_LOG(LogTemp, Error, TEXT("Local sockets are not supported on this platform"));
+  return false;
+}
+
+bool LocalSocket::Send(const std::string& Data)
+{
+  return false;
+}
+
+bool LocalSocket::Receive(int TimeoutMs, std::string& OutData)
+{
+  return false;
+}
+
+#else
+
+bool LocalSocket::Listen(const FString& Path)
+{
+  Close();
+
+  sockaddr_un Address;
+  if (!ToAddress(Path, Address))
+  {
+    return false;
+  }
+
+  Handle = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Handle < 0)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot create a socket: %s"), UTF8_TO_TCHAR(std::strerror(errno)));
+    return false;
+  }
+
+  unlink(Address.sun_path);
+  if (bind(Handle, (const sockaddr*) &Address, sizeof(Address)) < 0 || listen(Handle, 1) < 0)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot listen on socket %s: %s"), *Path, UTF8_TO_TCHAR(std::strerror(errno)));
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+std::unique_ptr<LocalSocket> LocalSocket::Accept(int TimeoutMs)
+{
+  if (Handle < 0 || !WaitForInput(Handle, TimeoutMs))
+  {
+    return nullptr;
+  }
+
+  const int Accepted = accept(Handle, nullptr, nullptr);
+  if (Accepted < 0)
+  {
+    return nullptr;
+  }
+
+  return std::unique_ptr<LocalSocket>(new LocalSocket(Accepted));
+}
+
+bool LocalSocket::Connect(const FString& Path)
+{
+  Close();
+
+  sockaddr_un Address;
+  if (!ToAddress(Path, Address))
+  {
+    return false;
+  }
+
+  Handle = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Handle < 0 || connect(Handle, (const sockaddr*) &Address, sizeof(Address)) < 0)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot connect to socket %s: %s"), *Path, UTF8_TO_TCHAR(std::strerror(errno)));
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool LocalSocket::Send(const std::string& Data)
+{
+#ifdef MSG_NOSIGNAL
+  // A closed peer is reported by the result instead of SIGPIPE
+  const int Flags = MSG_NOSIGNAL;
+#else
+  const int Flags = 0;
+#endif
+
+  size_t SentSize = 0;
+  while (Handle >= 0 && SentSize < Data.size())
+  {
+    const ssize_t Sent = send(Handle, Data.data() + SentSize, Data.size() - SentSize, Flags);
+    if (Sent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (Sent <= 0)
+    {
+      return false;
+    }
+    SentSize += Sent;
+  }
+
+  return Handle >= 0;
+}
+
+bool LocalSocket::Receive(int TimeoutMs, std::string& OutData)
+{
+  if (Handle < 0)
+  {
+    return false;
+  }
+
+  if (!WaitForInput(Handle, TimeoutMs))
+  {
+    return true;
+  }
+
+  char Buffer[LOCAL_SOCKET_RECEIVE_SIZE];
+  ssize_t Received = 0;
+  do
+  {
+    Received = recv(Handle, Buffer, sizeof(Buffer), 0);
+  } while (Received < 0 && errno == EINTR);
+
+  if (Received <= 0)
+  {
+    return false;
+  }
+
+  OutData.append(Buffer, Received);
+  return true;
+}
+
+#endif
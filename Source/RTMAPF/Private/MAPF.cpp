@@ -1,14 +1,183 @@
 #include "MAPF.h"
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <unordered_set>
+
+namespace
+{
+  SessionEvent ToAddAgentEvent(const UAgent* Agent, float Time)
+  {
+    SessionEvent Event;
+    Event.Type = ESessionEventType::AddAgent;
+    Event.Time = Time;
+    Event.ID = Agent->GetIDUnsafe();
+    Event.Point = Agent->GetStartSafe();
+    Event.Goal = Agent->GetGoalSafe();
+    Event.Value = Agent->GetSpeedSafe();
+    Event.Shape = Agent->GetShapeSafe();
+    Event.Moves = Agent->GetMovesSafe();
+    return Event;
+  }
+
+  // Goals queued after the current goal, they follow the AddAgent event of the agent
+  SessionEvent ToAddGoalsEvent(const UAgent* Agent, float Time)
+  {
+    ArrayType<FPoint> NextGoals;
+    Agent->GetNextGoalsSafe(NextGoals, std::numeric_limits<int>::max());
+
+    SessionEvent Event;
+    Event.Type = ESessionEventType::AddGoals;
+    Event.Time = Time;
+    Event.ID = Agent->GetIDUnsafe();
+    Event.Goals = TArray<FPoint>(NextGoals.data(), (int32) NextGoals.size());
+    return Event;
+  }
+}
+
 UMultiagentPathfinder::UMultiagentPathfinder()
 {
-  Depth = 30;
+  Horizon.MaxDepth = 30;
+  Horizon.MinDepth = 10;
+  ReservationChangeLatency = 2;
 }
 
 void UMultiagentPathfinder::SetDepth(float InDepth)
 {
-  Depth = InDepth;
-  // TODO add depth setting in AdaptivePath
+  check(InDepth > 0);
+  FScopeLock g(&AccessAgentPaths);
+
+  SessionEvent Event;
+  Event.Type = ESessionEventType::SetDepth;
+  Event.Value = InDepth;
+  RecordSetting(Event);
+
+  Horizon.MaxDepth = InDepth;
+  Horizon.MinDepth = std::min(Horizon.MinDepth, InDepth);
+
+  // Windows that are longer than allowed now should be shortened soon.
+  // Longer windows are applied at the next replan of every agent.
+  for (const auto& AdaptivePath : AgentPaths)
+  {
+    if (AdaptivePath.Value.GetDepth() > InDepth)
+    {
+      Scheduler.Prioritize(AdaptivePath.Key, CurrentTime + InDepth * WindowExpirationShare);
+    }
+  }
+}
+
+void UMultiagentPathfinder::SetMinDepth(float InMinDepth)
+{
+  check(InMinDepth > 0);
+  FScopeLock g(&AccessAgentPaths);
+
+  SessionEvent Event;
+  Event.Type = ESessionEventType::SetMinDepth;
+  Event.Value = InMinDepth;
+  RecordSetting(Event);
+
+  Horizon.MinDepth = std::min(InMinDepth, Horizon.MaxDepth);
+}
+
+void UMultiagentPathfinder::SetConflictResolution(bool bEnable)
+{
+  FScopeLock g(&AccessAgentPaths);
+
+  SessionEvent Event;
+  Event.Type = ESessionEventType::SetConflictResolution;
+  Event.bFlag = bEnable;
+  RecordSetting(Event);
+
+  bResolveConflicts = bEnable;
+  if (!bResolveConflicts)
+  {
+    PendingResolution.Reset();
+  }
+}
+
+void UMultiagentPathfinder::SetPathShortcuts(bool bEnable)
+{
+  FScopeLock g(&AccessAgentPaths);
+
+  SessionEvent Event;
+  Event.Type = ESessionEventType::SetPathShortcuts;
+  Event.bFlag = bEnable;
+  RecordSetting(Event);
+
+  bShortcutPaths = bEnable;
+  for (auto& AgentPath : AgentPaths)
+  {
+    AgentPath.Value.SetShortcuts(bEnable);
+  }
+}
+
+void UMultiagentPathfinder::SetBidirectionalHeuristic(bool bEnable)
+{
+  FScopeLock g(&AccessAgentPaths);
+
+  SessionEvent Event;
+  Event.Type = ESessionEventType::SetBidirectionalHeuristic;
+  Event.bFlag = bEnable;
+  RecordSetting(Event);
+
+  bBidirectionalHeuristic = bEnable;
+  for (auto& AgentPath : AgentPaths)
+  {
+    AgentPath.Value.SetBidirectionalHeuristic(bEnable);
+  }
+}
+
+bool UMultiagentPathfinder::SetSharding(int TileSize, int Halo, int InMaxConcurrentReplans)
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(SpaceWrapper);
+
+  if (TileSize < 0 || (TileSize > 0 && (Halo < 1 || Halo * 2 > TileSize)) || InMaxConcurrentReplans < 1)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Invalid sharding: tile size = %d, halo = %d, replans = %d"), TileSize, Halo, InMaxConcurrentReplans);
+    return false;
+  }
+
+  uint32_t MapWidth = 0;
+  uint32_t MapHeight = 0;
+  if (TileSize > 0 && !SpaceWrapper->GetMapSize(MapWidth, MapHeight))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Sharding needs a space loaded from a file"));
+    return false;
+  }
+
+  if (AgentPaths.Num() || PendingToAdd.Num())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Sharding can't be changed with existing agents"));
+    return false;
+  }
+
+  if (TileSize > 0 && RemotePlanner)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Sharding can't be used with planner service"));
+    return false;
+  }
+
+  SessionEvent Event;
+  Event.Type = ESessionEventType::SetSharding;
+  Event.Sharding.TileSize = TileSize;
+  Event.Sharding.Halo = Halo;
+  Event.Sharding.MaxConcurrentReplans = InMaxConcurrentReplans;
+  RecordSetting(Event);
+
+  if (!TileSize)
+  {
+    // Replans share the whole space
+    Shards = std::make_shared<ShardedSpace>(Space);
+    MaxConcurrentReplans = 1;
+    return true;
+  }
+
+  Shards = std::make_shared<ShardedSpace>(Space, MapWidth, MapHeight, TileSize, Halo);
+  MaxConcurrentReplans = InMaxConcurrentReplans;
+  return true;
 }
 
 void UMultiagentPathfinder::Initialize(FSubsystemCollectionBase& Collection)
@@ -24,20 +193,72 @@ void UMultiagentPathfinder::Deinitialize()
 void UMultiagentPathfinder::SetSpace(ASpace* InSpaceWrapper)
 {
   check(InSpaceWrapper);
+  if (SpaceWrapper)
+  {
+    SpaceWrapper->OnSpaceChanged.RemoveAll(this);
+    SpaceWrapper->OnObstacleChanged.RemoveAll(this);
+  }
+
   SpaceWrapper = InSpaceWrapper;
   Space = InSpaceWrapper->GetSpace();
+  Shards = std::make_shared<ShardedSpace>(Space);
+  MaxConcurrentReplans = 1;
+  DistanceTables->Clear();
+  DistanceTables->SetStaticSpace(InSpaceWrapper->GetStaticSpace());
+  Assignment.SetStaticSpace(InSpaceWrapper->GetStaticSpace(), DistanceTables);
+  SpaceWrapper->OnSpaceChanged.AddUObject(this, &UMultiagentPathfinder::HandleSpaceChange);
+  SpaceWrapper->OnObstacleChanged.AddUObject(this, &UMultiagentPathfinder::HandleObstacleChange);
 }
 
 void UMultiagentPathfinder::Reset()
 {
   FScopeLock g(&AccessAgentPaths);
+  if (ResolutionResult.IsValid())
+  {
+    ResolutionResult.Wait();
+    ResolutionResult.Reset();
+  }
+  PendingResolution.Reset();
+  ResolvingAgents.clear();
+  ForcedWhileResolving.clear();
+  Recorder.Stop();
   AgentPaths.Empty();
-  CurrentlyReplanning.Reset();
+  ExportedPaths->Clear();
+  if (SpaceWrapper && SpaceWrapper->GetStreamer())
+  {
+    SpaceWrapper->GetStreamer()->UnpinAll();
+  }
+  PendingToAdd.Empty();
+  for (UAgent* Agent : ReplayAgents)
+  {
+    // Their paths are already removed, failed agents may be destroyed
+    if (Agent)
+    {
+      Agent->MarkConnection(false);
+    }
+  }
+  ReplayAgents.Empty();
+  Scheduler.Clear();
+  ReservationAgents.Clear();
+  Stats.Clear();
+  GoalGenerator = nullptr;
+  GoalGenerationAgents.clear();
+  DistanceTables->Clear();
+  DistanceTables->SetStaticSpace(nullptr);
+  Assignment.Clear();
+  RunningReplans.clear();
+  PendingRemovals.clear();
+  PendingCellUpdates.clear();
+  RemotePlanner = nullptr;
+  if (SpaceWrapper)
+  {
+    SpaceWrapper->OnSpaceChanged.RemoveAll(this);
+    SpaceWrapper->OnObstacleChanged.RemoveAll(this);
+  }
   Space = nullptr;
+  Shards = nullptr;
+  MaxConcurrentReplans = 1;
   SpaceWrapper = nullptr; 
-  PendingRemove = false;
-  ReplanningFreshAgent = false;
-  ReplanRepeat = false;
 }
 
 void UMultiagentPathfinder::Tick(float DeltaTime)
@@ -46,169 +267,1425 @@ void UMultiagentPathfinder::Tick(float DeltaTime)
   check(SpaceWrapper);
   check(DeltaTime >= 0);
 
+  if (RemotePlanner)
+  {
+    // New agents are sent before the Tick, so the service plans them in it
+    SendRemoteAgents();
+  }
+
+  // Goal changes are recorded before the Tick, as they are replayed
+  AssignGoals();
+  GenerateGoals();
+
+  if (Recorder.IsRecording() || RemotePlanner)
+  {
+    SessionEvent Event;
+    Event.Type = ESessionEventType::Tick;
+    Event.Time = CurrentTime;
+    Event.Value = DeltaTime;
+    PublishEvent(Event);
+  }
+
   CurrentTime += DeltaTime;
+  Stats.AdvanceClock(DeltaTime);
+  // Running tasks keep the tables they have found, new tasks wait for the rebuilt ones
+  DistanceTables->RebuildIfStale(bDeterministic);
   for (auto& AdaptivePath : AgentPaths)
   {
     AdaptivePath.Value.MoveTimeBy(DeltaTime);
   }
+  // Before replans start, so they capture the next goals
+  UpdateReachedGoals();
+
+  if (RemotePlanner)
+  {
+    ReceiveRemotePaths();
+    ApplyPendingChanges();
+    return;
+  }
 
-  // Check if we need to replan
-  if (CurrentlyReplanning)
+  for (size_t ReplanIndex = 0; ReplanIndex < RunningReplans.size();)
   {
-    const auto& AdaptivePath = AgentPaths.Find(CurrentlyReplanning.GetValue());
-    if (!AdaptivePath->CheckForUpdate())
+    if (FinishReplan(RunningReplans[ReplanIndex]))
     {
-      // Still planning
-      return;
+      RunningReplans.erase(RunningReplans.begin() + ReplanIndex);
+    }
+    else
+    {
+      ++ReplanIndex;
+    }
+  }
+
+  // Other agents are planned while the group is resolved, as the resolver works in its own snapshot.
+  // Resolved paths are written when no running replan uses the tables of their shards
+  SetType<int> ResolutionShards;
+  if (ResolutionResult.IsValid())
+  {
+    if (bDeterministic)
+    {
+      ResolutionResult.Wait();
     }
 
-    if (ReplanningFreshAgent)
+    if (ResolutionResult.IsReady())
     {
-      if (!AdaptivePath->IsAnyPathReady())
+      Shards->FindBlock(ResolutionShard, ResolutionShards);
+      if (!IsAnyShardLocked(ResolutionShards))
       {
-        if (!PendingRemove)
-        {
-          AdaptivePath->GetAgent()->ConnectionFailed();
-        }
-        PendingRemove = true;
-        UE_LOG(LogTemp, Error, TEXT("New agent with id = %d failed to enter MAPF subsystem"), AdaptivePath->GetAgent()->GetIDUnsafe());
+        ApplyResolution(ResolutionResult.Get());
+        ResolutionResult.Reset();
+        ResolvingAgents.clear();
+        ForcedWhileResolving.clear();
+        ResolutionShards.clear();
+      }
+    }
+  }
+
+  if (RunningReplans.empty())
+  {
+    // Space isn't used by planning now
+    ApplyPendingChanges();
+
+    if (PendingResolution && !ResolutionResult.IsValid())
+    {
+      const int ResolvedID = PendingResolution.GetValue();
+      PendingResolution.Reset();
+      if (AgentPaths.Contains(ResolvedID))
+      {
+        StartResolution(ResolvedID);
+        return;
+      }
+    }
+  }
+  else if ((PendingResolution && !ResolutionResult.IsValid()) || PendingCellUpdates.size() || SpaceWrapper->GetObstacles()->HasStagedChanges())
+  {
+    // Running replans are finished first, so the changes are applied before new ones start
+    return;
+  }
+
+  std::shared_ptr<TileStreamer> Streamer = SpaceWrapper->GetStreamer();
+  while ((int) RunningReplans.size() < MaxConcurrentReplans)
+  {
+    // New agents are planned first, when the tiles around them are loaded
+    if (PendingToAdd.Num() && (!Streamer || Streamer->Demand(PendingToAdd.Last()->GetStartSafe())))
+    {
+      if (RunningReplans.size())
+      {
+        // Adding a path may move the paths used by running tasks
+        return;
+      }
+
+      UAgent* Agent = PendingToAdd.Pop();
+      while (AgentPaths.Contains(Agent->GetIDUnsafe()))
+      {
+        // TODO make something smarter
+        Agent->SetIDUnsafe(MaxAgentID++);
       }
-      else
+
+      AgentPaths.Add(Agent->GetIDUnsafe(), FAdaptivePath(Agent, Shards, Horizon.MaxDepth, CurrentTime));
+      AgentPaths[Agent->GetIDUnsafe()].SetDistanceTables(DistanceTables);
+      AgentPaths[Agent->GetIDUnsafe()].SetShortcuts(bShortcutPaths);
+      AgentPaths[Agent->GetIDUnsafe()].SetBidirectionalHeuristic(bBidirectionalHeuristic);
+      StartReplan(Agent->GetIDUnsafe(), true);
+      continue;
+    }
+
+    ReplanRequest Request;
+    const bool bFound = Scheduler.PopMostUrgent([this, &ResolutionShards](const ReplanRequest& Candidate) {
+      SetType<int> CandidateShards;
+      FindReplanShards(Candidate.AgentID, CandidateShards);
+      // Replans using the shards of a ready resolution wait till it is applied
+      for (int Shard : CandidateShards)
       {
-        if (!PendingRemove)
+        if (ResolutionShards.count(Shard))
         {
-          AdaptivePath->GetAgent()->MarkConnection();
+          return false;
         }
       }
+      return !IsAnyShardLocked(CandidateShards);
+    }, Request);
 
-      ReplanningFreshAgent = false;
+    if (!bFound)
+    {
+      return;
     }
 
-    if (PendingRemove)
+    check(AgentPaths.Contains(Request.AgentID));
+    if (Request.Deadline < CurrentTime)
     {
-      AgentPaths.Remove(CurrentlyReplanning.GetValue());
-      PendingRemove = false;
+      UE_LOG(LogTemp, Verbose, TEXT("Agent with id = %d is replanned %f after its deadline"), Request.AgentID, CurrentTime - Request.Deadline);
     }
-    else if (ReplanRepeat)
+    // Only the time after the deadline is the wait, earlier deadlines are not due yet
+    Stats.AddQueueWait(Request.AgentID, std::max(0.f, CurrentTime - Request.Deadline));
+
+    StartReplan(Request.AgentID, false);
+  }
+}
+
+void UMultiagentPathfinder::FindReplanShards(int ID, SetType<int>& OutShards) const
+{
+  const FAdaptivePath& AdaptivePath = AgentPaths[ID];
+  Shards->FindBlock(AdaptivePath.GetPathShard(), OutShards);
+  Shards->FindBlock(Shards->FindShard(AdaptivePath.GetCurrentPoint()), OutShards);
+}
+
+bool UMultiagentPathfinder::IsAnyShardLocked(const SetType<int>& CheckedShards) const
+{
+  for (const RunningReplan& Replan : RunningReplans)
+  {
+    for (int Shard : CheckedShards)
     {
-      ReplanRepeat = false;
-      bool ReplanBegin = AgentPaths[CurrentlyReplanning.GetValue()].Replan(Depth);
-      check(ReplanBegin);
-      return;
+      if (Replan.LockedShards.count(Shard))
+      {
+        return true;
+      }
     }
-    else
+  }
+
+  return false;
+}
+
+RunningReplan* UMultiagentPathfinder::FindRunningReplan(int ID)
+{
+  for (RunningReplan& Replan : RunningReplans)
+  {
+    if (Replan.AgentID == ID)
     {
-      AgentPaths[CurrentlyReplanning.GetValue()].GetAgent()->OnReplan.Broadcast();
-      Order.AddTail(CurrentlyReplanning.GetValue());
+      return &Replan;
     }
+  }
+
+  return nullptr;
+}
+
+void UMultiagentPathfinder::StartReplan(int ID, bool bFreshAgent)
+{
+  RunningReplan Replan;
+  Replan.AgentID = ID;
+  Replan.bFreshAgent = bFreshAgent;
+  FindReplanShards(ID, Replan.LockedShards);
 
-    CurrentlyReplanning.Reset();
+  // Tables are created here, so tasks never read the base space changed by the game thread
+  for (int Shard : Replan.LockedShards)
+  {
+    Shards->GetShardSpace(Shard);
   }
+  RunningReplans.push_back(std::move(Replan));
 
-  // Change CurrentlyReplanning
-  if (PendingToAdd.Num())
+  FAdaptivePath& AdaptivePath = AgentPaths[ID];
+  AdaptivePath.SetSearchShard(Shards->FindShard(AdaptivePath.GetCurrentPoint()));
+  bool ReplanBegin = AdaptivePath.Replan(Horizon, bDeterministic);
+  check(ReplanBegin);
+}
+
+bool UMultiagentPathfinder::FinishReplan(RunningReplan& Replan)
+{
+  FAdaptivePath* AdaptivePath = AgentPaths.Find(Replan.AgentID);
+  if (bDeterministic)
   {
-    UAgent* Agent = PendingToAdd.Pop();
-    while (AgentPaths.Contains(Agent->GetIDUnsafe()))
+    AdaptivePath->WaitForReplan();
+  }
+
+  if (!AdaptivePath->CheckForUpdate())
+  {
+    // Still planning
+    return false;
+  }
+
+  CollectStats(Replan.AgentID);
+  if (!AdaptivePath->IsLastReplanFailed())
+  {
+    ExportPath(Replan.AgentID);
+  }
+
+  // Agents near a new agent should react immediately, others can wait a little
+  const float NeighboursDeadline = CurrentTime + (Replan.bFreshAgent ? 0.f : ReservationChangeLatency);
+
+  if (Replan.bFreshAgent)
+  {
+    if (!AdaptivePath->IsAnyPathReady())
     {
-      // TODO make something smarter
-      Agent->SetIDUnsafe(MaxAgentID++);
+      if (!Replan.bPendingRemove)
+      {
+        AdaptivePath->GetAgent()->ConnectionFailed();
+      }
+      Replan.bPendingRemove = true;
+      UE_LOG(LogTemp, Error, TEXT("New agent with id = %d failed to enter MAPF subsystem"), AdaptivePath->GetAgent()->GetIDUnsafe());
+    }
+    else
+    {
+      if (!Replan.bPendingRemove)
+      {
+        AdaptivePath->GetAgent()->MarkConnection();
+      }
     }
 
-    AgentPaths.Add(Agent->GetIDUnsafe(), FAdaptivePath(Agent, Space, Depth, CurrentTime));
-    ReplanningFreshAgent = true;
-    CurrentlyReplanning = Agent->GetIDUnsafe();
-    bool ReplanBegin = AgentPaths[Agent->GetIDUnsafe()].Replan(Depth);
-    check(ReplanBegin);
-    return;
+    Replan.bFreshAgent = false;
   }
 
-  while (Order.Num() && !AgentPaths.Contains(Order.GetHead()->GetValue()))
+  if (Replan.bPendingRemove)
   {
-    Order.RemoveNode(Order.GetHead());
+    RemoveAgentPath(Replan.AgentID);
+    return true;
   }
 
-  if (Order.Num())
+  if (Replan.bRepeat)
   {
-    CurrentlyReplanning = AgentPaths[Order.GetHead()->GetValue()].GetAgent()->GetIDUnsafe();
-    bool ReplanBegin = AgentPaths[CurrentlyReplanning.GetValue()].Replan(Depth);
+    // The search shard is kept, so the replan stays in the locked block
+    Replan.bRepeat = false;
+    bool ReplanBegin = AdaptivePath->Replan(Horizon, bDeterministic);
     check(ReplanBegin);
-    Order.RemoveNode(Order.GetHead());
+    return false;
+  }
+
+  AdaptivePath->GetAgent()->OnReplan.Broadcast();
+  Scheduler.Schedule(Replan.AgentID, AdaptivePath->GetShard(), CurrentTime + AdaptivePath->GetDepth() * WindowExpirationShare);
+  ReservationAgents.Update(Replan.AgentID, AdaptivePath->GetFilledAreas());
+  PinStreamedTiles(Replan.AgentID);
+  PrioritizeNeighbours(Replan.AgentID, NeighboursDeadline);
+
+  // Groups are resolved by paths without kinodynamics, so kinodynamic agents wait for their next replan
+  if (bResolveConflicts && AdaptivePath->IsLastReplanFailed() && !AdaptivePath->GetAgent()->GetKinodynamicsSafe().bEnabled)
+  {
+    PendingResolution = Replan.AgentID;
   }
+
+  return true;
 }
 
-FVector UMultiagentPathfinder::GetCurrentLocation(int ID) const
+void UMultiagentPathfinder::RemoveAgentPath(int ID)
 {
-  FScopeLock g(&AccessAgentPaths);
-  check(AgentPaths.Contains(ID));
-  return AgentPaths.Find(ID)->GetCurrentLocation(SpaceWrapper);
+  PrioritizeNeighbours(ID, CurrentTime + ReservationChangeLatency);
+  ReservationAgents.Remove(ID);
+  AgentPaths.Remove(ID);
+  ExportedPaths->Remove(ID);
+  Assignment.RemoveAgent(ID);
+  Scheduler.Remove(ID);
+  Stats.RemoveAgent(ID);
+  if (SpaceWrapper->GetStreamer())
+  {
+    SpaceWrapper->GetStreamer()->UnpinAgent(ID);
+  }
 }
 
-FPathPoint UMultiagentPathfinder::GetNextMove(int ID) const
+void UMultiagentPathfinder::PinStreamedTiles(int ID)
 {
-  FScopeLock g(&AccessAgentPaths);
-  check(AgentPaths.Contains(ID));
-  return AgentPaths.Find(ID)->GetNextMove(SpaceWrapper);
+  if (std::shared_ptr<TileStreamer> Streamer = SpaceWrapper->GetStreamer())
+  {
+    const FAdaptivePath& AdaptivePath = AgentPaths[ID];
+    Streamer->PinAgent(ID, AdaptivePath.GetCurrentPoint(), AdaptivePath.GetFilledAreas());
+  }
 }
 
-float UMultiagentPathfinder::GetCurrentTime() const
+void UMultiagentPathfinder::CommitStreaming()
 {
-  return CurrentTime;
+  std::shared_ptr<TileStreamer> Streamer = SpaceWrapper->GetStreamer();
+  if (!Streamer)
+  {
+    return;
+  }
+
+  ArrayType<FPoint> ChangedPoints;
+  SetType<int> Impacted;
+  Streamer->Commit(bDeterministic, ChangedPoints, Impacted);
+
+  for (const FPoint& ChangedPoint : ChangedPoints)
+  {
+    Shards->UpdateCell(ChangedPoint);
+    ReservationAgents.FindAgents(ChangedPoint, Impacted);
+  }
+
+  // Agents waiting at the border of the loaded tiles may go further
+  for (int ImpactedID : Impacted)
+  {
+    Scheduler.Prioritize(ImpactedID, CurrentTime);
+  }
 }
 
-void UMultiagentPathfinder::AddAgent(UAgent* Agent)
+void UMultiagentPathfinder::ApplyPendingChanges()
 {
-  FScopeLock g(&AccessAgentPaths);
-  check(Space);
-  PendingToAdd.Add(Agent);
+  CommitObstacles();
+
+  for (const FPoint& ChangedPoint : PendingCellUpdates)
+  {
+    Shards->UpdateCell(ChangedPoint);
+  }
+  PendingCellUpdates.clear();
+
+  for (int RemovedID : PendingRemovals)
+  {
+    if (AgentPaths.Contains(RemovedID))
+    {
+      RemoveAgentPath(RemovedID);
+    }
+  }
+  PendingRemovals.clear();
+
+  CommitStreaming();
+
+  if (Shards->IsSharded())
+  {
+    // Tables of shards without agents and paths are released
+    SetType<int> UsedShards;
+    for (const auto& AdaptivePath : AgentPaths)
+    {
+      UsedShards.insert(AdaptivePath.Value.GetShard());
+    }
+    Shards->ReleaseIdle(UsedShards);
+  }
 }
 
-void UMultiagentPathfinder::RemoveAgent(int ID)
+void UMultiagentPathfinder::PrioritizeNeighbours(int ID, float Deadline)
+{
+  SetType<int> Neighbours;
+  ReservationAgents.FindNeighbours(ID, Neighbours);
+  for (int NeighbourID : Neighbours)
+  {
+    Scheduler.Prioritize(NeighbourID, Deadline);
+  }
+}
+
+void UMultiagentPathfinder::HandleSpaceChange(FPoint Point)
 {
   FScopeLock g(&AccessAgentPaths);
-  check(Space);
-  if (!AgentPaths.Contains(ID))
+
+  if (Recorder.IsRecording() || RemotePlanner)
   {
-    UE_LOG(LogTemp, Error, TEXT("Attempted to remove nonexisting agent"));
-    return;
+    SessionEvent Event;
+    Event.Type = ESessionEventType::ChangeSpace;
+    Event.Time = CurrentTime;
+    Event.Point = Point;
+    Event.bFlag = SpaceWrapper->IsTraversable(Point);
+    PublishEvent(Event);
   }
 
-  if (CurrentlyReplanning)
+  DistanceTables->MarkStale(Point);
+  Assignment.MarkStale(Point);
+  if (Shards->IsSharded())
   {
-    const auto& AdaptivePath = AgentPaths.Find(CurrentlyReplanning.GetValue());
-    check(AdaptivePath->GetAgent());
-    if (AdaptivePath->GetAgent()->GetIDUnsafe() == ID)
+    PendingCellUpdates.insert(Point);
+  }
+
+  SetType<int> Impacted;
+  ReservationAgents.FindAgents(Point, Impacted);
+  for (int ImpactedID : Impacted)
+  {
+    if (RunningReplan* Replan = FindRunningReplan(ImpactedID))
     {
-      UE_LOG(LogTemp, Log, TEXT("Removing agent is delayed as it is planning now"));
-      PendingRemove = true;
-      return;
+      // The plan being made may rely on the old space
+      Replan->bRepeat = true;
+      continue;
     }
-  }
 
-  AgentPaths.Remove(ID);
+    Scheduler.Prioritize(ImpactedID, CurrentTime);
+  }
 }
 
-void UMultiagentPathfinder::ForceReplan(int ID)
+void UMultiagentPathfinder::HandleObstacleChange(EObstacleChange Change, int ObstacleID, const FObstacleTrajectory& Trajectory)
 {
-  if (!AgentPaths.Contains(ID))
+  FScopeLock g(&AccessAgentPaths);
+  if (!Recorder.IsRecording() && !RemotePlanner)
   {
-    UE_LOG(LogTemp, Error, TEXT("Attempted to force replan with nonexisting agent"));
     return;
   }
 
-  if (CurrentlyReplanning && CurrentlyReplanning.GetValue() == ID)
+  // Obstacles are committed by Tick, so only publishing is needed here
+  SessionEvent Event;
+  switch (Change)
   {
-    ReplanRepeat = true;
-    return;
+  case EObstacleChange::Add: Event.Type = ESessionEventType::AddObstacle; break;
+  case EObstacleChange::Update: Event.Type = ESessionEventType::UpdateObstacle; break;
+  case EObstacleChange::Remove: Event.Type = ESessionEventType::RemoveObstacle; break;
   }
+  Event.Time = CurrentTime;
+  Event.ID = ObstacleID;
+  Event.Trajectory = Trajectory;
+  PublishEvent(Event);
+}
 
-  auto findNode = Order.FindNode(ID);
-  if (!findNode)
+void UMultiagentPathfinder::CommitObstacles()
+{
+  std::shared_ptr<DynamicObstacleLayer> Obstacles = SpaceWrapper->GetObstacles();
+  if (!Obstacles->HasStagedChanges())
   {
-    UE_LOG(LogTemp, Error, TEXT("Attempted to force replan with agent that is outside of Order"));
     return;
   }
 
-  Order.RemoveNode(findNode);
-  Order.AddHead(ID);
+  std::unordered_set<FPoint> ChangedPoints;
+  ArrayType<Area> ReleasedAreas;
+  ArrayType<Area> ReservedAreas;
+  Obstacles->Commit(ChangedPoints, ReleasedAreas, ReservedAreas);
+  Shards->ApplyObstacles(ReleasedAreas, ReservedAreas);
+
+  SetType<int> Impacted;
+  for (const FPoint& ChangedPoint : ChangedPoints)
+  {
+    ReservationAgents.FindAgents(ChangedPoint, Impacted);
+  }
+
+  for (int ImpactedID : Impacted)
+  {
+    Scheduler.Prioritize(ImpactedID, CurrentTime);
+  }
+}
+
+void UMultiagentPathfinder::AssignGoals()
+{
+  ArrayType<GoalAssignmentResult> Assignments;
+  Assignment.Solve(bDeterministic, Assignments);
+  for (const GoalAssignmentResult& Assigned : Assignments)
+  {
+    UE_LOG(LogTemp, Verbose, TEXT("Goal (%d, %d) is assigned to agent with id = %d, cost = %f"), Assigned.Goal.X, Assigned.Goal.Y, Assigned.AgentID, Assigned.Cost);
+    AgentPaths[Assigned.AgentID].GetAgent()->SetGoalSafe(Assigned.Goal);
+    ForceReplan(Assigned.AgentID);
+  }
+}
+
+void UMultiagentPathfinder::UpdateReachedGoals()
+{
+  ArrayType<int> ReachedAgents;
+  for (auto& AdaptivePath : AgentPaths)
+  {
+    const int ID = AdaptivePath.Key;
+    UAgent* Agent = AdaptivePath.Value.GetAgent();
+    FPoint Goal = Agent->GetGoalSafe();
+    FPoint LeftGoal = Goal;
+    bool bGoalChanged = false;
+
+    // Goals passed since the previous Tick are reported in their order,
+    // a goal reached before is left as soon as the next goals are queued
+    while (true)
+    {
+      if (AdaptivePath.Value.CheckGoalReached(Goal))
+      {
+        Stats.AddGoalReached(ID);
+        ReachedAgents.push_back(ID);
+      }
+      else if (!AdaptivePath.Value.IsGoalReached(Goal))
+      {
+        break;
+      }
+
+      LeftGoal = Goal;
+      if (!Agent->AdvanceGoalSafe(Goal))
+      {
+        break;
+      }
+      bGoalChanged = true;
+    }
+
+    // Agents on their last goals get the next ones before the next Tick
+    if (GoalGenerator && !Agent->HasNextGoalsSafe() && (bGoalChanged || AdaptivePath.Value.IsGoalReached(Goal)))
+    {
+      GoalGenerationAgents.insert(ID);
+    }
+
+    if (!bGoalChanged)
+    {
+      continue;
+    }
+
+    if (RemotePlanner)
+    {
+      // The service follows the goal queue too, the change keeps it in step with the agent
+      SessionEvent Event;
+      Event.Type = ESessionEventType::ChangeGoal;
+      Event.Time = CurrentTime;
+      Event.ID = ID;
+      Event.Goal = Goal;
+      RemotePlanner->Queue(Event);
+      continue;
+    }
+
+    // Windows passing through the goal already lead to the next ones, an agent waiting at the goal is replanned now
+    const std::vector<Node<Area>>& ReversedPath = AdaptivePath.Value.GetReversedPath();
+    if (ReversedPath.empty() || !(ReversedPath.front().Cell.Point == LeftGoal))
+    {
+      continue;
+    }
+
+    if (RunningReplan* Replan = FindRunningReplan(ID))
+    {
+      Replan->bRepeat = true;
+    }
+    else
+    {
+      Scheduler.Prioritize(ID, CurrentTime);
+    }
+  }
+
+  // Handlers may add goals or remove agents
+  for (int ID : ReachedAgents)
+  {
+    if (UAgent* Agent = FindAgent(ID))
+    {
+      Agent->OnGoalReached.Broadcast();
+    }
+  }
+}
+
+void UMultiagentPathfinder::GenerateGoals()
+{
+  for (int ID : GoalGenerationAgents)
+  {
+    UAgent* Agent = FindAgent(ID);
+    FPoint GeneratedGoal;
+    if (GoalGenerator && Agent && !Agent->HasNextGoalsSafe() && GoalGenerator(ID, Agent->GetGoalSafe(), GeneratedGoal))
+    {
+      Agent->AppendGoalsSafe({ GeneratedGoal });
+      HandleGoalsAdded(ID, { GeneratedGoal });
+    }
+  }
+  GoalGenerationAgents.clear();
+}
+
+void UMultiagentPathfinder::HandleGoalsAdded(int ID, const TArray<FPoint>& Goals)
+{
+  FScopeLock g(&AccessAgentPaths);
+
+  // Goals of agents that aren't added yet are recorded with them
+  if (!(Recorder.IsRecording() || RemotePlanner) || !FindAgent(ID))
+  {
+    return;
+  }
+
+  SessionEvent Event;
+  Event.Type = ESessionEventType::AddGoals;
+  Event.Time = CurrentTime;
+  Event.ID = ID;
+  Event.Goals = Goals;
+  Recorder.Record(Event);
+  // Agents waiting to be sent to the service are sent with all their goals
+  if (RemotePlanner && AgentPaths.Contains(ID))
+  {
+    RemotePlanner->Queue(Event);
+  }
+}
+
+void UMultiagentPathfinder::SetGoalGenerator(std::function<bool(int, FPoint, FPoint&)> Generator)
+{
+  FScopeLock g(&AccessAgentPaths);
+  GoalGenerator = Generator;
+}
+
+float UMultiagentPathfinder::GetGoalsPerMinute() const
+{
+  FScopeLock g(&AccessAgentPaths);
+  return (float) Stats.GetGoalsPerMinute();
+}
+
+void UMultiagentPathfinder::StartResolution(int ID)
+{
+  const FPoint FailedPoint = AgentPaths[ID].GetCurrentPoint();
+  // The group is resolved in the table of the shard of the failing agent
+  ResolutionShard = AgentPaths[ID].GetShard();
+
+  // Nearest agents sharing regions with the failing one form the group
+  SetType<int> Neighbours;
+  ReservationAgents.FindNeighbours(ID, Neighbours);
+  ArrayType<std::pair<float, int>> DistanceToNeighbour;
+  for (int NeighbourID : Neighbours)
+  {
+    const FAdaptivePath* NeighbourPath = AgentPaths.Find(NeighbourID);
+    if (!NeighbourPath || !NeighbourPath->IsAnyPathReady() || NeighbourPath->GetShard() != ResolutionShard
+      || NeighbourPath->GetAgent()->GetKinodynamicsSafe().bEnabled)
+    {
+      continue;
+    }
+
+    const FPoint Delta = NeighbourPath->GetCurrentPoint() - FailedPoint;
+    DistanceToNeighbour.push_back({ (float) (Delta.X * Delta.X + Delta.Y * Delta.Y), NeighbourID });
+  }
+  std::sort(DistanceToNeighbour.begin(), DistanceToNeighbour.end());
+
+  std::shared_ptr<GroupConflictResolver> Resolver = std::make_shared<GroupConflictResolver>(ResolutionSettings);
+  ArrayType<int> Group = { ID };
+  for (const auto& DistanceAndID : DistanceToNeighbour)
+  {
+    if ((int) Group.size() >= ResolutionSettings.MaxGroupSize)
+    {
+      break;
+    }
+    Group.push_back(DistanceAndID.second);
+  }
+
+  for (int GroupID : Group)
+  {
+    FReplanInput Input;
+    FAdaptivePath& GroupPath = AgentPaths[GroupID];
+    GroupPath.SetSearchShard(ResolutionShard);
+    GroupPath.CaptureReplanInput(Input);
+    Resolver->AddAgent(Input, GroupPath.GetFilledAreas());
+  }
+
+  Resolver->TakeSnapshot(*Shards->GetShardSpace(ResolutionShard));
+  for (int GroupID : Group)
+  {
+    // Replans of the group would be replaced by the resolution
+    Scheduler.Remove(GroupID);
+    ResolvingAgents.insert(GroupID);
+  }
+
+  UE_LOG(LogTemp, Log, TEXT("Resolving conflicts of agent with id = %d in a group of %d agents"), ID, (int) Group.size());
+  ResolutionResult = Async(EAsyncExecution::ThreadPool, [Resolver]() -> GroupResolution {
+    return Resolver->Resolve();
+  });
+}
+
+void UMultiagentPathfinder::ApplyResolution(const GroupResolution& Resolution)
+{
+  Stats.Add(Resolution.AgentIDs[0], Resolution.Stats, Resolution.Events);
+
+  // Agents of the group keep their paths and are replanned one by one
+  const auto RescheduleGroup = [this, &Resolution]() {
+    for (int GroupID : Resolution.AgentIDs)
+    {
+      if (AgentPaths.Contains(GroupID))
+      {
+        Scheduler.Schedule(GroupID, AgentPaths[GroupID].GetShard(), CurrentTime);
+      }
+    }
+  };
+
+  if (!Resolution.bSuccess)
+  {
+    UE_LOG(LogTemp, Warning, TEXT("Failed to resolve conflicts of agent with id = %d"), Resolution.AgentIDs[0]);
+    RescheduleGroup();
+    return;
+  }
+
+  // Release all old paths before the new ones are reserved, as they may overlap
+  for (int GroupID : Resolution.AgentIDs)
+  {
+    if (AgentPaths.Contains(GroupID))
+    {
+      AgentPaths[GroupID].ReleaseReservations();
+    }
+  }
+
+  // Paths of other agents and changes of the space were applied while the group was resolved
+  const std::shared_ptr<SpaceTime> ResolvedSpace = Shards->GetShardSpace(ResolutionShard);
+  for (size_t GroupIndex = 0; GroupIndex < Resolution.AgentIDs.size(); ++GroupIndex)
+  {
+    if (AgentPaths.Contains(Resolution.AgentIDs[GroupIndex])
+      && !IsPathFree(Resolution.ReversedPaths[GroupIndex], Resolution.Shapes[GroupIndex], *ResolvedSpace, CurrentTime, std::numeric_limits<float>::infinity()))
+    {
+      UE_LOG(LogTemp, Warning, TEXT("Resolved paths of agent with id = %d became outdated"), Resolution.AgentIDs[0]);
+      for (int GroupID : Resolution.AgentIDs)
+      {
+        if (AgentPaths.Contains(GroupID))
+        {
+          AgentPaths[GroupID].RestoreReservations();
+        }
+      }
+      RescheduleGroup();
+      return;
+    }
+  }
+
+  for (size_t GroupIndex = 0; GroupIndex < Resolution.AgentIDs.size(); ++GroupIndex)
+  {
+    const int GroupID = Resolution.AgentIDs[GroupIndex];
+    if (!AgentPaths.Contains(GroupID))
+    {
+      // Removed while the group was resolved
+      continue;
+    }
+
+    FAdaptivePath& GroupPath = AgentPaths[GroupID];
+    std::vector<Node<Area>> ReversedPath = Resolution.ReversedPaths[GroupIndex];
+    GroupPath.SetResolvedPath(std::move(ReversedPath), Resolution.Shapes[GroupIndex], ResolutionShard);
+    ExportPath(GroupID);
+
+    ReservationAgents.Update(GroupID, GroupPath.GetFilledAreas());
+    PinStreamedTiles(GroupID);
+    // The resolved path of an agent forced to replan may lead to its old goal
+    const float ReplanTime = ForcedWhileResolving.count(GroupID) ? CurrentTime : CurrentTime + GroupPath.GetDepth() * WindowExpirationShare;
+    Scheduler.Schedule(GroupID, ResolutionShard, ReplanTime);
+    GroupPath.GetAgent()->OnReplan.Broadcast();
+  }
+}
+
+void UMultiagentPathfinder::CollectStats(int ID)
+{
+  PlannerCounters Counters;
+  ArrayType<TraceEvent> Events;
+  AgentPaths[ID].TakeStats(Counters, Events);
+  Stats.Add(ID, Counters, Events);
+}
+
+void UMultiagentPathfinder::ExportPath(int ID)
+{
+  ExportedPaths->Publish(ID, AgentPaths[ID].GetReversedPath());
+}
+
+void UMultiagentPathfinder::PublishEvent(const SessionEvent& Event)
+{
+  Recorder.Record(Event);
+  if (RemotePlanner)
+  {
+    RemotePlanner->Queue(Event);
+  }
+}
+
+void UMultiagentPathfinder::RecordSetting(SessionEvent Event)
+{
+  if (Recorder.IsRecording() || RemotePlanner)
+  {
+    Event.Time = CurrentTime;
+    PublishEvent(Event);
+  }
+}
+
+void UMultiagentPathfinder::SendRemoteAgents()
+{
+  while (PendingToAdd.Num())
+  {
+    UAgent* Agent = PendingToAdd.Pop();
+    while (AgentPaths.Contains(Agent->GetIDUnsafe()))
+    {
+      Agent->SetIDUnsafe(MaxAgentID++);
+    }
+
+    // The path is empty till the first path of the service is received
+    AgentPaths.Add(Agent->GetIDUnsafe(), FAdaptivePath(Agent, Shards, Horizon.MaxDepth, CurrentTime));
+    RemotePlanner->Queue(ToAddAgentEvent(Agent, CurrentTime));
+    if (Agent->HasNextGoalsSafe())
+    {
+      RemotePlanner->Queue(ToAddGoalsEvent(Agent, CurrentTime));
+    }
+  }
+}
+
+void UMultiagentPathfinder::ReceiveRemotePaths()
+{
+  ArrayType<PlannerUpdate> Updates;
+  // Without waiting, the updates of the previous ticks are applied
+  if (!RemotePlanner->Flush() || !RemotePlanner->Receive(bDeterministic, Updates))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Planner service is disconnected, agents are planned locally"));
+    DisconnectPlannerService();
+    return;
+  }
+
+  for (PlannerUpdate& Update : Updates)
+  {
+    ApplyRemoteUpdate(Update);
+  }
+}
+
+void UMultiagentPathfinder::ApplyRemoteUpdate(PlannerUpdate& Update)
+{
+  if (Update.Type == EPlannerUpdateType::TickDone)
+  {
+    return;
+  }
+
+  FAdaptivePath* AdaptivePath = AgentPaths.Find(Update.AgentID);
+  if (!AdaptivePath)
+  {
+    // The agent was removed after the update was sent
+    return;
+  }
+
+  UAgent* Agent = AdaptivePath->GetAgent();
+  if (Update.Type == EPlannerUpdateType::Failed)
+  {
+    UE_LOG(LogTemp, Error, TEXT("New agent with id = %d failed to enter planner service"), Update.AgentID);
+    Agent->ConnectionFailed();
+    RemoveAgentPath(Update.AgentID);
+    return;
+  }
+
+  AdaptivePath->ReleaseReservations();
+  AdaptivePath->SetResolvedPath(std::move(Update.ReversedPath), Agent->GetShapeSafe(), 0);
+  ExportPath(Update.AgentID);
+  ReservationAgents.Update(Update.AgentID, AdaptivePath->GetFilledAreas());
+  if (!Agent->IsConnected())
+  {
+    Agent->MarkConnection();
+  }
+  Agent->OnReplan.Broadcast();
+}
+
+bool UMultiagentPathfinder::ConnectPlannerService(FString SocketPath)
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(SpaceWrapper);
+
+  if (AgentPaths.Num() || PendingToAdd.Num())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Planner service can't be connected with existing agents"));
+    return false;
+  }
+
+  if (Shards->IsSharded())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Planner service can't be used with sharding"));
+    return false;
+  }
+
+  std::shared_ptr<PlannerClient> Client = std::make_shared<PlannerClient>();
+  if (!Client->Connect(SocketPath))
+  {
+    return false;
+  }
+
+  RemotePlanner = Client;
+  return true;
+}
+
+void UMultiagentPathfinder::DisconnectPlannerService()
+{
+  FScopeLock g(&AccessAgentPaths);
+  if (!RemotePlanner)
+  {
+    return;
+  }
+
+  RemotePlanner->Disconnect();
+  RemotePlanner = nullptr;
+
+  TArray<UAgent*> UnplannedAgents;
+  for (const auto& AdaptivePath : AgentPaths)
+  {
+    if (AdaptivePath.Value.IsAnyPathReady())
+    {
+      Scheduler.Schedule(AdaptivePath.Key, AdaptivePath.Value.GetShard(), CurrentTime);
+    }
+    else
+    {
+      UnplannedAgents.Add(AdaptivePath.Value.GetAgent());
+    }
+  }
+
+  for (UAgent* Agent : UnplannedAgents)
+  {
+    AgentPaths.Remove(Agent->GetIDUnsafe());
+    PendingToAdd.Add(Agent);
+  }
+}
+
+FVector UMultiagentPathfinder::GetCurrentLocation(int ID) const
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(AgentPaths.Contains(ID));
+  return AgentPaths.Find(ID)->GetCurrentLocation(SpaceWrapper);
+}
+
+FPathPoint UMultiagentPathfinder::GetNextMove(int ID) const
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(AgentPaths.Contains(ID));
+  return AgentPaths.Find(ID)->GetNextMove(SpaceWrapper);
+}
+
+float UMultiagentPathfinder::GetCurrentYaw(int ID) const
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(AgentPaths.Contains(ID));
+  return AgentPaths.Find(ID)->GetCurrentYaw();
+}
+
+TArray<FPathPoint> UMultiagentPathfinder::GetPlannedPath(int ID) const
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(SpaceWrapper);
+
+  // Paths are published by this thread, so the nodes can't be reused while they are read
+  TArray<FPathPoint> PlannedPath;
+  const PathHandle Handle = ExportedPaths->GetHandle(ID);
+  const PathBufferNode* Nodes = ExportedPaths->Find(Handle);
+  if (Nodes)
+  {
+    PlannedPath.Reserve(Handle.Length);
+    for (uint32_t NodeIndex = 0; NodeIndex < Handle.Length; ++NodeIndex)
+    {
+      PlannedPath.Add({ Nodes[NodeIndex].Time, SpaceWrapper->Translate(Nodes[NodeIndex].Point) });
+    }
+  }
+  return PlannedPath;
+}
+
+PathHandle UMultiagentPathfinder::GetPathHandle(int ID) const
+{
+  FScopeLock g(&AccessAgentPaths);
+  return ExportedPaths->GetHandle(ID);
+}
+
+size_t UMultiagentPathfinder::EncodePathReplication(PathReplicationEncoder& Encoder, size_t MaxBytes, std::vector<uint8_t>& OutData) const
+{
+  FScopeLock g(&AccessAgentPaths);
+
+  ArrayType<int> ReplicatedIDs;
+  Encoder.GetAgentIDs(ReplicatedIDs);
+  for (int ReplicatedID : ReplicatedIDs)
+  {
+    if (!AgentPaths.Contains(ReplicatedID))
+    {
+      Encoder.RemoveAgent(ReplicatedID);
+    }
+  }
+
+  for (const auto& AdaptivePath : AgentPaths)
+  {
+    if (!Encoder.HasAgent(AdaptivePath.Key))
+    {
+      FReplanInput Properties;
+      AdaptivePath.Value.GetAgent()->GetPropertiesSafe(Properties.AgentID, Properties.Point, Properties.Goal, Properties.Shape, Properties.Moves, Properties.Speed);
+      Encoder.AddAgent(AdaptivePath.Key, Properties.Moves);
+    }
+  }
+
+  return Encoder.Encode(*ExportedPaths, MaxBytes, OutData);
+}
+
+float UMultiagentPathfinder::GetCurrentTime() const
+{
+  return CurrentTime;
+}
+
+void UMultiagentPathfinder::AddAgent(UAgent* Agent)
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(Space);
+
+  // The ID is final before the event is recorded, so the replay adds the agent under the same ID
+  auto IsIDTaken = [this, Agent](int ID) {
+    if (ID < 0 || AgentPaths.Contains(ID))
+    {
+      return true;
+    }
+    for (const UAgent* Pending : PendingToAdd)
+    {
+      if (Pending != Agent && Pending->GetIDUnsafe() == ID)
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+  while (IsIDTaken(Agent->GetIDUnsafe()))
+  {
+    Agent->SetIDUnsafe(MaxAgentID++);
+  }
+
+  if (Recorder.IsRecording())
+  {
+    Recorder.Record(ToAddAgentEvent(Agent, CurrentTime));
+    if (Agent->HasNextGoalsSafe())
+    {
+      Recorder.Record(ToAddGoalsEvent(Agent, CurrentTime));
+    }
+  }
+
+  PendingToAdd.Add(Agent);
+}
+
+void UMultiagentPathfinder::AddGoalsToAssign(const TArray<FPoint>& Goals)
+{
+  FScopeLock g(&AccessAgentPaths);
+  for (const FPoint& Goal : Goals)
+  {
+    Assignment.AddTarget(Goal);
+  }
+}
+
+void UMultiagentPathfinder::AddIdleAgents(const TArray<int>& AgentIDs)
+{
+  FScopeLock g(&AccessAgentPaths);
+  for (int ID : AgentIDs)
+  {
+    const FAdaptivePath* AdaptivePath = AgentPaths.Find(ID);
+    if (!AdaptivePath)
+    {
+      UE_LOG(LogTemp, Error, TEXT("Agent with id = %d can't wait for a goal before it enters MAPF subsystem"), ID);
+      continue;
+    }
+
+    FReplanInput Properties;
+    AdaptivePath->GetAgent()->GetPropertiesSafe(Properties.AgentID, Properties.Point, Properties.Goal, Properties.Shape, Properties.Moves, Properties.Speed);
+    Assignment.AddAgent(ID, AdaptivePath->GetCurrentPoint(), Properties.Shape, Properties.Moves, Properties.Speed);
+  }
+}
+
+int UMultiagentPathfinder::GetGoalsToAssignNum() const
+{
+  FScopeLock g(&AccessAgentPaths);
+  return Assignment.GetTargetsNum();
+}
+
+void UMultiagentPathfinder::RemoveAgent(int ID)
+{
+  FScopeLock g(&AccessAgentPaths);
+  check(Space);
+
+  if (Recorder.IsRecording() || RemotePlanner)
+  {
+    SessionEvent Event;
+    Event.Type = ESessionEventType::RemoveAgent;
+    Event.Time = CurrentTime;
+    Event.ID = ID;
+    PublishEvent(Event);
+  }
+
+  if (!AgentPaths.Contains(ID))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Attempted to remove nonexisting agent"));
+    return;
+  }
+
+  if (RunningReplan* Replan = FindRunningReplan(ID))
+  {
+    UE_LOG(LogTemp, Log, TEXT("Removing agent is delayed as it is planning now"));
+    Replan->bPendingRemove = true;
+    return;
+  }
+
+  if (Shards->IsSharded())
+  {
+    // Reservations of the path may be in the tables used by running replans
+    SetType<int> AgentShards;
+    Shards->FindBlock(AgentPaths[ID].GetShard(), AgentShards);
+    if (IsAnyShardLocked(AgentShards))
+    {
+      UE_LOG(LogTemp, Log, TEXT("Removing agent is delayed as its shards are planning now"));
+      Scheduler.Remove(ID);
+      if (std::find(PendingRemovals.begin(), PendingRemovals.end(), ID) == PendingRemovals.end())
+      {
+        PendingRemovals.push_back(ID);
+      }
+      return;
+    }
+  }
+
+  RemoveAgentPath(ID);
+}
+
+void UMultiagentPathfinder::ForceReplan(int ID)
+{
+  if (!AgentPaths.Contains(ID))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Attempted to force replan with nonexisting agent"));
+    return;
+  }
+
+  if (Recorder.IsRecording() || RemotePlanner)
+  {
+    // Goal changes are the reason of forced replans, so the goal is recorded with them
+    SessionEvent Event;
+    Event.Type = ESessionEventType::ChangeGoal;
+    Event.Time = CurrentTime;
+    Event.ID = ID;
+    Event.Goal = AgentPaths[ID].GetAgent()->GetGoalSafe();
+    PublishEvent(Event);
+  }
+
+  if (RemotePlanner)
+  {
+    // The agent is replanned by the service
+    return;
+  }
+
+  if (RunningReplan* Replan = FindRunningReplan(ID))
+  {
+    Replan->bRepeat = true;
+    return;
+  }
+
+  if (ResolvingAgents.count(ID))
+  {
+    // The resolution is applied first, the agent is replanned right after it
+    ForcedWhileResolving.insert(ID);
+    return;
+  }
+
+  if (!Scheduler.Prioritize(ID, CurrentTime))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Attempted to force replan with agent that is not scheduled"));
+  }
+}
+
+FString UMultiagentPathfinder::GetStatsJson() const
+{
+  FScopeLock g(&AccessAgentPaths);
+  return FString(Stats.ToJson().c_str());
+}
+
+void UMultiagentPathfinder::ResetStats()
+{
+  FScopeLock g(&AccessAgentPaths);
+  Stats.Clear();
+}
+
+bool UMultiagentPathfinder::ExportStats(FString FileName, bool bChromeTrace)
+{
+  FScopeLock g(&AccessAgentPaths);
+  std::ofstream StatsFile(*FileName);
+  if (!StatsFile.is_open())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot open File %s"), *FileName);
+    return false;
+  }
+
+  StatsFile << (bChromeTrace ? Stats.ToChromeTrace() : Stats.ToJson());
+  return StatsFile.good();
+}
+
+void UMultiagentPathfinder::SetTracing(bool bEnable)
+{
+  PlannerStats::SetTracing(bEnable);
+}
+
+bool UMultiagentPathfinder::StartRecording(FString FileName)
+{
+  FScopeLock g(&AccessAgentPaths);
+  if (AgentPaths.Num() || PendingToAdd.Num())
+  {
+    UE_LOG(LogTemp, Warning, TEXT("Recording is started with existing agents, they will be missing in the replay"));
+  }
+
+  if (!Recorder.Start(*FileName, CurrentTime))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot open File %s"), *FileName);
+    return false;
+  }
+
+  return true;
+}
+
+void UMultiagentPathfinder::StopRecording()
+{
+  Recorder.Stop();
+}
+
+bool UMultiagentPathfinder::RegisterGoals(const TArray<FPoint>& Goals, const FShape& Shape, const TArray<FPointMove>& Moves)
+{
+  FScopeLock g(&AccessAgentPaths);
+
+  if (Recorder.IsRecording())
+  {
+    SessionEvent Event;
+    Event.Type = ESessionEventType::RegisterGoals;
+    Event.Time = CurrentTime;
+    Event.Goals = Goals;
+    Event.Shape = Shape;
+    Event.Moves = Moves;
+    Recorder.Record(Event);
+  }
+
+  ArrayType<FPoint> GoalPoints;
+  for (const FPoint& Goal : Goals)
+  {
+    GoalPoints.push_back(Goal);
+  }
+
+  ArrayType<MoveDelta<FPoint>> MoveDeltas;
+  for (const FPointMove& Move : Moves)
+  {
+    MoveDeltas.push_back(Move.GetMoveDelta());
+  }
+
+  if (!DistanceTables->Register(GoalPoints, Shape, MoveDeltas))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Distance tables need a space loaded from a file"));
+    return false;
+  }
+
+  return true;
+}
+
+bool UMultiagentPathfinder::SaveDistanceTables(FString FileName)
+{
+  if (!DistanceTables->Save(*FileName))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot save distance tables to %s"), *FileName);
+    return false;
+  }
+
+  return true;
+}
+
+bool UMultiagentPathfinder::LoadDistanceTables(FString FileName)
+{
+  FScopeLock g(&AccessAgentPaths);
+
+  if (!DistanceTables->Load(*FileName))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot load distance tables from %s"), *FileName);
+    return false;
+  }
+
+  return true;
+}
+
+void UMultiagentPathfinder::SetDeterministic(bool bEnable)
+{
+  FScopeLock g(&AccessAgentPaths);
+  bDeterministic = bEnable;
+}
+
+UAgent* UMultiagentPathfinder::FindAgent(int ID) const
+{
+  FScopeLock g(&AccessAgentPaths);
+  if (const FAdaptivePath* AdaptivePath = AgentPaths.Find(ID))
+  {
+    return AdaptivePath->GetAgent();
+  }
+
+  for (UAgent* Agent : PendingToAdd)
+  {
+    if (Agent->GetIDUnsafe() == ID)
+    {
+      return Agent;
+    }
+  }
+
+  return nullptr;
+}
+
+void UMultiagentPathfinder::WaitForPlanning()
+{
+  FScopeLock g(&AccessAgentPaths);
+  if (ResolutionResult.IsValid())
+  {
+    ResolutionResult.Wait();
+  }
+
+  for (const RunningReplan& Replan : RunningReplans)
+  {
+    AgentPaths[Replan.AgentID].WaitForReplan();
+  }
+}
+
+void UMultiagentPathfinder::ApplySessionEvent(const SessionEvent& Event)
+{
+  switch (Event.Type)
+  {
+  case ESessionEventType::Tick:
+    Tick(Event.Value);
+    break;
+  case ESessionEventType::AddAgent:
+  {
+    UAgent* Agent = NewObject<UAgent>(this);
+    Agent->SetIDUnsafe(Event.ID);
+    Agent->InitUnsafe(Event.Point, Event.Goal, Event.Shape, Event.Moves, Event.Value);
+    ReplayAgents.Add(Agent);
+    AddAgent(Agent);
+    break;
+  }
+  case ESessionEventType::RemoveAgent:
+    RemoveAgent(Event.ID);
+    break;
+  case ESessionEventType::ChangeGoal:
+    if (UAgent* Agent = FindAgent(Event.ID))
+    {
+      Agent->SetGoalSafe(Event.Goal);
+    }
+    ForceReplan(Event.ID);
+    break;
+  case ESessionEventType::ChangeSpace:
+    SpaceWrapper->ChangeSpaceUnsafe(Event.Point, Event.bFlag);
+    break;
+  case ESessionEventType::AddObstacle:
+    if (SpaceWrapper->AddObstacle(Event.Trajectory) != Event.ID)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("Replayed obstacle with id = %d got another id"), Event.ID);
+    }
+    break;
+  case ESessionEventType::UpdateObstacle:
+    SpaceWrapper->UpdateObstacle(Event.ID, Event.Trajectory);
+    break;
+  case ESessionEventType::RemoveObstacle:
+    SpaceWrapper->RemoveObstacle(Event.ID);
+    break;
+  case ESessionEventType::SetDepth:
+    SetDepth(Event.Value);
+    break;
+  case ESessionEventType::SetMinDepth:
+    SetMinDepth(Event.Value);
+    break;
+  case ESessionEventType::SetConflictResolution:
+    SetConflictResolution(Event.bFlag);
+    break;
+  case ESessionEventType::SetPathShortcuts:
+    SetPathShortcuts(Event.bFlag);
+    break;
+  case ESessionEventType::SetBidirectionalHeuristic:
+    SetBidirectionalHeuristic(Event.bFlag);
+    break;
+  case ESessionEventType::RegisterGoals:
+    RegisterGoals(Event.Goals, Event.Shape, Event.Moves);
+    break;
+  case ESessionEventType::SetSharding:
+    SetSharding(Event.Sharding.TileSize, Event.Sharding.Halo, Event.Sharding.MaxConcurrentReplans);
+    break;
+  case ESessionEventType::AddGoals:
+    if (UAgent* Agent = FindAgent(Event.ID))
+    {
+      Agent->AppendGoalsSafe(Event.Goals);
+    }
+    break;
+  }
+}
+
+bool UMultiagentPathfinder::ReplaySession(FString SessionFileName, FString ReportFileName)
+{
+  check(SpaceWrapper);
+
+  std::ifstream SessionFile(*SessionFileName);
+  if (!SessionFile.is_open())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot open File %s"), *SessionFileName);
+    return false;
+  }
+
+  float StartTime = 0;
+  ArrayType<SessionEvent> Events;
+  if (!ReadSession(SessionFile, StartTime, Events))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot read session from %s"), *SessionFileName);
+    return false;
+  }
+
+  ASpace* ReplaySpaceWrapper = SpaceWrapper;
+  Reset();
+  SetSpace(ReplaySpaceWrapper);
+
+  const bool bWasDeterministic = bDeterministic;
+  bDeterministic = true;
+  CurrentTime = StartTime;
+  MaxAgentID = 0;
+
+  ReplayReport Report;
+  for (const SessionEvent& Event : Events)
+  {
+    if (Event.Type != ESessionEventType::Tick)
+    {
+      // Running tasks have already captured their inputs at this point of the recorded session
+      WaitForPlanning();
+      ApplySessionEvent(Event);
+      continue;
+    }
+
+    const std::chrono::steady_clock::time_point TickStart = std::chrono::steady_clock::now();
+    ApplySessionEvent(Event);
+    const std::chrono::duration<double, std::milli> TickLatency = std::chrono::steady_clock::now() - TickStart;
+    Report.AddTick(CurrentTime, TickLatency.count());
+  }
+
+  WaitForPlanning();
+  bDeterministic = bWasDeterministic;
+
+  UE_LOG(LogTemp, Log, TEXT("Session %s replayed: %d ticks, p50 = %f ms, p95 = %f ms"),
+    *SessionFileName, (int) Report.TickLatency.size(), Report.GetPercentile(50), Report.GetPercentile(95));
+
+  std::ofstream ReportFile(*ReportFileName);
+  if (!ReportFile.is_open())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot open File %s"), *ReportFileName);
+    return false;
+  }
+
+  ReportFile << "{\"replay\":" << Report.ToJson() << ",\"stats\":" << Stats.ToJson() << "}";
+  return ReportFile.good();
 }
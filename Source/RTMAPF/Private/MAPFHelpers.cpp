@@ -1,4 +1,11 @@
 #include "MAPFHelpers.h"
+#include "PlannerBenchmarks.h"
+#include "PlannerChecks.h"
+#include "PlannerService.h"
+#include "Space.h"
+
+#include <algorithm>
+#include <fstream>
 
 TArray<FAgentTask> UAnalyticsBlueprintLibrary::GetAgentTasksFromHogFile(FString FileName, int TasksNum)
 {
@@ -21,3 +28,110 @@ TArray<FAgentTask> UAnalyticsBlueprintLibrary::GetAgentTasksFromHogFile(FString
 
   return Result;
 }
+
+namespace
+{
+  TOptional<RawSpace> ReadHogMap(const FString& MapFileName)
+  {
+    std::ifstream MapFile(*MapFileName);
+    if (!MapFile.is_open())
+    {
+      UE_LOG(LogTemp, Error, TEXT("Cannot open File %s"), *MapFileName);
+      return TOptional<RawSpace>();
+    }
+
+    SpaceReader Reader;
+    TOptional<RawSpace> Map = Reader.FromHogFormat(MapFile);
+    if (!Map)
+    {
+      UE_LOG(LogTemp, Error, TEXT("Cannot read hog format from %s"), *MapFileName);
+    }
+
+    return Map;
+  }
+}
+
+bool UAnalyticsBlueprintLibrary::RunPlannerBenchmarks(FString MapFileName, FString ReportFileName, int ReservationsNum, float MinTime)
+{
+  TOptional<RawSpace> Map = ReadHogMap(MapFileName);
+  if (!Map)
+  {
+    return false;
+  }
+
+  BenchmarkSettings Settings;
+  Settings.ReservationsNum = ReservationsNum;
+  Settings.MinTime = MinTime;
+
+  PlannerBenchmarks Benchmarks(Map.GetValue(), Settings);
+  Benchmarks.RunAll();
+
+  std::ofstream ReportFile(*ReportFileName);
+  if (!ReportFile.is_open())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot open File %s"), *ReportFileName);
+    return false;
+  }
+
+  ReportFile << Benchmarks.ToJson();
+  return ReportFile.good();
+}
+
+bool UAnalyticsBlueprintLibrary::RunPlannerChecks()
+{
+  PlannerChecks Checks;
+  Checks.RunAll();
+
+  for (const std::string& Failure : Checks.GetFailures())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Planner check failed: %s"), ANSI_TO_TCHAR(Failure.c_str()));
+  }
+
+  UE_LOG(LogTemp, Log, TEXT("Planner checks: %d of %d expectations failed"), (int) Checks.GetFailures().size(), Checks.GetExpectationsNum());
+  return Checks.GetFailures().empty();
+}
+
+bool UAnalyticsBlueprintLibrary::RunPlannerService(FString MapFileName, FString SocketPath, float Depth, int MaxReplansPerTick, bool bOnce)
+{
+  TOptional<RawSpace> Map = ReadHogMap(MapFileName);
+  if (!Map)
+  {
+    return false;
+  }
+
+  PlannerServiceSettings Settings;
+  Settings.Horizon.MaxDepth = Depth;
+  Settings.Horizon.MinDepth = std::min(Settings.Horizon.MinDepth, Depth);
+  Settings.MaxReplansPerTick = MaxReplansPerTick;
+  return ServePlanner(Map.GetValue(), SocketPath, Settings, bOnce);
+}
+
+bool UAnalyticsBlueprintLibrary::RunPlannerServiceLoadTest(FString MapFileName, FString SocketPath, FString ReportFileName, int AgentsNum, int TicksNum, int Seed)
+{
+  TOptional<RawSpace> Map = ReadHogMap(MapFileName);
+  if (!Map)
+  {
+    return false;
+  }
+
+  PlannerLoadTestSettings Settings;
+  Settings.AgentsNum = AgentsNum;
+  Settings.TicksNum = TicksNum;
+  Settings.Seed = Seed;
+
+  ReplayReport Report;
+  if (!RunPlannerLoadTest(Map.GetValue(), SocketPath, Settings, Report))
+  {
+    return false;
+  }
+
+  std::ofstream ReportFile(*ReportFileName);
+  if (!ReportFile.is_open())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot open File %s"), *ReportFileName);
+    return false;
+  }
+
+  ReportFile << "{\"service\":" << Report.ToJson() << "}";
+  return ReportFile.good();
+}
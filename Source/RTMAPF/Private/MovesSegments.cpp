@@ -1,4 +1,5 @@
 #include "MovesSegments.h"
+#include "PlannerStats.h"
 
 float MakeStepInSquare(FVector2D& Point, const FVector2D& Speed, FPoint& MoveDescription)
 {
@@ -41,15 +42,65 @@ void SetLineTimings(std::unordered_map<FPoint, Segment>& Segments, const FVector
     CurrentTime += MakeStepInSquare(StartPoint, Speed, MoveDescription);
     NewSegment.End = std::min(CurrentTime, 1.f);
 
-    Segments[Point] = (Segments.count(Point) > 0) ? (Segments[Point] | NewSegment) : NewSegment;
+    // Found before writing, as Segments[Point] would insert an empty segment at the time 0 first.
+    // Lines of two corners may touch the cell at separate times, it is touched from the first till the last
+    const auto Found = Segments.find(Point);
+    if (Found != Segments.end())
+    {
+      Found->second = { std::min(Found->second.Start, NewSegment.Start), std::max(Found->second.End, NewSegment.End) };
+    }
+    else
+    {
+      Segments.emplace(Point, NewSegment);
+    }
 
     Point = Point + MoveDescription;
   }
 }
 
+std::unordered_map<FPoint, Segment> ComputeUnitTouchedSegments(const FPoint& Destination)
+{
+  FPoint Direction = { 1, 1 };
+  FPoint PositiveDestination = Destination;
+  if (PositiveDestination.X < 0)
+  {
+    PositiveDestination.X = -PositiveDestination.X;
+    Direction.X = -1;
+  }
+  if (PositiveDestination.Y < 0)
+  {
+    PositiveDestination.Y = -PositiveDestination.Y;
+    Direction.Y = -1;
+  }
+
+  const FVector2D Speed = { (float) PositiveDestination.X, (float) PositiveDestination.Y };
+  FVector2D ShapeDelta = Speed;
+  ShapeDelta.Normalize();
+
+  const FVector2D StartPoint = { 0.5, 0.5 };
+  std::unordered_map<FPoint, Segment> PositiveResult;
+  SetLineTimings(PositiveResult, Speed, StartPoint - ShapeDelta / 2);
+  SetLineTimings(PositiveResult, Speed, StartPoint + ShapeDelta / 2);
+  SetLineTimings(PositiveResult, Speed, StartPoint + FVector2D(ShapeDelta.X, -ShapeDelta.Y) / 2);
+  SetLineTimings(PositiveResult, Speed, StartPoint + FVector2D(-ShapeDelta.X, ShapeDelta.Y) / 2);
+
+  std::unordered_map<FPoint, Segment> Result;
+  for (const auto& ResultPair : PositiveResult)
+  {
+    Result[ResultPair.first * Direction] = { 
+      ResultPair.second.Start, 
+      ResultPair.second.End
+    };
+  }
+  return Result;
+}
+
 std::unordered_map<FPoint, Segment> GetTouchedSegments(const MoveDelta<FPoint>& Move)
 {
-  static std::unordered_map<FPoint, std::unordered_map<FPoint, Segment>> PointToSegments;
+  PLANNER_PHASE_SCOPE(EPlannerPhase::TouchedSegments);
+
+  // Cache is per thread as moves are tested by several planners at the same time
+  static thread_local std::unordered_map<FPoint, std::unordered_map<FPoint, Segment>> PointToSegments;
   std::unordered_map<FPoint, Segment> Result;
   if (PointToSegments.count(Move.Destination) > 0)
   {
@@ -57,38 +108,7 @@ std::unordered_map<FPoint, Segment> GetTouchedSegments(const MoveDelta<FPoint>&
   }
   else
   {
-    FPoint Direction = { 1, 1 };
-    FPoint PositiveDestination = Move.Destination;
-    if (PositiveDestination.X < 0)
-    {
-      PositiveDestination.X = -PositiveDestination.X;
-      Direction.X = -1;
-    }
-    if (PositiveDestination.Y < 0)
-    {
-      PositiveDestination.Y = -PositiveDestination.Y;
-      Direction.Y = -1;
-    }
-
-    const FVector2D Speed = { (float) PositiveDestination.X, (float) PositiveDestination.Y };
-    FVector2D ShapeDelta = Speed;
-    ShapeDelta.Normalize();
-
-    const FVector2D StartPoint = { 0.5, 0.5 };
-    std::unordered_map<FPoint, Segment> PositiveResult;
-    SetLineTimings(PositiveResult, Speed, StartPoint - ShapeDelta / 2);
-    SetLineTimings(PositiveResult, Speed, StartPoint + ShapeDelta / 2);
-    SetLineTimings(PositiveResult, Speed, StartPoint + FVector2D(ShapeDelta.X, -ShapeDelta.Y) / 2);
-    SetLineTimings(PositiveResult, Speed, StartPoint + FVector2D(-ShapeDelta.X, ShapeDelta.Y) / 2);
-
-    for (const auto& ResultPair : PositiveResult)
-    {
-      Result[ResultPair.first * Direction] = { 
-        ResultPair.second.Start, 
-        ResultPair.second.End
-      };
-    }
-
+    Result = ComputeUnitTouchedSegments(Move.Destination);
     PointToSegments[Move.Destination] = Result;
   }
 
@@ -0,0 +1,220 @@
+#include "PathBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// Number of a segment that holds no nodes yet or is being rewritten
+#define PATH_BUFFER_NO_SEGMENT std::numeric_limits<uint64_t>::max()
+
+static_assert(std::is_trivially_copyable<PathBufferNode>::value, "Nodes are copied as bytes by readers");
+
+PathBuffer::Segment::Segment()
+  : Number(PATH_BUFFER_NO_SEGMENT)
+{ }
+
+const PathBuffer::Segment& PathBuffer::GetSegment(uint64_t Offset) const
+{
+  return Segments[(Offset / PATH_BUFFER_SEGMENT_SIZE) % PATH_BUFFER_MAX_SEGMENTS];
+}
+
+PathBuffer::Segment& PathBuffer::GetSegment(uint64_t Offset)
+{
+  return Segments[(Offset / PATH_BUFFER_SEGMENT_SIZE) % PATH_BUFFER_MAX_SEGMENTS];
+}
+
+void PathBuffer::Release(const PathHandle& Handle)
+{
+  if (Handle.Length)
+  {
+    Segment& HandleSegment = GetSegment(Handle.Offset);
+    assert(HandleSegment.LivePaths > 0);
+    --HandleSegment.LivePaths;
+  }
+}
+
+void PathBuffer::StartSegment(uint64_t Number)
+{
+  Segment& NewSegment = Segments[Number % PATH_BUFFER_MAX_SEGMENTS];
+  const uint64_t OldNumber = NewSegment.Number.load(std::memory_order_relaxed);
+
+  // Paths still published in the reused segment are copied before it is rewritten
+  std::vector<std::pair<PathHandle*, std::vector<PathBufferNode>>> MovedPaths;
+  if (NewSegment.LivePaths > 0)
+  {
+    for (auto& Entry : Handles)
+    {
+      PathHandle& Handle = Entry.second;
+      if (Handle.Length && Handle.Offset / PATH_BUFFER_SEGMENT_SIZE == OldNumber)
+      {
+        const PathBufferNode* Nodes = NewSegment.Nodes.get() + Handle.Offset % PATH_BUFFER_SEGMENT_SIZE;
+        MovedPaths.emplace_back(&Handle, std::vector<PathBufferNode>(Nodes, Nodes + Handle.Length));
+      }
+    }
+  }
+
+  // Readers of the old nodes see the changed number after reading them
+  NewSegment.Number.store(PATH_BUFFER_NO_SEGMENT, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (!NewSegment.Nodes)
+  {
+    NewSegment.Nodes.reset(new PathBufferNode[PATH_BUFFER_SEGMENT_SIZE]);
+  }
+
+  WriteOffset = Number * PATH_BUFFER_SEGMENT_SIZE;
+  NewSegment.LivePaths = 0;
+  for (auto& MovedPath : MovedPaths)
+  {
+    std::copy(MovedPath.second.begin(), MovedPath.second.end(), NewSegment.Nodes.get() + WriteOffset % PATH_BUFFER_SEGMENT_SIZE);
+    PathHandle& Handle = *MovedPath.first;
+    Handle.Offset = WriteOffset;
+    ++Handle.Version;
+    ++NewSegment.LivePaths;
+    WriteOffset += Handle.Length;
+  }
+
+  NewSegment.Number.store(Number, std::memory_order_release);
+}
+
+bool PathBuffer::Reserve(uint32_t Length, uint64_t& OutOffset)
+{
+  for (int Attempt = 0; Attempt <= PATH_BUFFER_MAX_SEGMENTS; ++Attempt)
+  {
+    if (WriteOffset % PATH_BUFFER_SEGMENT_SIZE == 0)
+    {
+      StartSegment(WriteOffset / PATH_BUFFER_SEGMENT_SIZE);
+    }
+
+    if (WriteOffset % PATH_BUFFER_SEGMENT_SIZE + Length <= PATH_BUFFER_SEGMENT_SIZE)
+    {
+      OutOffset = WriteOffset;
+      WriteOffset += Length;
+      return true;
+    }
+
+    // Paths don't cross segments
+    WriteOffset = (WriteOffset / PATH_BUFFER_SEGMENT_SIZE + 1) * PATH_BUFFER_SEGMENT_SIZE;
+  }
+
+  return false;
+}
+
+bool PathBuffer::Publish(int AgentID, const std::vector<Node<Area>>& ReversedPath)
+{
+  if (ReversedPath.empty())
+  {
+    Remove(AgentID);
+    return true;
+  }
+
+  if (ReversedPath.size() > PATH_BUFFER_SEGMENT_SIZE)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Path of agent with id = %d is too long to be published: %d nodes"), AgentID, (int) ReversedPath.size());
+    Remove(AgentID);
+    return false;
+  }
+
+  PathHandle& Handle = Handles[AgentID];
+  Release(Handle);
+  Handle.Length = 0;
+
+  const uint32_t Length = (uint32_t) ReversedPath.size();
+  uint64_t Offset;
+  if (!Reserve(Length, Offset))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Path buffer is full, path of agent with id = %d is not published"), AgentID);
+    Handles.erase(AgentID);
+    return false;
+  }
+
+  Segment& PathSegment = GetSegment(Offset);
+  PathBufferNode* Nodes = PathSegment.Nodes.get() + Offset % PATH_BUFFER_SEGMENT_SIZE;
+  for (auto PathNode = ReversedPath.rbegin(); PathNode != ReversedPath.rend(); ++PathNode, ++Nodes)
+  {
+    Nodes->Point = PathNode->Cell.Point;
+    Nodes->Time = PathNode->MinTime;
+    Nodes->MoveDuration = PathNode->ArrivalCost;
+  }
+  ++PathSegment.LivePaths;
+
+  Handle.Offset = Offset;
+  Handle.Length = Length;
+  ++Handle.Version;
+  return true;
+}
+
+void PathBuffer::Remove(int AgentID)
+{
+  auto Found = Handles.find(AgentID);
+  if (Found != Handles.end())
+  {
+    Release(Found->second);
+    Handles.erase(Found);
+  }
+}
+
+void PathBuffer::Clear()
+{
+  Handles.clear();
+  for (Segment& ClearedSegment : Segments)
+  {
+    ClearedSegment.LivePaths = 0;
+  }
+}
+
+PathHandle PathBuffer::GetHandle(int AgentID) const
+{
+  auto Found = Handles.find(AgentID);
+  return Found != Handles.end() ? Found->second : PathHandle();
+}
+
+const PathBufferNode* PathBuffer::Find(const PathHandle& Handle) const
+{
+  if (!Handle.Length)
+  {
+    return nullptr;
+  }
+
+  const Segment& HandleSegment = GetSegment(Handle.Offset);
+  if (HandleSegment.Number.load(std::memory_order_acquire) != Handle.Offset / PATH_BUFFER_SEGMENT_SIZE)
+  {
+    return nullptr;
+  }
+
+  return HandleSegment.Nodes.get() + Handle.Offset % PATH_BUFFER_SEGMENT_SIZE;
+}
+
+bool PathBuffer::IsValid(const PathHandle& Handle) const
+{
+  if (!Handle.Length)
+  {
+    return false;
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return GetSegment(Handle.Offset).Number.load(std::memory_order_relaxed) == Handle.Offset / PATH_BUFFER_SEGMENT_SIZE;
+}
+
+bool PathBuffer::Read(const PathHandle& Handle, std::vector<PathBufferNode>& OutNodes) const
+{
+  OutNodes.clear();
+  const PathBufferNode* Nodes = Find(Handle);
+  if (!Nodes)
+  {
+    return false;
+  }
+
+  // The copy may be torn by the writer, it is used only if the segment wasn't reused after it
+  OutNodes.resize(Handle.Length);
+  std::memcpy(OutNodes.data(), Nodes, Handle.Length * sizeof(PathBufferNode));
+  if (!IsValid(Handle))
+  {
+    OutNodes.clear();
+    return false;
+  }
+  return true;
+}
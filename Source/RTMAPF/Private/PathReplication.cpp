@@ -0,0 +1,513 @@
+#include "PathReplication.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Move index of nodes written with their grid delta and duration
+#define PATH_REPLICATION_UNLISTED_MOVE 255
+
+namespace
+{
+  enum class EReplicationRecord : uint8_t
+  {
+    Agent = 1,
+    Path = 2,
+    Remove = 3
+  };
+
+  void WriteUnsigned(uint64_t Value, std::vector<uint8_t>& OutData)
+  {
+    while (Value >= 0x80)
+    {
+      OutData.push_back((uint8_t) (Value | 0x80));
+      Value >>= 7;
+    }
+    OutData.push_back((uint8_t) Value);
+  }
+
+  // Small negative values are written as small unsigned ones
+  void WriteSigned(int64_t Value, std::vector<uint8_t>& OutData)
+  {
+    WriteUnsigned(((uint64_t) Value << 1) ^ (uint64_t) (Value >> 63), OutData);
+  }
+
+  void WriteFloat(float Value, std::vector<uint8_t>& OutData)
+  {
+    uint32_t Bits;
+    std::memcpy(&Bits, &Value, sizeof(Bits));
+    for (int Byte = 0; Byte < 4; ++Byte)
+    {
+      OutData.push_back((uint8_t) (Bits >> (Byte * 8)));
+    }
+  }
+
+  class RecordReader
+  {
+    const uint8_t* Data;
+    size_t Size;
+    size_t Offset = 0;
+
+  public:
+    RecordReader(const uint8_t* InData, size_t InSize)
+      : Data(InData)
+      , Size(InSize)
+    { }
+
+    bool IsEnd() const { return Offset >= Size; }
+
+    bool ReadByte(uint8_t& OutValue)
+    {
+      if (Offset >= Size)
+      {
+        return false;
+      }
+      OutValue = Data[Offset++];
+      return true;
+    }
+
+    bool ReadUnsigned(uint64_t& OutValue)
+    {
+      OutValue = 0;
+      for (int Shift = 0; Shift < 64; Shift += 7)
+      {
+        uint8_t Byte;
+        if (!ReadByte(Byte))
+        {
+          return false;
+        }
+        OutValue |= (uint64_t) (Byte & 0x7f) << Shift;
+        if (!(Byte & 0x80))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool ReadSigned(int64_t& OutValue)
+    {
+      uint64_t Value;
+      if (!ReadUnsigned(Value))
+      {
+        return false;
+      }
+      OutValue = (int64_t) (Value >> 1) ^ -(int64_t) (Value & 1);
+      return true;
+    }
+
+    bool ReadFloat(float& OutValue)
+    {
+      uint32_t Bits = 0;
+      for (int Byte = 0; Byte < 4; ++Byte)
+      {
+        uint8_t Value;
+        if (!ReadByte(Value))
+        {
+          return false;
+        }
+        Bits |= (uint32_t) Value << (Byte * 8);
+      }
+      std::memcpy(&OutValue, &Bits, sizeof(OutValue));
+      return true;
+    }
+  };
+
+  int64_t Quantize(float Time)
+  {
+    return std::llround(Time / PATH_REPLICATION_TIME_QUANTUM);
+  }
+
+  float Dequantize(int64_t Quanta)
+  {
+    return Quanta * PATH_REPLICATION_TIME_QUANTUM;
+  }
+
+  // Shared by the decoder and the copy of the client path kept by the encoder, so they stay equal
+  PathBufferNode DecodeMove(const PathBufferNode& Previous, FPoint Delta, float Duration, int64_t WaitQuanta)
+  {
+    const float MoveStart = std::max(Previous.Time, Dequantize(Quantize(Previous.Time) + WaitQuanta));
+
+    PathBufferNode Decoded;
+    Decoded.Point = Previous.Point + Delta;
+    Decoded.Time = MoveStart + Duration;
+    Decoded.MoveDuration = Duration;
+    return Decoded;
+  }
+
+  PathBufferNode DecodeStart(FPoint Point, int64_t TimeQuanta, int64_t DurationQuanta)
+  {
+    PathBufferNode Decoded;
+    Decoded.Point = Point;
+    Decoded.Time = Dequantize(TimeQuanta);
+    Decoded.MoveDuration = Dequantize(DurationQuanta);
+    return Decoded;
+  }
+
+  bool IsSameDuration(float First, float Second)
+  {
+    return std::abs(First - Second) <= EPSILON * std::max(1.f, std::abs(First));
+  }
+
+  // Decoded node may be kept instead of the planned one
+  bool IsReplicated(const PathBufferNode& Decoded, const PathBufferNode& Planned)
+  {
+    return Decoded.Point == Planned.Point
+      && std::abs(Decoded.Time - Planned.Time) <= PATH_REPLICATION_TIME_QUANTUM
+      && std::abs(Decoded.MoveDuration - Planned.MoveDuration) <= PATH_REPLICATION_TIME_QUANTUM;
+  }
+}
+
+void PathReplicationEncoder::AddAgent(int AgentID, const ArrayType<MoveDelta<FPoint>>& Moves)
+{
+  if (Agents.count(AgentID))
+  {
+    return;
+  }
+
+  Agents[AgentID].Moves = Moves;
+  AgentOrder.push_back(AgentID);
+}
+
+void PathReplicationEncoder::RemoveAgent(int AgentID)
+{
+  auto Found = Agents.find(AgentID);
+  if (Found == Agents.end())
+  {
+    return;
+  }
+
+  // Agents unknown to the client are dropped silently
+  if (Found->second.bMovesSent)
+  {
+    PendingRemovals.push_back(AgentID);
+  }
+  Agents.erase(Found);
+
+  auto OrderPosition = std::find(AgentOrder.begin(), AgentOrder.end(), AgentID);
+  const size_t RemovedIndex = OrderPosition - AgentOrder.begin();
+  AgentOrder.erase(OrderPosition);
+  if (RemovedIndex < NextAgentIndex)
+  {
+    --NextAgentIndex;
+  }
+}
+
+bool PathReplicationEncoder::HasAgent(int AgentID) const
+{
+  return Agents.count(AgentID) > 0;
+}
+
+void PathReplicationEncoder::GetAgentIDs(ArrayType<int>& OutAgentIDs) const
+{
+  OutAgentIDs.insert(OutAgentIDs.end(), AgentOrder.begin(), AgentOrder.end());
+}
+
+void PathReplicationEncoder::EncodeAgent(int AgentID, ReplicatedAgent& Agent, const PathHandle& Handle, const PathBufferNode* Nodes, std::vector<uint8_t>& OutData)
+{
+  if (!Agent.bMovesSent)
+  {
+    OutData.push_back((uint8_t) EReplicationRecord::Agent);
+    WriteUnsigned(AgentID, OutData);
+    const size_t MovesNum = std::min<size_t>(Agent.Moves.size(), PATH_REPLICATION_UNLISTED_MOVE);
+    WriteUnsigned(MovesNum, OutData);
+    for (size_t MoveIndex = 0; MoveIndex < MovesNum; ++MoveIndex)
+    {
+      WriteSigned(Agent.Moves[MoveIndex].Destination.X, OutData);
+      WriteSigned(Agent.Moves[MoveIndex].Destination.Y, OutData);
+      WriteFloat(Agent.Moves[MoveIndex].MoveCost, OutData);
+    }
+    Agent.Moves.resize(MovesNum);
+    Agent.bMovesSent = true;
+  }
+
+  const uint32_t Length = Nodes ? Handle.Length : 0;
+
+  // The new path usually starts with a part of the previous one
+  size_t Skipped = Agent.Path.size();
+  size_t Kept = 0;
+  if (Length)
+  {
+    for (size_t OldIndex = 0; OldIndex < Agent.Path.size(); ++OldIndex)
+    {
+      if (IsReplicated(Agent.Path[OldIndex], Nodes[0]))
+      {
+        Skipped = OldIndex;
+        while (Skipped + Kept < Agent.Path.size() && Kept < Length && IsReplicated(Agent.Path[Skipped + Kept], Nodes[Kept]))
+        {
+          ++Kept;
+        }
+        break;
+      }
+    }
+  }
+  if (!Kept)
+  {
+    Skipped = 0;
+  }
+
+  OutData.push_back((uint8_t) EReplicationRecord::Path);
+  WriteUnsigned(AgentID, OutData);
+  WriteUnsigned(Handle.Version, OutData);
+  WriteUnsigned(Skipped, OutData);
+  WriteUnsigned(Kept, OutData);
+  WriteUnsigned(Length - Kept, OutData);
+
+  std::vector<PathBufferNode> DecodedPath(Agent.Path.begin() + std::min(Skipped, Agent.Path.size()), Agent.Path.begin() + std::min(Skipped + Kept, Agent.Path.size()));
+  DecodedPath.reserve(Length);
+  for (uint32_t NodeIndex = Kept; NodeIndex < Length; ++NodeIndex)
+  {
+    const PathBufferNode& PathNode = Nodes[NodeIndex];
+    if (DecodedPath.empty())
+    {
+      WriteSigned(PathNode.Point.X, OutData);
+      WriteSigned(PathNode.Point.Y, OutData);
+      WriteSigned(Quantize(PathNode.Time), OutData);
+      WriteSigned(Quantize(PathNode.MoveDuration), OutData);
+      DecodedPath.push_back(DecodeStart(PathNode.Point, Quantize(PathNode.Time), Quantize(PathNode.MoveDuration)));
+      continue;
+    }
+
+    const PathBufferNode& Previous = DecodedPath.back();
+    const FPoint Delta = PathNode.Point - Previous.Point;
+    const int64_t WaitQuanta = Quantize(PathNode.Time - PathNode.MoveDuration) - Quantize(Previous.Time);
+
+    size_t MoveIndex = 0;
+    while (MoveIndex < Agent.Moves.size()
+      && !(Agent.Moves[MoveIndex].Destination == Delta && IsSameDuration(Agent.Moves[MoveIndex].MoveCost, PathNode.MoveDuration)))
+    {
+      ++MoveIndex;
+    }
+
+    if (MoveIndex < Agent.Moves.size())
+    {
+      OutData.push_back((uint8_t) MoveIndex);
+      WriteSigned(WaitQuanta, OutData);
+      DecodedPath.push_back(DecodeMove(Previous, Delta, Agent.Moves[MoveIndex].MoveCost, WaitQuanta));
+    }
+    else
+    {
+      const int64_t DurationQuanta = Quantize(PathNode.MoveDuration);
+      OutData.push_back(PATH_REPLICATION_UNLISTED_MOVE);
+      WriteSigned(Delta.X, OutData);
+      WriteSigned(Delta.Y, OutData);
+      WriteSigned(WaitQuanta, OutData);
+      WriteSigned(DurationQuanta, OutData);
+      DecodedPath.push_back(DecodeMove(Previous, Delta, Dequantize(DurationQuanta), WaitQuanta));
+    }
+  }
+
+  Agent.Path = std::move(DecodedPath);
+  Agent.Version = Handle.Version;
+}
+
+size_t PathReplicationEncoder::Encode(const PathBuffer& Paths, size_t MaxBytes, std::vector<uint8_t>& OutData)
+{
+  const size_t StartSize = OutData.size();
+
+  for (int AgentID : PendingRemovals)
+  {
+    OutData.push_back((uint8_t) EReplicationRecord::Remove);
+    WriteUnsigned(AgentID, OutData);
+  }
+  PendingRemovals.clear();
+
+  std::vector<uint8_t> Record;
+  const size_t AgentsNum = AgentOrder.size();
+  for (size_t Visited = 0; Visited < AgentsNum; ++Visited)
+  {
+    if (NextAgentIndex >= AgentOrder.size())
+    {
+      NextAgentIndex = 0;
+    }
+
+    const int AgentID = AgentOrder[NextAgentIndex];
+    ReplicatedAgent& Agent = Agents[AgentID];
+    const PathHandle Handle = Paths.GetHandle(AgentID);
+    if (Handle.Version == Agent.Version)
+    {
+      ++NextAgentIndex;
+      continue;
+    }
+
+    // The copy of the client path is changed only if the record is sent
+    ReplicatedAgent EncodedAgent = Agent;
+    Record.clear();
+    EncodeAgent(AgentID, EncodedAgent, Handle, Paths.Find(Handle), Record);
+    if (OutData.size() - StartSize + Record.size() > MaxBytes && OutData.size() > StartSize)
+    {
+      break;
+    }
+
+    OutData.insert(OutData.end(), Record.begin(), Record.end());
+    Agent = std::move(EncodedAgent);
+    ++NextAgentIndex;
+  }
+
+  return OutData.size() - StartSize;
+}
+
+bool PathReplicationDecoder::Decode(const uint8_t* Data, size_t Size)
+{
+  RecordReader Reader(Data, Size);
+  while (!Reader.IsEnd())
+  {
+    uint8_t RecordType;
+    uint64_t AgentID;
+    if (!Reader.ReadByte(RecordType) || !Reader.ReadUnsigned(AgentID))
+    {
+      return false;
+    }
+
+    if (RecordType == (uint8_t) EReplicationRecord::Remove)
+    {
+      Agents.erase((int) AgentID);
+      continue;
+    }
+
+    if (RecordType == (uint8_t) EReplicationRecord::Agent)
+    {
+      uint64_t MovesNum;
+      if (!Reader.ReadUnsigned(MovesNum) || MovesNum > PATH_REPLICATION_UNLISTED_MOVE)
+      {
+        return false;
+      }
+
+      DecodedAgent& Agent = Agents[(int) AgentID];
+      Agent.Moves.clear();
+      for (uint64_t MoveIndex = 0; MoveIndex < MovesNum; ++MoveIndex)
+      {
+        int64_t X, Y;
+        MoveDelta<FPoint> Move;
+        if (!Reader.ReadSigned(X) || !Reader.ReadSigned(Y) || !Reader.ReadFloat(Move.MoveCost))
+        {
+          return false;
+        }
+        Move.Destination = FPoint((int) X, (int) Y);
+        Agent.Moves.push_back(Move);
+      }
+      continue;
+    }
+
+    if (RecordType != (uint8_t) EReplicationRecord::Path)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("Unknown path replication record %d"), (int) RecordType);
+      return false;
+    }
+
+    auto Found = Agents.find((int) AgentID);
+    uint64_t Version, Skipped, Kept, NewNodesNum;
+    if (Found == Agents.end() || !Reader.ReadUnsigned(Version) || !Reader.ReadUnsigned(Skipped) || !Reader.ReadUnsigned(Kept) || !Reader.ReadUnsigned(NewNodesNum))
+    {
+      return false;
+    }
+
+    DecodedAgent& Agent = Found->second;
+    if (Kept && (Skipped > Agent.Path.size() || Kept > Agent.Path.size() - Skipped))
+    {
+      return false;
+    }
+
+    std::vector<PathBufferNode> DecodedPath;
+    if (Kept)
+    {
+      DecodedPath.assign(Agent.Path.begin() + Skipped, Agent.Path.begin() + Skipped + Kept);
+    }
+
+    for (uint64_t NodeIndex = 0; NodeIndex < NewNodesNum; ++NodeIndex)
+    {
+      if (DecodedPath.empty())
+      {
+        int64_t X, Y, TimeQuanta, DurationQuanta;
+        if (!Reader.ReadSigned(X) || !Reader.ReadSigned(Y) || !Reader.ReadSigned(TimeQuanta) || !Reader.ReadSigned(DurationQuanta))
+        {
+          return false;
+        }
+        DecodedPath.push_back(DecodeStart(FPoint((int) X, (int) Y), TimeQuanta, DurationQuanta));
+        continue;
+      }
+
+      uint8_t MoveIndex;
+      int64_t WaitQuanta;
+      if (!Reader.ReadByte(MoveIndex))
+      {
+        return false;
+      }
+
+      if (MoveIndex == PATH_REPLICATION_UNLISTED_MOVE)
+      {
+        int64_t X, Y, DurationQuanta;
+        if (!Reader.ReadSigned(X) || !Reader.ReadSigned(Y) || !Reader.ReadSigned(WaitQuanta) || !Reader.ReadSigned(DurationQuanta))
+        {
+          return false;
+        }
+        DecodedPath.push_back(DecodeMove(DecodedPath.back(), FPoint((int) X, (int) Y), Dequantize(DurationQuanta), WaitQuanta));
+        continue;
+      }
+
+      if (MoveIndex >= Agent.Moves.size() || !Reader.ReadSigned(WaitQuanta))
+      {
+        return false;
+      }
+      const MoveDelta<FPoint>& Move = Agent.Moves[MoveIndex];
+      DecodedPath.push_back(DecodeMove(DecodedPath.back(), Move.Destination, Move.MoveCost, WaitQuanta));
+    }
+
+    Agent.Path = std::move(DecodedPath);
+    Agent.Version = (uint32_t) Version;
+  }
+
+  return true;
+}
+
+const std::vector<PathBufferNode>* PathReplicationDecoder::FindPath(int AgentID) const
+{
+  auto Found = Agents.find(AgentID);
+  if (Found == Agents.end() || Found->second.Path.empty())
+  {
+    return nullptr;
+  }
+
+  return &Found->second.Path;
+}
+
+uint32_t PathReplicationDecoder::GetVersion(int AgentID) const
+{
+  auto Found = Agents.find(AgentID);
+  return Found != Agents.end() ? Found->second.Version : 0;
+}
+
+bool PathReplicationDecoder::GetCurrentLocation(int AgentID, float Time, ASpace* SpaceWrapper, FVector& OutLocation) const
+{
+  check(SpaceWrapper);
+  const std::vector<PathBufferNode>* Path = FindPath(AgentID);
+  if (!Path)
+  {
+    return false;
+  }
+
+  auto NextNode = std::upper_bound(Path->begin(), Path->end(), Time, [](float Value, const PathBufferNode& PathNode) {
+    return Value < PathNode.Time;
+  });
+
+  if (NextNode == Path->begin() || NextNode == Path->end())
+  {
+    OutLocation = SpaceWrapper->Translate((NextNode == Path->begin() ? Path->front() : Path->back()).Point);
+    return true;
+  }
+
+  const PathBufferNode& PrevNode = *std::prev(NextNode);
+  const FVector PrevNodeLocation = SpaceWrapper->Translate(PrevNode.Point);
+  const FVector NextNodeLocation = SpaceWrapper->Translate(NextNode->Point);
+
+  const float MovementStartTime = NextNode->Time - NextNode->MoveDuration;
+  if (Time < MovementStartTime || NextNode->MoveDuration <= 0)
+  {
+    OutLocation = PrevNodeLocation;
+  }
+  else
+  {
+    OutLocation = FMath::Lerp(PrevNodeLocation, NextNodeLocation, (Time - MovementStartTime) / NextNode->MoveDuration);
+  }
+  return true;
+}
@@ -0,0 +1,454 @@
+#include "PlannerBenchmarks.h"
+#include "Agent.h"
+#include "AgentPlanner.h"
+#include "MovesSegments.h"
+#include "NodesHeap.h"
+#include "SearchArena.h"
+#include "Segments.h"
+#include "StaticDistances.h"
+#include "StaticMoves.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+#define BENCHMARK_SEGMENTS_NUM 16
+#define BENCHMARK_HEAP_SIZE 1024
+#define BENCHMARK_POINTS_NUM 256
+#define BENCHMARK_WINDOWS_NUM 16
+#define BENCHMARK_WINDOW_DEPTH 30.f
+
+PlannerBenchmarks::PlannerBenchmarks(const RawSpace& Map, const BenchmarkSettings& InSettings)
+  : Settings(InSettings)
+  , Static(std::make_shared<const RawSpace>(Map))
+  , Space(std::make_shared<SpaceTime>(InSettings.Depth, Map))
+  , Random(InSettings.Seed)
+{
+  for (int X = 0; X < (int) Map.GetWidth(); ++X)
+  {
+    for (int Y = 0; Y < (int) Map.GetHeight(); ++Y)
+    {
+      if (Map.GetAccess({ X, Y }) == Access::Accessable)
+      {
+        FreePoints.push_back({ X, Y });
+      }
+    }
+  }
+  check(FreePoints.size() > 0);
+
+  // The same moves as the default ones of UAgent
+  Moves = {
+    { 1.f, { 0, 1 } },
+    { 1.f, { 0, -1 } },
+    { 1.f, { 1, 0 } },
+    { 1.f, { -1, 0 } },
+    { std::sqrt(2.f), { 1, 1 } },
+    { std::sqrt(2.f), { -1, -1 } },
+    { std::sqrt(2.f), { 1, -1 } },
+    { std::sqrt(2.f), { -1, 1 } },
+  };
+
+  PopulateReservations();
+}
+
+FPoint PlannerBenchmarks::GetRandomFreePoint()
+{
+  return FreePoints[std::uniform_int_distribution<size_t>(0, FreePoints.size() - 1)(Random)];
+}
+
+Segment PlannerBenchmarks::GetRandomSegment(float MaxLength)
+{
+  const float Start = std::uniform_real_distribution<float>(0, Settings.Depth - MaxLength)(Random);
+  const float Length = std::uniform_real_distribution<float>(0.1f, MaxLength)(Random);
+  return { Start, Start + Length };
+}
+
+void PlannerBenchmarks::PopulateReservations()
+{
+  // Short reservations of agents passing through random cells
+  ArrayType<Area> Reservations;
+  for (int ReservationIndex = 0; ReservationIndex < Settings.ReservationsNum; ++ReservationIndex)
+  {
+    Reservations.push_back(Area(GetRandomFreePoint(), GetRandomSegment(Settings.MaxReservationLength)));
+  }
+
+  Space->MakeAreasInaccessable(Reservations);
+}
+
+void PlannerBenchmarks::Run(const std::string& Name, size_t OpsPerIteration, const std::function<size_t()>& Body)
+{
+  volatile size_t Sink = 0;
+  uint64_t Iterations = 1;
+  double Elapsed = 0;
+  SearchArenaCounters Counters;
+
+  while (true)
+  {
+    Counters = GetThreadArenaCounters();
+    const std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    for (uint64_t Iteration = 0; Iteration < Iterations; ++Iteration)
+    {
+      Sink = Sink + Body();
+    }
+    Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    if (Elapsed >= Settings.MinTime)
+    {
+      break;
+    }
+    Iterations *= 2;
+  }
+
+  Counters = GetThreadArenaCounters() - Counters;
+  const double OpsNum = (double) Iterations * OpsPerIteration;
+
+  BenchmarkResult Result;
+  Result.Name = Name;
+  Result.Iterations = Iterations;
+  Result.NanosecondsPerOp = Elapsed * 1e9 / OpsNum;
+  Result.ArenaAllocationsPerOp = Counters.ArenaAllocations / OpsNum;
+  Result.HeapAllocationsPerOp = Counters.HeapAllocations / OpsNum;
+  Result.BlockAllocationsPerOp = Counters.BlockAllocations / OpsNum;
+  Results.push_back(Result);
+
+  UE_LOG(LogTemp, Log, TEXT("%s: %f ns, %f arena allocations, %f heap allocations"),
+    *FString(Name.c_str()), Result.NanosecondsPerOp, Result.ArenaAllocationsPerOp, Result.HeapAllocationsPerOp);
+}
+
+void PlannerBenchmarks::BenchmarkSegmentHolder()
+{
+  ArrayType<Segment> Segments;
+  for (int SegmentIndex = 0; SegmentIndex < BENCHMARK_SEGMENTS_NUM; ++SegmentIndex)
+  {
+    Segments.push_back(GetRandomSegment(Settings.MaxReservationLength));
+  }
+
+  Run("SegmentHolder/AddSegment", Segments.size(), [&Segments]() -> size_t {
+    SegmentHolder Holder;
+    for (const Segment& NewSegment : Segments)
+    {
+      Holder.AddSegment(NewSegment);
+    }
+    return Holder.begin() != Holder.end();
+  });
+
+  const SegmentHolder FullHolder(Segment{ 0, Settings.Depth });
+  Run("SegmentHolder/RemoveSegment", Segments.size(), [&Segments, &FullHolder]() -> size_t {
+    SegmentHolder Holder = FullHolder;
+    for (const Segment& Removal : Segments)
+    {
+      Holder.RemoveSegment(Removal);
+    }
+    return Holder.begin() != Holder.end();
+  });
+
+  // Cells of the populated space, as intersected by the moves
+  ArrayType<SegmentHolder> Holders;
+  for (int PointIndex = 0; PointIndex < BENCHMARK_POINTS_NUM; ++PointIndex)
+  {
+    Holders.push_back(Space->GetSegments(GetRandomFreePoint()));
+  }
+
+  Run("SegmentHolder/Intersection", Holders.size() - 1, [&Holders]() -> size_t {
+    size_t NotEmpty = 0;
+    for (size_t HolderIndex = 1; HolderIndex < Holders.size(); ++HolderIndex)
+    {
+      const SegmentHolder Intersection = Holders[HolderIndex - 1] & Holders[HolderIndex];
+      NotEmpty += Intersection.begin() != Intersection.end();
+    }
+    return NotEmpty;
+  });
+}
+
+void PlannerBenchmarks::BenchmarkNodesHeap()
+{
+  std::uniform_real_distribution<float> TimeDistribution(0, Settings.Depth);
+  ArrayType<Node<FPoint>> Nodes;
+  for (int NodeIndex = 0; NodeIndex < BENCHMARK_HEAP_SIZE; ++NodeIndex)
+  {
+    Nodes.push_back(Node<FPoint>(GetRandomFreePoint(), TimeDistribution(Random), TimeDistribution(Random)));
+  }
+
+  Run("NodesBinaryHeap/Insert", Nodes.size(), [&Nodes]() -> size_t {
+    NodesBinaryHeap<FPoint> Heap(true);
+    for (Node<FPoint>& HeapNode : Nodes)
+    {
+      Heap.Insert(HeapNode);
+    }
+    return Heap.Size();
+  });
+
+  // Includes insertion of all nodes
+  Run("NodesBinaryHeap/InsertPopMin", Nodes.size(), [&Nodes]() -> size_t {
+    NodesBinaryHeap<FPoint> Heap(true);
+    for (Node<FPoint>& HeapNode : Nodes)
+    {
+      Heap.Insert(HeapNode);
+    }
+
+    size_t Popped = 0;
+    while (Heap.PopMin())
+    {
+      ++Popped;
+    }
+    return Popped;
+  });
+
+  // Includes insertion of all nodes, times are restored after every iteration
+  ArrayType<float> MinTimes;
+  for (const Node<FPoint>& HeapNode : Nodes)
+  {
+    MinTimes.push_back(HeapNode.MinTime);
+  }
+
+  Run("NodesBinaryHeap/InsertImproveTime", Nodes.size(), [&Nodes, &MinTimes]() -> size_t {
+    NodesBinaryHeap<FPoint> Heap(true);
+    for (size_t NodeIndex = 0; NodeIndex < Nodes.size(); ++NodeIndex)
+    {
+      Nodes[NodeIndex].MinTime = MinTimes[NodeIndex];
+      Heap.Insert(Nodes[NodeIndex]);
+    }
+
+    for (Node<FPoint>& HeapNode : Nodes)
+    {
+      Heap.ImproveTime(HeapNode, HeapNode.MinTime * 0.5f);
+    }
+    return Heap.Size();
+  });
+}
+
+void PlannerBenchmarks::BenchmarkTouchedSegments()
+{
+  // Long moves are used by any-angle paths
+  ArrayType<MoveDelta<FPoint>> TestedMoves = Moves;
+  TestedMoves.push_back({ std::sqrt(5.f), { 2, 1 } });
+  TestedMoves.push_back({ std::sqrt(13.f), { -3, 2 } });
+  TestedMoves.push_back({ std::sqrt(50.f), { 7, -1 } });
+
+  // After the first iteration every move is read from the per thread cache
+  Run("GetTouchedSegments/CacheHit", TestedMoves.size(), [&TestedMoves]() -> size_t {
+    size_t TouchedNum = 0;
+    for (const MoveDelta<FPoint>& Move : TestedMoves)
+    {
+      TouchedNum += GetTouchedSegments(Move).size();
+    }
+    return TouchedNum;
+  });
+
+  // The cache is bypassed, as happens for the first move to each destination of a thread
+  Run("GetTouchedSegments/CacheMiss", TestedMoves.size(), [&TestedMoves]() -> size_t {
+    size_t TouchedNum = 0;
+    for (const MoveDelta<FPoint>& Move : TestedMoves)
+    {
+      TouchedNum += ComputeUnitTouchedSegments(Move.Destination).size();
+    }
+    return TouchedNum;
+  });
+}
+
+void PlannerBenchmarks::BenchmarkUpdateShape()
+{
+  ArrayType<FPoint> Points;
+  for (int PointIndex = 0; PointIndex < BENCHMARK_POINTS_NUM; ++PointIndex)
+  {
+    Points.push_back(GetRandomFreePoint());
+  }
+
+  // Only cache misses are measured, so every iteration starts with an empty shape space
+  const FShape Shape;
+  Run("ShapeSpace/UpdateShape", Points.size(), [this, &Points, &Shape]() -> size_t {
+    ShapeSpace ShapedSpace(Settings.Depth, Space, Shape);
+    for (const FPoint& Point : Points)
+    {
+      ShapedSpace.UpdateShape(Point);
+    }
+    return ShapedSpace.ContainsSegmentsIn(Points[0]);
+  });
+}
+
+void PlannerBenchmarks::BenchmarkFindValidMoves()
+{
+  std::shared_ptr<ShapeSpace> ShapedSpace = std::make_shared<ShapeSpace>(Settings.Depth, Space, FShape());
+  MovesTestSegment MovesTest(Moves, ShapedSpace, Settings.Depth);
+
+  // Nodes at the first safe intervals of random cells, as the search expands them
+  ArrayType<Node<Area>> Nodes;
+  for (int PointIndex = 0; PointIndex < BENCHMARK_POINTS_NUM; ++PointIndex)
+  {
+    const FPoint Point = GetRandomFreePoint();
+    ShapedSpace->UpdateShape(Point);
+    if (!ShapedSpace->ContainsSegmentsIn(Point))
+    {
+      continue;
+    }
+
+    const SegmentHolder& Segments = ShapedSpace->GetSegments(Point);
+    if (Segments.begin() != Segments.end())
+    {
+      const Segment Interval = *Segments.begin();
+      Nodes.push_back(Node<Area>(Area(Point, Interval), Interval.Start));
+    }
+  }
+
+  if (Nodes.empty())
+  {
+    UE_LOG(LogTemp, Warning, TEXT("No cells for the shape, FindValidMoves is not measured"));
+    return;
+  }
+
+  // Shape cache is warmed by the first iteration, as in a long search
+  Run("MovesTestSegment/FindValidMoves", Nodes.size(), [&MovesTest, &Nodes]() -> size_t {
+    size_t ValidMoves = 0;
+    for (const Node<Area>& ExpandedNode : Nodes)
+    {
+      ValidMoves += MovesTest.FindValidMoves(ExpandedNode).size();
+    }
+    return ValidMoves;
+  });
+
+  // The same moves from the constexpr table, as the search of default agents runs them
+  StaticMovesTestSegment<EStaticMoveSet::EightConnected> StaticMovesTest(Moves, ShapedSpace, Settings.Depth);
+  Run("StaticMovesTestSegment/FindValidMoves", Nodes.size(), [&StaticMovesTest, &Nodes]() -> size_t {
+    size_t ValidMoves = 0;
+    for (const Node<Area>& ExpandedNode : Nodes)
+    {
+      ValidMoves += StaticMovesTest.FindValidMoves(ExpandedNode).size();
+    }
+    return ValidMoves;
+  });
+
+  // Temporary containers of the moves are allocated from a scratch arena, as by the planner context
+  SearchArena ScratchArena;
+  StaticMovesTest.SetScratchArena(&ScratchArena);
+  Run("StaticMovesTestSegment/FindValidMoves/Arena", Nodes.size(), [&StaticMovesTest, &Nodes]() -> size_t {
+    size_t ValidMoves = 0;
+    for (const Node<Area>& ExpandedNode : Nodes)
+    {
+      ValidMoves += StaticMovesTest.FindValidMoves(ExpandedNode).size();
+    }
+    return ValidMoves;
+  });
+}
+
+void PlannerBenchmarks::BenchmarkFindWindowPath()
+{
+  ArrayType<FReplanInput> Inputs;
+  for (int WindowIndex = 0; WindowIndex < BENCHMARK_WINDOWS_NUM; ++WindowIndex)
+  {
+    FReplanInput Input;
+    Input.AgentID = WindowIndex;
+    Input.Point = GetRandomFreePoint();
+    Input.Goal = GetRandomFreePoint();
+    Input.Depth = std::min(BENCHMARK_WINDOW_DEPTH, Settings.Depth);
+    Input.Moves = Moves;
+    Inputs.push_back(Input);
+  }
+
+  ArrayType<FReplanInput> BidirectionalInputs = Inputs;
+  for (FReplanInput& Input : BidirectionalInputs)
+  {
+    Input.bBidirectionalHeuristic = true;
+  }
+
+  // Whole replans of the worker context, nodes and cached cells are allocated from its arena
+  auto FindWindows = [this](const ArrayType<FReplanInput>& TestedInputs) -> size_t {
+    size_t Found = 0;
+    std::vector<Node<Area>> ReversedPath;
+    for (const FReplanInput& Input : TestedInputs)
+    {
+      ReversedPath.clear();
+      Found += FindWindowPath(Input, Space, ReversedPath, false);
+    }
+    return Found;
+  };
+  Run("FindWindowPath", Inputs.size(), [&FindWindows, &Inputs]() -> size_t { return FindWindows(Inputs); });
+  const size_t GoalResultIndex = Results.size() - 1;
+  Run("FindWindowPath/Bidirectional", BidirectionalInputs.size(), [&FindWindows, &BidirectionalInputs]() -> size_t { return FindWindows(BidirectionalInputs); });
+
+  CompareWindowHeuristics(Inputs, Results[GoalResultIndex], Results.back());
+}
+
+void PlannerBenchmarks::CompareWindowHeuristics(const ArrayType<FReplanInput>& Inputs, BenchmarkResult& GoalResult, BenchmarkResult& BidirectionalResult)
+{
+  BenchmarkResult* WindowResults[2] = { &GoalResult, &BidirectionalResult };
+  int FoundNum[2] = { 0, 0 };
+  for (size_t WindowIndex = 0; WindowIndex < Inputs.size(); ++WindowIndex)
+  {
+    // Progress is the decrease of the exact plane distance to the goal over the window
+    const FReplanInput& Input = Inputs[WindowIndex];
+    const std::shared_ptr<DistanceTable> ToGoal = DistanceTable::Build(*Static, Input.Goal, Input.Shape, Input.Moves);
+
+    float Costs[2] = { -1.f, -1.f };
+    float Progress[2] = { 0.f, 0.f };
+    for (int HeuristicIndex = 0; HeuristicIndex < 2; ++HeuristicIndex)
+    {
+      FReplanInput TestedInput = Input;
+      TestedInput.bBidirectionalHeuristic = HeuristicIndex == 1;
+      std::vector<Node<Area>> ReversedPath;
+      if (!FindWindowPath(TestedInput, Space, ReversedPath, false) || ReversedPath.empty())
+      {
+        continue;
+      }
+
+      const Node<Area>& WindowEnd = ReversedPath.front();
+      Costs[HeuristicIndex] = WindowEnd.MinTime - ReversedPath.back().MinTime;
+      Progress[HeuristicIndex] = ToGoal->GetDistance(Input.Point) - ToGoal->GetDistance(WindowEnd.Cell.Point);
+      WindowResults[HeuristicIndex]->WindowCost += Costs[HeuristicIndex];
+      WindowResults[HeuristicIndex]->WindowProgress += Progress[HeuristicIndex];
+      ++FoundNum[HeuristicIndex];
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Window %d: cost %f, progress %f from the goal; cost %f, progress %f bidirectional"),
+      (int) WindowIndex, Costs[0], Progress[0], Costs[1], Progress[1]);
+  }
+
+  for (int HeuristicIndex = 0; HeuristicIndex < 2; ++HeuristicIndex)
+  {
+    if (FoundNum[HeuristicIndex])
+    {
+      WindowResults[HeuristicIndex]->WindowCost /= FoundNum[HeuristicIndex];
+      WindowResults[HeuristicIndex]->WindowProgress /= FoundNum[HeuristicIndex];
+    }
+  }
+}
+
+void PlannerBenchmarks::RunAll()
+{
+  Results.clear();
+  BenchmarkSegmentHolder();
+  BenchmarkNodesHeap();
+  BenchmarkTouchedSegments();
+  BenchmarkUpdateShape();
+  BenchmarkFindValidMoves();
+  BenchmarkFindWindowPath();
+}
+
+std::string PlannerBenchmarks::ToJson() const
+{
+  std::ostringstream Stream;
+  Stream << "{\"context\":{"
+    << "\"reservations\":" << Settings.ReservationsNum << ","
+    << "\"depth\":" << Settings.Depth << ","
+    << "\"seed\":" << Settings.Seed << "},"
+    << "\"benchmarks\":[";
+  for (size_t ResultIndex = 0; ResultIndex < Results.size(); ++ResultIndex)
+  {
+    const BenchmarkResult& Result = Results[ResultIndex];
+    // Only wall time is measured, cpu_time is required by the comparison tools
+    Stream << (ResultIndex ? "," : "")
+      << "{\"name\":\"" << Result.Name << "\","
+      << "\"run_type\":\"iteration\","
+      << "\"iterations\":" << Result.Iterations << ","
+      << "\"real_time\":" << Result.NanosecondsPerOp << ","
+      << "\"cpu_time\":" << Result.NanosecondsPerOp << ","
+      << "\"time_unit\":\"ns\","
+      << "\"arena_allocs\":" << Result.ArenaAllocationsPerOp << ","
+      << "\"heap_allocs\":" << Result.HeapAllocationsPerOp << ","
+      << "\"arena_blocks\":" << Result.BlockAllocationsPerOp << ","
+      << "\"window_cost\":" << Result.WindowCost << ","
+      << "\"window_progress\":" << Result.WindowProgress << "}";
+  }
+  Stream << "]}";
+  return Stream.str();
+}
@@ -0,0 +1,1368 @@
+#include "PlannerChecks.h"
+#include "AgentPlanner.h"
+#include "DynamicObstacles.h"
+#include "GoalAssignment.h"
+#include "KinodynamicMoves.h"
+#include "MovesSegments.h"
+#include "PathBuffer.h"
+#include "PathReplication.h"
+#include "Pathfinding.h"
+#include "PlannerBenchmarks.h"
+#include "PlannerStats.h"
+#include "SearchArena.h"
+#include "Segments.h"
+#include "ShardedSpace.h"
+#include "Shapes.h"
+#include "Space.h"
+#include "StaticDistances.h"
+#include "StaticMoves.h"
+#include "TileStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+#define CHECKS_MAP_SIZE 4
+#define CHECKS_MAZE_SIZE 8
+#define CHECKS_DEPTH 100.f
+#define CHECKS_TIME_TOLERANCE 1e-5f
+#define CHECKS_RANDOM_SEED 42
+#define CHECKS_STREAMED_FILE "PlannerChecksStreamed.map"
+
+namespace
+{
+  // Maps of all checks, cells out of Blocked are accessible
+  std::shared_ptr<RawSpace> MakeStatic(int Size, const ArrayType<FPoint>& Blocked = {})
+  {
+    std::shared_ptr<RawSpace> Static = std::make_shared<RawSpace>(Size, Size);
+    for (int X = 0; X < Size; ++X)
+    {
+      for (int Y = 0; Y < Size; ++Y)
+      {
+        Static->SetAccess({ X, Y }, Access::Accessable);
+      }
+    }
+    for (FPoint Cell : Blocked)
+    {
+      Static->SetAccess(Cell, Access::Inaccessable);
+    }
+    return Static;
+  }
+
+  std::shared_ptr<SpaceTime> MakeSpace(const RawSpace& Static)
+  {
+    return std::make_shared<SpaceTime>(CHECKS_DEPTH, Static);
+  }
+
+  std::shared_ptr<SpaceTime> MakeFreeSpace()
+  {
+    return MakeSpace(*MakeStatic(CHECKS_MAP_SIZE));
+  }
+
+  // The wall at X = 1 separates the first column from the rest of the map
+  std::shared_ptr<RawSpace> MakeWalledStatic()
+  {
+    ArrayType<FPoint> Wall;
+    for (int Y = 0; Y < CHECKS_MAP_SIZE; ++Y)
+    {
+      Wall.push_back({ 1, Y });
+    }
+    return MakeStatic(CHECKS_MAP_SIZE, Wall);
+  }
+
+  // The wall at X = 4 is passed at its top, two more cells are blocked at both sides of it
+  std::shared_ptr<RawSpace> MakeMazeStatic()
+  {
+    ArrayType<FPoint> Blocked = { FPoint(2, 2), FPoint(6, 3) };
+    for (int Y = 0; Y < CHECKS_MAZE_SIZE - 2; ++Y)
+    {
+      Blocked.push_back({ 4, Y });
+    }
+    return MakeStatic(CHECKS_MAZE_SIZE, Blocked);
+  }
+
+  // Writes the map in the hog format
+  bool WriteHogFile(const RawSpace& Static, const char* FileName)
+  {
+    std::ofstream File(FileName, std::ios::binary);
+    File << "type octile\nheight " << Static.GetHeight() << "\nwidth " << Static.GetWidth() << "\nmap\n";
+    for (int Y = 0; Y < (int) Static.GetHeight(); ++Y)
+    {
+      for (int X = 0; X < (int) Static.GetWidth(); ++X)
+      {
+        File << (Static.GetAccess({ X, Y }) == Access::Accessable ? '.' : '@');
+      }
+      File << '\n';
+    }
+    return (bool) File;
+  }
+
+  FShape MakePointShape()
+  {
+    FShape Shape;
+    Shape.Points = { FPoint(0, 0) };
+    return Shape;
+  }
+
+  ArrayType<MoveDelta<FPoint>> MakeStraightMoves()
+  {
+    return {
+      { 1.f, { 0, 1 } },
+      { 1.f, { 0, -1 } },
+      { 1.f, { 1, 0 } },
+      { 1.f, { -1, 0 } },
+    };
+  }
+
+  ArrayType<MoveDelta<FPoint>> MakeEightConnectedMoves()
+  {
+    ArrayType<MoveDelta<FPoint>> Moves = MakeStraightMoves();
+    for (FPoint Delta : { FPoint(1, 1), FPoint(-1, -1), FPoint(1, -1), FPoint(-1, 1) })
+    {
+      Moves.push_back({ std::sqrt(2.f), Delta });
+    }
+    return Moves;
+  }
+
+  // Replan of a point agent at the time 0 with the unit speed
+  FReplanInput MakeInput(FPoint Point, FPoint Goal, const ArrayType<MoveDelta<FPoint>>& Moves, float Depth = CHECKS_DEPTH / 2)
+  {
+    FReplanInput Input;
+    Input.Point = Point;
+    Input.Goal = Goal;
+    Input.Depth = Depth;
+    Input.Shape = MakePointShape();
+    Input.Moves = Moves;
+    return Input;
+  }
+
+  FObstacleTrajectory MakeStandingObstacle(FPoint Point, float Start, float End)
+  {
+    FObstacleTrajectory Trajectory;
+    Trajectory.Shape = MakePointShape();
+
+    FObstacleWaypoint Waypoint;
+    Waypoint.Point = Point;
+    Waypoint.Time = Start;
+    Trajectory.Waypoints.Add(Waypoint);
+    if (End > Start)
+    {
+      Waypoint.Time = End;
+      Trajectory.Waypoints.Add(Waypoint);
+    }
+    return Trajectory;
+  }
+
+  // Cells out of the space, like the ones of unloaded tiles, are not free
+  bool IsFree(const SegmentSpace& Space, FPoint Point, float Time)
+  {
+    return Space.ContainsSegmentsIn(Point) && Space.FindArea(Point, Time).IsSet();
+  }
+
+  // Reversed path along the first row, starting at Time with a wait of Wait at the start
+  std::vector<Node<Area>> MakeRowPath(int Length, float Time, float Wait)
+  {
+    std::vector<Node<Area>> ReversedPath;
+    for (int X = Length - 1; X > 0; --X)
+    {
+      ReversedPath.emplace_back(Area({ X, 0 }, { 0, CHECKS_DEPTH }), Time + Wait + X, -1.f, 1.f);
+    }
+    ReversedPath.emplace_back(Area({ 0, 0 }, { 0, CHECKS_DEPTH }), Time);
+    return ReversedPath;
+  }
+}
+
+void PlannerChecks::Expect(bool bCondition, const std::string& Description)
+{
+  ++ExpectationsNum;
+  if (!bCondition)
+  {
+    Failures.push_back(Description);
+  }
+}
+
+void PlannerChecks::CheckOverlappingReservations()
+{
+  const FPoint Cell = { 1, 1 };
+  const ArrayType<Area> AgentAreas = { Area(Cell, { 15.f, 25.f }) };
+
+  // The agent releases its path while the obstacle stays
+  {
+    std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+    DynamicObstacleLayer Obstacles(Space);
+    std::unordered_set<FPoint> ChangedPoints;
+
+    const int ObstacleID = Obstacles.Add(MakeStandingObstacle(Cell, 10.f, 20.f));
+    Obstacles.Commit(ChangedPoints);
+    Space->MakeAreasInaccessable(AgentAreas);
+
+    Space->MakeAreasAccessable(AgentAreas);
+    Expect(!IsFree(*Space, Cell, 17.f), "released agent reservation reopens the hole of an obstacle");
+    Expect(IsFree(*Space, Cell, 22.f), "released agent reservation stays inaccessable outside of the hole");
+
+    Obstacles.Remove(ObstacleID);
+    Obstacles.Commit(ChangedPoints);
+    Expect(IsFree(*Space, Cell, 17.f), "removed obstacle leaves its hole");
+    Expect(Space->GetSegments(Cell).Num() == 1, "released reservations leave the cell split");
+  }
+
+  // The obstacle moves away while the agent keeps its path
+  {
+    std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+    DynamicObstacleLayer Obstacles(Space);
+    std::unordered_set<FPoint> ChangedPoints;
+
+    Space->MakeAreasInaccessable(AgentAreas);
+    const int ObstacleID = Obstacles.Add(MakeStandingObstacle(Cell, 10.f, 20.f));
+    Obstacles.Commit(ChangedPoints);
+
+    Obstacles.Update(ObstacleID, MakeStandingObstacle(Cell + FPoint(1, 0), 10.f, 20.f));
+    Obstacles.Commit(ChangedPoints);
+    Expect(!IsFree(*Space, Cell, 17.f), "moved obstacle reopens the reservation of an agent");
+    Expect(IsFree(*Space, Cell, 12.f), "moved obstacle leaves its hole outside of the reservation");
+    Expect(!IsFree(*Space, Cell + FPoint(1, 0), 12.f), "moved obstacle doesn't make a new hole");
+
+    Space->MakeAreasAccessable(AgentAreas);
+    Expect(IsFree(*Space, Cell, 17.f), "released agent reservation stays after the obstacle moved away");
+  }
+
+  // Two obstacles overlap in time
+  {
+    std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+    DynamicObstacleLayer Obstacles(Space);
+    std::unordered_set<FPoint> ChangedPoints;
+
+    const int FirstID = Obstacles.Add(MakeStandingObstacle(Cell, 10.f, 20.f));
+    Obstacles.Add(MakeStandingObstacle(Cell, 15.f, 30.f));
+    Obstacles.Commit(ChangedPoints);
+
+    Obstacles.Remove(FirstID);
+    Obstacles.Commit(ChangedPoints);
+    Expect(IsFree(*Space, Cell, 12.f), "removed obstacle leaves its hole next to another obstacle");
+    Expect(!IsFree(*Space, Cell, 17.f), "removed obstacle reopens the hole of another obstacle");
+  }
+
+  // The cell is removed and restored while the agent keeps its path
+  {
+    std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+    Space->MakeAreasInaccessable(AgentAreas);
+    Space->SetAccess(Cell, Access::Inaccessable, CHECKS_DEPTH);
+    Space->SetAccess(Cell, Access::Accessable, CHECKS_DEPTH);
+    Expect(!IsFree(*Space, Cell, 17.f) && IsFree(*Space, Cell, 12.f), "restored cell loses the reservation of an agent");
+
+    // Obstacle written while the cell is removed
+    const ArrayType<Area> ObstacleAreas = { Area(Cell, { 30.f, 40.f }) };
+    Space->SetAccess(Cell, Access::Inaccessable, CHECKS_DEPTH);
+    Space->MakeAreasInaccessable(ObstacleAreas);
+    Space->SetAccess(Cell, Access::Accessable, CHECKS_DEPTH);
+    Expect(!IsFree(*Space, Cell, 35.f), "restored cell loses an obstacle written while it was removed");
+
+    Space->MakeAreasAccessable(AgentAreas);
+    Space->MakeAreasAccessable(ObstacleAreas);
+    Expect(Space->GetSegments(Cell).Num() == 1 && IsFree(*Space, Cell, 17.f) && IsFree(*Space, Cell, 35.f), "released reservations of a restored cell stay");
+  }
+
+  // Overlapping reservations are released in another order than written
+  {
+    std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+    const ArrayType<Segment> Written = { { 10.f, 30.f }, { 20.f, 40.f }, { 15.f, 25.f }, { 20.f, 40.f }, { 50.f, 60.f } };
+    for (const Segment& Reserved : Written)
+    {
+      Space->MakeAreasInaccessable({ Area(Cell, Reserved) });
+    }
+
+    Space->MakeAreasAccessable({ Area(Cell, Written[1]) });
+    Space->MakeAreasAccessable({ Area(Cell, Written[0]) });
+    Expect(IsFree(*Space, Cell, 12.f) && !IsFree(*Space, Cell, 22.f) && !IsFree(*Space, Cell, 35.f), "released reservation reopens an overlapping one");
+
+    Space->MakeAreasAccessable({ Area(Cell, Written[3]) });
+    Expect(!IsFree(*Space, Cell, 22.f) && IsFree(*Space, Cell, 27.f) && !IsFree(*Space, Cell, 55.f), "reservations are reopened by other counts than written");
+
+    Space->MakeAreasAccessable({ Area(Cell, Written[2]) });
+    Space->MakeAreasAccessable({ Area(Cell, Written[4]) });
+    Expect(Space->GetSegments(Cell).Num() == 1, "released overlapping reservations leave the cell split");
+  }
+}
+
+void PlannerChecks::CheckObstacleMoments()
+{
+  const FPoint Cell = { 2, 1 };
+  std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+  DynamicObstacleLayer Obstacles(Space);
+  std::unordered_set<FPoint> ChangedPoints;
+
+  const int ObstacleID = Obstacles.Add(MakeStandingObstacle(Cell, 10.f, 10.f));
+  Obstacles.Commit(ChangedPoints);
+  Expect(!IsFree(*Space, Cell, 10.f), "obstacle existing at a single moment doesn't make a hole");
+  Expect(IsFree(*Space, Cell, 10.f + OBSTACLE_MOMENT_DURATION), "obstacle existing at a single moment makes a long hole");
+
+  Obstacles.Remove(ObstacleID);
+  Obstacles.Commit(ChangedPoints);
+  Expect(IsFree(*Space, Cell, 10.f), "removed moment obstacle leaves its hole");
+}
+
+void PlannerChecks::CheckObstaclesMovedToNewSpace()
+{
+  const FPoint Cell = { 0, 2 };
+  std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+  std::shared_ptr<DynamicObstacleLayer> Obstacles = std::make_shared<DynamicObstacleLayer>(Space);
+  std::unordered_set<FPoint> ChangedPoints;
+
+  const int ObstacleID = Obstacles->Add(MakeStandingObstacle(Cell, 10.f, 20.f));
+  Obstacles->Commit(ChangedPoints);
+
+  std::shared_ptr<SpaceTime> NewSpace = MakeFreeSpace();
+  Obstacles->SetSpace(NewSpace);
+  Expect(!IsFree(*NewSpace, Cell, 15.f), "obstacle is lost when the space is replaced");
+
+  Obstacles->Remove(ObstacleID);
+  Obstacles->Commit(ChangedPoints);
+  Expect(IsFree(*NewSpace, Cell, 15.f), "obstacle moved to a new space leaves its hole");
+}
+
+void PlannerChecks::CheckUnitMovesTable()
+{
+  for (const StaticMove& Move : UnitMoves)
+  {
+    const FPoint Destination = Move.Delta.ToPoint();
+    const std::string MoveName = "(" + std::to_string(Destination.X) + ", " + std::to_string(Destination.Y) + ")";
+    const auto PointToSegment = GetTouchedSegments({ 1.f, Destination });
+
+    Expect(Move.TouchedNum == (int) PointToSegment.size(), "unit move " + MoveName + " touches other cells than GetTouchedSegments");
+    Expect(Move.Touched[0].Delta.ToPoint() == FPoint(0, 0) && Move.Touched[1].Delta.ToPoint() == Destination,
+      "unit move " + MoveName + " doesn't start with the origin and the destination");
+
+    for (int TouchedIndex = 0; TouchedIndex < Move.TouchedNum; ++TouchedIndex)
+    {
+      const StaticTouchedCell& Touched = Move.Touched[TouchedIndex];
+      const auto Found = PointToSegment.find(Touched.Delta.ToPoint());
+      Expect(Found != PointToSegment.end()
+        && std::abs(Found->second.Start - Touched.Start) < CHECKS_TIME_TOLERANCE
+        && std::abs(Found->second.End - Touched.End) < CHECKS_TIME_TOLERANCE,
+        "unit move " + MoveName + " has another segment than GetTouchedSegments in its cell " + std::to_string(TouchedIndex));
+    }
+  }
+}
+
+void PlannerChecks::CheckArrivalCosts()
+{
+  // The diagonal move from the start to (1, 1) waits till the side cell (0, 1) is released,
+  // so (1, 1) is reached first by it and then earlier by the straight move from (1, 0)
+  std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+  Space->MakeAreasInaccessable({ Area({ 0, 1 }, { 0.f, 3.f }) });
+
+  const FReplanInput Input = MakeInput({ 0, 0 }, { 1, 3 }, MakeEightConnectedMoves());
+
+  std::vector<Node<Area>> ReversedPath;
+  Expect(FindWindowPath(Input, Space, ReversedPath, false), "path around a reserved side cell is not found");
+
+  bool bPassesImprovedNode = false;
+  for (size_t NodeIndex = 0; NodeIndex + 1 < ReversedPath.size(); ++NodeIndex)
+  {
+    const Node<Area>& Next = ReversedPath[NodeIndex];
+    const Node<Area>& Prev = ReversedPath[NodeIndex + 1];
+    const FPoint Delta = Next.Cell.Point - Prev.Cell.Point;
+    if (Delta == FPoint(0, 0))
+    {
+      continue;
+    }
+
+    bPassesImprovedNode |= Next.Cell.Point == FPoint(1, 1) && Prev.Cell.Point == FPoint(1, 0);
+    const float MoveCost = (Delta.X != 0 && Delta.Y != 0) ? std::sqrt(2.f) : 1.f;
+    Expect(std::abs(Next.ArrivalCost - MoveCost) < CHECKS_TIME_TOLERANCE,
+      "node (" + std::to_string(Next.Cell.Point.X) + ", " + std::to_string(Next.Cell.Point.Y) + ") keeps the arrival cost of another parent");
+  }
+  Expect(bPassesImprovedNode, "path doesn't pass the node reached by two moves");
+}
+
+void PlannerChecks::CheckKinodynamicProfile()
+{
+  // With the acceleration of 1 the cruise speed of 1 is reached after half of a straight step
+  FKinodynamicModel Model;
+  Model.bEnabled = true;
+  Model.MaxSpeed = 1.f;
+  Model.Acceleration = 1.f;
+  const KinodynamicPrimitives Primitives(Model);
+
+  const auto ExpectDuration = [this, &Primitives](int Heading, bool bStartMoving, bool bEndMoving, float Duration) {
+    Expect(std::abs(Primitives.GetStep(Heading, bStartMoving, bEndMoving).Duration - Duration) < CHECKS_TIME_TOLERANCE,
+      "step of the heading " + std::to_string(Heading) + " from " + (bStartMoving ? "moving" : "standing")
+      + " to " + (bEndMoving ? "moving" : "standing") + " doesn't take " + std::to_string(Duration));
+  };
+  ExpectDuration(0, false, false, 2.f);
+  ExpectDuration(0, false, true, 1.5f);
+  ExpectDuration(0, true, true, 1.f);
+  ExpectDuration(0, true, false, 1.5f);
+  // The diagonal step cruises for the rest of its length
+  ExpectDuration(1, false, false, 1.f + std::sqrt(2.f));
+
+  // Distance grows as the square of the time while accelerating and braking
+  Expect(std::abs(Primitives.GetDistanceShare(0, false, false, 0.25f) - 0.125f) < CHECKS_TIME_TOLERANCE, "acceleration isn't constant");
+  Expect(std::abs(Primitives.GetDistanceShare(0, false, false, 0.5f) - 0.5f) < CHECKS_TIME_TOLERANCE, "step from standing to standing isn't symmetric");
+  Expect(std::abs(Primitives.GetDistanceShare(0, false, false, 0.75f) - 0.875f) < CHECKS_TIME_TOLERANCE, "braking isn't constant");
+  Expect(std::abs(Primitives.GetDistanceShare(0, false, true, 2.f / 3) - 0.5f) < CHECKS_TIME_TOLERANCE, "cruise doesn't start after the acceleration");
+
+  float PrevShare = 0;
+  bool bMonotonic = true;
+  for (int Sample = 1; Sample <= 100; ++Sample)
+  {
+    const float Share = Primitives.GetDistanceShare(1, false, false, Sample / 100.f);
+    bMonotonic &= Share >= PrevShare;
+    PrevShare = Share;
+  }
+  Expect(bMonotonic && std::abs(PrevShare - 1.f) < CHECKS_TIME_TOLERANCE, "diagonal step doesn't move forward to its end");
+
+  for (int Heading = 0; Heading < KINODYNAMIC_HEADINGS_NUM; ++Heading)
+  {
+    const KinodynamicPrimitives::Step& Step = Primitives.GetStep(Heading, false, false);
+    bool bOrdered = Step.Touched.size() >= 2 && Step.Touched[0].Delta == FPoint(0, 0) && Step.Touched[1].Delta == GetHeadingDelta(Heading)
+      && Step.Touched[0].Start == 0 && std::abs(Step.Touched[1].End - 1.f) < CHECKS_TIME_TOLERANCE;
+    for (const KinodynamicPrimitives::TouchedCell& Touched : Step.Touched)
+    {
+      bOrdered &= Touched.Start >= 0 && Touched.Start <= Touched.End && Touched.End <= 1.f + CHECKS_TIME_TOLERANCE;
+    }
+    Expect(bOrdered, "touched cells of the heading " + std::to_string(Heading) + " are out of the step");
+  }
+
+  Model.Acceleration = 0;
+  Expect(std::abs(KinodynamicPrimitives(Model).GetStep(0, false, false).Duration - 1.f) < CHECKS_TIME_TOLERANCE, "speed doesn't change instantly without acceleration");
+}
+
+void PlannerChecks::CheckKinodynamicHeadings()
+{
+  const FPoint Origin = { 1, 1 };
+  const float Speed = 2.f;
+  std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+  const FShape Shape = MakePointShape();
+  std::shared_ptr<ShapeSpace> Shaped = std::make_shared<ShapeSpace>(CHECKS_DEPTH, Space, Shape);
+
+  FKinodynamicModel Model;
+  Model.bEnabled = true;
+  Model.TurnDuration = 0.5f;
+  for (bool bDiagonalHeadings : { true, false })
+  {
+    Model.bDiagonalHeadings = bDiagonalHeadings;
+    std::shared_ptr<const KinodynamicPrimitives> Primitives = std::make_shared<KinodynamicPrimitives>(Model);
+    KinodynamicMovesSegment Moves(Primitives, Speed, Shaped, CHECKS_DEPTH / 2);
+    const std::string ModelName = bDiagonalHeadings ? "8 headings" : "4 headings";
+
+    // A standing agent turns by one step of its model or steps along its heading
+    const Node<OrientedArea> Standing(OrientedArea(Area(Origin, { 0, CHECKS_DEPTH }), { 2, false }), 0);
+    SetType<int> TurnHeadings;
+    for (const MoveDelta<OrientedArea>& Move : Moves.FindValidMoves(Standing))
+    {
+      const OrientedArea& Destination = Move.Destination;
+      if (Destination.Point == Origin)
+      {
+        if (Move.MoveCost > 0)
+        {
+          TurnHeadings.insert(Destination.Heading);
+          Expect(!Destination.bMoving && std::abs(Move.MoveCost - Primitives->GetTurnDuration() / Speed) < CHECKS_TIME_TOLERANCE,
+            ModelName + ": turn doesn't take the turn duration of the model");
+        }
+        continue;
+      }
+
+      Expect(Destination.Point == Origin + GetHeadingDelta(2) && Destination.Heading == 2,
+        ModelName + ": standing agent steps not along its heading");
+      Expect(std::abs(Move.MoveCost - Primitives->GetStep(2, false, Destination.bMoving).Duration / Speed) < CHECKS_TIME_TOLERANCE,
+        ModelName + ": step doesn't take the duration of its profile");
+    }
+    const int TurnStep = Primitives->GetTurnStep();
+    Expect(TurnHeadings == SetType<int>({ 2 + TurnStep, 2 - TurnStep }), ModelName + ": standing agent turns by other angles than one turn");
+
+    // A moving agent steps on along its heading at once
+    const uint8 MovingHeading = bDiagonalHeadings ? 1 : 0;
+    const Node<OrientedArea> Moving(OrientedArea(Area(Origin, { 0, CHECKS_DEPTH }), { MovingHeading, true }), 1.f);
+    const ArrayType<MoveDelta<OrientedArea>> MovingMoves = Moves.FindValidMoves(Moving);
+    Expect(MovingMoves.size() == 2, ModelName + ": moving agent has other moves than steps to the next cell");
+    for (const MoveDelta<OrientedArea>& Move : MovingMoves)
+    {
+      Expect(Move.Destination.Point == Origin + GetHeadingDelta(MovingHeading) && Move.Destination.Heading == MovingHeading && Move.WaitCost == 0,
+        ModelName + ": moving agent turns or waits");
+    }
+  }
+}
+
+void PlannerChecks::CheckDistanceTablesStaleness()
+{
+  // The goal table reaches only the first column
+  std::shared_ptr<RawSpace> Static = MakeWalledStatic();
+  const FShape Shape = MakePointShape();
+  const ArrayType<MoveDelta<FPoint>> Moves = MakeStraightMoves();
+
+  StaticDistanceTables Tables;
+  Tables.SetStaticSpace(Static);
+  Expect(Tables.Register({ FPoint(0, 0) }, Shape, Moves), "distance table is not registered");
+
+  Static->SetAccess({ 3, 3 }, Access::Inaccessable);
+  Tables.MarkStale({ 3, 3 });
+  Expect((bool) Tables.Find({ 0, 0 }, Shape, Moves, 1.f), "change out of the reach of the table makes it stale");
+
+  Static->SetAccess({ 1, 1 }, Access::Accessable);
+  Tables.MarkStale({ 1, 1 });
+  Expect(!Tables.Find({ 0, 0 }, Shape, Moves, 1.f), "change next to a reached cell doesn't make the table stale");
+
+  Tables.RebuildIfStale(true);
+  const std::shared_ptr<const DistanceTable> Rebuilt = Tables.Find({ 0, 0 }, Shape, Moves, 1.f);
+  Expect(Rebuilt && std::abs(Rebuilt->GetDistance({ 2, 1 }) - 3.f) < CHECKS_TIME_TOLERANCE, "rebuilt table doesn't pass the opened cell");
+}
+
+void PlannerChecks::CheckGoalAssignmentStaleness()
+{
+  std::shared_ptr<RawSpace> Static = MakeWalledStatic();
+  const FShape Shape = MakePointShape();
+
+  GoalAssignment Assignment;
+  Assignment.SetStaticSpace(Static, nullptr);
+  Assignment.AddAgent(0, { 0, 0 }, Shape, MakeStraightMoves(), 1.f);
+  Assignment.AddTarget({ 3, 3 });
+
+  ArrayType<GoalAssignmentResult> Assignments;
+  Assignment.Solve(true, Assignments);
+  Expect(Assignments.empty() && Assignment.GetAgentsNum() == 1 && Assignment.GetTargetsNum() == 1, "goal behind the wall is assigned");
+
+  // The table of the target is kept, it is found again only because the opened cell is next to a reached one
+  Static->SetAccess({ 1, 0 }, Access::Accessable);
+  Assignment.MarkStale({ 1, 0 });
+  Assignment.Solve(true, Assignments);
+  Expect(Assignments.size() == 1 && std::abs(Assignments[0].Cost - 6.f) < CHECKS_TIME_TOLERANCE, "goal isn't assigned through the opened cell");
+  Expect(!Assignment.GetAgentsNum() && !Assignment.GetTargetsNum(), "assigned agent or goal stays pending");
+}
+
+void PlannerChecks::CheckPathReplicationRoundTrip()
+{
+  PathBuffer Paths;
+  PathReplicationEncoder Encoder;
+  PathReplicationDecoder Decoder;
+  Encoder.AddAgent(0, MakeStraightMoves());
+
+  const auto ExpectReplicated = [this, &Paths, &Decoder](const std::string& PathName) {
+    std::vector<PathBufferNode> Published;
+    Paths.Read(Paths.GetHandle(0), Published);
+    const std::vector<PathBufferNode>* Decoded = Decoder.FindPath(0);
+    bool bEqual = Decoded && Decoded->size() == Published.size() && Decoder.GetVersion(0) == Paths.GetHandle(0).Version;
+    for (size_t NodeIndex = 0; bEqual && NodeIndex < Published.size(); ++NodeIndex)
+    {
+      bEqual = (*Decoded)[NodeIndex].Point == Published[NodeIndex].Point
+        && std::abs((*Decoded)[NodeIndex].Time - Published[NodeIndex].Time) <= PATH_REPLICATION_TIME_QUANTUM
+        && std::abs((*Decoded)[NodeIndex].MoveDuration - Published[NodeIndex].MoveDuration) <= PATH_REPLICATION_TIME_QUANTUM;
+    }
+    Expect(bEqual, PathName + " is decoded with other nodes than published");
+  };
+
+  std::vector<uint8_t> Data;
+  Paths.Publish(0, MakeRowPath(CHECKS_MAP_SIZE, 0, 0.5f));
+  Encoder.Encode(Paths, SIZE_MAX, Data);
+  Expect(Decoder.Decode(Data.data(), Data.size()), "first path is not decoded");
+  ExpectReplicated("first path");
+
+  // The replan keeps the nodes after the start of the previous path
+  std::vector<Node<Area>> Replanned = MakeRowPath(CHECKS_MAP_SIZE, 0, 0.5f);
+  Replanned.pop_back();
+  Replanned.insert(Replanned.begin(), Node<Area>(Area({ CHECKS_MAP_SIZE - 1, 1 }, { 0, CHECKS_DEPTH }), Replanned.front().MinTime + 1.f, -1.f, 1.f));
+  Paths.Publish(0, Replanned);
+  Data.clear();
+  Encoder.Encode(Paths, SIZE_MAX, Data);
+  const std::vector<uint8_t> DeltaRecord = Data;
+
+  // A cut record is not applied at all
+  bool bTruncatedRejected = true;
+  for (size_t Cut = 1; Cut < DeltaRecord.size(); ++Cut)
+  {
+    PathReplicationDecoder Truncated = Decoder;
+    bTruncatedRejected &= !Truncated.Decode(DeltaRecord.data(), Cut) && Truncated.GetVersion(0) == Decoder.GetVersion(0);
+  }
+  Expect(bTruncatedRejected, "truncated path record is decoded");
+
+  Expect(Decoder.Decode(DeltaRecord.data(), DeltaRecord.size()), "path sharing nodes with the previous one is not decoded");
+  ExpectReplicated("path sharing nodes with the previous one");
+
+  // Path record dropping 2^64 - 1 nodes from the front and keeping 2 of them
+  const std::vector<uint8_t> HugeSkip = { 2, 0, 9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 2, 0 };
+  PathReplicationDecoder Malformed = Decoder;
+  Expect(!Malformed.Decode(HugeSkip.data(), HugeSkip.size()), "path record keeping nodes out of the previous path is decoded");
+
+  // Path record of an agent whose moves were never sent
+  const std::vector<uint8_t> UnknownAgent = { 2, 7, 1, 0, 0, 0 };
+  Expect(!Malformed.Decode(UnknownAgent.data(), UnknownAgent.size()), "path record of an unknown agent is decoded");
+
+  // Unknown record type
+  const std::vector<uint8_t> UnknownRecord = { 9, 0 };
+  Expect(!Malformed.Decode(UnknownRecord.data(), UnknownRecord.size()), "unknown record is decoded");
+  Expect(Malformed.GetVersion(0) == Decoder.GetVersion(0) && Malformed.FindPath(0) && Malformed.FindPath(0)->size() == Decoder.FindPath(0)->size(),
+    "broken records change the decoded path");
+}
+
+void PlannerChecks::CheckShardedReservations()
+{
+  // Shards of 2 x 2 tiles, the obstacle is written into the base space before the shard of its cell is copied
+  const FPoint Cell = { 1, 1 };
+  const ArrayType<Area> AgentAreas = { Area(Cell, { 15.f, 25.f }) };
+
+  // The obstacle is removed while the path stays
+  {
+    std::shared_ptr<SpaceTime> Base = MakeFreeSpace();
+    DynamicObstacleLayer Obstacles(Base);
+    ShardedSpace Shards(Base, CHECKS_MAP_SIZE, CHECKS_MAP_SIZE, 2, 1);
+    std::unordered_set<FPoint> ChangedPoints;
+    ArrayType<Area> ReleasedAreas, ReservedAreas;
+
+    const int ObstacleID = Obstacles.Add(MakeStandingObstacle(Cell, 10.f, 20.f));
+    Obstacles.Commit(ChangedPoints, ReleasedAreas, ReservedAreas);
+    Shards.ApplyObstacles(ReleasedAreas, ReservedAreas);
+
+    const std::shared_ptr<SpaceTime> Space = Shards.GetShardSpace(Shards.FindShard(Cell));
+    Shards.ReserveAreas(AgentAreas);
+
+    ReleasedAreas.clear();
+    ReservedAreas.clear();
+    Obstacles.Remove(ObstacleID);
+    Obstacles.Commit(ChangedPoints, ReleasedAreas, ReservedAreas);
+    Shards.ApplyObstacles(ReleasedAreas, ReservedAreas);
+    Expect(!IsFree(*Space, Cell, 17.f), "removed obstacle reopens a path reserved in a shard");
+    Expect(IsFree(*Space, Cell, 12.f), "removed obstacle stays in a shard outside of the path");
+  }
+
+  // The path is released while the obstacle stays
+  {
+    std::shared_ptr<SpaceTime> Base = MakeFreeSpace();
+    DynamicObstacleLayer Obstacles(Base);
+    ShardedSpace Shards(Base, CHECKS_MAP_SIZE, CHECKS_MAP_SIZE, 2, 1);
+    std::unordered_set<FPoint> ChangedPoints;
+    ArrayType<Area> ReleasedAreas, ReservedAreas;
+
+    Obstacles.Add(MakeStandingObstacle(Cell, 10.f, 20.f));
+    Obstacles.Commit(ChangedPoints, ReleasedAreas, ReservedAreas);
+    Shards.ApplyObstacles(ReleasedAreas, ReservedAreas);
+
+    Shards.ReserveAreas(AgentAreas);
+    Shards.ReleaseAreas(AgentAreas);
+    bool bObstacleKept = true;
+    bool bPathReleased = true;
+    for (int ShardIndex = 0; ShardIndex < Shards.GetShardsNum(); ++ShardIndex)
+    {
+      if (Shards.IsInRegion(ShardIndex, Cell))
+      {
+        const std::shared_ptr<SpaceTime> Space = Shards.GetShardSpace(ShardIndex);
+        bObstacleKept &= !IsFree(*Space, Cell, 17.f);
+        bPathReleased &= IsFree(*Space, Cell, 22.f);
+      }
+    }
+    Expect(bObstacleKept, "released path reopens an obstacle copied into a shard");
+    Expect(bPathReleased, "released path stays in a shard outside of the obstacle");
+  }
+}
+
+void PlannerChecks::CheckPathBufferSegmentReuse()
+{
+  PathBuffer Paths;
+  const std::vector<Node<Area>> LivePath = MakeRowPath(CHECKS_MAP_SIZE, 0, 0.5f);
+  Paths.Publish(0, LivePath);
+  const PathHandle LiveHandle = Paths.GetHandle(0);
+  std::vector<PathBufferNode> LiveNodes;
+  Expect(Paths.Read(LiveHandle, LiveNodes) && LiveNodes.size() == LivePath.size(), "published path is not read");
+
+  // Every path of a whole segment starts the next segment, so the segment of the live path is reused after all others
+  const std::vector<Node<Area>> SegmentPath = MakeRowPath(PATH_BUFFER_SEGMENT_SIZE, 0, 0);
+  Paths.Publish(1, SegmentPath);
+  const PathHandle ReplacedHandle = Paths.GetHandle(1);
+  for (int SegmentIndex = 2; SegmentIndex < PATH_BUFFER_MAX_SEGMENTS; ++SegmentIndex)
+  {
+    Paths.Publish(1, SegmentPath);
+  }
+  Expect(Paths.GetHandle(0).Version == LiveHandle.Version, "live path is moved before its segment is reused");
+
+  Paths.Publish(1, SegmentPath);
+  const PathHandle MovedHandle = Paths.GetHandle(0);
+  std::vector<PathBufferNode> MovedNodes;
+  Expect(MovedHandle.Version == LiveHandle.Version + 1 && MovedHandle.Offset != LiveHandle.Offset, "live path isn't moved out of the reused segment");
+  Expect(!Paths.Read(LiveHandle, LiveNodes) && LiveNodes.empty(), "handle of the reused segment is read");
+
+  bool bSameNodes = Paths.Read(MovedHandle, MovedNodes) && MovedNodes.size() == LivePath.size();
+  for (size_t NodeIndex = 0; bSameNodes && NodeIndex < MovedNodes.size(); ++NodeIndex)
+  {
+    const Node<Area>& PathNode = LivePath[LivePath.size() - NodeIndex - 1];
+    bSameNodes = MovedNodes[NodeIndex].Point == PathNode.Cell.Point && MovedNodes[NodeIndex].Time == PathNode.MinTime;
+  }
+  Expect(bSameNodes, "moved path is read with other nodes");
+
+  // The replaced path isn't moved, its segment is reused right after the moved path
+  std::vector<PathBufferNode> ReplacedNodes;
+  Expect(!Paths.Read(ReplacedHandle, ReplacedNodes), "replaced path is read from a reused segment");
+  Expect(Paths.Read(Paths.GetHandle(1), ReplacedNodes) && ReplacedNodes.size() == SegmentPath.size(), "path published into a reused segment is not read");
+
+  // The moved path counts as live in its new segment
+  for (int SegmentIndex = 0; SegmentIndex < PATH_BUFFER_MAX_SEGMENTS; ++SegmentIndex)
+  {
+    Paths.Publish(1, SegmentPath);
+  }
+  Expect(Paths.GetHandle(0).Version == MovedHandle.Version + 1 && Paths.Read(Paths.GetHandle(0), MovedNodes) && MovedNodes.size() == LivePath.size(),
+    "moved path is lost when its new segment is reused");
+
+  Expect(!Paths.Publish(2, MakeRowPath(PATH_BUFFER_SEGMENT_SIZE + 1, 0, 0)) && !Paths.GetHandle(2).Length, "path longer than a segment is published");
+}
+
+void PlannerChecks::CheckSegmentIntersectionKernel()
+{
+  std::mt19937 Random(CHECKS_RANDOM_SEED);
+  std::uniform_int_distribution<int> HalfSteps(0, 200);
+  std::uniform_real_distribution<float> Times(0.f, 100.f);
+
+  // Short segments stay apart, so holders keep most of them, long ones overlap many segments of the other holder.
+  // Halves of a second make touching and equal bounds likely, other bounds are arbitrary
+  const auto MakeHolder = [&Random, &HalfSteps, &Times](int SegmentsNum, float MaxLength) {
+    SegmentHolder Holder;
+    for (int SegmentIndex = 0; SegmentIndex < SegmentsNum; ++SegmentIndex)
+    {
+      const bool bHalfSteps = Random() % 2;
+      const float Start = bHalfSteps ? HalfSteps(Random) * 0.5f : Times(Random);
+      const float Length = bHalfSteps ? std::floor(Times(Random) * MaxLength / 50.f) * 0.5f : Times(Random) * MaxLength / 100.f;
+      Holder.AddSegment({ Start, Start + Length });
+    }
+    return Holder;
+  };
+
+  // Up to 39 segments of Other cover empty holders, a scalar tail alone and packs of four with every tail
+  int MismatchesNum = 0;
+  for (int Attempt = 0; Attempt < 2000; ++Attempt)
+  {
+    const SegmentHolder Holder = Random() % 2 ? MakeHolder((int) (Random() % 20), 3.f) : MakeHolder((int) (Random() % 6), 40.f);
+    const SegmentHolder Other = MakeHolder((int) (Random() % 40), 3.f);
+    const float Shift = Random() % 2 ? HalfSteps(Random) * 0.05f - 5.f : Times(Random) * 0.1f - 5.f;
+    const float Lowering = Random() % 3 ? 0.f : Times(Random) * 0.02f;
+
+    // Every pair of segments is intersected one by one
+    SegmentHolder Expected;
+    for (const Segment& HolderSegment : Holder)
+    {
+      for (const Segment& OtherSegment : Other)
+      {
+        const float Start = std::max(HolderSegment.Start, OtherSegment.Start - Shift);
+        const float End = std::min(HolderSegment.End, OtherSegment.End - Shift - Lowering);
+        if (Start <= End)
+        {
+          Expected.AddSegment({ Start, End });
+        }
+      }
+    }
+
+    SegmentHolder Intersected = Holder;
+    Intersected.IntersectWithLowered(Other, Shift, Lowering);
+    MismatchesNum += Intersected == Expected ? 0 : 1;
+  }
+  Expect(!MismatchesNum, "packed intersection of segments differs from the pairwise one in " + std::to_string(MismatchesNum) + " cases");
+}
+
+void PlannerChecks::CheckBidirectionalHeuristic()
+{
+  std::shared_ptr<RawSpace> Static = MakeMazeStatic();
+  std::shared_ptr<SpaceTime> Space = MakeSpace(*Static);
+  const FShape Shape = MakePointShape();
+  const ArrayType<MoveDelta<FPoint>> Moves = MakeEightConnectedMoves();
+  const FPoint Start(0, 0);
+  const FPoint Goal(CHECKS_MAZE_SIZE - 1, 0);
+  const std::shared_ptr<DistanceTable> ToGoal = DistanceTable::Build(*Static, Goal, Shape, Moves);
+
+  // Costs are bounded by the exact distances and don't drop by more than the move cost
+  // along any move, otherwise the window search, which never reopens nodes, may close them too early
+  using PlaneMovesType = StaticMovesTestSegment<EStaticMoveSet::EightConnected>;
+  std::shared_ptr<ShapeSpace> AgentSpace = std::make_shared<ShapeSpace>(std::numeric_limits<float>::infinity(), Space, Shape);
+  BidirectionalPathfinder<PlaneMovesType> Search(std::make_shared<PlaneMovesType>(Moves, AgentSpace, CHECKS_DEPTH), Goal, Start, 1.f);
+  Search.FindCost(Start);
+  Expect(Search.IsCostFound(Start) && std::abs(Search.GetCost(Start) - ToGoal->GetDistance(Start)) < CHECKS_TIME_TOLERANCE,
+    "bidirectional cost of the start differs from the distance");
+
+  int InadmissibleNum = 0;
+  int InconsistentNum = 0;
+  for (int X = 0; X < CHECKS_MAZE_SIZE; ++X)
+  {
+    for (int Y = 0; Y < CHECKS_MAZE_SIZE; ++Y)
+    {
+      const FPoint Cell(X, Y);
+      if (ToGoal->GetDistance(Cell) < 0 || !Search.IsCostFound(Cell))
+      {
+        continue;
+      }
+
+      const float Cost = Search.GetCost(Cell);
+      InadmissibleNum += Cost > ToGoal->GetDistance(Cell) + CHECKS_TIME_TOLERANCE;
+      for (const MoveDelta<FPoint>& Move : Moves)
+      {
+        // Diagonal moves pass both side cells
+        const FPoint Next = Cell + Move.Destination;
+        if (ToGoal->GetDistance(Next) < 0 || ToGoal->GetDistance({ Next.X, Y }) < 0 || ToGoal->GetDistance({ X, Next.Y }) < 0)
+        {
+          continue;
+        }
+        InconsistentNum += Cost > Move.MoveCost + Search.GetCost(Next) + CHECKS_TIME_TOLERANCE;
+      }
+    }
+  }
+  Expect(!InadmissibleNum, "bidirectional cost exceeds the distance in " + std::to_string(InadmissibleNum) + " cells");
+  Expect(!InconsistentNum, "bidirectional cost drops by more than the move cost along " + std::to_string(InconsistentNum) + " moves");
+
+  // Windows end as far along the shortest path as the ones of the search from the goal
+  for (float Depth : { 4.f, CHECKS_DEPTH / 2 })
+  {
+    float Costs[2] = { -1.f, -1.f };
+    float Remaining[2] = { -1.f, -1.f };
+    for (int HeuristicIndex = 0; HeuristicIndex < 2; ++HeuristicIndex)
+    {
+      FReplanInput Input = MakeInput(Start, Goal, Moves, Depth);
+      Input.bBidirectionalHeuristic = HeuristicIndex == 1;
+
+      std::vector<Node<Area>> ReversedPath;
+      if (FindWindowPath(Input, Space, ReversedPath, false) && !ReversedPath.empty())
+      {
+        Costs[HeuristicIndex] = ReversedPath.front().MinTime;
+        Remaining[HeuristicIndex] = ToGoal->GetDistance(ReversedPath.front().Cell.Point);
+      }
+    }
+
+    const std::string WindowName = "window of depth " + std::to_string((int) Depth);
+    Expect(Costs[0] >= 0 && Costs[1] >= 0, WindowName + " is not found");
+    Expect(std::abs(Costs[0] - Costs[1]) < CHECKS_TIME_TOLERANCE && std::abs(Remaining[0] - Remaining[1]) < CHECKS_TIME_TOLERANCE,
+      WindowName + " of the bidirectional heuristic ends at " + std::to_string(Remaining[1]) + " from the goal instead of " + std::to_string(Remaining[0]));
+  }
+}
+
+void PlannerChecks::CheckPlannerStatsCapture()
+{
+  const int AgentID = 7;
+  PlannerCounters Counters;
+  PlannerCounters EmptyCounters;
+  ArrayType<TraceEvent> Events;
+  PlannerStats::SetTracing(true);
+  {
+    PlannerStatsCapture Capture(AgentID);
+    std::vector<Node<Area>> ReversedPath;
+    Expect(FindWindowPath(MakeInput({ 0, 0 }, { 3, 3 }, MakeStraightMoves()), MakeFreeSpace(), ReversedPath, false), "path on the free map is not found");
+    {
+      PLANNER_PHASE_SCOPE(EPlannerPhase::ReservationFill);
+    }
+    Capture.Finish(Counters, Events);
+    Capture.Finish(EmptyCounters, Events);
+  }
+  PlannerStats::SetTracing(false);
+
+  Expect(Counters.SearchSteps > 0 && Counters.NodesCreated > 0, "steps of the window search are not counted");
+  Expect(!EmptyCounters.SearchSteps && !EmptyCounters.PhaseCalls[(size_t) EPlannerPhase::ReservationFill], "counters are captured again after Finish");
+#if RTMAPF_STATS
+  Expect(Counters.PhaseCalls[(size_t) EPlannerPhase::SippExpansion] > 0, "expansions of the window search are not timed");
+  Expect(Events.size() == 1 && Events[0].Phase == EPlannerPhase::ReservationFill && Events[0].AgentID == AgentID,
+    "traced phase is not captured once for its agent");
+#endif
+
+  // Counters of removed agents stay only in the global ones
+  PlannerStatsCollector Collector;
+  Collector.Add(AgentID, Counters, Events);
+  Collector.Add(AgentID + 1, Counters, {});
+  Collector.AddGoalReached(AgentID + 1);
+  Collector.AddGoalReached(AgentID + 1);
+  Collector.AdvanceClock(60.);
+  Collector.RemoveAgent(AgentID);
+  Expect(Collector.GetGlobal().SearchSteps == 2 * Counters.SearchSteps, "global counters don't sum the ones of the agents");
+  Expect(!Collector.Find(AgentID) && Collector.Find(AgentID + 1) && Collector.Find(AgentID + 1)->GoalsReached == 2, "counters of agents aren't kept till removal");
+  Expect(std::abs(Collector.GetGoalsPerMinute() - 2.) < CHECKS_TIME_TOLERANCE, "goals per minute differ from the goals reached in a minute");
+  Expect(Collector.ToJson().find("\"" + std::to_string(AgentID) + "\":") == std::string::npos, "removed agent is exported");
+
+  Collector.Clear();
+  Expect(!Collector.Find(AgentID + 1) && !Collector.GetGlobal().GoalsReached && !Collector.GetGoalsPerMinute(), "cleared collector keeps counters");
+}
+
+void PlannerChecks::CheckTouchedSegmentsCache()
+{
+  // The per thread cache keeps segments of the unit cost, so moves to one destination may have other costs
+  int MismatchesNum = 0;
+  for (FPoint Destination : { FPoint(2, 1), FPoint(-3, 2), FPoint(7, -1) })
+  {
+    const std::unordered_map<FPoint, Segment> UnitSegments = ComputeUnitTouchedSegments(Destination);
+    for (float MoveCost : { 1.f, 2.5f, 0.5f })
+    {
+      const std::unordered_map<FPoint, Segment> Touched = GetTouchedSegments({ MoveCost, Destination });
+      MismatchesNum += Touched.size() != UnitSegments.size();
+      for (const auto& UnitSegment : UnitSegments)
+      {
+        const auto Found = Touched.find(UnitSegment.first);
+        MismatchesNum += Found == Touched.end()
+          || std::abs(Found->second.Start - UnitSegment.second.Start * MoveCost) > CHECKS_TIME_TOLERANCE
+          || std::abs(Found->second.End - UnitSegment.second.End * MoveCost) > CHECKS_TIME_TOLERANCE;
+      }
+    }
+  }
+  Expect(!MismatchesNum, "cached touched segments differ from the computed ones in " + std::to_string(MismatchesNum) + " cells");
+}
+
+void PlannerChecks::CheckBenchmarksRun()
+{
+  // A single iteration of every benchmark on the small map, so the suite keeps running after changes of the primitives
+  BenchmarkSettings Settings;
+  Settings.MinTime = 0;
+  Settings.ReservationsNum = CHECKS_MAZE_SIZE * 2;
+  Settings.MaxReservationLength = 1.f;
+  Settings.Depth = CHECKS_DEPTH;
+
+  PlannerBenchmarks Benchmarks(*MakeMazeStatic(), Settings);
+  Benchmarks.RunAll();
+
+  const std::string Json = Benchmarks.ToJson();
+  const char* ExpectedNames[] = {
+    "SegmentHolder/AddSegment",
+    "SegmentHolder/RemoveSegment",
+    "SegmentHolder/Intersection",
+    "NodesBinaryHeap/Insert",
+    "NodesBinaryHeap/InsertPopMin",
+    "NodesBinaryHeap/InsertImproveTime",
+    "GetTouchedSegments/CacheHit",
+    "GetTouchedSegments/CacheMiss",
+    "ShapeSpace/UpdateShape",
+    "MovesTestSegment/FindValidMoves",
+    "StaticMovesTestSegment/FindValidMoves",
+    "StaticMovesTestSegment/FindValidMoves/Arena",
+    "FindWindowPath",
+    "FindWindowPath/Bidirectional",
+  };
+  for (const char* Name : ExpectedNames)
+  {
+    const BenchmarkResult* Found = nullptr;
+    for (const BenchmarkResult& Result : Benchmarks.GetResults())
+    {
+      Found = Result.Name == Name ? &Result : Found;
+    }
+    Expect(Found && Found->Iterations == 1 && Found->NanosecondsPerOp >= 0, std::string("benchmark ") + Name + " doesn't run once");
+    Expect(Json.find(std::string("\"") + Name + "\"") != std::string::npos, std::string("benchmark ") + Name + " is not reported");
+    if (Found && std::string(Name).find("FindWindowPath") == 0)
+    {
+      Expect(Found->WindowCost > 0, std::string("windows of ") + Name + " are not compared");
+    }
+  }
+}
+
+void PlannerChecks::CheckBatchedHeuristic()
+{
+  // Two equal plane searches from the goal are queried for the same cells in the same order,
+  // one cell at a time through SpaceAdapter and in batches of neighbors through StaticSpaceAdapter
+  using PlaneMovesType = StaticMovesTestSegment<EStaticMoveSet::EightConnected>;
+  using PlaneSearchType = Pathfinder<FPoint, PlaneMovesType, EuclideanHeuristic>;
+  const FPoint Start(0, 0);
+  const FPoint Goal(CHECKS_MAZE_SIZE - 1, 0);
+  std::shared_ptr<SpaceTime> Space = MakeSpace(*MakeMazeStatic());
+  std::shared_ptr<ShapeSpace> AgentSpace = std::make_shared<ShapeSpace>(std::numeric_limits<float>::infinity(), Space, MakePointShape());
+  std::shared_ptr<PlaneMovesType> Moves = std::make_shared<PlaneMovesType>(MakeEightConnectedMoves(), AgentSpace, CHECKS_DEPTH);
+
+  SpaceAdapter<FPoint, Area> SingleCells(std::make_shared<PlaneSearchType>(Moves, Goal, std::make_shared<EuclideanHeuristic>(Start)));
+  StaticSpaceAdapter<FPoint, Area, PlaneSearchType> Batches(std::make_shared<PlaneSearchType>(Moves, Goal, std::make_shared<EuclideanHeuristic>(Start)));
+
+  int MismatchesNum = 0;
+  int FoundNum = 0;
+  ArrayType<Area> Cells;
+  ArrayType<float> BatchCosts;
+  for (int X = 0; X < CHECKS_MAZE_SIZE; ++X)
+  {
+    for (int Y = 0; Y < CHECKS_MAZE_SIZE; ++Y)
+    {
+      // Blocked cells are queried as well, their costs are never found
+      Cells.clear();
+      for (int NeighborX = std::max(X - 1, 0); NeighborX <= std::min(X + 1, CHECKS_MAZE_SIZE - 1); ++NeighborX)
+      {
+        for (int NeighborY = std::max(Y - 1, 0); NeighborY <= std::min(Y + 1, CHECKS_MAZE_SIZE - 1); ++NeighborY)
+        {
+          Cells.push_back(Area(FPoint(NeighborX, NeighborY)));
+        }
+      }
+
+      BatchCosts.resize(Cells.size());
+      Batches.FindCosts(Cells.data(), Cells.size(), BatchCosts.data());
+      for (size_t CellIndex = 0; CellIndex < Cells.size(); ++CellIndex)
+      {
+        SingleCells.FindCost(Cells[CellIndex]);
+        const float Cost = SingleCells.IsCostFound(Cells[CellIndex]) ? SingleCells.GetCost(Cells[CellIndex]) : HEURISTIC_COST_NOT_FOUND;
+        MismatchesNum += std::abs(Cost - BatchCosts[CellIndex]) > CHECKS_TIME_TOLERANCE;
+        FoundNum += Cost >= 0;
+      }
+    }
+  }
+  Expect(FoundNum > 0 && FoundNum < CHECKS_MAZE_SIZE * CHECKS_MAZE_SIZE * 9, "queried cells are all found or none of them");
+  Expect(!MismatchesNum, "batched heuristic costs differ from the ones of single cells in " + std::to_string(MismatchesNum) + " queries");
+}
+
+void PlannerChecks::CheckPathExtension()
+{
+  const FPoint Goal(CHECKS_MAZE_SIZE - 1, CHECKS_MAZE_SIZE - 1);
+  const float Depth = 4.f;
+  std::shared_ptr<SpaceTime> Space = MakeSpace(*MakeStatic(CHECKS_MAZE_SIZE));
+  std::vector<Node<Area>> PreviousReversedPath;
+  Expect(FindWindowPath(MakeInput({ 0, 0 }, Goal, MakeEightConnectedMoves(), Depth), Space, PreviousReversedPath, false)
+    && PreviousReversedPath.size() > 3, "previous window is not found");
+  if (PreviousReversedPath.size() <= 3)
+  {
+    return;
+  }
+
+  // The next replan starts at the first node after the start of the previous path
+  const Node<Area>& Restart = PreviousReversedPath[PreviousReversedPath.size() - 2];
+  const Node<Area>& PreviousEnd = PreviousReversedPath.front();
+  FReplanInput Input = MakeInput(Restart.Cell.Point, Goal, MakeEightConnectedMoves(), Depth);
+  Input.Time = Restart.MinTime;
+
+  std::vector<Node<Area>> ReversedPath;
+  Expect(ExtendWindowPath(Input, Space, PreviousReversedPath, ReversedPath), "free previous path is not extended");
+
+  int ChangedNum = 0;
+  int BlockedNum = 0;
+  for (const Node<Area>& PreviousNode : PreviousReversedPath)
+  {
+    if (PreviousNode.MinTime < Input.Time + EPSILON)
+    {
+      continue;
+    }
+
+    bool bKept = false;
+    for (const Node<Area>& PathNode : ReversedPath)
+    {
+      bKept |= PathNode.Cell.Point == PreviousNode.Cell.Point && std::abs(PathNode.MinTime - PreviousNode.MinTime) < CHECKS_TIME_TOLERANCE;
+    }
+    ChangedNum += !bKept;
+  }
+  for (const Node<Area>& PathNode : ReversedPath)
+  {
+    BlockedNum += !IsFree(*Space, PathNode.Cell.Point, PathNode.MinTime);
+  }
+  Expect(!ChangedNum, std::to_string(ChangedNum) + " nodes of the previous path are changed by the extension");
+  Expect(!BlockedNum, std::to_string(BlockedNum) + " nodes of the extended path are reserved");
+  Expect(!ReversedPath.empty() && (ReversedPath.front().MinTime >= Input.Time + Depth - CHECKS_TIME_TOLERANCE || ReversedPath.front().Cell.Point == Goal),
+    "extended path doesn't reach the end of the new window");
+
+  // A previous path ending out of the new window or crossing a new reservation isn't kept
+  FReplanInput ShortInput = Input;
+  ShortInput.Depth = PreviousEnd.MinTime - Input.Time;
+  Expect(!ExtendWindowPath(ShortInput, Space, PreviousReversedPath, ReversedPath), "previous path ending at the new window end is extended");
+
+  const Node<Area>& Kept = PreviousReversedPath[1];
+  Space->MakeAreasInaccessable({ Area(Kept.Cell.Point, { Kept.MinTime - 0.1f, Kept.MinTime + 0.1f }) });
+  Expect(!ExtendWindowPath(Input, Space, PreviousReversedPath, ReversedPath), "previous path crossing a new reservation is extended");
+}
+
+void PlannerChecks::CheckWorkerContextReuse()
+{
+  // Replans of other agents in other spaces run on the same worker context in between
+  std::shared_ptr<SpaceTime> Space = MakeSpace(*MakeMazeStatic());
+  std::shared_ptr<SpaceTime> OtherSpace = MakeFreeSpace();
+  OtherSpace->MakeAreasInaccessable({ Area({ 2, 2 }, { 0.f, 5.f }) });
+  const FReplanInput Input = MakeInput({ 0, 0 }, { CHECKS_MAZE_SIZE - 1, 0 }, MakeStraightMoves());
+  FReplanInput OtherInput = MakeInput({ 1, 1 }, { 3, 3 }, MakeEightConnectedMoves());
+  OtherInput.bBidirectionalHeuristic = true;
+
+  // A new thread starts with a new context
+  std::vector<Node<Area>> FreshPath;
+  std::thread([&Input, &Space, &FreshPath]() { FindWindowPath(Input, Space, FreshPath, false); }).join();
+
+  std::vector<Node<Area>> FirstPath;
+  std::vector<Node<Area>> OtherPath;
+  std::vector<Node<Area>> ReusedPath;
+  FindWindowPath(Input, Space, FirstPath, false);
+  FindWindowPath(OtherInput, OtherSpace, OtherPath, false);
+  FindWindowPath(Input, Space, ReusedPath, false);
+
+  const auto IsSamePath = [](const std::vector<Node<Area>>& First, const std::vector<Node<Area>>& Second) {
+    bool bSame = First.size() == Second.size();
+    for (size_t NodeIndex = 0; bSame && NodeIndex < First.size(); ++NodeIndex)
+    {
+      bSame = First[NodeIndex].Cell.Point == Second[NodeIndex].Cell.Point
+        && std::abs(First[NodeIndex].MinTime - Second[NodeIndex].MinTime) < CHECKS_TIME_TOLERANCE;
+    }
+    return bSame;
+  };
+  Expect(!FreshPath.empty() && !OtherPath.empty(), "windows of the reused context are not found");
+  Expect(IsSamePath(FreshPath, FirstPath), "window of a reused context differs from the one of a new context");
+  Expect(IsSamePath(FreshPath, ReusedPath), "window differs after a replan in another space on the same context");
+}
+
+void PlannerChecks::CheckSearchArenaReuse()
+{
+  // Allocations take four blocks, the last one is larger than the default size
+  const size_t Sizes[] = { 24, 8, 40000, 3, 30000, 16, 50000, SEARCH_ARENA_BLOCK_SIZE * 2 };
+  const size_t Alignments[] = { 8, 4, 16, 1, 8, 16, 4, 8 };
+  const size_t AllocationsNum = sizeof(Sizes) / sizeof(Sizes[0]);
+
+  SearchArena Arena;
+  void* FirstPointers[AllocationsNum];
+  int MisalignedNum = 0;
+  for (size_t AllocationIndex = 0; AllocationIndex < AllocationsNum; ++AllocationIndex)
+  {
+    FirstPointers[AllocationIndex] = Arena.Allocate(Sizes[AllocationIndex], Alignments[AllocationIndex]);
+    MisalignedNum += reinterpret_cast<uintptr_t>(FirstPointers[AllocationIndex]) % Alignments[AllocationIndex] != 0;
+  }
+  Expect(!MisalignedNum, std::to_string(MisalignedNum) + " arena allocations are misaligned");
+  Expect(Arena.GetReservedBytes() >= SEARCH_ARENA_BLOCK_SIZE * 3, "arena blocks don't hold the allocations");
+
+  // The next search gets the same memory without new blocks
+  const size_t ReservedBytes = Arena.GetReservedBytes();
+  const SearchArenaCounters StartCounters = GetThreadArenaCounters();
+  Arena.Release();
+  int MovedNum = 0;
+  for (size_t AllocationIndex = 0; AllocationIndex < AllocationsNum; ++AllocationIndex)
+  {
+    MovedNum += Arena.Allocate(Sizes[AllocationIndex], Alignments[AllocationIndex]) != FirstPointers[AllocationIndex];
+  }
+  const SearchArenaCounters ReuseCounters = GetThreadArenaCounters() - StartCounters;
+  Expect(!MovedNum && !ReuseCounters.BlockAllocations && Arena.GetReservedBytes() == ReservedBytes,
+    "released arena allocates new memory for the same allocations");
+
+  // Temporary containers of a scope are rewound at its end
+  Arena.Release();
+  void* BeforeScope = Arena.Allocate(Sizes[0], Alignments[0]);
+  void* InScope = nullptr;
+  {
+    SearchArenaScope Scope(&Arena);
+    std::vector<int, ArenaAllocator<int>> Temporary{ ArenaAllocator<int>(&Arena) };
+    Temporary.resize(1000);
+    InScope = Temporary.data();
+  }
+  void* AfterScope = Arena.Allocate(sizeof(int) * 1000, alignof(int));
+  Expect(BeforeScope && AfterScope == InScope, "memory of a scope is not available after it");
+
+  // Containers of the arena don't allocate from the heap, their copies do
+  const SearchArenaCounters ContainerStart = GetThreadArenaCounters();
+  std::vector<int, ArenaAllocator<int>> Values{ ArenaAllocator<int>(&Arena) };
+  for (int Value = 0; Value < 1000; ++Value)
+  {
+    Values.push_back(Value);
+  }
+  const SearchArenaCounters ContainerCounters = GetThreadArenaCounters() - ContainerStart;
+  const SearchArenaCounters CopyStart = GetThreadArenaCounters();
+  const std::vector<int, ArenaAllocator<int>> Copy = Values;
+  const SearchArenaCounters CopyCounters = GetThreadArenaCounters() - CopyStart;
+  Expect(ContainerCounters.ArenaAllocations > 0 && !ContainerCounters.HeapAllocations, "container of the arena allocates from the heap");
+  Expect(!Copy.get_allocator().GetArena() && CopyCounters.HeapAllocations == 1, "copy of an arena container is not allocated from the heap");
+
+  // A repeated replan of a worker reuses the blocks of its arena
+  std::shared_ptr<SpaceTime> Space = MakeSpace(*MakeMazeStatic());
+  const FReplanInput Input = MakeInput({ 0, 0 }, { CHECKS_MAZE_SIZE - 1, 0 }, MakeEightConnectedMoves());
+  std::vector<Node<Area>> ReversedPath;
+  FindWindowPath(Input, Space, ReversedPath, false);
+  const SearchArenaCounters ReplanStart = GetThreadArenaCounters();
+  FindWindowPath(Input, Space, ReversedPath, false);
+  const SearchArenaCounters ReplanCounters = GetThreadArenaCounters() - ReplanStart;
+  Expect(ReplanCounters.ArenaAllocations > 0 && !ReplanCounters.BlockAllocations, "repeated replan allocates new arena blocks");
+}
+
+void PlannerChecks::CheckTileStreamingEviction()
+{
+  // Four tiles of the maze, only two of them fit into the space
+  const int TileSize = CHECKS_MAZE_SIZE / 2;
+  if (!WriteHogFile(*MakeMazeStatic(), CHECKS_STREAMED_FILE))
+  {
+    Expect(false, "cannot write the streamed map");
+    return;
+  }
+
+  std::shared_ptr<SpaceTime> Space = std::make_shared<SpaceTime>(CHECKS_DEPTH);
+  TileStreamer Streamer(Space);
+  Expect(Streamer.Open(CHECKS_STREAMED_FILE, TileSize, 2, 0), "cannot open the streamed map");
+
+  const FPoint PinnedCell = { 0, 0 };
+  const FPoint FirstCell = { TileSize + 1, 1 };
+  const FPoint SecondCell = { 1, TileSize + 1 };
+  const FPoint ThirdCell = { TileSize + 2, TileSize + 2 };
+  Streamer.OverrideCell({ 2, 2 }, true);
+  Streamer.OverrideCell({ 1, 1 }, false);
+
+  ArrayType<FPoint> ChangedPoints;
+  SetType<int> WaitingAgents;
+  Streamer.PinAgent(0, PinnedCell, {});
+  Expect(!Streamer.Demand(FirstCell) && !Streamer.Demand(SecondCell), "tiles are loaded before the commit");
+  Streamer.Commit(true, ChangedPoints, WaitingAgents);
+
+  // The least recently demanded tile is evicted, the pinned one is kept though it was demanded first
+  Expect(Streamer.GetLoadedTilesNum() == 2, "loaded tiles exceed the budget");
+  Expect(Streamer.IsTileLoaded(PinnedCell) && Streamer.IsTileLoaded(SecondCell) && !Streamer.IsTileLoaded(FirstCell),
+    "wrong tile is evicted");
+  Expect(IsFree(*Space, PinnedCell, 0) && IsFree(*Space, SecondCell, 0) && !IsFree(*Space, FirstCell, 0),
+    "cells of loaded and evicted tiles don't match them");
+  Expect(WaitingAgents.count(0) == 1, "agent of the loaded tile doesn't wait for a replan");
+
+  // Runtime changes are applied over the file
+  Expect(IsFree(*Space, { 2, 2 }, 0) && !IsFree(*Space, { 1, 1 }, 0), "cell overrides are not applied");
+
+  Streamer.Demand(ThirdCell);
+  Streamer.Commit(true, ChangedPoints, WaitingAgents);
+  Expect(Streamer.IsTileLoaded(PinnedCell) && Streamer.IsTileLoaded(ThirdCell) && !Streamer.IsTileLoaded(SecondCell),
+    "pinned tile is evicted or the least recently demanded one is kept");
+
+  // The unpinned tile goes first, the reloaded one is read again with its walls
+  Streamer.UnpinAgent(0);
+  Streamer.Demand(FirstCell);
+  Streamer.Commit(true, ChangedPoints, WaitingAgents);
+  Expect(!Streamer.IsTileLoaded(PinnedCell) && !IsFree(*Space, PinnedCell, 0), "unpinned tile is not evicted");
+  Expect(IsFree(*Space, FirstCell, 0) && !IsFree(*Space, { TileSize, 1 }, 0), "reloaded tile doesn't match the map");
+
+  // Overrides are applied to the reloaded tile again
+  Streamer.Demand(PinnedCell);
+  Streamer.Commit(true, ChangedPoints, WaitingAgents);
+  Expect(Streamer.GetLoadedTilesNum() == 2 && IsFree(*Space, PinnedCell, 0), "evicted tile is not reloaded");
+  Expect(IsFree(*Space, { 2, 2 }, 0) && !IsFree(*Space, { 1, 1 }, 0), "cell overrides are lost by the reload");
+
+  std::remove(CHECKS_STREAMED_FILE);
+}
+
+void PlannerChecks::CheckNextGoalsContinuation()
+{
+  // Goals at three corners of the free map are reached one by one along its sides
+  std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+  const int Last = CHECKS_MAP_SIZE - 1;
+  FReplanInput Input = MakeInput({ 0, 0 }, { Last, 0 }, MakeStraightMoves(), 4.f * Last);
+  Input.NextGoals = { FPoint(Last, Last), FPoint(0, Last) };
+  Input.NextDistances.resize(Input.NextGoals.size());
+
+  // Returns the first arrival at the point or a negative time if it is not passed
+  auto FindArrival = [](const std::vector<Node<Area>>& ReversedPath, FPoint Point)
+  {
+    for (auto NodeIt = ReversedPath.rbegin(); NodeIt != ReversedPath.rend(); ++NodeIt)
+    {
+      if (NodeIt->Cell.Point == Point)
+      {
+        return NodeIt->MinTime;
+      }
+    }
+    return -1.f;
+  };
+
+  std::vector<Node<Area>> ReversedPath;
+  Expect(FindWindowPath(Input, Space, ReversedPath, false), "path to the first goal is not found");
+  const float GoalArrival = FindArrival(ReversedPath, Input.Goal);
+  Expect(ContinueToNextGoals(Input, Space, ReversedPath) == 2, "early reached goals are not passed");
+  Expect(!ReversedPath.empty() && ReversedPath.front().Cell.Point == Input.NextGoals.back(), "path doesn't end at the last goal");
+  Expect(std::abs(FindArrival(ReversedPath, Input.Goal) - GoalArrival) < CHECKS_TIME_TOLERANCE, "path to the first goal is changed");
+  Expect(std::abs(FindArrival(ReversedPath, Input.NextGoals[0]) - 2.f * Last) < CHECKS_TIME_TOLERANCE
+    && std::abs(FindArrival(ReversedPath, Input.NextGoals[1]) - 3.f * Last) < CHECKS_TIME_TOLERANCE,
+    "next goals are not reached by the shortest paths");
+
+  int UnorderedNum = 0;
+  for (size_t NodeIndex = 0; NodeIndex + 1 < ReversedPath.size(); ++NodeIndex)
+  {
+    UnorderedNum += ReversedPath[NodeIndex].MinTime < ReversedPath[NodeIndex + 1].MinTime;
+  }
+  Expect(!UnorderedNum && ReversedPath.front().MinTime <= Input.Time + Input.Depth + CHECKS_TIME_TOLERANCE,
+    "continued path goes back in time or out of the window");
+
+  // The window ends on the way to the second goal
+  Input.Depth = 1.5f * Last;
+  ReversedPath.clear();
+  FindWindowPath(Input, Space, ReversedPath, false);
+  Expect(ContinueToNextGoals(Input, Space, ReversedPath) == 1 && !(ReversedPath.front().Cell.Point == Input.NextGoals[0]),
+    "goal out of the window is passed");
+
+  // Nothing is continued if the window ends before the first goal
+  Input.Depth = Last - 1.f;
+  ReversedPath.clear();
+  FindWindowPath(Input, Space, ReversedPath, false);
+  const std::vector<Node<Area>> WindowPath = ReversedPath;
+  Expect(!ContinueToNextGoals(Input, Space, ReversedPath) && ReversedPath.size() == WindowPath.size(), "path that doesn't reach the goal is continued");
+}
+
+void PlannerChecks::CheckShortcutReservations()
+{
+  // The path goes around the cells between its ends through the first row
+  const int Last = CHECKS_MAP_SIZE - 1;
+  const FReplanInput Input = MakeInput({ 0, 1 }, { Last, 1 }, MakeStraightMoves());
+  auto MakeDetourPath = [Last]()
+  {
+    std::vector<Node<Area>> ReversedPath = { Node<Area>(Area({ Last, 1 }, { 0, CHECKS_DEPTH }), Last + 2.f, -1.f, 1.f) };
+    for (int X = Last; X >= 0; --X)
+    {
+      ReversedPath.emplace_back(Area({ X, 0 }, { 0, CHECKS_DEPTH }), X + 1.f, -1.f, 1.f);
+    }
+    ReversedPath.emplace_back(Area({ 0, 1 }, { 0, CHECKS_DEPTH }), 0.f);
+    return ReversedPath;
+  };
+
+  // Samples positions of the point agent between the nodes, waits happen at the start of moves
+  auto CountBlockedSamples = [](const std::vector<Node<Area>>& ReversedPath, const SegmentSpace& Space)
+  {
+    int BlockedNum = 0;
+    for (size_t NodeIndex = 0; NodeIndex + 1 < ReversedPath.size(); ++NodeIndex)
+    {
+      const Node<Area>& To = ReversedPath[NodeIndex];
+      const Node<Area>& From = ReversedPath[NodeIndex + 1];
+      const float Departure = To.MinTime - To.ArrivalCost;
+      for (float Time = From.MinTime + 0.013f; Time < To.MinTime; Time += 0.05f)
+      {
+        const float Progress = Time < Departure ? 0.f : (Time - Departure) / To.ArrivalCost;
+        const FPoint Cell = {
+          (int) std::lround(From.Cell.Point.X + (To.Cell.Point.X - From.Cell.Point.X) * Progress),
+          (int) std::lround(From.Cell.Point.Y + (To.Cell.Point.Y - From.Cell.Point.Y) * Progress)
+        };
+        BlockedNum += !IsFree(Space, Cell, Time);
+      }
+    }
+    return BlockedNum;
+  };
+
+  // On the free map the detour becomes one straight move arriving at the same time
+  std::shared_ptr<SpaceTime> Space = MakeFreeSpace();
+  std::vector<Node<Area>> ReversedPath = MakeDetourPath();
+  const std::vector<Node<Area>> DetourPath = ReversedPath;
+  Expect(ShortcutWindowPath(Input, *Space, ReversedPath) == (int) DetourPath.size() - 2 && ReversedPath.size() == 2,
+    "free detour is not replaced by the straight move");
+  Expect(ReversedPath.front().Cell.Point == Input.Goal && std::abs(ReversedPath.front().MinTime - DetourPath.front().MinTime) < CHECKS_TIME_TOLERANCE
+    && std::abs(ReversedPath.front().ArrivalCost - Last) < CHECKS_TIME_TOLERANCE, "shortcut doesn't arrive at the goal in time");
+
+  // Goals stay in the path
+  FReplanInput GoalsInput = Input;
+  GoalsInput.NextGoals = { FPoint(2, 0) };
+  ReversedPath = MakeDetourPath();
+  ShortcutWindowPath(GoalsInput, *Space, ReversedPath);
+  Expect(std::any_of(ReversedPath.begin(), ReversedPath.end(), [](const Node<Area>& PathNode) {
+    return PathNode.Cell.Point == FPoint(2, 0) && std::abs(PathNode.MinTime - 3.f) < CHECKS_TIME_TOLERANCE;
+  }), "next goal is skipped by a shortcut");
+
+  // Reserved cells between the ends are not crossed, the free row is still shortened
+  Space->MakeAreasInaccessable({ Area({ 1, 1 }, { 0.f, CHECKS_DEPTH }), Area({ 2, 1 }, { 0.f, CHECKS_DEPTH }) });
+  ReversedPath = MakeDetourPath();
+  Expect(!CountBlockedSamples(ReversedPath, *Space), "detour crosses reservations");
+  const int RemovedNum = ShortcutWindowPath(Input, *Space, ReversedPath);
+  Expect(RemovedNum > 0 && ReversedPath.size() > 2, "free part of the detour is not shortened");
+  Expect(!CountBlockedSamples(ReversedPath, *Space), "shortcut crosses reservations");
+  Expect(ReversedPath.front().Cell.Point == Input.Goal && ReversedPath.back().Cell.Point == Input.Point
+    && std::abs(ReversedPath.front().MinTime - DetourPath.front().MinTime) < CHECKS_TIME_TOLERANCE, "ends of the shortened path are changed");
+}
+
+void PlannerChecks::RunAll()
+{
+  Failures.clear();
+  ExpectationsNum = 0;
+
+  CheckOverlappingReservations();
+  CheckObstacleMoments();
+  CheckObstaclesMovedToNewSpace();
+  CheckUnitMovesTable();
+  CheckArrivalCosts();
+  CheckKinodynamicProfile();
+  CheckKinodynamicHeadings();
+  CheckDistanceTablesStaleness();
+  CheckGoalAssignmentStaleness();
+  CheckPathReplicationRoundTrip();
+  CheckShardedReservations();
+  CheckPathBufferSegmentReuse();
+  CheckSegmentIntersectionKernel();
+  CheckBidirectionalHeuristic();
+  CheckPlannerStatsCapture();
+  CheckTouchedSegmentsCache();
+  CheckBenchmarksRun();
+  CheckBatchedHeuristic();
+  CheckPathExtension();
+  CheckWorkerContextReuse();
+  CheckSearchArenaReuse();
+  CheckTileStreamingEviction();
+  CheckNextGoalsContinuation();
+  CheckShortcutReservations();
+}
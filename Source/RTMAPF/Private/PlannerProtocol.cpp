@@ -0,0 +1,177 @@
+#include "PlannerProtocol.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+  struct UpdateTypeName
+  {
+    EPlannerUpdateType Type;
+    const char* Name;
+  };
+
+  const UpdateTypeName UpdateTypeNames[] = {
+    { EPlannerUpdateType::Path, "path" },
+    { EPlannerUpdateType::Failed, "failed" },
+    { EPlannerUpdateType::TickDone, "tick_done" },
+  };
+
+  const char* ToName(EPlannerUpdateType Type)
+  {
+    for (const UpdateTypeName& TypeName : UpdateTypeNames)
+    {
+      if (TypeName.Type == Type)
+      {
+        return TypeName.Name;
+      }
+    }
+
+    check(false);
+    return "";
+  }
+
+  bool FromName(const std::string& Name, EPlannerUpdateType& OutType)
+  {
+    for (const UpdateTypeName& TypeName : UpdateTypeNames)
+    {
+      if (Name == TypeName.Name)
+      {
+        OutType = TypeName.Type;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Ends of safe intervals are infinite, which can't be read by the stream operator
+  bool ReadFloat(std::istream& Stream, float& OutValue)
+  {
+    std::string Token;
+    if (!(Stream >> Token))
+    {
+      return false;
+    }
+
+    char* TokenEnd = nullptr;
+    OutValue = std::strtof(Token.c_str(), &TokenEnd);
+    return TokenEnd == Token.c_str() + Token.size();
+  }
+}
+
+void WritePlannerUpdate(std::ostream& Stream, const PlannerUpdate& Update)
+{
+  Stream << ToName(Update.Type);
+  switch (Update.Type)
+  {
+  case EPlannerUpdateType::Path:
+    Stream << ' ' << Update.AgentID << ' ' << Update.ReversedPath.size();
+    for (const Node<Area>& PathNode : Update.ReversedPath)
+    {
+      Stream << ' ' << PathNode.Cell.Point.X << ' ' << PathNode.Cell.Point.Y
+        << ' ' << PathNode.Cell.Interval.Start << ' ' << PathNode.Cell.Interval.End
+        << ' ' << PathNode.MinTime << ' ' << PathNode.ArrivalCost;
+    }
+    break;
+  case EPlannerUpdateType::Failed:
+    Stream << ' ' << Update.AgentID;
+    break;
+  case EPlannerUpdateType::TickDone:
+    Stream << ' ' << Update.Time;
+    break;
+  }
+  Stream << '\n';
+}
+
+bool ReadPlannerUpdate(std::istream& Stream, PlannerUpdate& OutUpdate)
+{
+  std::string TypeName;
+  if (!(Stream >> TypeName) || !FromName(TypeName, OutUpdate.Type))
+  {
+    return false;
+  }
+
+  int NodesNum = 0;
+  switch (OutUpdate.Type)
+  {
+  case EPlannerUpdateType::Path:
+    if (!(Stream >> OutUpdate.AgentID >> NodesNum) || NodesNum < 0)
+    {
+      return false;
+    }
+
+    OutUpdate.ReversedPath.clear();
+    OutUpdate.ReversedPath.reserve(NodesNum);
+    for (int NodeIndex = 0; NodeIndex < NodesNum; ++NodeIndex)
+    {
+      Node<Area> PathNode;
+      if (!(Stream >> PathNode.Cell.Point.X >> PathNode.Cell.Point.Y)
+        || !ReadFloat(Stream, PathNode.Cell.Interval.Start)
+        || !ReadFloat(Stream, PathNode.Cell.Interval.End)
+        || !ReadFloat(Stream, PathNode.MinTime)
+        || !ReadFloat(Stream, PathNode.ArrivalCost))
+      {
+        return false;
+      }
+      OutUpdate.ReversedPath.push_back(PathNode);
+    }
+    return true;
+  case EPlannerUpdateType::Failed:
+    return (bool) (Stream >> OutUpdate.AgentID);
+  case EPlannerUpdateType::TickDone:
+    return ReadFloat(Stream, OutUpdate.Time);
+  }
+
+  return false;
+}
+
+PlannerLineBuffer::PlannerLineBuffer(size_t InMaxLineLength)
+  : MaxLineLength(InMaxLineLength)
+{
+  check(MaxLineLength > 0);
+}
+
+bool PlannerLineBuffer::Append(const char* Data, size_t Size)
+{
+  // A peer that never ends its line can't grow the buffer without a limit
+  const char* const DataEnd = Data + Size;
+  size_t LineLength = PendingLineLength;
+  for (const char* LineBegin = Data; LineBegin < DataEnd;)
+  {
+    const char* LineEnd = (const char*) std::memchr(LineBegin, '\n', DataEnd - LineBegin);
+    LineLength += (LineEnd ? LineEnd : DataEnd) - LineBegin;
+    if (LineLength > MaxLineLength)
+    {
+      return false;
+    }
+
+    LineBegin = LineEnd ? LineEnd + 1 : DataEnd;
+    LineLength = LineEnd ? 0 : LineLength;
+  }
+  PendingLineLength = LineLength;
+
+  // Read lines are dropped before the buffer grows
+  if (LineStart > 0 && LineStart * 2 >= Received.size())
+  {
+    Received.erase(0, LineStart);
+    LineStart = 0;
+  }
+
+  Received.append(Data, Size);
+  return true;
+}
+
+bool PlannerLineBuffer::NextLine(std::string& OutLine)
+{
+  const size_t LineEnd = Received.find('\n', LineStart);
+  if (LineEnd == std::string::npos)
+  {
+    return false;
+  }
+
+  OutLine.assign(Received, LineStart, LineEnd - LineStart);
+  LineStart = LineEnd + 1;
+  return true;
+}
@@ -0,0 +1,636 @@
+#include "PlannerService.h"
+#include "Shapes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <unordered_set>
+
+PlannerService::PlannerService(std::shared_ptr<SpaceTime> InSpace, const PlannerServiceSettings& InSettings)
+  : Settings(InSettings)
+  , Space(InSpace)
+  , Shards(std::make_shared<ShardedSpace>(InSpace))
+  , Obstacles(InSpace)
+{
+  check(Space);
+  check(Settings.Horizon.MinDepth > 0 && Settings.Horizon.MinDepth <= Settings.Horizon.MaxDepth);
+  check(Settings.MaxReplansPerTick > 0);
+}
+
+bool PlannerService::Replan(FAdaptivePath& Path)
+{
+  // The input is captured now, so the replan doesn't depend on when the pool starts it
+  bool ReplanBegin = Path.Replan(Settings.Horizon, true);
+  check(ReplanBegin);
+  Path.WaitForReplan();
+  Path.CheckForUpdate();
+  return !Path.IsLastReplanFailed();
+}
+
+void PlannerService::AdvanceGoals(int ID, FAdaptivePath& Path)
+{
+  const FReplanInput& Properties = Path.GetProperties();
+  FPoint Goal = Properties.Goal;
+  FPoint LeftGoal = Goal;
+  size_t AdvancedGoals = 0;
+
+  // Goals passed since the previous Tick are left in their order
+  while ((Path.CheckGoalReached(Goal) || Path.IsGoalReached(Goal)) && AdvancedGoals < Properties.NextGoals.size())
+  {
+    LeftGoal = Goal;
+    Goal = Properties.NextGoals[AdvancedGoals++];
+  }
+
+  if (!AdvancedGoals)
+  {
+    return;
+  }
+
+  FReplanInput Advanced = Properties;
+  Advanced.Goal = Goal;
+  Advanced.NextGoals.erase(Advanced.NextGoals.begin(), Advanced.NextGoals.begin() + AdvancedGoals);
+  Path.SetProperties(Advanced);
+
+  // Windows passing through the goal already lead to the next ones, an agent waiting at the goal is replanned now
+  const std::vector<Node<Area>>& ReversedPath = Path.GetReversedPath();
+  if (ReversedPath.size() && ReversedPath.front().Cell.Point == LeftGoal)
+  {
+    Scheduler.Prioritize(ID, CurrentTime);
+  }
+}
+
+void PlannerService::CommitObstacles()
+{
+  if (!Obstacles.HasStagedChanges())
+  {
+    return;
+  }
+
+  std::unordered_set<FPoint> ChangedPoints;
+  Obstacles.Commit(ChangedPoints);
+
+  SetType<int> Impacted;
+  for (const FPoint& ChangedPoint : ChangedPoints)
+  {
+    ReservationAgents.FindAgents(ChangedPoint, Impacted);
+  }
+
+  for (int ImpactedID : Impacted)
+  {
+    Scheduler.Prioritize(ImpactedID, CurrentTime);
+  }
+}
+
+void PlannerService::PrioritizeNeighbours(int ID, float Deadline)
+{
+  SetType<int> Neighbours;
+  ReservationAgents.FindNeighbours(ID, Neighbours);
+  for (int NeighbourID : Neighbours)
+  {
+    Scheduler.Prioritize(NeighbourID, Deadline);
+  }
+}
+
+void PlannerService::RemoveAgent(int ID)
+{
+  auto Found = Agents.find(ID);
+  if (Found == Agents.end())
+  {
+    UE_LOG(LogTemp, Error, TEXT("Attempted to remove nonexisting agent"));
+    return;
+  }
+
+  PrioritizeNeighbours(ID, CurrentTime + Settings.ReservationChangeLatency);
+  ReservationAgents.Remove(ID);
+  Scheduler.Remove(ID);
+  PendingAgents.erase(std::remove(PendingAgents.begin(), PendingAgents.end(), ID), PendingAgents.end());
+  // Reservations of the path are released by the path
+  Agents.erase(Found);
+}
+
+void PlannerService::Tick(float Time, ArrayType<PlannerUpdate>& OutUpdates)
+{
+  // The clock follows the client, so times of the paths are the times of its agents
+  const float DeltaTime = std::max(0.f, Time - CurrentTime);
+  CurrentTime += DeltaTime;
+  for (auto& IDAndPath : Agents)
+  {
+    IDAndPath.second.MoveTimeBy(DeltaTime);
+    AdvanceGoals(IDAndPath.first, IDAndPath.second);
+  }
+  CommitObstacles();
+
+  ArrayType<int> PlannedAgents;
+  PlannedAgents.swap(PendingAgents);
+  for (int ID : PlannedAgents)
+  {
+    FAdaptivePath& Path = Agents.at(ID);
+    if (!Replan(Path))
+    {
+      UE_LOG(LogTemp, Error, TEXT("New agent with id = %d failed to enter planner service"), ID);
+      PlannerUpdate Update;
+      Update.Type = EPlannerUpdateType::Failed;
+      Update.AgentID = ID;
+      OutUpdates.push_back(std::move(Update));
+      Agents.erase(ID);
+      continue;
+    }
+
+    PlannerUpdate Update;
+    Update.Type = EPlannerUpdateType::Path;
+    Update.AgentID = ID;
+    Update.ReversedPath = Path.GetReversedPath();
+    OutUpdates.push_back(std::move(Update));
+
+    Scheduler.Schedule(ID, CurrentTime + Path.GetDepth() * Settings.WindowExpirationShare);
+    ReservationAgents.Update(ID, Path.GetFilledAreas());
+    // Agents near a new agent should react immediately
+    PrioritizeNeighbours(ID, CurrentTime);
+  }
+
+  for (int ReplansNum = 0; ReplansNum < Settings.MaxReplansPerTick && Scheduler.Size(); ++ReplansNum)
+  {
+    if (Scheduler.GetMostUrgent().Deadline > CurrentTime)
+    {
+      break;
+    }
+
+    const int ID = Scheduler.PopMostUrgent().AgentID;
+    FAdaptivePath& Path = Agents.at(ID);
+    if (Replan(Path))
+    {
+      PlannerUpdate Update;
+      Update.Type = EPlannerUpdateType::Path;
+      Update.AgentID = ID;
+      Update.ReversedPath = Path.GetReversedPath();
+      OutUpdates.push_back(std::move(Update));
+    }
+
+    // A failed agent keeps its path and tries again when its window expires
+    Scheduler.Schedule(ID, CurrentTime + Path.GetDepth() * Settings.WindowExpirationShare);
+    ReservationAgents.Update(ID, Path.GetFilledAreas());
+    PrioritizeNeighbours(ID, CurrentTime + Settings.ReservationChangeLatency);
+  }
+
+  PlannerUpdate Done;
+  Done.Type = EPlannerUpdateType::TickDone;
+  Done.Time = CurrentTime;
+  OutUpdates.push_back(std::move(Done));
+}
+
+void PlannerService::Handle(const SessionEvent& Event, ArrayType<PlannerUpdate>& OutUpdates)
+{
+  switch (Event.Type)
+  {
+  case ESessionEventType::Tick:
+    Tick(Event.Time + Event.Value, OutUpdates);
+    break;
+  case ESessionEventType::AddAgent:
+  {
+    if (Agents.count(Event.ID))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Agent with id = %d is already added to planner service"), Event.ID);
+      PlannerUpdate Update;
+      Update.Type = EPlannerUpdateType::Failed;
+      Update.AgentID = Event.ID;
+      OutUpdates.push_back(std::move(Update));
+      break;
+    }
+
+    FReplanInput Properties;
+    Properties.AgentID = Event.ID;
+    Properties.Point = Event.Point;
+    Properties.Goal = Event.Goal;
+    Properties.Speed = Event.Value;
+    Properties.Shape = Event.Shape;
+    for (const FPointMove& Move : Event.Moves)
+    {
+      Properties.Moves.push_back(Move.GetMoveDelta(Event.Value));
+    }
+
+    FAdaptivePath Path(Properties, Shards, Settings.Horizon.MaxDepth, CurrentTime);
+    Path.SetShortcuts(bShortcuts);
+    Path.SetBidirectionalHeuristic(bBidirectionalHeuristic);
+    Path.SetSearchShard(0);
+    Agents.emplace(Event.ID, std::move(Path));
+    PendingAgents.push_back(Event.ID);
+    break;
+  }
+  case ESessionEventType::RemoveAgent:
+    RemoveAgent(Event.ID);
+    break;
+  case ESessionEventType::ChangeGoal:
+  {
+    auto Found = Agents.find(Event.ID);
+    if (Found == Agents.end())
+    {
+      UE_LOG(LogTemp, Error, TEXT("Attempted to change goal of nonexisting agent"));
+      break;
+    }
+
+    // The client also reports the goals its agents leave, the service may have left them already
+    FReplanInput Properties = Found->second.GetProperties();
+    Properties.Goal = Event.Goal;
+    if (Properties.NextGoals.size() && Properties.NextGoals.front() == Event.Goal)
+    {
+      Properties.NextGoals.erase(Properties.NextGoals.begin());
+    }
+    Found->second.SetProperties(Properties);
+    // New agents are planned at the next Tick anyway
+    Scheduler.Prioritize(Event.ID, CurrentTime);
+    break;
+  }
+  case ESessionEventType::AddGoals:
+  {
+    auto Found = Agents.find(Event.ID);
+    if (Found == Agents.end())
+    {
+      UE_LOG(LogTemp, Error, TEXT("Attempted to add goals to nonexisting agent"));
+      break;
+    }
+
+    // An agent waiting at its goal leaves it at the next Tick
+    FReplanInput Properties = Found->second.GetProperties();
+    for (const FPoint& Goal : Event.Goals)
+    {
+      Properties.NextGoals.push_back(Goal);
+    }
+    Found->second.SetProperties(Properties);
+    break;
+  }
+  case ESessionEventType::ChangeSpace:
+  {
+    Space->SetAccess(Event.Point, Event.bFlag ? Access::Accessable : Access::Inaccessable, std::numeric_limits<float>::infinity());
+
+    SetType<int> Impacted;
+    ReservationAgents.FindAgents(Event.Point, Impacted);
+    for (int ImpactedID : Impacted)
+    {
+      Scheduler.Prioritize(ImpactedID, CurrentTime);
+    }
+    break;
+  }
+  case ESessionEventType::AddObstacle:
+    if (ObstacleIDs.count(Event.ID))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Obstacle with id = %d is already added to planner service"), Event.ID);
+      break;
+    }
+    ObstacleIDs[Event.ID] = Obstacles.Add(Event.Trajectory);
+    break;
+  case ESessionEventType::UpdateObstacle:
+  {
+    auto Found = ObstacleIDs.find(Event.ID);
+    if (Found == ObstacleIDs.end() || !Obstacles.Update(Found->second, Event.Trajectory))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Attempted to update nonexisting obstacle"));
+    }
+    break;
+  }
+  case ESessionEventType::RemoveObstacle:
+  {
+    auto Found = ObstacleIDs.find(Event.ID);
+    if (Found == ObstacleIDs.end())
+    {
+      UE_LOG(LogTemp, Error, TEXT("Attempted to remove nonexisting obstacle"));
+      break;
+    }
+    Obstacles.Remove(Found->second);
+    ObstacleIDs.erase(Found);
+    break;
+  }
+  case ESessionEventType::SetDepth:
+    check(Event.Value > 0);
+    Settings.Horizon.MaxDepth = Event.Value;
+    Settings.Horizon.MinDepth = std::min(Settings.Horizon.MinDepth, Event.Value);
+
+    // Windows that are longer than allowed now should be shortened soon
+    for (const auto& IDAndPath : Agents)
+    {
+      if (IDAndPath.second.GetDepth() > Event.Value)
+      {
+        Scheduler.Prioritize(IDAndPath.first, CurrentTime + Event.Value * Settings.WindowExpirationShare);
+      }
+    }
+    break;
+  case ESessionEventType::SetMinDepth:
+    check(Event.Value > 0);
+    Settings.Horizon.MinDepth = std::min(Event.Value, Settings.Horizon.MaxDepth);
+    break;
+  case ESessionEventType::SetPathShortcuts:
+    bShortcuts = Event.bFlag;
+    for (auto& IDAndPath : Agents)
+    {
+      IDAndPath.second.SetShortcuts(bShortcuts);
+    }
+    break;
+  case ESessionEventType::SetBidirectionalHeuristic:
+    bBidirectionalHeuristic = Event.bFlag;
+    for (auto& IDAndPath : Agents)
+    {
+      IDAndPath.second.SetBidirectionalHeuristic(bBidirectionalHeuristic);
+    }
+    break;
+  case ESessionEventType::SetConflictResolution:
+    // Failed agents keep their paths and try again when their windows expire
+    if (Event.bFlag)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("Planner service doesn't resolve conflicts by groups"));
+    }
+    break;
+  case ESessionEventType::SetSharding:
+    // The subsystem refuses sharding with a planner service, so only disabling is expected
+    if (Event.Sharding.TileSize > 0)
+    {
+      UE_LOG(LogTemp, Error, TEXT("Planner service can't be used with sharding"));
+    }
+    break;
+  default:
+    UE_LOG(LogTemp, Warning, TEXT("Event %d is not supported by planner service and is ignored"), (int) Event.Type);
+    break;
+  }
+}
+
+bool PlannerClient::Connect(const FString& SocketPath)
+{
+  QueuedEvents.clear();
+  ReceivedLines = PlannerLineBuffer();
+  return Socket.Connect(SocketPath);
+}
+
+void PlannerClient::Queue(const SessionEvent& Event)
+{
+  std::ostringstream Stream;
+  Stream.precision(std::numeric_limits<float>::max_digits10);
+  WriteSessionEvent(Stream, Event);
+  QueuedEvents += Stream.str();
+}
+
+bool PlannerClient::Flush()
+{
+  const bool bSent = Socket.Send(QueuedEvents);
+  QueuedEvents.clear();
+  return bSent;
+}
+
+bool PlannerClient::Receive(bool bUntilTickDone, ArrayType<PlannerUpdate>& OutUpdates)
+{
+  std::string Received;
+  bool bTickDone = false;
+  do
+  {
+    // Data that has already arrived is read without waiting
+    Received.clear();
+    if (!Socket.Receive(bUntilTickDone && !bTickDone ? -1 : 0, Received))
+    {
+      return false;
+    }
+    if (!ReceivedLines.Append(Received.data(), Received.size()))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Too long update is received from planner service"));
+      return false;
+    }
+
+    std::string Line;
+    while (ReceivedLines.NextLine(Line))
+    {
+      std::istringstream Stream(Line);
+      PlannerUpdate Update;
+      if (!ReadPlannerUpdate(Stream, Update))
+      {
+        UE_LOG(LogTemp, Error, TEXT("Broken update is received from planner service"));
+        return false;
+      }
+
+      bTickDone = bTickDone || Update.Type == EPlannerUpdateType::TickDone;
+      OutUpdates.push_back(std::move(Update));
+    }
+  } while (Received.size() || (bUntilTickDone && !bTickDone));
+
+  return true;
+}
+
+void PlannerClient::Disconnect()
+{
+  Socket.Close();
+  QueuedEvents.clear();
+}
+
+namespace
+{
+  // Returns false when the client disconnects
+  bool ServeClient(LocalSocket& Client, PlannerService& Service)
+  {
+    PlannerLineBuffer ReceivedLines;
+    std::string Received;
+    ArrayType<PlannerUpdate> Updates;
+    std::ostringstream Answer;
+    Answer.precision(std::numeric_limits<float>::max_digits10);
+
+    while (true)
+    {
+      Received.clear();
+      if (!Client.Receive(-1, Received))
+      {
+        return false;
+      }
+      if (!ReceivedLines.Append(Received.data(), Received.size()))
+      {
+        UE_LOG(LogTemp, Error, TEXT("Too long event is received by planner service"));
+        return false;
+      }
+
+      // Events received together are handled together and their updates are sent at once
+      std::string Line;
+      while (ReceivedLines.NextLine(Line))
+      {
+        std::istringstream Stream(Line);
+        SessionEvent Event;
+        if (!ReadSessionEvent(Stream, Event))
+        {
+          UE_LOG(LogTemp, Error, TEXT("Broken event is received by planner service"));
+          return false;
+        }
+        Service.Handle(Event, Updates);
+      }
+
+      if (Updates.size())
+      {
+        Answer.str(std::string());
+        for (const PlannerUpdate& Update : Updates)
+        {
+          WritePlannerUpdate(Answer, Update);
+        }
+        Updates.clear();
+
+        if (!Client.Send(Answer.str()))
+        {
+          return false;
+        }
+      }
+    }
+  }
+}
+
+bool ServePlanner(const RawSpace& Map, const FString& SocketPath, const PlannerServiceSettings& Settings, bool bOnce)
+{
+  LocalSocket Listener;
+  if (!Listener.Listen(SocketPath))
+  {
+    return false;
+  }
+
+  UE_LOG(LogTemp, Log, TEXT("Planner service is listening on %s"), *SocketPath);
+  do
+  {
+    std::unique_ptr<LocalSocket> Client = Listener.Accept(-1);
+    if (!Client)
+    {
+      continue;
+    }
+
+    // Every client starts with the static map
+    PlannerService Service(std::make_shared<SpaceTime>(std::numeric_limits<float>::infinity(), Map), Settings);
+    ServeClient(*Client, Service);
+    UE_LOG(LogTemp, Log, TEXT("Planner service client disconnected with %d agents at %f"), Service.GetAgentsNum(), Service.GetCurrentTime());
+  } while (!bOnce);
+
+  return true;
+}
+
+namespace
+{
+  bool IsShapeFree(const RawSpace& Map, FPoint Point, const FShape& Shape)
+  {
+    for (const FPoint& ShapePoint : Shape.Points)
+    {
+      const FPoint Cell = Point + ShapePoint;
+      if (!Map.Contains(Cell) || Map.GetAccess(Cell) != Access::Accessable)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+}
+
+bool RunPlannerLoadTest(const RawSpace& Map, const FString& SocketPath, const PlannerLoadTestSettings& Settings, ReplayReport& OutReport)
+{
+  check(Settings.AgentsNum >= 0 && Settings.AgentsPerTick > 0 && Settings.DeltaTime > 0);
+
+  // Agents of the default shape and moves of UAgent
+  const FShape Shape;
+  const TArray<FPointMove> Moves = {
+    FPointMove{ 1.f, {0, 1}},
+    FPointMove{ 1.f, {0, -1}},
+    FPointMove{ 1.f, {1, 0}},
+    FPointMove{ 1.f, {-1, 0}},
+    FPointMove{ std::sqrt(2.f), {1, 1}},
+    FPointMove{ std::sqrt(2.f), {-1, -1}},
+    FPointMove{ std::sqrt(2.f), {1, -1}},
+    FPointMove{ std::sqrt(2.f), {-1, 1}},
+  };
+
+  ArrayType<FPoint> FreePoints;
+  for (int X = 0; X < (int) Map.GetWidth(); ++X)
+  {
+    for (int Y = 0; Y < (int) Map.GetHeight(); ++Y)
+    {
+      if (IsShapeFree(Map, { X, Y }, Shape))
+      {
+        FreePoints.push_back({ X, Y });
+      }
+    }
+  }
+
+  if ((int) FreePoints.size() < Settings.AgentsNum)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Map has only %d free cells for %d agents"), (int) FreePoints.size(), Settings.AgentsNum);
+    return false;
+  }
+
+  std::mt19937 Random(Settings.Seed);
+  std::shuffle(FreePoints.begin(), FreePoints.end(), Random);
+  std::uniform_int_distribution<size_t> PointDistribution(0, FreePoints.size() - 1);
+
+  PlannerClient Client;
+  if (!Client.Connect(SocketPath))
+  {
+    return false;
+  }
+
+  float CurrentTime = 0;
+  int AddedNum = 0;
+  int PathsNum = 0;
+  SetType<int> FailedAgents;
+  ArrayType<PlannerUpdate> Updates;
+  for (int TickIndex = 0; TickIndex < Settings.TicksNum; ++TickIndex)
+  {
+    const std::chrono::steady_clock::time_point TickStart = std::chrono::steady_clock::now();
+
+    // Starts are distinct cells, so new agents don't overlap
+    for (int BatchIndex = 0; BatchIndex < Settings.AgentsPerTick && AddedNum < Settings.AgentsNum; ++BatchIndex, ++AddedNum)
+    {
+      SessionEvent Event;
+      Event.Type = ESessionEventType::AddAgent;
+      Event.Time = CurrentTime;
+      Event.ID = AddedNum;
+      Event.Point = FreePoints[AddedNum];
+      Event.Goal = FreePoints[PointDistribution(Random)];
+      Event.Value = 1.f;
+      Event.Shape = Shape;
+      Event.Moves = Moves;
+      Client.Queue(Event);
+    }
+
+    for (int ChangeIndex = 0; ChangeIndex < Settings.GoalChangesPerTick && AddedNum > 0; ++ChangeIndex)
+    {
+      SessionEvent Event;
+      Event.Type = ESessionEventType::ChangeGoal;
+      Event.Time = CurrentTime;
+      Event.ID = std::uniform_int_distribution<int>(0, AddedNum - 1)(Random);
+      if (FailedAgents.count(Event.ID))
+      {
+        continue;
+      }
+      Event.Goal = FreePoints[PointDistribution(Random)];
+      Client.Queue(Event);
+    }
+
+    SessionEvent TickEvent;
+    TickEvent.Type = ESessionEventType::Tick;
+    TickEvent.Time = CurrentTime;
+    TickEvent.Value = Settings.DeltaTime;
+    Client.Queue(TickEvent);
+    CurrentTime += Settings.DeltaTime;
+
+    Updates.clear();
+    if (!Client.Flush() || !Client.Receive(true, Updates))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Planner service disconnected at tick %d"), TickIndex);
+      return false;
+    }
+
+    const std::chrono::duration<double, std::milli> TickLatency = std::chrono::steady_clock::now() - TickStart;
+    OutReport.AddTick(CurrentTime, TickLatency.count());
+
+    for (const PlannerUpdate& Update : Updates)
+    {
+      PathsNum += Update.Type == EPlannerUpdateType::Path ? 1 : 0;
+      if (Update.Type == EPlannerUpdateType::Failed)
+      {
+        FailedAgents.insert(Update.AgentID);
+      }
+    }
+  }
+
+  Client.Disconnect();
+
+  UE_LOG(LogTemp, Log, TEXT("Planner load test: %d agents, %d ticks, %d paths, %d failed agents, p50 = %f ms, p95 = %f ms"),
+    AddedNum, Settings.TicksNum, PathsNum, (int) FailedAgents.size(), OutReport.GetPercentile(50), OutReport.GetPercentile(95));
+  return true;
+}
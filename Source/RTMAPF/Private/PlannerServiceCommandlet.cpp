@@ -0,0 +1,51 @@
+#include "PlannerServiceCommandlet.h"
+#include "MAPFHelpers.h"
+
+UPlannerServiceCommandlet::UPlannerServiceCommandlet()
+{
+  IsClient = false;
+  IsServer = false;
+  IsEditor = false;
+  LogToConsole = true;
+}
+
+int32 UPlannerServiceCommandlet::Main(const FString& Params)
+{
+  FString MapFileName;
+  FString SocketPath;
+  if (!FParse::Value(*Params, TEXT("map="), MapFileName) || !FParse::Value(*Params, TEXT("socket="), SocketPath))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Planner service needs -map= and -socket="));
+    return 1;
+  }
+
+  if (FParse::Param(*Params, TEXT("stubclient")))
+  {
+    FString ReportFileName;
+    int32 AgentsNum = 100;
+    int32 TicksNum = 600;
+    int32 Seed = 42;
+    if (!FParse::Value(*Params, TEXT("report="), ReportFileName))
+    {
+      UE_LOG(LogTemp, Error, TEXT("Stub client needs -report="));
+      return 1;
+    }
+    FParse::Value(*Params, TEXT("agents="), AgentsNum);
+    FParse::Value(*Params, TEXT("ticks="), TicksNum);
+    FParse::Value(*Params, TEXT("seed="), Seed);
+
+    return UAnalyticsBlueprintLibrary::RunPlannerServiceLoadTest(MapFileName, SocketPath, ReportFileName, AgentsNum, TicksNum, Seed) ? 0 : 1;
+  }
+
+  float Depth = 30.f;
+  int32 MaxReplansPerTick = 64;
+  FParse::Value(*Params, TEXT("depth="), Depth);
+  FParse::Value(*Params, TEXT("replans="), MaxReplansPerTick);
+  if (Depth <= 0 || MaxReplansPerTick < 1)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Invalid planner service settings: depth = %f, replans = %d"), Depth, MaxReplansPerTick);
+    return 1;
+  }
+
+  return UAnalyticsBlueprintLibrary::RunPlannerService(MapFileName, SocketPath, Depth, MaxReplansPerTick, FParse::Param(*Params, TEXT("once"))) ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+#include "PlannerStats.h"
+
+#include <functional>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+  struct ThreadStats
+  {
+    PlannerCounters Counters;
+    ArrayType<TraceEvent> Events;
+    int AgentID = -1;
+    uint32_t ThreadID = (uint32_t) std::hash<std::thread::id>()(std::this_thread::get_id());
+  };
+
+  thread_local ThreadStats CurrentThreadStats;
+
+  std::atomic<bool> bTracingEnabled(false);
+
+  std::chrono::steady_clock::time_point GetEpoch()
+  {
+    static const std::chrono::steady_clock::time_point Epoch = std::chrono::steady_clock::now();
+    return Epoch;
+  }
+
+  bool IsTraceable(EPlannerPhase Phase)
+  {
+    // Fine grained phases are called too often to be traced
+    return Phase == EPlannerPhase::ReservationClear
+      || Phase == EPlannerPhase::ReservationFill
+      || Phase == EPlannerPhase::ReplanTask;
+  }
+
+  void WriteCounters(std::ostringstream& Stream, const PlannerCounters& Counters)
+  {
+    Stream << "{\"phases\":{";
+    for (size_t PhaseIndex = 0; PhaseIndex < PlannerCounters::PhasesNum; ++PhaseIndex)
+    {
+      Stream << (PhaseIndex ? "," : "")
+        << "\"" << GetPhaseName((EPlannerPhase) PhaseIndex) << "\":{"
+        << "\"time\":" << Counters.PhaseTime[PhaseIndex] << ","
+        << "\"calls\":" << Counters.PhaseCalls[PhaseIndex] << "}";
+    }
+    Stream << "},"
+      << "\"searchSteps\":" << Counters.SearchSteps << ","
+      << "\"nodesCreated\":" << Counters.NodesCreated << ","
+      << "\"successes\":" << Counters.Successes << ","
+      << "\"failures\":" << Counters.Failures << ","
+      << "\"pathReuses\":" << Counters.PathReuses << ","
+      << "\"shortcutNodes\":" << Counters.ShortcutNodes << ","
+      << "\"queueWait\":" << Counters.QueueWait << ","
+      << "\"queueWaits\":" << Counters.QueueWaits << ","
+      << "\"goalsReached\":" << Counters.GoalsReached << "}";
+  }
+}
+
+const char* GetPhaseName(EPlannerPhase Phase)
+{
+  switch (Phase)
+  {
+  case EPlannerPhase::HeuristicSearch: return "HeuristicSearch";
+  case EPlannerPhase::SippExpansion: return "SippExpansion";
+  case EPlannerPhase::TouchedSegments: return "TouchedSegments";
+  case EPlannerPhase::UpdateShape: return "UpdateShape";
+  case EPlannerPhase::ReservationClear: return "ReservationClear";
+  case EPlannerPhase::ReservationFill: return "ReservationFill";
+  case EPlannerPhase::ReplanTask: return "ReplanTask";
+  default: return "Unknown";
+  }
+}
+
+PlannerCounters& PlannerCounters::operator+=(const PlannerCounters& Other)
+{
+  for (size_t PhaseIndex = 0; PhaseIndex < PhasesNum; ++PhaseIndex)
+  {
+    PhaseTime[PhaseIndex] += Other.PhaseTime[PhaseIndex];
+    PhaseCalls[PhaseIndex] += Other.PhaseCalls[PhaseIndex];
+  }
+
+  SearchSteps += Other.SearchSteps;
+  NodesCreated += Other.NodesCreated;
+  Successes += Other.Successes;
+  Failures += Other.Failures;
+  PathReuses += Other.PathReuses;
+  ShortcutNodes += Other.ShortcutNodes;
+  QueueWait += Other.QueueWait;
+  QueueWaits += Other.QueueWaits;
+  GoalsReached += Other.GoalsReached;
+
+  return *this;
+}
+
+PlannerCounters PlannerCounters::operator-(const PlannerCounters& Other) const
+{
+  PlannerCounters Result = *this;
+  for (size_t PhaseIndex = 0; PhaseIndex < PhasesNum; ++PhaseIndex)
+  {
+    Result.PhaseTime[PhaseIndex] -= Other.PhaseTime[PhaseIndex];
+    Result.PhaseCalls[PhaseIndex] -= Other.PhaseCalls[PhaseIndex];
+  }
+
+  Result.SearchSteps -= Other.SearchSteps;
+  Result.NodesCreated -= Other.NodesCreated;
+  Result.Successes -= Other.Successes;
+  Result.Failures -= Other.Failures;
+  Result.PathReuses -= Other.PathReuses;
+  Result.ShortcutNodes -= Other.ShortcutNodes;
+  Result.QueueWait -= Other.QueueWait;
+  Result.QueueWaits -= Other.QueueWaits;
+  Result.GoalsReached -= Other.GoalsReached;
+
+  return Result;
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(EPlannerPhase InPhase)
+  : Phase(InPhase)
+  , TimerStart(std::chrono::steady_clock::now())
+{ }
+
+ScopedPhaseTimer::~ScopedPhaseTimer()
+{
+  const std::chrono::steady_clock::time_point TimerEnd = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> Duration = TimerEnd - TimerStart;
+
+  ThreadStats& Stats = CurrentThreadStats;
+  Stats.Counters.PhaseTime[(size_t) Phase] += Duration.count();
+  Stats.Counters.PhaseCalls[(size_t) Phase]++;
+
+  if (IsTraceable(Phase) && PlannerStats::IsTracing())
+  {
+    const std::chrono::duration<double, std::micro> Start = TimerStart - GetEpoch();
+    Stats.Events.push_back({ Phase, Stats.AgentID, Stats.ThreadID, Start.count(), Duration.count() * 1e6 });
+  }
+}
+
+PlannerStatsCapture::PlannerStatsCapture(int AgentID)
+  : StartCounters(CurrentThreadStats.Counters)
+  , StartEvent(CurrentThreadStats.Events.size())
+  , PreviousAgentID(CurrentThreadStats.AgentID)
+{
+  CurrentThreadStats.AgentID = AgentID;
+}
+
+PlannerStatsCapture::~PlannerStatsCapture()
+{
+  CurrentThreadStats.AgentID = PreviousAgentID;
+}
+
+void PlannerStatsCapture::Finish(PlannerCounters& OutCounters, ArrayType<TraceEvent>& OutEvents)
+{
+  ThreadStats& Stats = CurrentThreadStats;
+  OutCounters = Stats.Counters - StartCounters;
+  StartCounters = Stats.Counters;
+
+  if (StartEvent < Stats.Events.size())
+  {
+    OutEvents.insert(OutEvents.end(), Stats.Events.begin() + StartEvent, Stats.Events.end());
+    Stats.Events.resize(StartEvent);
+  }
+}
+
+void PlannerStats::AddSearch(uint64_t Steps, uint64_t NodesCreated)
+{
+  CurrentThreadStats.Counters.SearchSteps += Steps;
+  CurrentThreadStats.Counters.NodesCreated += NodesCreated;
+}
+
+void PlannerStats::SetTracing(bool bEnable)
+{
+  bTracingEnabled = bEnable;
+}
+
+bool PlannerStats::IsTracing()
+{
+  return bTracingEnabled.load(std::memory_order_relaxed);
+}
+
+void PlannerStatsCollector::Add(int AgentID, const PlannerCounters& Counters, const ArrayType<TraceEvent>& NewEvents)
+{
+  Global += Counters;
+  PerAgent[AgentID] += Counters;
+
+  for (const TraceEvent& Event : NewEvents)
+  {
+    if (Events.size() >= PLANNER_MAX_TRACE_EVENTS)
+    {
+      ++DroppedEvents;
+      continue;
+    }
+    Events.push_back(Event);
+  }
+}
+
+void PlannerStatsCollector::AddQueueWait(int AgentID, double Wait)
+{
+  PlannerCounters Counters;
+  Counters.QueueWait = Wait;
+  Counters.QueueWaits = 1;
+
+  Global += Counters;
+  PerAgent[AgentID] += Counters;
+}
+
+void PlannerStatsCollector::AddGoalReached(int AgentID)
+{
+  ++Global.GoalsReached;
+  ++PerAgent[AgentID].GoalsReached;
+}
+
+void PlannerStatsCollector::AdvanceClock(double DeltaTime)
+{
+  ClockTime += DeltaTime;
+}
+
+double PlannerStatsCollector::GetGoalsPerMinute() const
+{
+  return ClockTime > 0 ? Global.GoalsReached * 60. / ClockTime : 0;
+}
+
+const PlannerCounters* PlannerStatsCollector::Find(int AgentID) const
+{
+  auto Found = PerAgent.find(AgentID);
+  return (Found == PerAgent.end()) ? nullptr : &Found->second;
+}
+
+void PlannerStatsCollector::RemoveAgent(int AgentID)
+{
+  PerAgent.erase(AgentID);
+}
+
+std::string PlannerStatsCollector::ToJson() const
+{
+  std::ostringstream Stream;
+  Stream << "{\"global\":";
+  WriteCounters(Stream, Global);
+
+  Stream << ",\"agents\":{";
+  bool bFirst = true;
+  for (const auto& IDAndCounters : PerAgent)
+  {
+    Stream << (bFirst ? "" : ",") << "\"" << IDAndCounters.first << "\":";
+    WriteCounters(Stream, IDAndCounters.second);
+    bFirst = false;
+  }
+
+  Stream << "},\"clockTime\":" << ClockTime
+    << ",\"goalsPerMinute\":" << GetGoalsPerMinute()
+    << ",\"droppedEvents\":" << DroppedEvents << "}";
+  return Stream.str();
+}
+
+std::string PlannerStatsCollector::ToChromeTrace() const
+{
+  std::ostringstream Stream;
+  Stream << "{\"traceEvents\":[";
+  for (size_t EventIndex = 0; EventIndex < Events.size(); ++EventIndex)
+  {
+    const TraceEvent& Event = Events[EventIndex];
+    Stream << (EventIndex ? "," : "")
+      << "{\"name\":\"" << GetPhaseName(Event.Phase) << "\","
+      << "\"ph\":\"X\",\"pid\":0,"
+      << "\"tid\":" << Event.ThreadID << ","
+      << "\"ts\":" << Event.Start << ","
+      << "\"dur\":" << Event.Duration << ","
+      << "\"args\":{\"agent\":" << Event.AgentID << "}}";
+  }
+  Stream << "],\"displayTimeUnit\":\"ms\"}";
+  return Stream.str();
+}
+
+void PlannerStatsCollector::Clear()
+{
+  Global = PlannerCounters();
+  PerAgent.clear();
+  Events.clear();
+  DroppedEvents = 0;
+  ClockTime = 0;
+}
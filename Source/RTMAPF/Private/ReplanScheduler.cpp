@@ -0,0 +1,231 @@
+#include "ReplanScheduler.h"
+
+#include <utility>
+
+ReplanScheduler::ReplanScheduler()
+  : Requests{ ReplanRequest{ -1, 0.f } }
+{ }
+
+bool ReplanScheduler::Compare(size_t First, size_t Second) const
+{
+  return Requests[First].Deadline > Requests[Second].Deadline;
+}
+
+void ReplanScheduler::Swap(size_t First, size_t Second)
+{
+  std::swap(Requests[First], Requests[Second]);
+  AgentToIndex[Requests[First].AgentID] = First;
+  AgentToIndex[Requests[Second].AgentID] = Second;
+}
+
+void ReplanScheduler::MoveUp(size_t Index)
+{
+  for (size_t ParentIndex = (Index >> 1);
+    ParentIndex && Compare(ParentIndex, Index);
+    Index >>= 1, ParentIndex >>= 1)
+  {
+    Swap(ParentIndex, Index);
+  }
+}
+
+void ReplanScheduler::MoveDown(size_t Index)
+{
+  for (size_t MinChildIndex = Index << 1; MinChildIndex < Requests.size(); MinChildIndex = Index << 1)
+  {
+    if (MinChildIndex + 1 < Requests.size() && Compare(MinChildIndex, MinChildIndex + 1))
+    {
+      ++MinChildIndex;
+    }
+
+    if (!Compare(Index, MinChildIndex))
+    {
+      return;
+    }
+
+    Swap(Index, MinChildIndex);
+    Index = MinChildIndex;
+  }
+}
+
+void ReplanScheduler::RemoveAt(size_t Index)
+{
+  AgentToIndex.erase(Requests[Index].AgentID);
+
+  const size_t LastIndex = Requests.size() - 1;
+  if (Index != LastIndex)
+  {
+    Requests[Index] = Requests[LastIndex];
+    AgentToIndex[Requests[Index].AgentID] = Index;
+  }
+  Requests.pop_back();
+
+  if (Index < Requests.size())
+  {
+    MoveUp(Index);
+    MoveDown(Index);
+  }
+}
+
+void ReplanScheduler::Schedule(int AgentID, float Deadline)
+{
+  auto Found = AgentToIndex.find(AgentID);
+  if (Found != AgentToIndex.end())
+  {
+    const size_t Index = Found->second;
+    Requests[Index].Deadline = Deadline;
+    MoveUp(Index);
+    MoveDown(Index);
+    return;
+  }
+
+  const size_t Index = Requests.size();
+  Requests.push_back({ AgentID, Deadline });
+  AgentToIndex[AgentID] = Index;
+  MoveUp(Index);
+}
+
+bool ReplanScheduler::Prioritize(int AgentID, float Deadline)
+{
+  auto Found = AgentToIndex.find(AgentID);
+  if (Found == AgentToIndex.end())
+  {
+    return false;
+  }
+
+  const size_t Index = Found->second;
+  if (Requests[Index].Deadline > Deadline)
+  {
+    Requests[Index].Deadline = Deadline;
+    MoveUp(Index);
+  }
+
+  return true;
+}
+
+void ReplanScheduler::Remove(int AgentID)
+{
+  auto Found = AgentToIndex.find(AgentID);
+  if (Found != AgentToIndex.end())
+  {
+    RemoveAt(Found->second);
+  }
+}
+
+bool ReplanScheduler::Contains(int AgentID) const
+{
+  return AgentToIndex.count(AgentID) > 0;
+}
+
+const ReplanRequest& ReplanScheduler::GetMostUrgent() const
+{
+  assert(Size() > 0);
+  return Requests[1];
+}
+
+ReplanRequest ReplanScheduler::PopMostUrgent()
+{
+  assert(Size() > 0);
+  ReplanRequest Result = Requests[1];
+  RemoveAt(1);
+  return Result;
+}
+
+size_t ReplanScheduler::Size() const
+{
+  assert(Requests.size() >= 1);
+  return Requests.size() - 1;
+}
+
+void ReplanScheduler::Clear()
+{
+  Requests.resize(1);
+  AgentToIndex.clear();
+}
+
+void ShardedReplanScheduler::Schedule(int AgentID, int Shard, float Deadline)
+{
+  auto Found = AgentToShard.find(AgentID);
+  if (Found != AgentToShard.end() && Found->second != Shard)
+  {
+    Remove(AgentID);
+  }
+
+  ShardToScheduler[Shard].Schedule(AgentID, Deadline);
+  AgentToShard[AgentID] = Shard;
+}
+
+bool ShardedReplanScheduler::Prioritize(int AgentID, float Deadline)
+{
+  auto Found = AgentToShard.find(AgentID);
+  if (Found == AgentToShard.end())
+  {
+    return false;
+  }
+
+  return ShardToScheduler[Found->second].Prioritize(AgentID, Deadline);
+}
+
+void ShardedReplanScheduler::Remove(int AgentID)
+{
+  auto Found = AgentToShard.find(AgentID);
+  if (Found == AgentToShard.end())
+  {
+    return;
+  }
+
+  auto FoundScheduler = ShardToScheduler.find(Found->second);
+  FoundScheduler->second.Remove(AgentID);
+  if (!FoundScheduler->second.Size())
+  {
+    // Only shards with waiting agents are inspected by PopMostUrgent
+    ShardToScheduler.erase(FoundScheduler);
+  }
+  AgentToShard.erase(Found);
+}
+
+bool ShardedReplanScheduler::Contains(int AgentID) const
+{
+  return AgentToShard.count(AgentID) > 0;
+}
+
+bool ShardedReplanScheduler::PopMostUrgent(const std::function<bool(const ReplanRequest&)>& CanStart, ReplanRequest& OutRequest)
+{
+  int ChosenShard = -1;
+  for (const auto& ShardAndScheduler : ShardToScheduler)
+  {
+    const ReplanRequest& Request = ShardAndScheduler.second.GetMostUrgent();
+    if (ChosenShard >= 0)
+    {
+      const ReplanRequest& Chosen = ShardToScheduler.at(ChosenShard).GetMostUrgent();
+      if (Request.Deadline > Chosen.Deadline || (Request.Deadline == Chosen.Deadline && ShardAndScheduler.first > ChosenShard))
+      {
+        continue;
+      }
+    }
+
+    if (CanStart(Request))
+    {
+      ChosenShard = ShardAndScheduler.first;
+    }
+  }
+
+  if (ChosenShard < 0)
+  {
+    return false;
+  }
+
+  OutRequest = ShardToScheduler.at(ChosenShard).GetMostUrgent();
+  Remove(OutRequest.AgentID);
+  return true;
+}
+
+size_t ShardedReplanScheduler::Size() const
+{
+  return AgentToShard.size();
+}
+
+void ShardedReplanScheduler::Clear()
+{
+  ShardToScheduler.clear();
+  AgentToShard.clear();
+}
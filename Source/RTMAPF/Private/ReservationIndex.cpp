@@ -0,0 +1,98 @@
+#include "ReservationIndex.h"
+
+#include <cassert>
+#include <unordered_set>
+
+ReservationIndex::ReservationIndex(int InRegionSize)
+  : RegionSize(InRegionSize)
+{
+  assert(RegionSize > 0);
+}
+
+FPoint ReservationIndex::ToRegion(FPoint Point) const
+{
+  // Round towards negative infinity so that regions near zero have the same size
+  auto FloorDivide = [this](int Value) {
+    return (Value >= 0) ? (Value / RegionSize) : -((-Value + RegionSize - 1) / RegionSize);
+  };
+
+  return { FloorDivide(Point.X), FloorDivide(Point.Y) };
+}
+
+void ReservationIndex::Update(int AgentID, const ArrayType<Area>& Areas)
+{
+  Remove(AgentID);
+
+  std::unordered_set<FPoint> TouchedRegions;
+  for (const Area& ReservedArea : Areas)
+  {
+    TouchedRegions.insert(ToRegion(ReservedArea.Point));
+  }
+
+  ArrayType<FPoint>& Regions = AgentToRegions[AgentID];
+  Regions.reserve(TouchedRegions.size());
+  for (const FPoint& Region : TouchedRegions)
+  {
+    RegionToAgents[Region].insert(AgentID);
+    Regions.push_back(Region);
+  }
+}
+
+void ReservationIndex::Remove(int AgentID)
+{
+  auto Found = AgentToRegions.find(AgentID);
+  if (Found == AgentToRegions.end())
+  {
+    return;
+  }
+
+  for (const FPoint& Region : Found->second)
+  {
+    auto RegionAgents = RegionToAgents.find(Region);
+    assert(RegionAgents != RegionToAgents.end());
+
+    RegionAgents->second.erase(AgentID);
+    if (RegionAgents->second.empty())
+    {
+      RegionToAgents.erase(RegionAgents);
+    }
+  }
+
+  AgentToRegions.erase(Found);
+}
+
+void ReservationIndex::FindAgents(FPoint Point, SetType<int>& Agents) const
+{
+  auto RegionAgents = RegionToAgents.find(ToRegion(Point));
+  if (RegionAgents != RegionToAgents.end())
+  {
+    Agents.insert(RegionAgents->second.begin(), RegionAgents->second.end());
+  }
+}
+
+void ReservationIndex::FindNeighbours(int AgentID, SetType<int>& Agents) const
+{
+  auto Found = AgentToRegions.find(AgentID);
+  if (Found == AgentToRegions.end())
+  {
+    return;
+  }
+
+  for (const FPoint& Region : Found->second)
+  {
+    const SetType<int>& RegionAgents = RegionToAgents.at(Region);
+    for (int OtherID : RegionAgents)
+    {
+      if (OtherID != AgentID)
+      {
+        Agents.insert(OtherID);
+      }
+    }
+  }
+}
+
+void ReservationIndex::Clear()
+{
+  RegionToAgents.clear();
+  AgentToRegions.clear();
+}
@@ -0,0 +1,93 @@
+#include "SearchArena.h"
+
+#include <algorithm>
+#include <new>
+
+namespace
+{
+  thread_local SearchArenaCounters ThreadCounters;
+
+  size_t AlignUp(size_t Offset, size_t Alignment)
+  {
+    return (Offset + Alignment - 1) & ~(Alignment - 1);
+  }
+}
+
+SearchArenaCounters GetThreadArenaCounters()
+{
+  return ThreadCounters;
+}
+
+void* SearchArena::Allocate(size_t Size, size_t Alignment)
+{
+  ++ThreadCounters.ArenaAllocations;
+
+  if (BlockIndex < Blocks.size())
+  {
+    const size_t Aligned = AlignUp(Offset, Alignment);
+    if (Aligned + Size <= Blocks[BlockIndex].Size)
+    {
+      Offset = Aligned + Size;
+      return Blocks[BlockIndex].Data.get() + Aligned;
+    }
+  }
+
+  return AllocateInNextBlock(Size, Alignment);
+}
+
+void* SearchArena::AllocateInNextBlock(size_t Size, size_t Alignment)
+{
+  // Blocks left by the previous searches are reused if the allocation fits
+  size_t NextIndex = Blocks.empty() ? 0 : BlockIndex + 1;
+  while (NextIndex < Blocks.size() && Blocks[NextIndex].Size < Size + Alignment)
+  {
+    ++NextIndex;
+  }
+
+  if (NextIndex == Blocks.size())
+  {
+    ++ThreadCounters.BlockAllocations;
+    const size_t BlockSize = std::max<size_t>(SEARCH_ARENA_BLOCK_SIZE, Size + Alignment);
+    Blocks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[BlockSize]), BlockSize });
+  }
+
+  BlockIndex = NextIndex;
+  uint8_t* Data = Blocks[BlockIndex].Data.get();
+  const size_t Aligned = AlignUp(reinterpret_cast<uintptr_t>(Data), Alignment) - reinterpret_cast<uintptr_t>(Data);
+  Offset = Aligned + Size;
+  return Data + Aligned;
+}
+
+void SearchArena::Release()
+{
+  BlockIndex = 0;
+  Offset = 0;
+}
+
+void SearchArena::Rewind(Mark InMark)
+{
+  check(InMark.BlockIndex < BlockIndex || (InMark.BlockIndex == BlockIndex && InMark.Offset <= Offset));
+  BlockIndex = InMark.BlockIndex;
+  Offset = InMark.Offset;
+}
+
+size_t SearchArena::GetReservedBytes() const
+{
+  size_t Bytes = 0;
+  for (const Block& ArenaBlock : Blocks)
+  {
+    Bytes += ArenaBlock.Size;
+  }
+  return Bytes;
+}
+
+void* SearchArena::AllocateFromHeap(size_t Size)
+{
+  ++ThreadCounters.HeapAllocations;
+  return ::operator new(Size);
+}
+
+void SearchArena::FreeToHeap(void* Pointer)
+{
+  ::operator delete(Pointer);
+}
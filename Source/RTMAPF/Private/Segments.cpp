@@ -1,7 +1,9 @@
 #include "Segments.h"
+#include "Math/VectorRegister.h"
 
 #include <algorithm>
 #include <cassert>
+#include <iterator>
 
 Segment Segment::operator&(const Segment& Other) const
 {
@@ -69,139 +71,229 @@ Segment Segment::Invalid()
   return Segment{ 1, -1 }; 
 }
 
+size_t SegmentHolder::LowerBound(float Time) const
+{
+  return std::lower_bound(Ends.begin(), Ends.end(), Time) - Ends.begin();
+}
+
+size_t SegmentHolder::UpperBound(float Time) const
+{
+  return std::upper_bound(Ends.begin(), Ends.end(), Time) - Ends.begin();
+}
+
+void SegmentHolder::Append(float Start, float End)
+{
+  if (Ends.size() && Start <= Ends.back())
+  {
+    Starts.back() = std::min(Starts.back(), Start);
+    Ends.back() = std::max(Ends.back(), End);
+    return;
+  }
+
+  Starts.push_back(Start);
+  Ends.push_back(End);
+}
+
 bool SegmentHolder::Contains(Segment Other) const
 {
-  return (Segments.count(Other) > 0);
+  // Segments are equivalent if their ends are equal, as in the ordering of Segment
+  const size_t Index = LowerBound(Other.End);
+  return Index < Ends.size() && Ends[Index] == Other.End;
 }
 
 void SegmentHolder::AddSegment(Segment NewSegment)
 {
-  const_iterator UnionCandidate = Segments.lower_bound({ NewSegment.Start, NewSegment.Start });
-  while (UnionCandidate != Segments.end() && (NewSegment & *UnionCandidate).IsValid())
+  const size_t First = LowerBound(NewSegment.Start);
+  size_t Last = First;
+  while (Last < Ends.size() && (NewSegment & Segment{ Starts[Last], Ends[Last] }).IsValid())
   {
-    NewSegment = NewSegment | *UnionCandidate;
-    Segments.erase(UnionCandidate++);
+    NewSegment = NewSegment | Segment{ Starts[Last], Ends[Last] };
+    ++Last;
   }
 
-  Segments.insert(NewSegment);
+  if (Last == First)
+  {
+    Starts.insert(Starts.begin() + First, NewSegment.Start);
+    Ends.insert(Ends.begin() + First, NewSegment.End);
+    return;
+  }
+
+  // United segments are replaced with the first one
+  Starts[First] = NewSegment.Start;
+  Ends[First] = NewSegment.End;
+  Starts.erase(Starts.begin() + First + 1, Starts.begin() + Last);
+  Ends.erase(Ends.begin() + First + 1, Ends.begin() + Last);
 }
 
 void SegmentHolder::RemoveSegment(Segment removal)
 {
-  const_iterator RemovalCandidate = Segments.upper_bound({ removal.Start, removal.Start });
-  while (RemovalCandidate != Segments.end() && (removal & *RemovalCandidate).IsValid())
+  size_t Index = UpperBound(removal.Start);
+  while (Index < Ends.size() && (removal & Segment{ Starts[Index], Ends[Index] }).IsValid())
   {
-    auto Difference = (*RemovalCandidate) - removal;
-    Segments.erase(RemovalCandidate++);
-    for (auto& NewSegment : Difference)
+    const auto Difference = Segment{ Starts[Index], Ends[Index] } - removal;
+    Starts.erase(Starts.begin() + Index);
+    Ends.erase(Ends.begin() + Index);
+    for (const auto& NewSegment : Difference)
     {
-      Segments.insert(NewSegment);
+      Starts.insert(Starts.begin() + Index, NewSegment.Start);
+      Ends.insert(Ends.begin() + Index, NewSegment.End);
+      ++Index;
     }
   }
 }
 
 SegmentHolder::const_iterator SegmentHolder::begin() const
 {
-  return Segments.begin();
+  return const_iterator(this, 0);
 }
 
 SegmentHolder::const_iterator SegmentHolder::end() const
 {
-  return Segments.end();
+  return const_iterator(this, Ends.size());
 }
 
-SegmentHolder SegmentHolder::operator&(const SegmentHolder& Other) const
+void SegmentHolder::IntersectInto(const SegmentHolder& Other, float Shift, float Lowering, SegmentHolder& Out) const
 {
-  SegmentHolder newHolder;
-
-  const_iterator SelfSegment = begin();
-  if (SelfSegment == end())
+  const size_t OtherNum = Other.Ends.size();
+  const float* OtherStarts = Other.Starts.data();
+  const float* OtherEnds = Other.Ends.data();
+
+  Out.Starts.clear();
+  Out.Ends.clear();
+  Out.Starts.reserve(std::max(Ends.size(), OtherNum));
+  Out.Ends.reserve(std::max(Ends.size(), OtherNum));
+
+  const VectorRegister ShiftVector = VectorSetFloat1(Shift);
+  const VectorRegister LoweringVector = VectorSetFloat1(Lowering);
+  float IntersectionStarts[4];
+  float IntersectionEnds[4];
+
+  // First segment of Other that doesn't end before the current segment of this
+  size_t FirstOther = 0;
+  for (size_t Index = 0; Index < Ends.size(); ++Index)
   {
-    return newHolder;
-  }
-
-  const_iterator OtherSegment = Other.Segments.lower_bound({ SelfSegment->Start,  SelfSegment->Start });
-
-  while (OtherSegment != Other.end() && SelfSegment != end())
-  {
-    Segment NewSegment = *SelfSegment & *OtherSegment;
-
-    if (NewSegment.IsValid())
+    const float Start = Starts[Index];
+    const float End = Ends[Index];
+    while (FirstOther < OtherNum && OtherEnds[FirstOther] - Shift - Lowering < Start)
     {
-      newHolder.AddSegment(NewSegment);
+      ++FirstOther;
     }
 
-    if (OtherSegment->End > SelfSegment->End)
+    const VectorRegister StartVector = VectorSetFloat1(Start);
+    const VectorRegister EndVector = VectorSetFloat1(End);
+
+    // Four segments of Other are intersected at once. Segments starting after End
+    // give invalid intersections, as well as the ones that became invalid after lowering
+    size_t OtherIndex = FirstOther;
+    for (; OtherIndex + 4 <= OtherNum; OtherIndex += 4)
     {
-      SelfSegment++;
+      const VectorRegister ShiftedStarts = VectorSubtract(VectorLoad(OtherStarts + OtherIndex), ShiftVector);
+      const VectorRegister ShiftedEnds = VectorSubtract(VectorSubtract(VectorLoad(OtherEnds + OtherIndex), ShiftVector), LoweringVector);
+      const VectorRegister NewStarts = VectorMax(StartVector, ShiftedStarts);
+      const VectorRegister NewEnds = VectorMin(EndVector, ShiftedEnds);
+
+      const int ValidMask = VectorMaskBits(VectorCompareLE(NewStarts, NewEnds));
+      if (ValidMask)
+      {
+        VectorStore(NewStarts, IntersectionStarts);
+        VectorStore(NewEnds, IntersectionEnds);
+        for (int Lane = 0; Lane < 4; ++Lane)
+        {
+          if (ValidMask & (1 << Lane))
+          {
+            Out.Append(IntersectionStarts[Lane], IntersectionEnds[Lane]);
+          }
+        }
+      }
+
+      if (OtherStarts[OtherIndex + 3] - Shift > End)
+      {
+        OtherIndex = OtherNum;
+        break;
+      }
     }
-    else
+
+    for (; OtherIndex < OtherNum && OtherStarts[OtherIndex] - Shift <= End; ++OtherIndex)
     {
-      OtherSegment++;
+      const float NewStart = std::max(Start, OtherStarts[OtherIndex] - Shift);
+      const float NewEnd = std::min(End, OtherEnds[OtherIndex] - Shift - Lowering);
+      if (NewStart <= NewEnd)
+      {
+        Out.Append(NewStart, NewEnd);
+      }
     }
   }
+}
 
+SegmentHolder SegmentHolder::operator&(const SegmentHolder& Other) const
+{
+  SegmentHolder newHolder;
+  IntersectInto(Other, 0.f, 0.f, newHolder);
   return newHolder;
 }
 
+void SegmentHolder::IntersectWithLowered(const SegmentHolder& Other, float Shift, float Lowering)
+{
+  SegmentHolder newHolder;
+  IntersectInto(Other, Shift, Lowering, newHolder);
+  *this = std::move(newHolder);
+}
+
 bool SegmentHolder::operator==(const SegmentHolder& Other) const
 {
-  return Segments == Other.Segments;
+  return Starts == Other.Starts && Ends == Other.Ends;
 }
 
 SegmentHolder::SegmentHolder()
-  : Segments()
+  : Starts()
+  , Ends()
 {
 
 }
 
 SegmentHolder::SegmentHolder(Segment StartSegment)
-  : Segments({ StartSegment })
+  : Starts({ StartSegment.Start })
+  , Ends({ StartSegment.End })
 {
 
 }
 
 void SegmentHolder::LowerSegments(float DeltaTime)
 {
-  std::set<Segment> NewSegments;
-
-  for (const_iterator Iterator = begin(); Iterator != end(); ++Iterator)
+  size_t Kept = 0;
+  for (size_t Index = 0; Index < Ends.size(); ++Index)
   {
-    Segment NewSegment = *Iterator;
-    NewSegment.End -= DeltaTime;
-    if (NewSegment.IsValid())
+    const float NewEnd = Ends[Index] - DeltaTime;
+    if (Starts[Index] <= NewEnd)
     {
-      NewSegments.insert(NewSegment);
+      Starts[Kept] = Starts[Index];
+      Ends[Kept] = NewEnd;
+      ++Kept;
     }
   }
 
-  Segments = NewSegments;
+  Starts.resize(Kept);
+  Ends.resize(Kept);
 }
 
 
 void SegmentHolder::operator-=(float DeltaTime)
 {
-  std::set<Segment> NewSegments;
-
-  for (const_iterator Iterator = begin(); Iterator != end(); ++Iterator)
+  for (size_t Index = 0; Index < Ends.size(); ++Index)
   {
-    Segment NewSegment = *Iterator;
-    NewSegment.End -= DeltaTime;
-    NewSegment.Start -= DeltaTime;
-    NewSegments.insert(NewSegment);
+    Starts[Index] -= DeltaTime;
+    Ends[Index] -= DeltaTime;
   }
-
-  Segments = NewSegments;
 }
 
 Segment SegmentHolder::Find(float Time) const
 {
-  auto PossibleSegment = Segments.lower_bound({ Time,  Time });
+  const size_t Index = LowerBound(Time);
 
-  if (PossibleSegment == Segments.end())
+  if (Index == Ends.size())
   {
     return Segment::Invalid();
   }
 
-  return *PossibleSegment;
+  return { Starts[Index], Ends[Index] };
 }
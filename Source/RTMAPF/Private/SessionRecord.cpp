@@ -0,0 +1,431 @@
+#include "SessionRecord.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+  struct EventTypeName
+  {
+    ESessionEventType Type;
+    const char* Name;
+  };
+
+  const EventTypeName EventTypeNames[] = {
+    { ESessionEventType::Tick, "tick" },
+    { ESessionEventType::AddAgent, "add" },
+    { ESessionEventType::RemoveAgent, "remove" },
+    { ESessionEventType::ChangeGoal, "goal" },
+    { ESessionEventType::ChangeSpace, "space" },
+    { ESessionEventType::AddObstacle, "obstacle_add" },
+    { ESessionEventType::UpdateObstacle, "obstacle_update" },
+    { ESessionEventType::RemoveObstacle, "obstacle_remove" },
+    { ESessionEventType::SetDepth, "depth" },
+    { ESessionEventType::SetMinDepth, "min_depth" },
+    { ESessionEventType::SetConflictResolution, "resolution" },
+    { ESessionEventType::RegisterGoals, "goals" },
+    { ESessionEventType::SetSharding, "sharding" },
+    { ESessionEventType::AddGoals, "goal_queue" },
+    { ESessionEventType::SetPathShortcuts, "shortcuts" },
+    { ESessionEventType::SetBidirectionalHeuristic, "bidirectional" },
+  };
+
+  const char* ToName(ESessionEventType Type)
+  {
+    for (const EventTypeName& TypeName : EventTypeNames)
+    {
+      if (TypeName.Type == Type)
+      {
+        return TypeName.Name;
+      }
+    }
+
+    check(false);
+    return "";
+  }
+
+  bool FromName(const std::string& Name, ESessionEventType& OutType)
+  {
+    for (const EventTypeName& TypeName : EventTypeNames)
+    {
+      if (Name == TypeName.Name)
+      {
+        OutType = TypeName.Type;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void WritePoint(std::ostream& Stream, FPoint Point)
+  {
+    Stream << ' ' << Point.X << ' ' << Point.Y;
+  }
+
+  bool ReadPoint(std::istream& Stream, FPoint& OutPoint)
+  {
+    return (bool) (Stream >> OutPoint.X >> OutPoint.Y);
+  }
+
+  void WriteShape(std::ostream& Stream, const FShape& Shape)
+  {
+    Stream << ' ' << Shape.Points.Num();
+    for (const FPoint& ShapePoint : Shape.Points)
+    {
+      WritePoint(Stream, ShapePoint);
+    }
+  }
+
+  bool ReadShape(std::istream& Stream, FShape& OutShape)
+  {
+    int PointsNum = 0;
+    if (!(Stream >> PointsNum) || PointsNum < 0)
+    {
+      return false;
+    }
+
+    OutShape.Points.Empty();
+    for (int PointIndex = 0; PointIndex < PointsNum; ++PointIndex)
+    {
+      FPoint ShapePoint;
+      if (!ReadPoint(Stream, ShapePoint))
+      {
+        return false;
+      }
+      OutShape.Points.Add(ShapePoint);
+    }
+
+    return true;
+  }
+
+  void WriteMoves(std::ostream& Stream, const TArray<FPointMove>& Moves)
+  {
+    Stream << ' ' << Moves.Num();
+    for (const FPointMove& Move : Moves)
+    {
+      Stream << ' ' << Move.Cost;
+      WritePoint(Stream, Move.Delta);
+    }
+  }
+
+  bool ReadMoves(std::istream& Stream, TArray<FPointMove>& OutMoves)
+  {
+    int MovesNum = 0;
+    if (!(Stream >> MovesNum) || MovesNum < 0)
+    {
+      return false;
+    }
+
+    OutMoves.Empty();
+    for (int MoveIndex = 0; MoveIndex < MovesNum; ++MoveIndex)
+    {
+      FPointMove Move;
+      if (!(Stream >> Move.Cost) || !ReadPoint(Stream, Move.Delta))
+      {
+        return false;
+      }
+      OutMoves.Add(Move);
+    }
+
+    return true;
+  }
+
+  void WritePoints(std::ostream& Stream, const TArray<FPoint>& Points)
+  {
+    Stream << ' ' << Points.Num();
+    for (const FPoint& Point : Points)
+    {
+      WritePoint(Stream, Point);
+    }
+  }
+
+  bool ReadPoints(std::istream& Stream, TArray<FPoint>& OutPoints)
+  {
+    int PointsNum = 0;
+    if (!(Stream >> PointsNum) || PointsNum < 0)
+    {
+      return false;
+    }
+
+    OutPoints.Empty();
+    for (int PointIndex = 0; PointIndex < PointsNum; ++PointIndex)
+    {
+      FPoint Point;
+      if (!ReadPoint(Stream, Point))
+      {
+        return false;
+      }
+      OutPoints.Add(Point);
+    }
+
+    return true;
+  }
+
+  void WriteTrajectory(std::ostream& Stream, const FObstacleTrajectory& Trajectory)
+  {
+    WriteShape(Stream, Trajectory.Shape);
+    Stream << ' ' << Trajectory.Waypoints.Num();
+    for (const FObstacleWaypoint& Waypoint : Trajectory.Waypoints)
+    {
+      WritePoint(Stream, Waypoint.Point);
+      Stream << ' ' << Waypoint.Time;
+    }
+  }
+
+  bool ReadTrajectory(std::istream& Stream, FObstacleTrajectory& OutTrajectory)
+  {
+    int WaypointsNum = 0;
+    if (!ReadShape(Stream, OutTrajectory.Shape) || !(Stream >> WaypointsNum) || WaypointsNum < 0)
+    {
+      return false;
+    }
+
+    OutTrajectory.Waypoints.Empty();
+    for (int WaypointIndex = 0; WaypointIndex < WaypointsNum; ++WaypointIndex)
+    {
+      FObstacleWaypoint Waypoint;
+      if (!ReadPoint(Stream, Waypoint.Point) || !(Stream >> Waypoint.Time))
+      {
+        return false;
+      }
+      OutTrajectory.Waypoints.Add(Waypoint);
+    }
+
+    return true;
+  }
+}
+
+void WriteSessionEvent(std::ostream& Stream, const SessionEvent& Event)
+{
+  Stream << Event.Time << ' ' << ToName(Event.Type);
+  switch (Event.Type)
+  {
+  case ESessionEventType::Tick:
+  case ESessionEventType::SetDepth:
+  case ESessionEventType::SetMinDepth:
+    Stream << ' ' << Event.Value;
+    break;
+  case ESessionEventType::AddAgent:
+    Stream << ' ' << Event.ID;
+    WritePoint(Stream, Event.Point);
+    WritePoint(Stream, Event.Goal);
+    Stream << ' ' << Event.Value;
+    WriteShape(Stream, Event.Shape);
+    WriteMoves(Stream, Event.Moves);
+    break;
+  case ESessionEventType::RemoveAgent:
+  case ESessionEventType::RemoveObstacle:
+    Stream << ' ' << Event.ID;
+    break;
+  case ESessionEventType::ChangeGoal:
+    Stream << ' ' << Event.ID;
+    WritePoint(Stream, Event.Goal);
+    break;
+  case ESessionEventType::ChangeSpace:
+    WritePoint(Stream, Event.Point);
+    Stream << ' ' << (int) Event.bFlag;
+    break;
+  case ESessionEventType::AddObstacle:
+  case ESessionEventType::UpdateObstacle:
+    Stream << ' ' << Event.ID;
+    WriteTrajectory(Stream, Event.Trajectory);
+    break;
+  case ESessionEventType::SetConflictResolution:
+  case ESessionEventType::SetPathShortcuts:
+  case ESessionEventType::SetBidirectionalHeuristic:
+    Stream << ' ' << (int) Event.bFlag;
+    break;
+  case ESessionEventType::RegisterGoals:
+    WritePoints(Stream, Event.Goals);
+    WriteShape(Stream, Event.Shape);
+    WriteMoves(Stream, Event.Moves);
+    break;
+  case ESessionEventType::SetSharding:
+    Stream << ' ' << Event.Sharding.TileSize << ' ' << Event.Sharding.Halo << ' ' << Event.Sharding.MaxConcurrentReplans;
+    break;
+  case ESessionEventType::AddGoals:
+    Stream << ' ' << Event.ID;
+    WritePoints(Stream, Event.Goals);
+    break;
+  }
+  Stream << '\n';
+}
+
+bool ReadSessionEvent(std::istream& Stream, SessionEvent& OutEvent)
+{
+  std::string TypeName;
+  if (!(Stream >> OutEvent.Time >> TypeName) || !FromName(TypeName, OutEvent.Type))
+  {
+    return false;
+  }
+
+  int Flag = 0;
+  switch (OutEvent.Type)
+  {
+  case ESessionEventType::Tick:
+  case ESessionEventType::SetDepth:
+  case ESessionEventType::SetMinDepth:
+    return (bool) (Stream >> OutEvent.Value);
+  case ESessionEventType::AddAgent:
+    return (Stream >> OutEvent.ID)
+      && ReadPoint(Stream, OutEvent.Point)
+      && ReadPoint(Stream, OutEvent.Goal)
+      && (Stream >> OutEvent.Value)
+      && ReadShape(Stream, OutEvent.Shape)
+      && ReadMoves(Stream, OutEvent.Moves);
+  case ESessionEventType::RemoveAgent:
+  case ESessionEventType::RemoveObstacle:
+    return (bool) (Stream >> OutEvent.ID);
+  case ESessionEventType::ChangeGoal:
+    return (Stream >> OutEvent.ID) && ReadPoint(Stream, OutEvent.Goal);
+  case ESessionEventType::ChangeSpace:
+    if (!ReadPoint(Stream, OutEvent.Point) || !(Stream >> Flag))
+    {
+      return false;
+    }
+    OutEvent.bFlag = Flag != 0;
+    return true;
+  case ESessionEventType::AddObstacle:
+  case ESessionEventType::UpdateObstacle:
+    return (Stream >> OutEvent.ID) && ReadTrajectory(Stream, OutEvent.Trajectory);
+  case ESessionEventType::SetConflictResolution:
+  case ESessionEventType::SetPathShortcuts:
+  case ESessionEventType::SetBidirectionalHeuristic:
+    if (!(Stream >> Flag))
+    {
+      return false;
+    }
+    OutEvent.bFlag = Flag != 0;
+    return true;
+  case ESessionEventType::RegisterGoals:
+    return ReadPoints(Stream, OutEvent.Goals)
+      && ReadShape(Stream, OutEvent.Shape)
+      && ReadMoves(Stream, OutEvent.Moves);
+  case ESessionEventType::SetSharding:
+    return (bool) (Stream >> OutEvent.Sharding.TileSize >> OutEvent.Sharding.Halo >> OutEvent.Sharding.MaxConcurrentReplans);
+  case ESessionEventType::AddGoals:
+    return (Stream >> OutEvent.ID) && ReadPoints(Stream, OutEvent.Goals);
+  }
+
+  return false;
+}
+
+bool SessionRecorder::Start(const TCHAR* FileName, float StartTime)
+{
+  FScopeLock RecordLock(&RecordSync);
+
+  if (SessionFile.is_open())
+  {
+    SessionFile.close();
+  }
+
+  SessionFile.open(FileName);
+  if (!SessionFile.is_open())
+  {
+    return false;
+  }
+
+  // Floats are written with enough digits to be read back exactly
+  SessionFile.precision(std::numeric_limits<float>::max_digits10);
+  SessionFile << "rtmapf-session " << SESSION_FORMAT_VERSION << ' ' << StartTime << '\n';
+  return true;
+}
+
+void SessionRecorder::Stop()
+{
+  FScopeLock RecordLock(&RecordSync);
+
+  if (SessionFile.is_open())
+  {
+    SessionFile.close();
+  }
+}
+
+bool SessionRecorder::IsRecording() const
+{
+  FScopeLock RecordLock(&RecordSync);
+
+  return SessionFile.is_open();
+}
+
+void SessionRecorder::Record(const SessionEvent& Event)
+{
+  FScopeLock RecordLock(&RecordSync);
+
+  if (SessionFile.is_open())
+  {
+    WriteSessionEvent(SessionFile, Event);
+  }
+}
+
+bool ReadSession(std::istream& Stream, float& OutStartTime, ArrayType<SessionEvent>& OutEvents)
+{
+  std::string Header;
+  int Version = 0;
+  if (!(Stream >> Header >> Version >> OutStartTime) || Header != "rtmapf-session" || Version != SESSION_FORMAT_VERSION)
+  {
+    return false;
+  }
+
+  OutEvents.clear();
+  SessionEvent Event;
+  while (Stream >> std::ws && !Stream.eof())
+  {
+    Event = SessionEvent();
+    if (!ReadSessionEvent(Stream, Event))
+    {
+      return false;
+    }
+    OutEvents.push_back(Event);
+  }
+
+  return true;
+}
+
+void ReplayReport::AddTick(float Time, double Latency)
+{
+  TickTime.push_back(Time);
+  TickLatency.push_back(Latency);
+}
+
+double ReplayReport::GetPercentile(double Percentile) const
+{
+  if (TickLatency.empty())
+  {
+    return 0;
+  }
+
+  ArrayType<double> Sorted = TickLatency;
+  std::sort(Sorted.begin(), Sorted.end());
+  // Nearest rank
+  const size_t Rank = (size_t) std::ceil(Percentile / 100.0 * Sorted.size());
+  return Sorted[std::min(Sorted.size(), std::max(Rank, (size_t) 1)) - 1];
+}
+
+std::string ReplayReport::ToJson() const
+{
+  double Total = 0;
+  for (double Latency : TickLatency)
+  {
+    Total += Latency;
+  }
+
+  std::ostringstream Stream;
+  Stream << "{\"ticks\":" << TickLatency.size() << ","
+    << "\"totalMs\":" << Total << ","
+    << "\"meanMs\":" << (TickLatency.size() ? Total / TickLatency.size() : 0.0) << ","
+    << "\"p50Ms\":" << GetPercentile(50) << ","
+    << "\"p95Ms\":" << GetPercentile(95) << ","
+    << "\"p99Ms\":" << GetPercentile(99) << ","
+    << "\"maxMs\":" << GetPercentile(100) << ","
+    << "\"perTick\":[";
+  for (size_t TickIndex = 0; TickIndex < TickLatency.size(); ++TickIndex)
+  {
+    Stream << (TickIndex ? "," : "") << "[" << TickTime[TickIndex] << "," << TickLatency[TickIndex] << "]";
+  }
+  Stream << "]}";
+  return Stream.str();
+}
@@ -1,5 +1,8 @@
 #include "Shapes.h"
 #include "MovesSegments.h"
+#include "PlannerStats.h"
+
+#include <algorithm>
 
 ArrayType<FPoint> FShape::ApplyShapeTo(FPoint Point) const
 {
@@ -12,43 +15,124 @@ ArrayType<FPoint> FShape::ApplyShapeTo(FPoint Point) const
   return Result;
 }
 
+namespace
+{
+  template<size_t PointsNum>
+  bool IsShapeOf(const FShape& Shape, const StaticDelta (&ShapePoints)[PointsNum])
+  {
+    if (Shape.Points.Num() != (int) PointsNum)
+    {
+      return false;
+    }
+
+    for (const StaticDelta& ShapePoint : ShapePoints)
+    {
+      if (!Shape.Points.Contains(ShapePoint.ToPoint()))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+}
+
+EStaticShape ClassifyShape(const FShape& Shape)
+{
+  if (IsShapeOf(Shape, CellShapePoints))
+  {
+    return EStaticShape::Cell;
+  }
+  if (IsShapeOf(Shape, PlusShapePoints))
+  {
+    return EStaticShape::Plus;
+  }
+  if (IsShapeOf(Shape, SquareShapePoints))
+  {
+    return EStaticShape::Square;
+  }
+
+  return EStaticShape::Custom;
+}
+
 ShapeSpace::ShapeSpace(float Depth, std::shared_ptr<SegmentSpace> InSpace, const FShape& InShape)
   : SpaceTime(Depth)
   , OriginalSpace(InSpace)
   , Shape(InShape)
+  , StaticShape(ClassifyShape(InShape))
 { }
 
-void ShapeSpace::UpdateShape(FPoint Point)
+void ShapeSpace::Reset(std::shared_ptr<SegmentSpace> InSpace, const FShape& InShape, SearchArena* Arena)
 {
-  if (PointCache.count(Point))
+  OriginalSpace = InSpace;
+  Shape = InShape;
+  StaticShape = ClassifyShape(InShape);
+
+  const ArenaAllocator<FPoint> Allocator(Arena);
+  if (PointCache.get_allocator() == Allocator)
   {
+    SegmentGrid.clear();
+    PointCache.clear();
     return;
   }
 
-  PointCache.insert(Point);
+  SegmentGrid = SegmentGridType(PreviousCellsNum, std::hash<FPoint>(), std::equal_to<FPoint>(), Allocator);
+  PointCache = PointCacheType(PreviousCellsNum, std::hash<FPoint>(), std::equal_to<FPoint>(), Allocator);
+}
 
-  ArrayType<FPoint> JoinedPoints = Shape.ApplyShapeTo(Point);
+void ShapeSpace::ReleaseSpace()
+{
+  OriginalSpace.reset();
+  PreviousCellsNum = std::max(PreviousCellsNum, PointCache.size());
+  SegmentGrid = SegmentGridType();
+  PointCache = PointCacheType();
+}
 
-  bool Contains = true;
-  for (FPoint& OriginalSpacePoint : JoinedPoints)
+template<typename PointsType>
+void ShapeSpace::JoinShape(FPoint Point, const PointsType& ShapePoints)
+{
+  for (const auto& ShapePoint : ShapePoints)
   {
-    if (!OriginalSpace->ContainsSegmentsIn(OriginalSpacePoint))
+    if (!OriginalSpace->ContainsSegmentsIn(Point + FPoint(ShapePoint.X, ShapePoint.Y)))
     {
-      Contains = false;
-      break;
+      return;
     }
   }
 
-  if (!Contains)
+  SegmentHolder Joined(Segment{ 0, Depth });
+  for (const auto& ShapePoint : ShapePoints)
+  {
+    Joined = Joined & OriginalSpace->GetSegments(Point + FPoint(ShapePoint.X, ShapePoint.Y));
+  }
+  SegmentGrid[Point] = std::move(Joined);
+}
+
+void ShapeSpace::UpdateShape(FPoint Point)
+{
+  if (PointCache.count(Point))
   {
     return;
   }
 
-  SegmentGrid[Point] = SegmentHolder(Segment{ 0, Depth });
-  for (FPoint& OriginalSpacePoint : JoinedPoints)
+  PointCache.insert(Point);
+
+  PLANNER_PHASE_SCOPE(EPlannerPhase::UpdateShape);
+
+  // Common shapes are unrolled by the compiler
+  switch (StaticShape)
   {
-    const SegmentHolder& Segments = OriginalSpace->GetSegments(OriginalSpacePoint);
-    SegmentGrid[Point] = SegmentGrid[Point] & Segments;
+  case EStaticShape::Cell:
+    JoinShape(Point, CellShapePoints);
+    break;
+  case EStaticShape::Plus:
+    JoinShape(Point, PlusShapePoints);
+    break;
+  case EStaticShape::Square:
+    JoinShape(Point, SquareShapePoints);
+    break;
+  default:
+    JoinShape(Point, Shape.Points);
+    break;
   }
 }
 
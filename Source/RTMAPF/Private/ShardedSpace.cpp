@@ -0,0 +1,320 @@
+#include "ShardedSpace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+ShardedSpace::ShardedSpace(std::shared_ptr<SpaceTime> InBase)
+  : Base(InBase)
+{
+  check(Base);
+  Shards.resize(1);
+  Shards[0].Space = Base;
+}
+
+ShardedSpace::ShardedSpace(std::shared_ptr<SpaceTime> InBase, int InWidth, int InHeight, int InTileSize, int InHalo)
+  : Base(InBase)
+  , Width(InWidth)
+  , Height(InHeight)
+  , TileSize(InTileSize)
+  , Halo(InHalo)
+{
+  check(Base);
+  check(TileSize > 0 && Halo >= 1 && Halo * 2 <= TileSize);
+
+  TilesX = std::max(1, (Width + TileSize - 1) / TileSize);
+  TilesY = std::max(1, (Height + TileSize - 1) / TileSize);
+  Shards.resize(TilesX * TilesY);
+}
+
+int ShardedSpace::FindShard(FPoint Point) const
+{
+  if (!IsSharded())
+  {
+    return 0;
+  }
+
+  const int TileX = std::min(std::max(Point.X, 0) / TileSize, TilesX - 1);
+  const int TileY = std::min(std::max(Point.Y, 0) / TileSize, TilesY - 1);
+  return GetShardIndex({ TileX, TileY });
+}
+
+void ShardedSpace::FindBlock(int ShardIndex, SetType<int>& OutShards) const
+{
+  if (ShardIndex < 0)
+  {
+    return;
+  }
+
+  const FPoint Tile = GetTile(ShardIndex);
+  for (int TileX = std::max(0, Tile.X - 1); TileX <= std::min(TilesX - 1, Tile.X + 1); ++TileX)
+  {
+    for (int TileY = std::max(0, Tile.Y - 1); TileY <= std::min(TilesY - 1, Tile.Y + 1); ++TileY)
+    {
+      OutShards.insert(GetShardIndex({ TileX, TileY }));
+    }
+  }
+}
+
+bool ShardedSpace::IsInRegion(int ShardIndex, FPoint Point) const
+{
+  if (!IsSharded())
+  {
+    return true;
+  }
+
+  const FPoint Tile = GetTile(ShardIndex);
+  return Point.X >= Tile.X * TileSize - Halo && Point.X < (Tile.X + 1) * TileSize + Halo
+    && Point.Y >= Tile.Y * TileSize - Halo && Point.Y < (Tile.Y + 1) * TileSize + Halo;
+}
+
+void ShardedSpace::FindShardsHolding(FPoint Point, ArrayType<int>& OutShards) const
+{
+  SetType<int> Block;
+  FindBlock(FindShard(Point), Block);
+  for (int ShardIndex : Block)
+  {
+    if (IsInRegion(ShardIndex, Point))
+    {
+      OutShards.push_back(ShardIndex);
+    }
+  }
+}
+
+std::shared_ptr<SpaceTime> ShardedSpace::GetShardSpace(int ShardIndex)
+{
+  Shard& FoundShard = Shards.at(ShardIndex);
+  if (FoundShard.Space)
+  {
+    return FoundShard.Space;
+  }
+
+  FoundShard.Space = std::make_shared<SpaceTime>(Base->GetDepth());
+  FoundShard.ReservedAreasNum = 0;
+
+  const FPoint Tile = GetTile(ShardIndex);
+  for (int X = std::max(0, Tile.X * TileSize - Halo); X < std::min(Width, (Tile.X + 1) * TileSize + Halo); ++X)
+  {
+    for (int Y = std::max(0, Tile.Y * TileSize - Halo); Y < std::min(Height, (Tile.Y + 1) * TileSize + Halo); ++Y)
+    {
+      // Obstacles in inaccessable cells are copied too, they are cut out when the cells are made accessable
+      FoundShard.Space->CopyCellFrom(*Base, { X, Y });
+    }
+  }
+
+  return FoundShard.Space;
+}
+
+FPoint ShardedSpace::FindRegionGoal(int ShardIndex, FPoint Goal, const FShape& Shape)
+{
+  if (IsInRegion(ShardIndex, Goal))
+  {
+    return Goal;
+  }
+
+  // The shape doesn't fit into the cells of the region border
+  int ShapeRadius = 0;
+  for (const FPoint& ShapePoint : Shape.Points)
+  {
+    ShapeRadius = std::max(ShapeRadius, std::max(std::abs(ShapePoint.X), std::abs(ShapePoint.Y)));
+  }
+
+  const std::shared_ptr<SpaceTime> Space = GetShardSpace(ShardIndex);
+  const FPoint Tile = GetTile(ShardIndex);
+  const int MinX = std::max(0, Tile.X * TileSize - Halo) + ShapeRadius;
+  const int MinY = std::max(0, Tile.Y * TileSize - Halo) + ShapeRadius;
+  const int MaxX = std::min(Width, (Tile.X + 1) * TileSize + Halo) - 1 - ShapeRadius;
+  const int MaxY = std::min(Height, (Tile.Y + 1) * TileSize + Halo) - 1 - ShapeRadius;
+
+  FPoint RegionGoal = Goal;
+  int64_t MinDistance = std::numeric_limits<int64_t>::max();
+  for (int X = MinX; X <= MaxX; ++X)
+  {
+    for (int Y = MinY; Y <= MaxY; ++Y)
+    {
+      if (X != MinX && X != MaxX && Y != MinY && Y != MaxY)
+      {
+        // Only the border is inspected
+        Y = MaxY - 1;
+        continue;
+      }
+
+      const FPoint Point = { X, Y };
+      const int64_t DeltaX = Goal.X - X;
+      const int64_t DeltaY = Goal.Y - Y;
+      const int64_t Distance = DeltaX * DeltaX + DeltaY * DeltaY;
+      if (Distance >= MinDistance)
+      {
+        continue;
+      }
+
+      bool bShapeFits = true;
+      for (const FPoint& ShapePoint : Shape.Points)
+      {
+        if (!Space->ContainsSegmentsIn(Point + ShapePoint))
+        {
+          bShapeFits = false;
+          break;
+        }
+      }
+
+      if (bShapeFits)
+      {
+        MinDistance = Distance;
+        RegionGoal = Point;
+      }
+    }
+  }
+
+  return RegionGoal;
+}
+
+void ShardedSpace::WriteAreas(const ArrayType<Area>& Areas, bool bReserve)
+{
+  if (!IsSharded())
+  {
+    if (bReserve)
+    {
+      Base->MakeAreasInaccessable(Areas);
+    }
+    else
+    {
+      Base->MakeAreasAccessable(Areas);
+    }
+    return;
+  }
+
+  MapType<int, ArrayType<Area>> ShardToAreas;
+  ArrayType<int> Holding;
+  for (const Area& WrittenArea : Areas)
+  {
+    Holding.clear();
+    FindShardsHolding(WrittenArea.Point, Holding);
+    for (int ShardIndex : Holding)
+    {
+      ShardToAreas[ShardIndex].push_back(WrittenArea);
+    }
+  }
+
+  for (const auto& ShardAndAreas : ShardToAreas)
+  {
+    const std::shared_ptr<SpaceTime> Space = GetShardSpace(ShardAndAreas.first);
+    Shard& WrittenShard = Shards[ShardAndAreas.first];
+    if (bReserve)
+    {
+      Space->MakeAreasInaccessable(ShardAndAreas.second);
+      WrittenShard.ReservedAreasNum += ShardAndAreas.second.size();
+    }
+    else
+    {
+      Space->MakeAreasAccessable(ShardAndAreas.second);
+      WrittenShard.ReservedAreasNum -= ShardAndAreas.second.size();
+      check(WrittenShard.ReservedAreasNum >= 0);
+    }
+  }
+}
+
+void ShardedSpace::ReserveAreas(const ArrayType<Area>& Areas)
+{
+  WriteAreas(Areas, true);
+}
+
+void ShardedSpace::ReleaseAreas(const ArrayType<Area>& Areas)
+{
+  WriteAreas(Areas, false);
+}
+
+void ShardedSpace::ApplyObstacles(const ArrayType<Area>& ReleasedAreas, const ArrayType<Area>& ReservedAreas)
+{
+  if (!IsSharded())
+  {
+    return;
+  }
+
+  // Areas outside the region of a shard are not written into its table
+  ArrayType<Area> ShardReleased;
+  ArrayType<Area> ShardReserved;
+  for (int ShardIndex = 0; ShardIndex < (int) Shards.size(); ++ShardIndex)
+  {
+    const std::shared_ptr<SpaceTime>& Space = Shards[ShardIndex].Space;
+    if (!Space)
+    {
+      continue;
+    }
+
+    ShardReleased.clear();
+    ShardReserved.clear();
+    for (const Area& Released : ReleasedAreas)
+    {
+      if (IsInRegion(ShardIndex, Released.Point))
+      {
+        ShardReleased.push_back(Released);
+      }
+    }
+    for (const Area& Reserved : ReservedAreas)
+    {
+      if (IsInRegion(ShardIndex, Reserved.Point))
+      {
+        ShardReserved.push_back(Reserved);
+      }
+    }
+    Space->MakeAreasAccessable(ShardReleased);
+    Space->MakeAreasInaccessable(ShardReserved);
+  }
+}
+
+void ShardedSpace::UpdateCell(FPoint Point)
+{
+  if (!IsSharded())
+  {
+    return;
+  }
+
+  ArrayType<int> Holding;
+  FindShardsHolding(Point, Holding);
+  for (int ShardIndex : Holding)
+  {
+    const std::shared_ptr<SpaceTime>& Space = Shards[ShardIndex].Space;
+    if (!Space)
+    {
+      continue;
+    }
+
+    if (!Base->ContainsSegmentsIn(Point))
+    {
+      Space->SetAccess(Point, Access::Inaccessable, Space->GetDepth());
+    }
+    else if (!Space->ContainsSegmentsIn(Point))
+    {
+      // Reservations of paths and obstacles in the cell are counted by the table
+      Space->SetAccess(Point, Access::Accessable, Space->GetDepth());
+    }
+  }
+}
+
+void ShardedSpace::ReleaseIdle(const SetType<int>& UsedShards)
+{
+  if (!IsSharded())
+  {
+    return;
+  }
+
+  for (int ShardIndex = 0; ShardIndex < (int) Shards.size(); ++ShardIndex)
+  {
+    Shard& IdleShard = Shards[ShardIndex];
+    if (IdleShard.Space && IdleShard.ReservedAreasNum == 0 && !UsedShards.count(ShardIndex))
+    {
+      IdleShard.Space.reset();
+    }
+  }
+}
+
+int ShardedSpace::GetActiveShardsNum() const
+{
+  int ActiveNum = 0;
+  for (const Shard& ActiveShard : Shards)
+  {
+    ActiveNum += ActiveShard.Space ? 1 : 0;
+  }
+  return ActiveNum;
+}
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <iterator>
 #include <iostream>
 #include <string>
 
@@ -66,13 +67,7 @@ TOptional<RawSpace> SpaceReader::FromHogFormat(std::istream& File)
     for (int Column = 0; Column < (int) Width; ++Column)
     {
       File.get(GridValue);
-      Access NewAccess = Access::Inaccessable;
-      if (SymbolToAccess.count(GridValue))
-      {
-        NewAccess = SymbolToAccess[GridValue];
-      }
-
-      ReadSpace.SetAccess(FPoint{ Column, Row }, NewAccess);
+      ReadSpace.SetAccess(FPoint{ Column, Row }, FromSymbol(GridValue));
     }
 
     File.ignore(2, '\n');
@@ -81,6 +76,32 @@ TOptional<RawSpace> SpaceReader::FromHogFormat(std::istream& File)
   return std::move(ReadSpace);
 }
 
+bool SpaceReader::FindHogLayout(std::istream& File, uint32_t& Width, uint32_t& Height, std::streamoff& RowsOffset, std::streamoff& RowStride)
+{
+  if (!CheckHogFileStart(File, Width, Height)) return false;
+  File.ignore(2, '\n');
+
+  RowsOffset = File.tellg();
+  std::string FirstRow;
+  std::getline(File, FirstRow);
+  RowStride = File.tellg() - RowsOffset;
+
+  // Rows end with \n or \r\n
+  if (File.fail() || RowStride < (std::streamoff) Width + 1 || RowStride > (std::streamoff) Width + 2)
+  {
+    std::cerr << "ReadSpace::FindHogLayout: rows of File have different lengths\n";
+    return false;
+  }
+
+  return true;
+}
+
+Access SpaceReader::FromSymbol(char Symbol) const
+{
+  auto Found = SymbolToAccess.find(Symbol);
+  return Found != SymbolToAccess.end() ? Found->second : Access::Inaccessable;
+}
+
 bool SpaceReader::CheckHogFileStart(std::istream& File, uint32_t& Width, uint32_t& Height)
 {
   std::string Buffer;
@@ -127,6 +148,28 @@ void SegmentSpace::SetSegments(FPoint Point, const SegmentHolder & NewAccess)
   SegmentGrid[Point] = NewAccess;
 }
 
+void SegmentSpace::CopyCellFrom(const SegmentSpace& Source, FPoint Point)
+{
+  if (Source.ContainsSegmentsIn(Point))
+  {
+    SegmentGrid[Point] = Source.GetSegments(Point);
+  }
+  else
+  {
+    SegmentGrid.erase(Point);
+  }
+
+  auto Found = Source.Reservations.find(Point);
+  if (Found != Source.Reservations.end())
+  {
+    Reservations[Point] = Found->second;
+  }
+  else
+  {
+    Reservations.erase(Point);
+  }
+}
+
 bool SegmentSpace::ContainsSegmentsIn(FPoint Point) const
 {
   return SegmentGrid.count(Point) > 0;
@@ -145,7 +188,19 @@ void SegmentSpace::SetAccess(const FPoint& Point, Access Access, const float& De
   {
     if (Access == Access::Accessable)
     {
-      SegmentGrid[Point] = SegmentHolder(Segment{ 0, Depth });
+      SegmentHolder& Segments = SegmentGrid[Point] = SegmentHolder(Segment{ 0, Depth });
+
+      auto Found = Reservations.find(Point);
+      if (Found != Reservations.end())
+      {
+        for (auto Piece = Found->second.begin(); Piece != Found->second.end(); ++Piece)
+        {
+          if (Piece->second > 0)
+          {
+            Segments.RemoveSegment({ Piece->first, std::next(Piece)->first });
+          }
+        }
+      }
     }
   }
 }
@@ -172,11 +227,13 @@ void SegmentSpace::MakeAreasInaccessable(const std::vector<Area>& Areas)
 {
   for (const Area& Area : Areas)
   {
-    if (!ContainsSegmentsIn(Area.Point))
+    ReserveSegment(Area.Point, Area.Interval);
+
+    auto Cell = SegmentGrid.find(Area.Point);
+    if (Cell != SegmentGrid.end())
     {
-      continue;
+      Cell->second.RemoveSegment(Area.Interval);
     }
-    SegmentGrid[Area.Point].RemoveSegment(Area.Interval);
 
     // If UsedSegment holder becomes empty, it is still contained inside the SegmentSpace,
     // because in future it may be needed to add accessable intervals there
@@ -187,11 +244,89 @@ void SegmentSpace::MakeAreasAccessable(const std::vector<Area>& Areas)
 {
   for (const Area& Area : Areas)
   {
-    if (!ContainsSegmentsIn(Area.Point))
+    ReleaseSegment(Area.Point, Area.Interval);
+  }
+}
+
+SegmentSpace::ReservationCounts::iterator SegmentSpace::SplitCounts(ReservationCounts& Counts, float Time)
+{
+  auto Next = Counts.lower_bound(Time);
+  if (Next != Counts.end() && Next->first == Time)
+  {
+    return Next;
+  }
+
+  const int Count = Next != Counts.begin() ? std::prev(Next)->second : 0;
+  return Counts.emplace_hint(Next, Time, Count);
+}
+
+void SegmentSpace::MergeCounts(ReservationCounts& Counts, ReservationCounts::iterator Piece)
+{
+  if (Piece == Counts.end())
+  {
+    return;
+  }
+
+  // Times before the first key aren't reserved
+  const int PrevCount = Piece != Counts.begin() ? std::prev(Piece)->second : 0;
+  if (Piece->second == PrevCount)
+  {
+    Counts.erase(Piece);
+  }
+}
+
+void SegmentSpace::ReserveSegment(FPoint Point, const Segment& Reserved)
+{
+  if (Reserved.Start >= Reserved.End)
+  {
+    return;
+  }
+
+  ReservationCounts& Counts = Reservations[Point];
+  const auto First = SplitCounts(Counts, Reserved.Start);
+  const auto Last = SplitCounts(Counts, Reserved.End);
+  for (auto Piece = First; Piece != Last; ++Piece)
+  {
+    ++Piece->second;
+  }
+
+  MergeCounts(Counts, Last);
+  MergeCounts(Counts, First);
+}
+
+void SegmentSpace::ReleaseSegment(FPoint Point, const Segment& Released)
+{
+  if (Released.Start >= Released.End)
+  {
+    return;
+  }
+
+  auto Found = Reservations.find(Point);
+  assert(Found != Reservations.end());
+  if (Found == Reservations.end())
+  {
+    // Released without a reservation, the cell is left as it is
+    return;
+  }
+
+  ReservationCounts& Counts = Found->second;
+  const auto First = SplitCounts(Counts, Released.Start);
+  const auto Last = SplitCounts(Counts, Released.End);
+  auto Cell = SegmentGrid.find(Point);
+  for (auto Piece = First; Piece != Last; ++Piece)
+  {
+    assert(Piece->second > 0);
+    if (Piece->second > 0 && --Piece->second == 0 && Cell != SegmentGrid.end())
     {
-      continue;
+      Cell->second.AddSegment({ Piece->first, std::next(Piece)->first });
     }
-    SegmentGrid[Area.Point].AddSegment(Area.Interval);
+  }
+
+  MergeCounts(Counts, Last);
+  MergeCounts(Counts, First);
+  if (Counts.empty())
+  {
+    Reservations.erase(Found);
   }
 }
 
@@ -34,6 +34,55 @@ void ASpace::InitFromFile(FString FileName)
   UE_LOG(LogTemp, Log, TEXT("File %s processed correctly"), *FileName);
 
   Space = std::make_shared<SpaceTime>(std::numeric_limits<float>::infinity(), RawSpace.GetValue());
+  // Obstacles added before the map is loaded are kept
+  Obstacles->SetSpace(Space);
+  StaticSpace = std::make_shared<::RawSpace>(RawSpace.GetValue());
+  Streamer = nullptr;
+}
+
+bool ASpace::InitStreamingFromFile(FString FileName, int TileSize, int MaxLoadedTiles, int DemandRadius)
+{
+  if (TileSize <= 0 || MaxLoadedTiles <= 0 || DemandRadius < 0)
+  {
+    UE_LOG(LogTemp, Error, TEXT("Invalid streaming: tile size = %d, tiles = %d, radius = %d"), TileSize, MaxLoadedTiles, DemandRadius);
+    return false;
+  }
+
+  std::shared_ptr<SpaceTime> StreamedSpace = std::make_shared<SpaceTime>(std::numeric_limits<float>::infinity());
+  std::shared_ptr<TileStreamer> NewStreamer = std::make_shared<TileStreamer>(StreamedSpace);
+  if (!NewStreamer->Open(FileName, TileSize, MaxLoadedTiles, DemandRadius))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Cannot stream hog format from %s"), *FileName);
+    return false;
+  }
+
+  UE_LOG(LogTemp, Log, TEXT("File %s is streamed"), *FileName);
+
+  // Tiles are loaded on demand, holes of the kept obstacles are counted by the space till they load
+  Space = StreamedSpace;
+  Obstacles->SetSpace(Space);
+  StaticSpace = nullptr;
+  Streamer = NewStreamer;
+  return true;
+}
+
+bool ASpace::GetMapSize(uint32_t& OutWidth, uint32_t& OutHeight) const
+{
+  if (StaticSpace)
+  {
+    OutWidth = StaticSpace->GetWidth();
+    OutHeight = StaticSpace->GetHeight();
+    return true;
+  }
+
+  if (Streamer)
+  {
+    OutWidth = Streamer->GetWidth();
+    OutHeight = Streamer->GetHeight();
+    return true;
+  }
+
+  return false;
 }
 
 FVector ASpace::Translate(FPoint Point) const
@@ -64,5 +113,43 @@ FPoint ASpace::Projection(FVector Location) const
 void ASpace::ChangeSpaceUnsafe(FPoint Point, bool IsTraversable)
 {
   const auto inf = std::numeric_limits<float>::infinity();
-  Space->SetAccess(Point, IsTraversable ? Access::Accessable : Access::Inaccessable, inf);
+  if (Streamer)
+  {
+    // Cells of tiles that aren't loaded are changed when the tile is loaded
+    Streamer->OverrideCell(Point, IsTraversable);
+  }
+  if (!Streamer || Streamer->IsTileLoaded(Point))
+  {
+    Space->SetAccess(Point, IsTraversable ? Access::Accessable : Access::Inaccessable, inf);
+  }
+  if (StaticSpace && StaticSpace->Contains(Point))
+  {
+    StaticSpace->SetAccess(Point, IsTraversable ? Access::Accessable : Access::Inaccessable);
+  }
+  OnSpaceChanged.Broadcast(Point);
+}
+
+int ASpace::AddObstacle(const FObstacleTrajectory& Trajectory)
+{
+  const int ObstacleID = Obstacles->Add(Trajectory);
+  OnObstacleChanged.Broadcast(EObstacleChange::Add, ObstacleID, Trajectory);
+  return ObstacleID;
+}
+
+bool ASpace::UpdateObstacle(int ObstacleID, const FObstacleTrajectory& Trajectory)
+{
+  if (!Obstacles->Update(ObstacleID, Trajectory))
+  {
+    UE_LOG(LogTemp, Error, TEXT("Attempted to update nonexisting obstacle with id = %d"), ObstacleID);
+    return false;
+  }
+
+  OnObstacleChanged.Broadcast(EObstacleChange::Update, ObstacleID, Trajectory);
+  return true;
+}
+
+void ASpace::RemoveObstacle(int ObstacleID)
+{
+  Obstacles->Remove(ObstacleID);
+  OnObstacleChanged.Broadcast(EObstacleChange::Remove, ObstacleID, FObstacleTrajectory());
 }
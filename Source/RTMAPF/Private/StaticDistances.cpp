@@ -0,0 +1,598 @@
+#include "StaticDistances.h"
+#include "Agent.h"
+#include "Async/Async.h"
+#include "Async/MappedFileHandle.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformFilemanager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace
+{
+  const char TablesMagic[8] = { 'R', 'T', 'M', 'A', 'P', 'F', 'D', 'T' };
+
+  struct TablesHeader
+  {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t TablesNum;
+    uint64_t MapHash;
+  };
+
+  struct MappedTablesFile
+  {
+    std::unique_ptr<IMappedFileHandle> Handle;
+    // Declared after the handle, so it is unmapped first
+    std::unique_ptr<IMappedFileRegion> Region;
+  };
+
+  uint64_t HashStaticSpace(const RawSpace& Static)
+  {
+    // FNV-1a of the access of every cell
+    uint64_t Hash = 14695981039346656037ULL;
+    for (int Y = 0; Y < (int) Static.GetHeight(); ++Y)
+    {
+      for (int X = 0; X < (int) Static.GetWidth(); ++X)
+      {
+        Hash ^= (uint64_t) Static.GetAccess({ X, Y });
+        Hash *= 1099511628211ULL;
+      }
+    }
+    return Hash;
+  }
+
+  template<typename ValueType>
+  void WriteValue(std::ostream& Stream, const ValueType& Value)
+  {
+    Stream.write(reinterpret_cast<const char*>(&Value), sizeof(ValueType));
+  }
+
+  class MappedReader
+  {
+  private:
+    const uint8* Data;
+    size_t Size;
+    size_t Offset = 0;
+
+  public:
+    MappedReader(const uint8* InData, size_t InSize)
+      : Data(InData)
+      , Size(InSize)
+    {}
+
+    template<typename ValueType>
+    bool Read(ValueType& OutValue)
+    {
+      if (Offset + sizeof(ValueType) > Size)
+      {
+        return false;
+      }
+
+      std::memcpy(&OutValue, Data + Offset, sizeof(ValueType));
+      Offset += sizeof(ValueType);
+      return true;
+    }
+
+    // Distances are used in place, offsets in the file keep them aligned
+    const float* ReadFloats(size_t Num)
+    {
+      if (Offset + Num * sizeof(float) > Size)
+      {
+        return nullptr;
+      }
+
+      const float* Floats = reinterpret_cast<const float*>(Data + Offset);
+      Offset += Num * sizeof(float);
+      return Floats;
+    }
+  };
+}
+
+DistanceTable::DistanceTable(
+  FPoint InGoal,
+  const FShape& InShape,
+  const ArrayType<MoveDelta<FPoint>>& InMoves,
+  uint32_t InWidth,
+  uint32_t InHeight,
+  std::shared_ptr<const void> InStorage,
+  const float* InDistances
+)
+  : Goal(InGoal)
+  , Shape(InShape)
+  , Moves(InMoves)
+  , Width(InWidth)
+  , Height(InHeight)
+  , Storage(InStorage)
+  , Distances(InDistances)
+{
+  check(Distances);
+}
+
+std::shared_ptr<DistanceTable> DistanceTable::Build(const RawSpace& Static, FPoint Goal, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves)
+{
+  const uint32_t Width = Static.GetWidth();
+  const uint32_t Height = Static.GetHeight();
+  std::shared_ptr<ArrayType<float>> Storage = std::make_shared<ArrayType<float>>((size_t) Width * Height, HEURISTIC_COST_NOT_FOUND);
+  ArrayType<float>& Distances = *Storage;
+
+  if (Static.Contains(Goal))
+  {
+    // The same move test as the plane search of the planner, without reservations
+    const float Depth = std::numeric_limits<float>::infinity();
+    std::shared_ptr<SpaceTime> Segments = std::make_shared<SpaceTime>(Depth, Static);
+    std::shared_ptr<ShapeSpace> AgentSpace = std::make_shared<ShapeSpace>(Depth, Segments, Shape);
+    ArrayType<MoveDelta<FPoint>> TestedMoves = Moves;
+    MovesTestSegment MovesTest(TestedMoves, AgentSpace, Depth);
+
+    using QueueItem = std::pair<float, size_t>;
+    std::priority_queue<QueueItem, ArrayType<QueueItem>, std::greater<QueueItem>> OpenCells;
+
+    const size_t GoalIndex = Goal.X + (size_t) Goal.Y * Width;
+    Distances[GoalIndex] = 0;
+    OpenCells.push({ 0.f, GoalIndex });
+
+    while (!OpenCells.empty())
+    {
+      const QueueItem Expanded = OpenCells.top();
+      OpenCells.pop();
+      if (Expanded.first > Distances[Expanded.second])
+      {
+        continue;
+      }
+
+      const FPoint Point((int) (Expanded.second % Width), (int) (Expanded.second / Width));
+      for (const MoveDelta<FPoint>& Move : MovesTest.FindValidMoves(Node<FPoint>(Point)))
+      {
+        if (!Static.Contains(Move.Destination))
+        {
+          continue;
+        }
+
+        const size_t DestinationIndex = Move.Destination.X + (size_t) Move.Destination.Y * Width;
+        const float Distance = Expanded.first + Move.MoveCost;
+        if (Distances[DestinationIndex] < 0 || Distance < Distances[DestinationIndex])
+        {
+          Distances[DestinationIndex] = Distance;
+          OpenCells.push({ Distance, DestinationIndex });
+        }
+      }
+    }
+  }
+
+  return std::make_shared<DistanceTable>(Goal, Shape, Moves, Width, Height, Storage, Storage->data());
+}
+
+bool IsSameShape(const FShape& First, const FShape& Second)
+{
+  if (First.Points.Num() != Second.Points.Num())
+  {
+    return false;
+  }
+
+  for (const FPoint& ShapePoint : First.Points)
+  {
+    if (!Second.Points.Contains(ShapePoint))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool DistanceTable::IsFor(const FShape& InShape, const ArrayType<MoveDelta<FPoint>>& InMoves, float Speed) const
+{
+  if (InMoves.size() != Moves.size() || !IsSameShape(InShape, Shape))
+  {
+    return false;
+  }
+
+  for (size_t MoveIndex = 0; MoveIndex < Moves.size(); ++MoveIndex)
+  {
+    const MoveDelta<FPoint>& Move = Moves[MoveIndex];
+    if (!(InMoves[MoveIndex].Destination == Move.Destination)
+      || std::abs(InMoves[MoveIndex].MoveCost * Speed - Move.MoveCost) > EPSILON * std::max(1.f, Move.MoveCost))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool DistanceTable::IsAffectedBy(FPoint Changed) const
+{
+  // Cells swept by a move with the shape are within the reach of its start cell
+  int Reach = 0;
+  for (const FPoint& ShapePoint : Shape.Points)
+  {
+    Reach = std::max(Reach, std::max(std::abs(ShapePoint.X), std::abs(ShapePoint.Y)));
+  }
+  int MoveReach = 0;
+  for (const MoveDelta<FPoint>& Move : Moves)
+  {
+    MoveReach = std::max(MoveReach, std::max(std::abs(Move.Destination.X), std::abs(Move.Destination.Y)));
+  }
+  Reach += MoveReach;
+
+  for (int Y = Changed.Y - Reach; Y <= Changed.Y + Reach; ++Y)
+  {
+    for (int X = Changed.X - Reach; X <= Changed.X + Reach; ++X)
+    {
+      if (GetDistance({ X, Y }) >= 0)
+      {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+void StaticDistanceTables::SetStaticSpace(std::shared_ptr<const RawSpace> InStatic)
+{
+  FScopeLock TablesLock(&TablesSync);
+
+  Static = InStatic;
+  MarkAllStale();
+}
+
+void StaticDistanceTables::MarkAllStale()
+{
+  ++ChangesNum;
+  for (const auto& GoalAndTables : GoalToTables)
+  {
+    for (const std::shared_ptr<const DistanceTable>& Table : GoalAndTables.second)
+    {
+      StaleTables[Table.get()] = ChangesNum;
+    }
+  }
+}
+
+void StaticDistanceTables::BuildTables(const GoalSet& Set, ArrayType<std::shared_ptr<const DistanceTable>>& OutTables) const
+{
+  check(Static);
+
+  OutTables.resize(Set.Goals.size());
+  ParallelFor((int32) Set.Goals.size(), [&](int32 GoalIndex) {
+    OutTables[GoalIndex] = DistanceTable::Build(*Static, Set.Goals[GoalIndex], Set.Shape, Set.Moves);
+  });
+}
+
+bool StaticDistanceTables::Register(const ArrayType<FPoint>& Goals, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves)
+{
+  if (!Static)
+  {
+    return false;
+  }
+
+  GoalSet Set{ Goals, Shape, Moves };
+  ArrayType<std::shared_ptr<const DistanceTable>> Tables;
+  BuildTables(Set, Tables);
+
+  FScopeLock TablesLock(&TablesSync);
+  Registered.push_back(Set);
+  for (const std::shared_ptr<const DistanceTable>& Table : Tables)
+  {
+    GoalToTables[Table->GetGoal()].push_back(Table);
+  }
+  return true;
+}
+
+void StaticDistanceTables::MarkStale(FPoint ChangedPoint)
+{
+  FScopeLock TablesLock(&TablesSync);
+
+  ++ChangesNum;
+  for (const auto& GoalAndTables : GoalToTables)
+  {
+    for (const std::shared_ptr<const DistanceTable>& Table : GoalAndTables.second)
+    {
+      if (Table->IsAffectedBy(ChangedPoint))
+      {
+        StaleTables[Table.get()] = ChangesNum;
+      }
+    }
+  }
+}
+
+bool StaticDistanceTables::StartRebuild()
+{
+  std::shared_ptr<const RawSpace> StaticCopy;
+  RebuiltTables Tables;
+  {
+    FScopeLock TablesLock(&TablesSync);
+    if (StaleTables.empty() || !Static)
+    {
+      return false;
+    }
+
+    for (const auto& GoalAndTables : GoalToTables)
+    {
+      for (const std::shared_ptr<const DistanceTable>& Table : GoalAndTables.second)
+      {
+        if (StaleTables.count(Table.get()))
+        {
+          Tables.Stale.push_back(Table);
+        }
+      }
+    }
+
+    // The static space is changed by the game thread while the tables are built
+    StaticCopy = std::make_shared<const RawSpace>(*Static);
+    Tables.ChangesNum = ChangesNum;
+  }
+
+  Rebuild = Async(EAsyncExecution::ThreadPool, [StaticCopy, Tables = std::move(Tables)]() mutable -> RebuiltTables {
+    Tables.Rebuilt.resize(Tables.Stale.size());
+    ParallelFor((int32) Tables.Stale.size(), [&](int32 TableIndex) {
+      const DistanceTable& Stale = *Tables.Stale[TableIndex];
+      Tables.Rebuilt[TableIndex] = DistanceTable::Build(*StaticCopy, Stale.GetGoal(), Stale.GetShape(), Stale.GetMoves());
+    });
+    return std::move(Tables);
+  });
+  return true;
+}
+
+void StaticDistanceTables::FinishRebuild(bool bWait)
+{
+  if (!Rebuild.IsValid())
+  {
+    return;
+  }
+
+  if (bWait)
+  {
+    Rebuild.Wait();
+  }
+  if (!Rebuild.IsReady())
+  {
+    return;
+  }
+
+  const RebuiltTables Tables = Rebuild.Get();
+  Rebuild.Reset();
+
+  // Tables being used by planning tasks stay alive till the tasks are finished
+  FScopeLock TablesLock(&TablesSync);
+  for (size_t TableIndex = 0; TableIndex < Tables.Stale.size(); ++TableIndex)
+  {
+    const std::shared_ptr<const DistanceTable>& Stale = Tables.Stale[TableIndex];
+
+    // Tables replaced by Load or Clear during the rebuild are dropped
+    const auto GoalTables = GoalToTables.find(Stale->GetGoal());
+    if (GoalTables == GoalToTables.end())
+    {
+      continue;
+    }
+    const auto Found = std::find(GoalTables->second.begin(), GoalTables->second.end(), Stale);
+    if (Found == GoalTables->second.end())
+    {
+      continue;
+    }
+
+    *Found = Tables.Rebuilt[TableIndex];
+    const auto StaleFound = StaleTables.find(Stale.get());
+    if (StaleFound != StaleTables.end())
+    {
+      const uint64_t LastChange = StaleFound->second;
+      StaleTables.erase(StaleFound);
+      if (LastChange > Tables.ChangesNum)
+      {
+        StaleTables[Found->get()] = LastChange;
+      }
+    }
+  }
+}
+
+void StaticDistanceTables::RebuildIfStale(bool bWait)
+{
+  FinishRebuild(bWait);
+  if (!Rebuild.IsValid() && StartRebuild() && bWait)
+  {
+    FinishRebuild(true);
+  }
+}
+
+std::shared_ptr<const DistanceTable> StaticDistanceTables::Find(FPoint Goal, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves, float Speed) const
+{
+  FScopeLock TablesLock(&TablesSync);
+
+  const auto GoalTables = GoalToTables.find(Goal);
+  if (GoalTables == GoalToTables.end())
+  {
+    return nullptr;
+  }
+
+  for (const std::shared_ptr<const DistanceTable>& Table : GoalTables->second)
+  {
+    if (Table->IsFor(Shape, Moves, Speed))
+    {
+      return StaleTables.count(Table.get()) ? nullptr : Table;
+    }
+  }
+
+  return nullptr;
+}
+
+bool StaticDistanceTables::Save(const TCHAR* FileName) const
+{
+  FScopeLock TablesLock(&TablesSync);
+
+  if (!Static || StaleTables.size())
+  {
+    return false;
+  }
+
+  std::ofstream TablesFile(FileName, std::ios::binary);
+  if (!TablesFile.is_open())
+  {
+    return false;
+  }
+
+  TablesHeader Header;
+  std::memcpy(Header.Magic, TablesMagic, sizeof(TablesMagic));
+  Header.Version = DISTANCE_TABLES_FORMAT_VERSION;
+  Header.Width = Static->GetWidth();
+  Header.Height = Static->GetHeight();
+  Header.TablesNum = 0;
+  for (const auto& GoalAndTables : GoalToTables)
+  {
+    Header.TablesNum += (uint32_t) GoalAndTables.second.size();
+  }
+  Header.MapHash = HashStaticSpace(*Static);
+  WriteValue(TablesFile, Header);
+
+  // Every field is 4 bytes long, so distances stay aligned when the file is mapped
+  for (const auto& GoalAndTables : GoalToTables)
+  {
+    for (const std::shared_ptr<const DistanceTable>& Table : GoalAndTables.second)
+    {
+      WriteValue(TablesFile, (int32_t) Table->GetGoal().X);
+      WriteValue(TablesFile, (int32_t) Table->GetGoal().Y);
+
+      WriteValue(TablesFile, (uint32_t) Table->GetShape().Points.Num());
+      for (const FPoint& ShapePoint : Table->GetShape().Points)
+      {
+        WriteValue(TablesFile, (int32_t) ShapePoint.X);
+        WriteValue(TablesFile, (int32_t) ShapePoint.Y);
+      }
+
+      WriteValue(TablesFile, (uint32_t) Table->GetMoves().size());
+      for (const MoveDelta<FPoint>& Move : Table->GetMoves())
+      {
+        WriteValue(TablesFile, Move.MoveCost);
+        WriteValue(TablesFile, (int32_t) Move.Destination.X);
+        WriteValue(TablesFile, (int32_t) Move.Destination.Y);
+      }
+
+      TablesFile.write(reinterpret_cast<const char*>(Table->GetDistances()), (size_t) Table->GetWidth() * Table->GetHeight() * sizeof(float));
+    }
+  }
+
+  return TablesFile.good();
+}
+
+bool StaticDistanceTables::Load(const TCHAR* FileName)
+{
+  if (!Static)
+  {
+    return false;
+  }
+
+  std::shared_ptr<MappedTablesFile> File = std::make_shared<MappedTablesFile>();
+  File->Handle.reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(FileName));
+  if (!File->Handle)
+  {
+    return false;
+  }
+
+  File->Region.reset(File->Handle->MapRegion(0, File->Handle->GetFileSize()));
+  if (!File->Region)
+  {
+    return false;
+  }
+
+  MappedReader Reader(File->Region->GetMappedPtr(), (size_t) File->Region->GetMappedSize());
+  TablesHeader Header;
+  if (!Reader.Read(Header)
+    || std::memcmp(Header.Magic, TablesMagic, sizeof(TablesMagic)) != 0
+    || Header.Version != DISTANCE_TABLES_FORMAT_VERSION
+    || Header.Width != Static->GetWidth()
+    || Header.Height != Static->GetHeight()
+    || Header.MapHash != HashStaticSpace(*Static))
+  {
+    return false;
+  }
+
+  ArrayType<GoalSet> NewRegistered;
+  MapType<FPoint, ArrayType<std::shared_ptr<const DistanceTable>>> NewGoalToTables;
+  for (uint32_t TableIndex = 0; TableIndex < Header.TablesNum; ++TableIndex)
+  {
+    GoalSet Set;
+    int32_t GoalX = 0;
+    int32_t GoalY = 0;
+    uint32_t ShapeNum = 0;
+    if (!Reader.Read(GoalX) || !Reader.Read(GoalY) || !Reader.Read(ShapeNum))
+    {
+      return false;
+    }
+
+    Set.Shape.Points.Empty();
+    for (uint32_t PointIndex = 0; PointIndex < ShapeNum; ++PointIndex)
+    {
+      int32_t X = 0;
+      int32_t Y = 0;
+      if (!Reader.Read(X) || !Reader.Read(Y))
+      {
+        return false;
+      }
+      Set.Shape.Points.Add(FPoint(X, Y));
+    }
+
+    uint32_t MovesNum = 0;
+    if (!Reader.Read(MovesNum))
+    {
+      return false;
+    }
+
+    for (uint32_t MoveIndex = 0; MoveIndex < MovesNum; ++MoveIndex)
+    {
+      MoveDelta<FPoint> Move;
+      int32_t X = 0;
+      int32_t Y = 0;
+      if (!Reader.Read(Move.MoveCost) || !Reader.Read(X) || !Reader.Read(Y))
+      {
+        return false;
+      }
+      Move.Destination = FPoint(X, Y);
+      Set.Moves.push_back(Move);
+    }
+
+    const float* Distances = Reader.ReadFloats((size_t) Header.Width * Header.Height);
+    if (!Distances)
+    {
+      return false;
+    }
+
+    Set.Goals.push_back(FPoint(GoalX, GoalY));
+    NewGoalToTables[Set.Goals[0]].push_back(std::make_shared<DistanceTable>(
+      Set.Goals[0], Set.Shape, Set.Moves, Header.Width, Header.Height, File, Distances
+    ));
+    NewRegistered.push_back(std::move(Set));
+  }
+
+  FScopeLock TablesLock(&TablesSync);
+  Registered = std::move(NewRegistered);
+  GoalToTables = std::move(NewGoalToTables);
+  StaleTables.clear();
+  return true;
+}
+
+void StaticDistanceTables::Clear()
+{
+  FScopeLock TablesLock(&TablesSync);
+
+  Registered.clear();
+  GoalToTables.clear();
+  StaleTables.clear();
+}
+
+size_t StaticDistanceTables::Num() const
+{
+  FScopeLock TablesLock(&TablesSync);
+
+  size_t TablesNum = 0;
+  for (const auto& GoalAndTables : GoalToTables)
+  {
+    TablesNum += GoalAndTables.second.size();
+  }
+  return TablesNum;
+}
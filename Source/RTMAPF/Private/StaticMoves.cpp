@@ -0,0 +1,27 @@
+#include "StaticMoves.h"
+
+EStaticMoveSet ClassifyMoves(const ArrayType<MoveDelta<FPoint>>& Moves)
+{
+  EStaticMoveSet MoveSet;
+  switch (Moves.size())
+  {
+  case StaticMoveTable<EStaticMoveSet::FourConnected>::Num:
+    MoveSet = EStaticMoveSet::FourConnected;
+    break;
+  case StaticMoveTable<EStaticMoveSet::EightConnected>::Num:
+    MoveSet = EStaticMoveSet::EightConnected;
+    break;
+  default:
+    return EStaticMoveSet::Custom;
+  }
+
+  for (size_t MoveIndex = 0; MoveIndex < Moves.size(); ++MoveIndex)
+  {
+    if (!(UnitMoves[MoveIndex].Delta == Moves[MoveIndex].Destination))
+    {
+      return EStaticMoveSet::Custom;
+    }
+  }
+
+  return MoveSet;
+}
@@ -0,0 +1,334 @@
+#include "TileStreamer.h"
+#include "Async/Async.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+namespace
+{
+  StreamedTile ReadTile(const FString& FileName, std::streamoff RowsOffset, std::streamoff RowStride, FPoint Min, FPoint Max)
+  {
+    StreamedTile Tile;
+    std::ifstream File(*FileName, std::ios::binary);
+    if (!File.is_open())
+    {
+      return Tile;
+    }
+
+    SpaceReader Reader;
+    std::string Row(Max.X - Min.X, '@');
+    for (int Y = Min.Y; Y < Max.Y; ++Y)
+    {
+      File.seekg(RowsOffset + Y * RowStride + Min.X);
+      File.read(&Row[0], Row.size());
+      if (!File)
+      {
+        return Tile;
+      }
+
+      for (int X = Min.X; X < Max.X; ++X)
+      {
+        if (Reader.FromSymbol(Row[X - Min.X]) == Access::Accessable)
+        {
+          Tile.FreePoints.push_back({ X, Y });
+        }
+      }
+    }
+
+    Tile.bRead = true;
+    return Tile;
+  }
+}
+
+TileStreamer::TileStreamer(std::shared_ptr<SpaceTime> InSpace)
+  : Space(InSpace)
+{
+  check(Space);
+}
+
+bool TileStreamer::Open(const FString& InFileName, int InTileSize, int InMaxLoadedTiles, int InDemandRadius)
+{
+  check(InTileSize > 0 && InMaxLoadedTiles > 0 && InDemandRadius >= 0);
+
+  std::ifstream File(*InFileName, std::ios::binary);
+  if (!File.is_open())
+  {
+    return false;
+  }
+
+  SpaceReader Reader;
+  if (!Reader.FindHogLayout(File, Width, Height, RowsOffset, RowStride))
+  {
+    return false;
+  }
+
+  FileName = InFileName;
+  TileSize = InTileSize;
+  MaxLoadedTiles = InMaxLoadedTiles;
+  DemandRadius = InDemandRadius;
+  TilesX = (Width + TileSize - 1) / TileSize;
+  TilesY = (Height + TileSize - 1) / TileSize;
+  return true;
+}
+
+FPoint TileStreamer::GetTileMax(int Tile) const
+{
+  const FPoint Min = GetTileMin(Tile);
+  return { std::min<int>(Width, Min.X + TileSize), std::min<int>(Height, Min.Y + TileSize) };
+}
+
+int TileStreamer::FindTile(FPoint Point) const
+{
+  if (Point.X < 0 || Point.Y < 0 || Point.X >= (int) Width || Point.Y >= (int) Height)
+  {
+    return -1;
+  }
+
+  return Point.X / TileSize + (Point.Y / TileSize) * TilesX;
+}
+
+bool TileStreamer::IsTileLoaded(FPoint Point) const
+{
+  auto Found = Tiles.find(FindTile(Point));
+  return Found != Tiles.end() && Found->second.bLoaded;
+}
+
+void TileStreamer::FindTilesAround(FPoint Point, SetType<int>& OutTiles) const
+{
+  const int MinTileX = std::max(0, Point.X - DemandRadius) / TileSize;
+  const int MinTileY = std::max(0, Point.Y - DemandRadius) / TileSize;
+  const int MaxTileX = std::min<int>(Width - 1, Point.X + DemandRadius) / TileSize;
+  const int MaxTileY = std::min<int>(Height - 1, Point.Y + DemandRadius) / TileSize;
+  for (int TileX = MinTileX; TileX <= MaxTileX; ++TileX)
+  {
+    for (int TileY = MinTileY; TileY <= MaxTileY; ++TileY)
+    {
+      OutTiles.insert(TileX + TileY * TilesX);
+    }
+  }
+}
+
+void TileStreamer::RequestTiles(const SetType<int>& RequestedTiles)
+{
+  ++DemandClock;
+  for (int Tile : RequestedTiles)
+  {
+    TileState& State = Tiles[Tile];
+    State.LastDemand = DemandClock;
+    if (State.bLoaded || Loads.count(Tile))
+    {
+      continue;
+    }
+
+    const FString ReadFileName = FileName;
+    const std::streamoff ReadRowsOffset = RowsOffset;
+    const std::streamoff ReadRowStride = RowStride;
+    const FPoint Min = GetTileMin(Tile);
+    const FPoint Max = GetTileMax(Tile);
+    Loads.emplace(Tile, Async(EAsyncExecution::ThreadPool, [ReadFileName, ReadRowsOffset, ReadRowStride, Min, Max]() -> StreamedTile {
+      return ReadTile(ReadFileName, ReadRowsOffset, ReadRowStride, Min, Max);
+    }));
+  }
+}
+
+bool TileStreamer::Demand(FPoint Point)
+{
+  SetType<int> DemandedTiles;
+  FindTilesAround(Point, DemandedTiles);
+  RequestTiles(DemandedTiles);
+
+  for (int Tile : DemandedTiles)
+  {
+    if (!Tiles[Tile].bLoaded)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void TileStreamer::PinAgent(int AgentID, FPoint Point, const ArrayType<Area>& FilledAreas)
+{
+  SetType<int> PinnedTiles;
+  FindTilesAround(Point, PinnedTiles);
+  for (const Area& FilledArea : FilledAreas)
+  {
+    const int Tile = FindTile(FilledArea.Point);
+    if (Tile >= 0)
+    {
+      PinnedTiles.insert(Tile);
+    }
+  }
+
+  UnpinAgent(AgentID);
+  for (int Tile : PinnedTiles)
+  {
+    ++Tiles[Tile].Pins;
+  }
+  RequestTiles(PinnedTiles);
+  AgentToTiles[AgentID] = std::move(PinnedTiles);
+}
+
+void TileStreamer::UnpinAgent(int AgentID)
+{
+  auto Found = AgentToTiles.find(AgentID);
+  if (Found == AgentToTiles.end())
+  {
+    return;
+  }
+
+  for (int Tile : Found->second)
+  {
+    auto FoundTile = Tiles.find(Tile);
+    check(FoundTile != Tiles.end() && FoundTile->second.Pins > 0);
+    if (!--FoundTile->second.Pins && !FoundTile->second.bLoaded && !Loads.count(Tile))
+    {
+      Tiles.erase(FoundTile);
+    }
+  }
+  AgentToTiles.erase(Found);
+}
+
+void TileStreamer::UnpinAll()
+{
+  AgentToTiles.clear();
+  for (auto& TileAndState : Tiles)
+  {
+    TileAndState.second.Pins = 0;
+  }
+}
+
+void TileStreamer::OverrideCell(FPoint Point, bool bTraversable)
+{
+  CellOverrides[Point] = bTraversable;
+}
+
+void TileStreamer::ApplyTile(int Tile, const StreamedTile& ReadTile, ArrayType<FPoint>& OutChangedPoints)
+{
+  const float Depth = Space->GetDepth();
+  for (const FPoint& FreePoint : ReadTile.FreePoints)
+  {
+    if (!CellOverrides.count(FreePoint) && !Space->ContainsSegmentsIn(FreePoint))
+    {
+      Space->SetAccess(FreePoint, Access::Accessable, Depth);
+      OutChangedPoints.push_back(FreePoint);
+    }
+  }
+
+  for (const auto& PointAndTraversable : CellOverrides)
+  {
+    const FPoint& Point = PointAndTraversable.first;
+    if (PointAndTraversable.second && FindTile(Point) == Tile && !Space->ContainsSegmentsIn(Point))
+    {
+      Space->SetAccess(Point, Access::Accessable, Depth);
+      OutChangedPoints.push_back(Point);
+    }
+  }
+}
+
+void TileStreamer::EvictTile(int Tile, ArrayType<FPoint>& OutChangedPoints)
+{
+  const FPoint Min = GetTileMin(Tile);
+  const FPoint Max = GetTileMax(Tile);
+  for (int X = Min.X; X < Max.X; ++X)
+  {
+    for (int Y = Min.Y; Y < Max.Y; ++Y)
+    {
+      const FPoint Point = { X, Y };
+      if (Space->ContainsSegmentsIn(Point))
+      {
+        Space->SetAccess(Point, Access::Inaccessable, Space->GetDepth());
+        OutChangedPoints.push_back(Point);
+      }
+    }
+  }
+}
+
+void TileStreamer::Commit(bool bWait, ArrayType<FPoint>& OutChangedPoints, SetType<int>& OutWaitingAgents)
+{
+  // Tiles are applied in the same order independently of the hash map
+  ArrayType<int> LoadingTiles;
+  for (const auto& TileAndLoad : Loads)
+  {
+    LoadingTiles.push_back(TileAndLoad.first);
+  }
+  std::sort(LoadingTiles.begin(), LoadingTiles.end());
+
+  SetType<int> LoadedTiles;
+  for (int Tile : LoadingTiles)
+  {
+    TFuture<StreamedTile>& Load = Loads.at(Tile);
+    if (bWait)
+    {
+      Load.Wait();
+    }
+
+    if (!Load.IsReady())
+    {
+      continue;
+    }
+
+    const StreamedTile ReadTile = Load.Get();
+    Loads.erase(Tile);
+
+    TileState& State = Tiles[Tile];
+    if (!ReadTile.bRead)
+    {
+      UE_LOG(LogTemp, Error, TEXT("Cannot read tile %d from File %s"), Tile, *FileName);
+      if (!State.Pins)
+      {
+        Tiles.erase(Tile);
+      }
+      continue;
+    }
+
+    ApplyTile(Tile, ReadTile, OutChangedPoints);
+    State.bLoaded = true;
+    ++LoadedTilesNum;
+    LoadedTiles.insert(Tile);
+  }
+
+  for (const auto& AgentAndTiles : AgentToTiles)
+  {
+    for (int Tile : AgentAndTiles.second)
+    {
+      if (LoadedTiles.count(Tile))
+      {
+        OutWaitingAgents.insert(AgentAndTiles.first);
+        break;
+      }
+    }
+  }
+
+  while (LoadedTilesNum > MaxLoadedTiles)
+  {
+    int EvictedTile = -1;
+    uint64_t EvictedDemand = 0;
+    for (const auto& TileAndState : Tiles)
+    {
+      const TileState& State = TileAndState.second;
+      if (!State.bLoaded || State.Pins)
+      {
+        continue;
+      }
+
+      if (EvictedTile < 0 || State.LastDemand < EvictedDemand || (State.LastDemand == EvictedDemand && TileAndState.first < EvictedTile))
+      {
+        EvictedTile = TileAndState.first;
+        EvictedDemand = State.LastDemand;
+      }
+    }
+
+    if (EvictedTile < 0)
+    {
+      UE_LOG(LogTemp, Warning, TEXT("All %d loaded tiles are pinned by agents, the budget of %d tiles is exceeded"), LoadedTilesNum, MaxLoadedTiles);
+      break;
+    }
+
+    EvictTile(EvictedTile, OutChangedPoints);
+    Tiles.erase(EvictedTile);
+    --LoadedTilesNum;
+  }
+}
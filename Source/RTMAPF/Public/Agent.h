@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "KinodynamicMoves.h"
 #include "Moves.h"
 #include "SearchTypes.h"
 #include "Shapes.h"
@@ -17,6 +18,7 @@ protected:
   float Depth;
   std::shared_ptr<ShapeSpace> Space;
   ArrayType<MoveDelta<FPoint>> Moves;
+  SearchArena* ScratchArena = nullptr;
 
 public:
   virtual ArrayType<MoveDelta<Area>> FindValidMoves(const Node<Area>& Node) override;
@@ -28,6 +30,16 @@ public:
     , Space(InSpace)
     , Moves(InMoves)
   {}
+
+  // Moves are tested in the same space for another agent
+  void Reset(const ArrayType<MoveDelta<FPoint>>& InMoves, float InDepth)
+  {
+    Moves = InMoves;
+    Depth = InDepth;
+  }
+
+  // Temporary containers of a move are allocated from the arena, which is rewound after the move
+  void SetScratchArena(SearchArena* InScratchArena) { ScratchArena = InScratchArena; }
 };
 
 class UMultiagentPathfinder;
@@ -64,9 +76,17 @@ protected:
   UPROPERTY(EditAnywhere, BlueprintReadOnly)
   FPoint Goal;
 
+  // Goals after Goal in the lifelong mode, the first one becomes Goal when Goal is reached
+  UPROPERTY(EditAnywhere, BlueprintReadOnly)
+  TArray<FPoint> NextGoals;
+
   UPROPERTY(EditAnywhere, BlueprintReadOnly, meta = (ClampMin = "0.01"))
   float SpeedModifier = 1.f;
 
+  // If enabled, paths follow the heading and acceleration limits of the model instead of Moves
+  UPROPERTY(EditAnywhere, BlueprintReadOnly)
+  FKinodynamicModel Kinodynamics;
+
   bool bIsConnected = false;
 
   mutable FCriticalSection PropertiesSync;
@@ -93,6 +113,10 @@ public:
   UPROPERTY(BlueprintAssignable)
   FOnConnection OnReplan;
 
+  // Broadcast by the pathfinder tick after the agent arrives to its goal, before the next goal is taken
+  UPROPERTY(BlueprintAssignable)
+  FOnConnection OnGoalReached;
+
   UFUNCTION(BlueprintCallable)
   void InitFrom(FAgentTask Task);
 
@@ -103,6 +127,117 @@ public:
     return Start;
   }
 
+  FPoint GetGoalSafe() const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    return Goal;
+  }
+
+  float GetSpeedSafe() const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    return SpeedModifier;
+  }
+
+  FShape GetShapeSafe() const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    return Shape;
+  }
+
+  TArray<FPointMove> GetMovesSafe() const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    return Moves;
+  }
+
+  FKinodynamicModel GetKinodynamicsSafe() const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    return Kinodynamics;
+  }
+
+  void SetGoalSafe(FPoint NewGoal)
+  {
+    FScopeLock g(&PropertiesSync);
+
+    Goal = NewGoal;
+  }
+
+  // Up to MaxNum first goals after the current one
+  void GetNextGoalsSafe(ArrayType<FPoint>& OuterGoals, int MaxNum) const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    for (int GoalIndex = 0; GoalIndex < NextGoals.Num() && GoalIndex < MaxNum; ++GoalIndex)
+    {
+      OuterGoals.push_back(NextGoals[GoalIndex]);
+    }
+  }
+
+  // The current goal with up to MaxNum next goals, read together so an advance of the goal isn't seen halfway
+  void GetGoalsSafe(FPoint& OuterGoal, ArrayType<FPoint>& OuterNextGoals, int MaxNum) const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    OuterGoal = Goal;
+    for (int GoalIndex = 0; GoalIndex < NextGoals.Num() && GoalIndex < MaxNum; ++GoalIndex)
+    {
+      OuterNextGoals.push_back(NextGoals[GoalIndex]);
+    }
+  }
+
+  bool HasNextGoalsSafe() const
+  {
+    FScopeLock g(&PropertiesSync);
+
+    return NextGoals.Num() > 0;
+  }
+
+  void AppendGoalsSafe(const TArray<FPoint>& Goals)
+  {
+    FScopeLock g(&PropertiesSync);
+
+    NextGoals.Append(Goals);
+  }
+
+  /**
+   * Makes the first of the next goals the current one.
+   * Returns false if there are no next goals.
+   */
+  bool AdvanceGoalSafe(FPoint& OuterGoal)
+  {
+    FScopeLock g(&PropertiesSync);
+
+    if (!NextGoals.Num())
+    {
+      return false;
+    }
+
+    Goal = NextGoals[0];
+    NextGoals.RemoveAt(0);
+    OuterGoal = Goal;
+    return true;
+  }
+
+  /**
+   * Sets all properties without adding the agent to MAPF subsystem,
+   * used to restore recorded agents.
+   */
+  void InitUnsafe(FPoint InStart, FPoint InGoal, const FShape& InShape, const TArray<FPointMove>& InMoves, float InSpeedModifier)
+  {
+    Start = InStart;
+    Goal = InGoal;
+    Shape = InShape;
+    Moves = InMoves;
+    SpeedModifier = InSpeedModifier;
+  }
+
   UFUNCTION(BlueprintCallable)
   int GetIDUnsafe() const
   {
@@ -146,6 +281,17 @@ public:
   UFUNCTION(BlueprintCallable)
   FPathPoint GetNextMove() const;
 
+  // Yaw of a kinodynamic agent along its path in degrees, zero for other agents
+  UFUNCTION(BlueprintCallable)
+  float GetCurrentYaw() const;
+
   UFUNCTION(BlueprintCallable)
   void ChangeGoal(FPoint NewGoal);
+
+  /**
+   * Lifelong mode: queues goals to be reached one after another after the current goal.
+   * Windows of the agent continue through the queued goals when the current one is reached early.
+   */
+  UFUNCTION(BlueprintCallable)
+  void AddGoals(const TArray<FPoint>& Goals);
 };
@@ -2,34 +2,206 @@
 
 #include "Agent.h"
 #include "CoreMinimal.h"
+#include "KinodynamicMoves.h"
 #include "Misc/ScopeLock.h"
 #include "Pathfinding.h"
+#include "PlannerStats.h"
 #include "SearchTypes.h"
+#include "ShardedSpace.h"
 #include "SpaceWrapper.h"
+#include "StaticDistances.h"
 
+#include <limits>
 #include <list>
 #include <memory>
 
+// Goals queued after the current one that a window may pass through in the lifelong mode
+#define REPLAN_MAX_NEXT_GOALS 4
+
+// Nodes of a path that one straight move of the shortcut pass may replace
+#define PATH_SHORTCUT_MAX_NODES 16
+
 struct ReplanChanges
 {
 	bool ReplanSeccess;
 	std::vector<Node<Area>> ReversedPath;
+	// States of the path nodes and the primitives of the path of a kinodynamic agent
+	std::vector<KinodynamicState> ReversedStates;
+	std::shared_ptr<const KinodynamicPrimitives> Primitives;
+	ArrayType<Area> FilledAreas;
+	// Window chosen by the task, applied with the changes
+	float Depth;
+
+	PlannerCounters Stats;
+	ArrayType<TraceEvent> Events;
+};
+
+/**
+ * Limits of a per-agent planning window.
+ * The window grows from MinDepth in open uncongested areas up to MaxDepth
+ * in corridors and crowds, but never far beyond the estimated time to reach the goal.
+ */
+struct FHorizonSettings
+{
+	float MinDepth = 10;
+	float MaxDepth = 30;
+
+	// Half size of the square around an agent which is inspected
+	int NeighbourhoodRadius = 3;
+
+	// Window is limited by (time to reach the goal in open space) * GoalDistanceSlack
+	float GoalDistanceSlack = 2.f;
+};
+
+/**
+ * If the agent is in the middle of a move when replanning starts,
+ * the new path begins at the end of the move and PrevNode is appended to it.
+ */
+struct RepairDetails
+{
+	Node<Area> PrevNode;
+	float NextNodeArrivalCost;
+	// State of a kinodynamic agent at PrevNode
+	KinodynamicState PrevState;
+
+	RepairDetails(const Node<Area>& InPrevNode, float InNextNodeArrivalCost);
+};
+
+/**
+ * Everything needed to plan one window of an agent, captured at the replan start.
+ */
+struct FReplanInput
+{
+	int AgentID = -1;
+	FPoint Point;
+	FPoint Goal;
+	float Speed = 1.f;
+	float Time = 0;
+	float Depth = 0;
+	FShape Shape;
+	std::vector<MoveDelta<FPoint>> Moves;
+	TOptional<RepairDetails> Repair;
+	// Precomputed plane heuristic to the goal, if it is registered
+	std::shared_ptr<const DistanceTable> Distances;
+	// Lifelong mode: goals queued after Goal and their precomputed heuristics
+	std::vector<FPoint> NextGoals;
+	std::vector<std::shared_ptr<const DistanceTable>> NextDistances;
+	// Kinodynamic agents start the window in StartState, primitives are built for their model
+	FKinodynamicModel Kinodynamics;
+	std::shared_ptr<const KinodynamicPrimitives> Primitives;
+	KinodynamicState StartState;
+	// Found paths are shortened by ShortcutWindowPath
+	bool bShortcuts = false;
+	// Without a distance table the plane heuristic is found by BidirectionalPathfinder
+	bool bBidirectionalHeuristic = false;
 };
 
+/**
+ * Runs windowed SIPP for one agent in the given space, which is not changed.
+ * On success OutReversedPath holds the new path from the window end to the start.
+ */
+bool FindWindowPath(const FReplanInput& Input, std::shared_ptr<SegmentSpace> InSpace, std::vector<Node<Area>>& OutReversedPath, bool bLogFailures = true);
+
+/**
+ * FindWindowPath for a kinodynamic agent, nodes of the search are split by the heading and the speed.
+ * OutReversedStates holds the states of the agent at the nodes of the path.
+ */
+bool FindKinodynamicWindowPath(
+	const FReplanInput& Input,
+	std::shared_ptr<SegmentSpace> InSpace,
+	std::vector<Node<Area>>& OutReversedPath,
+	std::vector<KinodynamicState>& OutReversedStates,
+	bool bLogFailures = true
+);
+
+/**
+ * Keeps the rest of the previous path planned for the same goal and agent class
+ * if it is still free in the given space, and searches only the part of the window after its end.
+ * Returns false if the previous path can't be kept, the whole window should be searched then.
+ */
+bool ExtendWindowPath(const FReplanInput& Input, std::shared_ptr<SegmentSpace> InSpace, const std::vector<Node<Area>>& PreviousReversedPath, std::vector<Node<Area>>& OutReversedPath);
+
+/**
+ * Lifelong mode: if the path reaches the goal before the window end, the rest of the window
+ * is searched from the goal to the next goal of the input, and so on while goals are reached early.
+ * Returns the number of passed goals, the path is changed only after them.
+ */
+int ContinueToNextGoals(const FReplanInput& Input, std::shared_ptr<SegmentSpace> InSpace, std::vector<Node<Area>>& InOutReversedPath);
+
+/**
+ * Replaces sequences of grid moves with straight moves at the speed of the fastest move of the agent,
+ * if the cells they sweep are free in the given space. Nodes kept in the path arrive at the same times,
+ * the agent waits at the start of a straight move instead. Goals of the input and the repaired move
+ * stay in the path. Returns the number of removed nodes.
+ */
+int ShortcutWindowPath(const FReplanInput& Input, const SegmentSpace& Space, std::vector<Node<Area>>& InOutReversedPath);
+
+/**
+ * Returns false if any area reserved by the path between StartTime and EndTime isn't free in the space.
+ */
+bool IsPathFree(const std::vector<Node<Area>>& ReversedPath, const FShape& Shape, const SegmentSpace& Space, float StartTime, float EndTime);
+
+/**
+ * Paths planned for one input may be extended by the next replan of another one
+ * if they have the same goals, speed, shape and moves.
+ */
+bool IsSameAgentClass(const FReplanInput& First, const FReplanInput& Second);
+
+/**
+ * Moves NextNodeIndex to the first node of the path that is not reached at Time.
+ */
+void AdvanceAlongPath(const std::vector<Node<Area>>& ReversedPath, float Time, size_t& NextNodeIndex);
+
+/**
+ * Sets the point and time where a new path starts, Input.Time should be the current time.
+ * If the agent is in the middle of a move, the new path starts at its end and Input.Repair is set.
+ */
+void CapturePathPosition(const std::vector<Node<Area>>& ReversedPath, size_t NextNodeIndex, FReplanInput& Input);
+
 struct FAdaptivePath
 {
 protected:
 	UAgent* Agent;
+	// Properties of an agent planned without UObject, they are read instead of Agent when it isn't set
+	FReplanInput Properties;
 
+	// Paths are reserved in all shards holding their cells, windows are searched in the table of SearchShard
+	// chosen by SetSearchShard before every replan
+	std::shared_ptr<ShardedSpace> Shards;
 	std::shared_ptr<SpaceTime> Space;
+	int SearchShard = 0;
+	// Shard of the search that found the current path
+	int PathShard = -1;
+	std::shared_ptr<const StaticDistanceTables> DistanceTables;
+	// Replaced only when no replanning task is running, the task reads it without PathSync
 	mutable std::vector<Node<Area>> ReversedPath;
+	// Replaced with the path, empty if the path isn't kinodynamic
+	std::vector<KinodynamicState> ReversedStates;
+	std::shared_ptr<const KinodynamicPrimitives> Primitives;
 	size_t NextNodeIndex = 1;
+	bool bLastReplanFailed = false;
+	bool bShortcuts = false;
+	bool bBidirectionalHeuristic = false;
+
+	// Statistics of finished replans that are not collected yet
+	PlannerCounters PendingStats;
+	ArrayType<TraceEvent> PendingEvents;
+
+	// Areas reserved in Space by the current path
+	ArrayType<Area> FilledAreas;
 	
 	float Depth = 0;
 	float CurrentTime = 0;
 	float InactivityDelay = 1.f;
 
+	// Nodes of the path reached before this time are already checked for the goal
+	float GoalCheckTime = std::numeric_limits<float>::lowest();
+	// Goal reported by CheckGoalReached, it isn't reported again till another goal is checked
+	TOptional<FPoint> ReachedGoal;
+
 	FShape AgentShapeCapture;
+	// Input of the replan that found the current path, if the path may be extended by the next replan
+	TOptional<FReplanInput> PathInput;
 
 	TFuture<ReplanChanges> ReplanResult;
 
@@ -38,19 +210,77 @@ protected:
 private:
 	inline const Node<Area>& GetNextNode() const;
 	inline const Node<Area>& GetPreviousNode() const;
+	inline FPoint GetStart() const;
 
-	void ClearAreasWithPath(const std::vector<Node<Area>>& InReversedPath) const;
-	void FillAreasWithPath(const std::vector<Node<Area>>& InReversedPath) const;
+	// Kinodynamic paths are given with their states and primitives, other ones with empty states
+	void CollectPathAreas(
+		const std::vector<Node<Area>>& InReversedPath,
+		const std::vector<KinodynamicState>& InReversedStates,
+		const KinodynamicPrimitives* InPrimitives,
+		ArrayType<Area>& OutAreas
+	) const;
+	void ClearAreasWithPath(const std::vector<Node<Area>>& InReversedPath, const std::vector<KinodynamicState>& InReversedStates, const KinodynamicPrimitives* InPrimitives) const;
+	void FillAreasWithPath(const std::vector<Node<Area>>& InReversedPath, const std::vector<KinodynamicState>& InReversedStates, const KinodynamicPrimitives* InPrimitives) const;
+	void FillAreasWithPath(
+		const std::vector<Node<Area>>& InReversedPath,
+		const std::vector<KinodynamicState>& InReversedStates,
+		const KinodynamicPrimitives* InPrimitives,
+		ArrayType<Area>& OutFilledAreas
+	) const;
 
 public:
 	FAdaptivePath() = default;
-	FAdaptivePath(UAgent* InAgent, std::shared_ptr<SpaceTime> Space, float Depth, float CurrentTime, float InactivityDelay = 1.f);
+	FAdaptivePath(UAgent* InAgent, std::shared_ptr<ShardedSpace> InShards, float Depth, float CurrentTime, float InactivityDelay = 1.f);
+	// The agent is given by its properties, Point is the start and the path has no UAgent
+	FAdaptivePath(const FReplanInput& InProperties, std::shared_ptr<ShardedSpace> InShards, float Depth, float CurrentTime);
 	FAdaptivePath(FAdaptivePath&& Other);
 
-	bool Replan(float InDepth);
+	// Reads the search space, so it's called by the replanning task which owns the space
+	float ChooseDepth(const FHorizonSettings& Settings, const FReplanInput& Input) const;
+	/**
+	 * The window is chosen by the task within Settings, a fixed window is given by equal MinDepth and MaxDepth.
+	 * With bCaptureNow the input is captured before the call returns, not when the task starts.
+	 */
+	bool Replan(const FHorizonSettings& Settings, bool bCaptureNow = false);
+	void CaptureReplanInput(FReplanInput& Input) const;
+	void SetDistanceTables(std::shared_ptr<const StaticDistanceTables> InDistanceTables);
+	// Applied from the next replan
+	void SetShortcuts(bool bEnable);
+	void SetBidirectionalHeuristic(bool bEnable);
+	// Applied from the next replan of a path without UAgent
+	void SetProperties(const FReplanInput& InProperties);
+
+	// Should be called before Replan, when no replanning task is running
+	void SetSearchShard(int Shard);
+
+	// Used to replace the path outside of Replan, when no replanning task is running
+	void ReleaseReservations();
+	// Reserves the current path again, if its replacement is dropped after ReleaseReservations
+	void RestoreReservations();
+	void SetResolvedPath(std::vector<Node<Area>>&& InReversedPath, const FShape& InShape, int Shard);
 	bool CheckForUpdate();
+	// Blocks till the running replan is finished, its result is still applied by CheckForUpdate
+	void WaitForReplan() const;
 	void MoveTimeBy(float DeltaTime);
 
+	/**
+	 * Returns true if the path arrived to Goal by the current time, once per goal.
+	 * Nodes after the arrival are checked for the next goal, so goals passed in one tick are found in order.
+	 */
+	bool CheckGoalReached(FPoint Goal);
+
+	// True if Goal is the last goal reported by CheckGoalReached
+	bool IsGoalReached(FPoint Goal) const
+	{
+		return ReachedGoal && ReachedGoal.GetValue() == Goal;
+	}
+
+	// Should be read by the thread applying the replans
+	const std::vector<Node<Area>>& GetReversedPath() const
+	{
+		return ReversedPath;
+	}
+
 	bool IsAnyPathReady() const
 	{
 		FScopeLock PathLock(&PathSync);
@@ -62,7 +292,54 @@ public:
 		return Agent;
 	}
 
+	// Should be read by the thread setting them
+	const FReplanInput& GetProperties() const
+	{
+		return Properties;
+	}
+
+	void TakeStats(PlannerCounters& OutStats, ArrayType<TraceEvent>& OutEvents);
+
+	bool IsKinodynamic() const
+	{
+		return ReversedStates.size() > 0;
+	}
+
+	bool IsLastReplanFailed() const
+	{
+		return bLastReplanFailed;
+	}
+
+	float GetDepth() const
+	{
+		return Depth;
+	}
+
+	int GetSearchShard() const
+	{
+		return SearchShard;
+	}
+
+	// Shard of the current path, or the search shard before the first path is found
+	int GetShard() const
+	{
+		return PathShard >= 0 ? PathShard : SearchShard;
+	}
+
+	int GetPathShard() const
+	{
+		return PathShard;
+	}
+
+	const ArrayType<Area>& GetFilledAreas() const
+	{
+		return FilledAreas;
+	}
+
+	FPoint GetCurrentPoint() const;
 	FVector GetCurrentLocation(ASpace* SpaceWrapper) const;
+	// Degrees from +X towards +Y along the heading of a kinodynamic path, zero for other paths
+	float GetCurrentYaw() const;
 	FPathPoint GetNextMove(ASpace* SpaceWrapper) const;
 
 	~FAdaptivePath();
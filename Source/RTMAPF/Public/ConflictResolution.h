@@ -0,0 +1,94 @@
+#pragma once
+
+#include "AgentPlanner.h"
+#include "SearchTypes.h"
+#include "Segments.h"
+#include "Space.h"
+
+#include <memory>
+
+struct FConflictResolutionSettings
+{
+  // Failing agent and its nearest neighbours that are replanned together
+  int MaxGroupSize = 6;
+
+  // Priority orders evaluated in parallel at one generation
+  int MaxBranches = 8;
+
+  // Rounds of priority swapping before the resolution gives up
+  int MaxGenerations = 3;
+
+  // Cells around the group that are copied to the local space
+  int RegionMargin = 10;
+};
+
+struct GroupResolution
+{
+  bool bSuccess = false;
+  ArrayType<int> AgentIDs;
+  ArrayType<FShape> Shapes;
+  ArrayType<std::vector<Node<Area>>> ReversedPaths;
+
+  // Summed over all evaluated branches
+  PlannerCounters Stats;
+  ArrayType<TraceEvent> Events;
+};
+
+/**
+ * Replans a group of agents around a failing one with prioritized planning
+ * and priority swapping (in the spirit of Priority Based Search).
+ *
+ * The group is planned in a local copy of the space limited by the group's bounding box,
+ * where reservations of the group are released. Every branch is a priority order
+ * evaluated in its own copy, so branches run in parallel. When an agent fails in a branch,
+ * child branches move it before the agents planned earlier.
+ */
+class GroupConflictResolver
+{
+protected:
+  FConflictResolutionSettings Settings;
+
+  // Index 0 is the failing agent
+  ArrayType<FReplanInput> Inputs;
+  ArrayType<ArrayType<Area>> GroupAreas;
+
+  std::shared_ptr<SegmentSpace> LocalSpace;
+  FPoint RegionMin;
+  FPoint RegionMax;
+
+  bool IsInRegion(FPoint Point) const;
+  FPoint FindLocalGoal(FPoint Goal) const;
+
+  struct BranchResult
+  {
+    bool bSuccess = false;
+    size_t FailedPosition = 0;
+    float Cost = 0;
+    ArrayType<std::vector<Node<Area>>> ReversedPaths;
+
+    PlannerCounters Stats;
+    ArrayType<TraceEvent> Events;
+  };
+
+  BranchResult EvaluateBranch(const ArrayType<size_t>& Order) const;
+
+public:
+  GroupConflictResolver(const FConflictResolutionSettings& InSettings);
+
+  /**
+   * The first added agent is the failing one.
+   * FilledAreas are reservations of the agent that will be replaced.
+   */
+  void AddAgent(const FReplanInput& Input, const ArrayType<Area>& FilledAreas);
+
+  /**
+   * Copies the group region of the space. Should be called after all agents are added
+   * and while Space isn't changed by planning.
+   */
+  void TakeSnapshot(const SegmentSpace& Space);
+
+  /**
+   * Doesn't use the original space, can be run asynchronously.
+   */
+  GroupResolution Resolve() const;
+};
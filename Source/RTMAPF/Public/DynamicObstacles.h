@@ -0,0 +1,113 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Optional.h"
+#include "Misc/ScopeLock.h"
+#include "SearchTypes.h"
+#include "Segments.h"
+#include "Shapes.h"
+
+#include <memory>
+#include <unordered_set>
+
+#include "DynamicObstacles.generated.h"
+
+// Length of the hole of an obstacle that exists at a single moment, e.g. while teleporting
+#define OBSTACLE_MOMENT_DURATION 1e-2f
+
+USTRUCT(BlueprintType)
+struct FObstacleWaypoint
+{
+  GENERATED_BODY()
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  FPoint Point;
+
+  // Time in the clock of the multiagent pathfinder
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  float Time = 0;
+};
+
+enum class EObstacleChange : uint8_t
+{
+  Add,
+  Update,
+  Remove
+};
+
+/**
+ * Obstacle moves between waypoints along straight lines with constant speed.
+ * Before the first and after the last waypoint the obstacle doesn't exist.
+ */
+USTRUCT(BlueprintType)
+struct FObstacleTrajectory
+{
+  GENERATED_BODY()
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  TArray<FObstacleWaypoint> Waypoints;
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  FShape Shape;
+};
+
+/**
+ * Writes moving obstacles as time-bounded holes into a SegmentSpace.
+ *
+ * Add, Update and Remove only stage changes, so they are cheap and can be called
+ * from any thread. Staged changes are applied by Commit in one batch: for every
+ * changed obstacle only the difference between old and new holes is written.
+ *
+ * Agents whose reservations overlap a new hole must be replanned. Space counts
+ * overlapping reservations, so the hole stays when they release their old path,
+ * and the reservations stay when the hole is released.
+ */
+class DynamicObstacleLayer
+{
+protected:
+  std::shared_ptr<SegmentSpace> Space;
+
+  // Holes that are written into Space
+  MapType<int, ArrayType<Area>> ObstacleAreas;
+
+  // Not set trajectory means removal
+  MapType<int, TOptional<FObstacleTrajectory>> StagedChanges;
+
+  int MaxObstacleID = 0;
+
+  mutable FCriticalSection StagingSync;
+
+public:
+  DynamicObstacleLayer() = delete;
+  DynamicObstacleLayer(std::shared_ptr<SegmentSpace> InSpace);
+
+  int Add(const FObstacleTrajectory& Trajectory);
+
+  /**
+   * Returns false if the obstacle was neither added nor committed.
+   */
+  bool Update(int ObstacleID, const FObstacleTrajectory& Trajectory);
+
+  void Remove(int ObstacleID);
+
+  bool HasStagedChanges() const;
+
+  /**
+   * Applies staged changes to Space. Should not be called while Space is used by planning.
+   * Points of changed holes are added to ChangedPoints.
+   */
+  void Commit(std::unordered_set<FPoint>& ChangedPoints);
+
+  /**
+   * Also appends the released and reserved holes, so they can be written into copies of Space.
+   */
+  void Commit(std::unordered_set<FPoint>& ChangedPoints, ArrayType<Area>& ReleasedAreas, ArrayType<Area>& ReservedAreas);
+
+  /**
+   * Moves committed holes to another space, e.g. when the map is loaded again.
+   * Staged changes and identifiers of obstacles are kept.
+   */
+  void SetSpace(std::shared_ptr<SegmentSpace> NewSpace);
+};
+
+void FromTrajectoryToFilledAreas(const FObstacleTrajectory& Trajectory, ArrayType<Area>& Areas);
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Moves.h"
+#include "SearchTypes.h"
+#include "Shapes.h"
+#include "Space.h"
+#include "StaticDistances.h"
+
+#include <memory>
+
+// Cost of a pair of an agent and a goal which can't reach each other
+#define GOAL_ASSIGNMENT_FORBIDDEN_COST 1e9f
+
+struct GoalAssignmentResult
+{
+  int AgentID = -1;
+  int TargetID = -1;
+  FPoint Goal;
+  float Cost = 0;
+};
+
+/**
+ * Assigns idle agents to target goals in batches, minimizing the sum of travel costs.
+ *
+ * Costs are plane distances in the static space divided by the speed of an agent,
+ * read from registered distance tables or from tables built for the pending targets.
+ * Without a static space they are straight line distances. Agents and targets are added
+ * as they arrive. Only the costs are kept between solves: they are computed for the new pairs
+ * and kept till the agent or the target is assigned or removed. The pairing itself is found
+ * from scratch by every solve, by the Hungarian method in the thread pool, on a copy of
+ * the pending agents and targets, so a solve is started only after they or their costs changed.
+ */
+class GoalAssignment
+{
+protected:
+  // Agents of one class share the tables of a target, moves are for the speed of 1
+  struct AgentClass
+  {
+    FShape Shape;
+    ArrayType<MoveDelta<FPoint>> Moves;
+  };
+
+  struct PendingAgent
+  {
+    int AgentID;
+    FPoint Point;
+    float Speed;
+    int ClassIndex;
+    // Costs to the targets by their ids, filled by Solve for the new ones
+    MapType<int, float> Costs;
+  };
+
+  struct PendingTarget
+  {
+    int TargetID;
+    FPoint Goal;
+    // Tables indexed by agent classes, built when the first agent of the class needs them
+    ArrayType<std::shared_ptr<const DistanceTable>> Tables;
+  };
+
+  // Copy of the pending agents and targets solved by a task, with the tables and costs it finds
+  struct SolveState
+  {
+    // Solves started before SetStaticSpace or Clear are dropped
+    uint64_t Epoch = 0;
+    // Copy of the static space, if tables are built by the task
+    std::shared_ptr<const RawSpace> Static;
+    bool bStraightCosts = false;
+    ArrayType<AgentClass> Classes;
+    ArrayType<PendingAgent> Agents;
+    ArrayType<PendingTarget> Targets;
+    // Pairs of targets and classes whose tables are built by the task
+    ArrayType<std::pair<size_t, int>> MissingTables;
+    ArrayType<GoalAssignmentResult> Assignments;
+  };
+
+  std::shared_ptr<const RawSpace> Static;
+  std::shared_ptr<const StaticDistanceTables> RegisteredTables;
+
+  ArrayType<AgentClass> Classes;
+  ArrayType<PendingAgent> Agents;
+  ArrayType<PendingTarget> Targets;
+  int NextTargetID = 0;
+
+  TFuture<SolveState> RunningSolve;
+  uint64_t Epoch = 0;
+  // Agents, targets or their costs changed since the last solve was started
+  bool bChanged = false;
+  // Cells of the static space changed while the solve runs, its tables reaching them are dropped
+  ArrayType<FPoint> ChangedDuringSolve;
+
+  int FindClass(const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves, float Speed);
+  void DropTables();
+  // Returns false if there is nothing to pair
+  bool StartSolve();
+  void FinishSolve(bool bWait, ArrayType<GoalAssignmentResult>& OutAssignments);
+
+  // Run by the solve task
+  static void FindCosts(SolveState& State);
+  static float FindCost(const SolveState& State, const PendingAgent& Agent, const PendingTarget& Target);
+  static void Match(SolveState& State);
+
+public:
+  /**
+   * Tables registered in the pathfinder are used for their goals instead of building new ones.
+   */
+  void SetStaticSpace(std::shared_ptr<const RawSpace> InStatic, std::shared_ptr<const StaticDistanceTables> InRegisteredTables);
+
+  // Tables reaching the changed cell of the static space and their costs are found again at the next Solve
+  void MarkStale(FPoint ChangedPoint);
+
+  /**
+   * Moves should be scaled by the speed of the agent, as given by UAgent::GetPropertiesSafe.
+   * An agent added again is moved to the new point.
+   */
+  void AddAgent(int AgentID, FPoint Point, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves, float Speed);
+
+  void RemoveAgent(int AgentID);
+
+  // Returns the id of the new target
+  int AddTarget(FPoint Goal);
+
+  void RemoveTarget(int TargetID);
+
+  /**
+   * Returns the pairs of the solve started by a previous call once it is finished, and starts pairing
+   * as many pending agents and targets as possible with the minimal sum of costs in the thread pool.
+   * With bWait the started solve is finished before the call returns.
+   * Paired agents and targets are removed. Pairs which can't reach each other are never made, neither are
+   * pairs of agents or targets changed or removed during the solve, or read from tables changed during it.
+   */
+  void Solve(bool bWait, ArrayType<GoalAssignmentResult>& OutAssignments);
+
+  int GetAgentsNum() const { return (int) Agents.size(); }
+  int GetTargetsNum() const { return (int) Targets.size(); }
+
+  void Clear();
+};
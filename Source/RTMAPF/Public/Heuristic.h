@@ -1,11 +1,15 @@
 #pragma once
 
 #include "Agent.h"
+#include "PlannerStats.h"
 #include "SearchTypes.h"
 #include "Space.h"
 
 #include <memory>
 
+// Cost written by FindCosts for cells whose cost isn't found
+#define HEURISTIC_COST_NOT_FOUND -1.f
+
 template<class CellType>
 class Heuristic
 {
@@ -22,6 +26,20 @@ public:
 
   virtual void FindCost(CellType To) { };
 
+  /**
+   * Finds costs of all cells in one call, the cost is HEURISTIC_COST_NOT_FOUND if it isn't found.
+   * Used by the search to evaluate all neighbors of an expanded node, heuristics
+   * override it to skip repeated lookups of the same cell.
+   */
+  virtual void FindCosts(const CellType* Cells, size_t Num, float* OutCosts)
+  {
+    for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+    {
+      FindCost(Cells[CellIndex]);
+      OutCosts[CellIndex] = IsCostFound(Cells[CellIndex]) ? GetCost(Cells[CellIndex]) : HEURISTIC_COST_NOT_FOUND;
+    }
+  }
+
   virtual CellType GetOrigin() const { return CellType(); }
 
   virtual ~Heuristic() {};
@@ -45,7 +63,7 @@ public:
   }
 };
 
-class EuclideanHeuristic : public Heuristic<FPoint>
+class EuclideanHeuristic final : public Heuristic<FPoint>
 {
 private:
   FPoint Origin;
@@ -54,15 +72,41 @@ private:
 public:
   EuclideanHeuristic(FPoint Origin, float Speed = 1.f);
 
-  virtual float GetCost(FPoint To) const;
+  virtual float GetCost(FPoint To) const override;
+
+  virtual void FindCost(FPoint To) override;
+
+  virtual void FindCosts(const FPoint* Cells, size_t Num, float* OutCosts) override;
+};
+
+/**
+ * Average of the Euclidean costs to the target and from the source, for searches from both of them.
+ * Heuristics of the two directions sum to the cost between the source and the target in every cell,
+ * which lets the bidirectional search stop as soon as the fronts meet along the shortest path.
+ * It is consistent but weaker than the Euclidean cost to the target.
+ */
+class BalancedEuclideanHeuristic final : public Heuristic<FPoint>
+{
+private:
+  EuclideanHeuristic ToTarget;
+  EuclideanHeuristic ToSource;
+  float SourceToTarget;
+
+public:
+  BalancedEuclideanHeuristic(FPoint Source, FPoint Target, float Speed = 1.f);
+
+  virtual float GetCost(FPoint To) const override;
 
-  virtual void FindCost(FPoint To);
+  virtual void FindCost(FPoint To) override;
+
+  virtual void FindCosts(const FPoint* Cells, size_t Num, float* OutCosts) override;
 };
 
 template<typename FromType, typename ToType>
 class SpaceAdapter : public Heuristic<ToType>
 {
   std::shared_ptr<Heuristic<FromType>> HeuristicPtr;
+  ArrayType<FromType> BatchCells;
 
 public:
   SpaceAdapter(std::shared_ptr<Heuristic<FromType>> InHeuristic)
@@ -74,7 +118,63 @@ public:
 
   virtual float GetCost(ToType To) const override { return HeuristicPtr->GetCost(FromType(To)); }
 
-  virtual void FindCost(ToType To) override { return HeuristicPtr->FindCost(FromType(To)); }
+  virtual void FindCost(ToType To) override
+  {
+    PLANNER_PHASE_SCOPE(EPlannerPhase::HeuristicSearch);
+    return HeuristicPtr->FindCost(FromType(To));
+  }
+
+  virtual void FindCosts(const ToType* Cells, size_t Num, float* OutCosts) override
+  {
+    PLANNER_PHASE_SCOPE(EPlannerPhase::HeuristicSearch);
+    BatchCells.clear();
+    for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+    {
+      BatchCells.push_back(FromType(Cells[CellIndex]));
+    }
+    HeuristicPtr->FindCosts(BatchCells.data(), Num, OutCosts);
+  }
+
+  virtual ToType GetOrigin() const override { return ToType(HeuristicPtr->GetOrigin()); }
+};
+
+/**
+ * SpaceAdapter for a heuristic type known at compile time. With a final HeuristicType
+ * (or one whose methods are final) calls to it are resolved statically,
+ * and the adapter itself is final to be called by Pathfinder without virtual dispatch.
+ */
+template<typename FromType, typename ToType, typename HeuristicType>
+class StaticSpaceAdapter final : public Heuristic<ToType>
+{
+  std::shared_ptr<HeuristicType> HeuristicPtr;
+  ArrayType<FromType> BatchCells;
+
+public:
+  StaticSpaceAdapter(std::shared_ptr<HeuristicType> InHeuristic)
+    : Heuristic<ToType>(ToType(InHeuristic->GetOrigin()))
+    , HeuristicPtr(InHeuristic)
+  {}
+
+  virtual bool IsCostFound(ToType To) const override { return HeuristicPtr->IsCostFound(FromType(To)); }
+
+  virtual float GetCost(ToType To) const override { return HeuristicPtr->GetCost(FromType(To)); }
+
+  virtual void FindCost(ToType To) override
+  {
+    PLANNER_PHASE_SCOPE(EPlannerPhase::HeuristicSearch);
+    return HeuristicPtr->FindCost(FromType(To));
+  }
+
+  virtual void FindCosts(const ToType* Cells, size_t Num, float* OutCosts) override
+  {
+    PLANNER_PHASE_SCOPE(EPlannerPhase::HeuristicSearch);
+    BatchCells.clear();
+    for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+    {
+      BatchCells.push_back(FromType(Cells[CellIndex]));
+    }
+    HeuristicPtr->FindCosts(BatchCells.data(), Num, OutCosts);
+  }
 
   virtual ToType GetOrigin() const override { return ToType(HeuristicPtr->GetOrigin()); }
 };
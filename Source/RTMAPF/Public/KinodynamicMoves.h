@@ -0,0 +1,212 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Moves.h"
+#include "SearchArena.h"
+#include "SearchTypes.h"
+#include "Segments.h"
+#include "Shapes.h"
+
+#include <memory>
+
+#include "KinodynamicMoves.generated.h"
+
+// Headings in angular order from +X towards +Y, odd ones are diagonal
+#define KINODYNAMIC_HEADINGS_NUM 8
+
+/**
+ * Motion limits of an agent that can't move in any direction at once.
+ *
+ * The agent moves forward along its heading, which is one of 8 directions (or 4 without diagonals).
+ * It turns only when it stands, by 45 (or 90) degrees per turn. A step to the next cell starts
+ * and ends either standing or at the cruise speed, the speed changes with the constant acceleration.
+ * All durations are for the speed modifier of 1 and are divided by the speed modifier of the agent.
+ */
+USTRUCT(BlueprintType)
+struct FKinodynamicModel
+{
+  GENERATED_BODY()
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  bool bEnabled = false;
+
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  bool bDiagonalHeadings = true;
+
+  // Cells per second
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.01"))
+  float MaxSpeed = 1.f;
+
+  // Cells per second squared, zero means the speed changes instantly
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0"))
+  float Acceleration = 1.f;
+
+  // Seconds to turn in place by 45 degrees
+  UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0"))
+  float TurnDuration = 0.5f;
+
+  // Heading of the agent before its first path, degrees from +X towards +Y
+  UPROPERTY(EditAnywhere, BlueprintReadWrite)
+  float StartYaw = 0.f;
+
+  bool operator==(const FKinodynamicModel& Other) const
+  {
+    return bEnabled == Other.bEnabled && bDiagonalHeadings == Other.bDiagonalHeadings && MaxSpeed == Other.MaxSpeed
+      && Acceleration == Other.Acceleration && TurnDuration == Other.TurnDuration && StartYaw == Other.StartYaw;
+  }
+};
+
+/**
+ * Heading of an agent at a node of its path and whether it passes the node at the cruise speed.
+ */
+struct KinodynamicState
+{
+  uint8 Heading = 0;
+  bool bMoving = false;
+
+  bool operator==(const KinodynamicState& Other) const
+  {
+    return Heading == Other.Heading && bMoving == Other.bMoving;
+  }
+};
+
+// Unit grid delta of a heading
+FPoint GetHeadingDelta(int Heading);
+
+// Heading of a unit grid delta, -1 for other deltas
+int FindHeading(FPoint Delta);
+
+/**
+ * Area of a node of the kinodynamic search, safe intervals are split by the state of the agent.
+ */
+struct OrientedArea : public Area
+{
+  uint8 Heading = 0;
+  bool bMoving = false;
+
+  OrientedArea() = default;
+
+  explicit OrientedArea(const FPoint& InPoint)
+    : Area(InPoint)
+  { }
+
+  OrientedArea(const Area& InArea, KinodynamicState State)
+    : Area(InArea)
+    , Heading(State.Heading)
+    , bMoving(State.bMoving)
+  { }
+
+  KinodynamicState GetState() const { return { Heading, bMoving }; }
+
+  bool operator==(const OrientedArea& Other) const
+  {
+    return Area::operator==(Other) && Heading == Other.Heading && bMoving == Other.bMoving;
+  }
+};
+
+MAKE_HASHABLE(OrientedArea, Type.Point, Type.Interval, Type.Heading, Type.bMoving);
+
+/**
+ * Moves of a kinodynamic agent with the cells they sweep, computed once per model.
+ * Touched cells of a step are the ones of GetTouchedSegments for the same delta, but their
+ * time segments follow the speed profile of the step instead of the constant speed.
+ * Times are shares of the step duration, which is for the speed modifier of 1.
+ */
+class KinodynamicPrimitives
+{
+public:
+  struct TouchedCell
+  {
+    FPoint Delta;
+    float Start;
+    float End;
+  };
+
+  struct Step
+  {
+    FPoint Delta;
+    float Duration = 0;
+    // The origin and the destination are the first two cells
+    ArrayType<TouchedCell> Touched;
+  };
+
+protected:
+  FKinodynamicModel Model;
+  float CruiseSpeed;
+  Step Steps[KINODYNAMIC_HEADINGS_NUM][2][2];
+
+public:
+  explicit KinodynamicPrimitives(const FKinodynamicModel& InModel);
+
+  const FKinodynamicModel& GetModel() const { return Model; }
+
+  // Heading change of one turn
+  int GetTurnStep() const { return Model.bDiagonalHeadings ? 1 : 2; }
+
+  float GetTurnDuration() const { return Model.TurnDuration * GetTurnStep(); }
+
+  float GetCruiseSpeed() const { return CruiseSpeed; }
+
+  const Step& GetStep(int Heading, bool bStartMoving, bool bEndMoving) const
+  {
+    return Steps[Heading][bStartMoving][bEndMoving];
+  }
+
+  // Heading of the model start yaw, rounded to the allowed headings
+  int GetStartHeading() const;
+
+  /**
+   * Share of the step length passed after TimeShare of its duration.
+   */
+  float GetDistanceShare(int Heading, bool bStartMoving, bool bEndMoving, float TimeShare) const;
+};
+
+/**
+ * Moves of the kinodynamic search. A standing agent may wait, turn or start a step,
+ * a moving one continues by a step along its heading at once. A step may end moving
+ * only before the window end, so every path can be stopped at its last node.
+ */
+class KinodynamicMovesSegment final : public MoveComponent<OrientedArea>
+{
+protected:
+  float Depth;
+  float Speed;
+  std::shared_ptr<ShapeSpace> Space;
+  std::shared_ptr<const KinodynamicPrimitives> Primitives;
+  SearchArena* ScratchArena = nullptr;
+
+  void AddStep(const Node<OrientedArea>& Node, bool bEndMoving, ArrayType<MoveDelta<OrientedArea>>& OutMoves);
+
+public:
+  virtual ArrayType<MoveDelta<OrientedArea>> FindValidMoves(const Node<OrientedArea>& Node) override;
+
+  KinodynamicMovesSegment(std::shared_ptr<const KinodynamicPrimitives> InPrimitives, float InSpeed, std::shared_ptr<ShapeSpace> InSpace, float InDepth)
+    : Space(InSpace)
+  {
+    Reset(InPrimitives, InSpeed, InDepth);
+  }
+
+  // Moves are tested in the same space for another agent
+  void Reset(std::shared_ptr<const KinodynamicPrimitives> InPrimitives, float InSpeed, float InDepth)
+  {
+    check(InPrimitives && InSpeed > 0);
+    Primitives = InPrimitives;
+    Speed = InSpeed;
+    Depth = InDepth;
+  }
+
+  // Temporary containers of a move are allocated from the arena, which is rewound after the move
+  void SetScratchArena(SearchArena* InScratchArena) { ScratchArena = InScratchArena; }
+};
+
+/**
+ * Areas reserved by a kinodynamic path, as FromReversedPathToFilledAreas does for other paths.
+ * Nodes at the same point are turns or waits, the other ones are steps with the states of the path.
+ */
+void FromReversedKinodynamicPathToFilledAreas(
+  const ArrayType<Node<Area>>& Path,
+  const ArrayType<KinodynamicState>& States,
+  const KinodynamicPrimitives& Primitives,
+  const FShape& Shape,
+  ArrayType<Area>& Areas
+);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <memory>
+#include <string>
+
+/**
+ * Stream socket of the local machine, a Unix domain socket bound to a file path.
+ * Sockets are blocking, waits are limited by the timeouts of Accept and Receive.
+ * Not supported on Windows, where all calls fail.
+ */
+class LocalSocket
+{
+protected:
+  int Handle = -1;
+
+  explicit LocalSocket(int InHandle);
+
+public:
+  LocalSocket() = default;
+  LocalSocket(const LocalSocket&) = delete;
+  LocalSocket& operator=(const LocalSocket&) = delete;
+  ~LocalSocket();
+
+  /**
+   * Binds the socket to the path, an existing socket file is replaced.
+   */
+  bool Listen(const FString& Path);
+
+  /**
+   * Waits up to TimeoutMs for a connection, negative timeout waits forever.
+   * Returns null if nobody has connected.
+   */
+  std::unique_ptr<LocalSocket> Accept(int TimeoutMs);
+
+  bool Connect(const FString& Path);
+
+  /**
+   * Blocks till all data is sent. Returns false if the connection is broken.
+   */
+  bool Send(const std::string& Data);
+
+  /**
+   * Waits up to TimeoutMs for data, negative timeout waits forever, and appends received data to OutData.
+   * Returns false if the connection is closed or broken.
+   */
+  bool Receive(int TimeoutMs, std::string& OutData);
+
+  bool IsOpen() const { return Handle >= 0; }
+
+  void Close();
+};
@@ -2,18 +2,44 @@
 
 #include "Agent.h"
 #include "AgentPlanner.h"
+#include "ConflictResolution.h"
 #include "CoreMinimal.h"
+#include "GoalAssignment.h"
 #include "Misc/Optional.h"
 #include "Misc/ScopeLock.h"
+#include "PathBuffer.h"
+#include "PathReplication.h"
 #include "Pathfinding.h"
+#include "PlannerService.h"
+#include "PlannerStats.h"
+#include "ReplanScheduler.h"
+#include "ReservationIndex.h"
 #include "SearchTypes.h"
+#include "SessionRecord.h"
+#include "ShardedSpace.h"
 #include "SpaceWrapper.h"
 
+#include <functional>
 #include <list>
 #include <memory>
+#include <unordered_set>
 
 #include "MAPF.generated.h"
 
+/**
+ * Replanning task of one agent and the shards it may write.
+ */
+struct RunningReplan
+{
+	int AgentID = -1;
+	bool bFreshAgent = false;
+	bool bPendingRemove = false;
+	// The space or the goal changed while planning, the result is replaced by a new replan
+	bool bRepeat = false;
+	// Blocks of the shards of the current path and of the search
+	SetType<int> LockedShards;
+};
+
 UCLASS()
 class RTMAPF_API UMultiagentPathfinder : public UGameInstanceSubsystem
 {
@@ -24,28 +50,125 @@ protected:
 	ASpace* SpaceWrapper;
 
 	std::shared_ptr<SpaceTime> Space;
+	// Reservation tables of tiles of Space, or Space itself if sharding is disabled
+	std::shared_ptr<ShardedSpace> Shards;
 
 	// TODO maybe make unique ptr
 	TMap<int, FAdaptivePath> AgentPaths;
 
 	UPROPERTY()
 	TArray<UAgent*> PendingToAdd;
-	// Order in which IDs shoud be processed. 
-	// Can have improper IDs
-	TDoubleLinkedList<int> Order;
+	// Agents waiting for a replan in every shard, the one with the earliest deadline is processed first
+	ShardedReplanScheduler Scheduler;
+	// Regions touched by reservations of each agent
+	ReservationIndex ReservationAgents;
 
-	TOptional<int> CurrentlyReplanning;
-	bool PendingRemove = false;
-	bool ReplanningFreshAgent = false;
-	bool ReplanRepeat = false;
+	// Replans of agents whose blocks of shards don't intersect run at the same time
+	ArrayType<RunningReplan> RunningReplans;
+	int MaxConcurrentReplans = 1;
+	// Agents whose paths are in blocks used by running replans are removed when nothing is planning
+	ArrayType<int> PendingRemovals;
+	// Changed cells of the static space, copied to the shard tables when nothing is planning
+	std::unordered_set<FPoint> PendingCellUpdates;
 
 	float CurrentTime = 0;
-	float Depth = 0;
+	FHorizonSettings Horizon;
+
+	// Part of the planning window after which an agent must be replanned
+	float WindowExpirationShare = 0.5f;
+	// Max delay of a replan caused by a reservation change in the neighbourhood
+	float ReservationChangeLatency = 0;
+
+	// If enabled, failing agents are replanned together with their neighbours
+	bool bResolveConflicts = false;
+	FConflictResolutionSettings ResolutionSettings;
+	TOptional<int> PendingResolution;
+	int ResolutionShard = 0;
+	TFuture<GroupResolution> ResolutionResult;
+	// Agents of the resolved group are not scheduled till the resolution is applied, others are planned meanwhile
+	SetType<int> ResolvingAgents;
+	// Agents of the group forced to replan meanwhile, e.g. by a goal change, are replanned at once after the resolution
+	SetType<int> ForcedWhileResolving;
+
+	// If enabled, found paths are shortened by straight moves where they are free
+	bool bShortcutPaths = false;
+
+	// If enabled, windows of goals without distance tables use the bidirectional plane heuristic
+	bool bBidirectionalHeuristic = false;
+
+	// Plane distances to registered goals, shared by planning tasks of all agents
+	std::shared_ptr<StaticDistanceTables> DistanceTables = std::make_shared<StaticDistanceTables>();
+
+	// Current paths of all agents, read by consumers without copies
+	std::shared_ptr<PathBuffer> ExportedPaths = std::make_shared<PathBuffer>();
+
+	// Idle agents and goals waiting to be paired, paired in the thread pool and assigned by Tick
+	GoalAssignment Assignment;
+
+	// Lifelong mode: gives the next goal of an agent whose goal queue is empty
+	std::function<bool(int, FPoint, FPoint&)> GoalGenerator;
+	// Agents which took their last goals, the generator is called for them at the next Tick
+	SetType<int> GoalGenerationAgents;
+
+	// Planner counters collected from finished replans and resolutions
+	PlannerStatsCollector Stats;
+
+	// Calls changing the state of the pathfinder are written to the session file
+	SessionRecorder Recorder;
+
+	// Planning tasks are always finished at the next Tick, independently of the thread pool timing
+	bool bDeterministic = false;
+
+	// If connected, agents are planned by a planner service in another process
+	// and their paths are mirrored in Space
+	std::shared_ptr<PlannerClient> RemotePlanner;
+
+	// Replayed agents are owned by the pathfinder till Reset
+	UPROPERTY()
+	TArray<UAgent*> ReplayAgents;
 
 	int MaxAgentID = 0;
 
 	mutable FCriticalSection AccessAgentPaths;
 
+protected:
+	void PrioritizeNeighbours(int ID, float Deadline);
+	void FindReplanShards(int ID, SetType<int>& OutShards) const;
+	bool IsAnyShardLocked(const SetType<int>& CheckedShards) const;
+	RunningReplan* FindRunningReplan(int ID);
+	void StartReplan(int ID, bool bFreshAgent);
+	// Returns false if the replan is still running
+	bool FinishReplan(RunningReplan& Replan);
+	void RemoveAgentPath(int ID);
+	void PinStreamedTiles(int ID);
+	void CommitStreaming();
+	void ApplyPendingChanges();
+	void HandleSpaceChange(FPoint Point);
+	void HandleObstacleChange(EObstacleChange Change, int ObstacleID, const FObstacleTrajectory& Trajectory);
+	void CommitObstacles();
+	// Sets the goals paired by Assignment and replans their agents
+	void AssignGoals();
+	// Reports goals reached by the current time and moves the agents to their next goals
+	void UpdateReachedGoals();
+	// Queues generated goals, they are recorded before the Tick as they are replayed
+	void GenerateGoals();
+	void StartResolution(int ID);
+	void ApplyResolution(const GroupResolution& Resolution);
+	void CollectStats(int ID);
+	// Publishes the current path of the agent to ExportedPaths
+	void ExportPath(int ID);
+	// Writes the event to the session file and sends it to the planner service
+	void PublishEvent(const SessionEvent& Event);
+	// Publishes the change of a setting at the current time, if it is recorded or planned by the service
+	void RecordSetting(SessionEvent Event);
+	void SendRemoteAgents();
+	void ReceiveRemotePaths();
+	void ApplyRemoteUpdate(PlannerUpdate& Update);
+
+	UAgent* FindAgent(int ID) const;
+	void WaitForPlanning();
+	void ApplySessionEvent(const SessionEvent& Event);
+
 public:
 	UMultiagentPathfinder();
 
@@ -61,9 +184,71 @@ public:
 		return SpaceWrapper;
 	}
 
+	/**
+	 * Sets the longest planning window. Agents whose current windows
+	 * expire later than the new depth allows are rescheduled.
+	 */
 	UFUNCTION(BlueprintCallable)
 	void SetDepth(float InDepth);
 
+	/**
+	 * Sets the shortest planning window used in open uncongested areas.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetMinDepth(float InMinDepth);
+
+	/**
+	 * Enables replanning of failing agents together with their neighbours
+	 * using priority swapping. Paths of the group are searched in parallel branches.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetConflictResolution(bool bEnable);
+
+	/**
+	 * Enables shortening of found paths: sequences of grid moves are replaced with straight moves
+	 * of any angle where the swept cells are free. Applied from the next replan of every agent.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetPathShortcuts(bool bEnable);
+
+	/**
+	 * Enables the bidirectional search of the plane heuristic for goals without registered distance tables,
+	 * see BidirectionalPathfinder. It expands less for far starts in cluttered spaces or behind obstacles.
+	 * The heuristic is exact along the shortest paths and only bounded from below off them,
+	 * so windows are found by more expansions near obstacles, see the FindWindowPath benchmarks.
+	 * Applied from the next replan of every agent.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetBidirectionalHeuristic(bool bEnable);
+
+	/**
+	 * Splits the space into square tiles with their own reservation tables and replan queues.
+	 * Windows of an agent are searched in the tile of its position and the halo around it,
+	 * agents move to the neighbour tiles at replans. Up to MaxConcurrentReplans replans
+	 * of distant tiles run at the same time. Zero TileSize disables sharding.
+	 * Needs a space loaded from a file and should be called before agents are added,
+	 * SetSpace and Reset disable sharding.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool SetSharding(int TileSize, int Halo, int InMaxConcurrentReplans);
+
+	/**
+	 * Moves planning to a planner service listening on the local socket, see PlannerService.
+	 * Adding, removing and goal changes of agents, queued goals, space changes, moving obstacles,
+	 * planner settings and ticks are sent to the service, paths are received at the next ticks.
+	 * Distance tables are not sent.
+	 * Should be called before agents are added and without sharding.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool ConnectPlannerService(FString SocketPath);
+
+	/**
+	 * Agents with received paths are replanned locally from them, others are added again.
+	 * Called when the connection is broken as well.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void DisconnectPlannerService();
+
 	UFUNCTION(BlueprintCallable)
 	void Reset();
 
@@ -76,17 +261,152 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void RemoveAgent(int ID);
 
+	/**
+	 * Adds goals to be assigned to idle agents. At every Tick pending goals and idle agents
+	 * are paired minimizing the sum of their plane distances in the thread pool, see GoalAssignment.
+	 * Paired agents get the goals as by ChangeGoal at the Tick after the pairing is done,
+	 * unpaired ones wait for the next pairing.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void AddGoalsToAssign(const TArray<FPoint>& Goals);
+
+	/**
+	 * Makes the agents wait for a goal from AddGoalsToAssign at their current points.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void AddIdleAgents(const TArray<int>& AgentIDs);
+
+	UFUNCTION(BlueprintCallable)
+	int GetGoalsToAssignNum() const;
+
+	/**
+	 * Called by UAgent::AddGoals after the goals are queued to the agent.
+	 * An agent waiting at its reached goal leaves for the next one at the next Tick.
+	 */
+	void HandleGoalsAdded(int ID, const TArray<FPoint>& Goals);
+
+	/**
+	 * Lifelong mode: when an agent takes the last goal of its queue, Generator(ID, Goal, OutNextGoal)
+	 * may give the goal after it at the next Tick, so the windows of the agent don't end at the goal.
+	 * Agents waiting at their reached goals are asked at every Tick.
+	 * Generated goals are recorded as added by UAgent::AddGoals. Empty function disables generation.
+	 */
+	void SetGoalGenerator(std::function<bool(int, FPoint, FPoint&)> Generator);
+
+	/**
+	 * Throughput: goals reached by all agents per minute of the pathfinder clock since the last Reset.
+	 */
+	UFUNCTION(BlueprintCallable)
+	float GetGoalsPerMinute() const;
+
 	UFUNCTION(BlueprintCallable)
   FVector GetCurrentLocation(int ID) const;
 	
 	UFUNCTION(BlueprintCallable)
   FPathPoint GetNextMove(int ID) const;
 
+	UFUNCTION(BlueprintCallable)
+	float GetCurrentYaw(int ID) const;
+
+	/**
+	 * Copy of the whole current path of the agent, for the handle of the path see GetPathHandle.
+	 */
+	UFUNCTION(BlueprintCallable)
+	TArray<FPathPoint> GetPlannedPath(int ID) const;
+
 	UFUNCTION(BlueprintCallable)
 	void ForceReplan(int ID);
 
 	UFUNCTION(BlueprintCallable)
 	float GetCurrentTime() const;
 
+	/**
+	 * Per-phase timings, search counters and queue waits, globally and per agent.
+	 */
+	UFUNCTION(BlueprintCallable)
+	FString GetStatsJson() const;
+
+	/**
+	 * Clears all counters, trace events and the throughput clock. Counters of removed agents
+	 * are dropped when they are removed, so the statistics don't grow in long sessions.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void ResetStats();
+
+	/**
+	 * Writes the statistics as JSON, or the traced events in the Chrome trace format
+	 * (chrome://tracing, Perfetto). Returns false if the file can't be written.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool ExportStats(FString FileName, bool bChromeTrace);
+
+	/**
+	 * Enables recording of trace events. Counters are collected regardless.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetTracing(bool bEnable);
+
+	/**
+	 * Records agents, goal changes, space and obstacle changes and ticks to the file
+	 * till StopRecording or Reset. Should be started before agents are added.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool StartRecording(FString FileName);
+
+	UFUNCTION(BlueprintCallable)
+	void StopRecording();
+
+	/**
+	 * Precomputes distances from every cell of the static map to each goal for agents
+	 * of the shape and moves, so their plane searches are replaced by table lookups.
+	 * Tables are rebuilt on the next Tick after a change of the map.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool RegisterGoals(const TArray<FPoint>& Goals, const FShape& Shape, const TArray<FPointMove>& Moves);
+
+	UFUNCTION(BlueprintCallable)
+	bool SaveDistanceTables(FString FileName);
+
+	/**
+	 * Maps tables saved by SaveDistanceTables for the same map, possibly by another process.
+	 * Registered tables are replaced.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool LoadDistanceTables(FString FileName);
+
+	/**
+	 * In deterministic mode Tick waits for running planning tasks instead of polling them,
+	 * so the result depends only on the sequence of calls.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetDeterministic(bool bEnable);
+
+	/**
+	 * Resets the pathfinder and replays the recorded session deterministically
+	 * in the current space, which should be loaded from the same map as the recorded one.
+	 * Wall clock latency of every tick is written to the report as JSON.
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool ReplaySession(FString SessionFileName, FString ReportFileName);
+
 	std::shared_ptr<SpaceTime> GetSpace() const { return Space; };
+
+	/**
+	 * Paths of agents in grid points. PathBuffer::Read copies the nodes of a handle on any thread without locks,
+	 * the buffer is shared till the pathfinder is destroyed.
+	 */
+	std::shared_ptr<const PathBuffer> GetPathBuffer() const { return ExportedPaths; }
+
+	/**
+	 * Handle of the current path of the agent in GetPathBuffer, its Version changes with every new path.
+	 * Takes the lock of the agent paths, so readers on other threads should cache the handle and fetch it
+	 * again only when Read fails or a newer path is needed, e.g. once per tick of the pathfinder.
+	 */
+	PathHandle GetPathHandle(int ID) const;
+
+	/**
+	 * Appends changes of the paths for one networked client, up to MaxBytes, see PathReplicationEncoder.
+	 * The encoder remembers what the client has received, so every client needs its own one.
+	 */
+	size_t EncodePathReplication(PathReplicationEncoder& Encoder, size_t MaxBytes, std::vector<uint8_t>& OutData) const;
 };
@@ -11,6 +11,36 @@ class UAnalyticsBlueprintLibrary : public UBlueprintFunctionLibrary
 {
   GENERATED_BODY()
 
+public:
   UFUNCTION(BlueprintCallable)
   static TArray<FAgentTask> GetAgentTasksFromHogFile(FString FileName, int TasksNum);
+
+  /**
+   * Measures the search primitives on the map with random reservations
+   * and writes the results in the JSON format of Google Benchmark.
+   */
+  UFUNCTION(BlueprintCallable)
+  static bool RunPlannerBenchmarks(FString MapFileName, FString ReportFileName, int ReservationsNum = 5000, float MinTime = 0.5f);
+
+  /**
+   * Runs behavioral checks of the planner primitives, see PlannerChecks.
+   * Failed checks are logged as errors, returns true if all of them pass.
+   */
+  UFUNCTION(BlueprintCallable)
+  static bool RunPlannerChecks();
+
+  /**
+   * Runs the planner service of the map on the local socket, see PlannerService.
+   * Depth is the longest planning window, shorter ones are chosen in open areas.
+   * Blocks till the first client disconnects if bOnce is set, or forever otherwise.
+   */
+  UFUNCTION(BlueprintCallable)
+  static bool RunPlannerService(FString MapFileName, FString SocketPath, float Depth = 30.f, int MaxReplansPerTick = 64, bool bOnce = false);
+
+  /**
+   * Drives a running planner service with agents of random tasks on the same map
+   * and writes the round trip latency of every tick as JSON.
+   */
+  UFUNCTION(BlueprintCallable)
+  static bool RunPlannerServiceLoadTest(FString MapFileName, FString SocketPath, FString ReportFileName, int AgentsNum = 100, int TicksNum = 600, int Seed = 42);
 };
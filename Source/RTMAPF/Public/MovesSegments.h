@@ -8,4 +8,7 @@ float MakeStepInSquare(FVector2D& Point, const FVector2D& Speed, FPoint& MoveDes
 
 void SetLineTimings(std::unordered_map<FPoint, Segment>& Segments, const FVector2D& Speed, FVector2D StartPoint);
 
+// Touched segments for the move cost of 1, computed without the cache of GetTouchedSegments
+std::unordered_map<FPoint, Segment> ComputeUnitTouchedSegments(const FPoint& Destination);
+
 std::unordered_map<FPoint, Segment> GetTouchedSegments(const MoveDelta<FPoint>& Move);
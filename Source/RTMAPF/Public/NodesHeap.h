@@ -35,11 +35,19 @@ public:
 
   NodeType* PopMin();
 
+  // Nullptr if the heap is empty
+  NodeType* Top() const;
+
   void Insert(NodeType& NewNode);
 
   void ImproveTime(NodeType& ChangedNode, float NewMinTime);
 
   size_t Size() const;
+
+  // Removes all nodes, the memory is kept for the next search
+  void Clear();
+
+  void Reserve(size_t NodesNum);
 };
 
 template<typename CellType>
@@ -121,6 +129,12 @@ Node<CellType>* NodesBinaryHeap<CellType>::PopMin()
   return Result;
 }
 
+template<typename CellType>
+Node<CellType>* NodesBinaryHeap<CellType>::Top() const
+{
+  return Size() ? Nodes[1] : nullptr;
+}
+
 template<typename CellType>
 size_t NodesBinaryHeap<CellType>::Size() const
 {
@@ -128,6 +142,18 @@ size_t NodesBinaryHeap<CellType>::Size() const
   return Nodes.size() - 1;
 }
 
+template<typename CellType>
+void NodesBinaryHeap<CellType>::Clear()
+{
+  Nodes.resize(1);
+}
+
+template<typename CellType>
+void NodesBinaryHeap<CellType>::Reserve(size_t NodesNum)
+{
+  Nodes.reserve(NodesNum + 1);
+}
+
 template<typename CellType>
 bool NodesBinaryHeap<CellType>::Compare(const NodeType& First, const NodeType& Second) const
 {
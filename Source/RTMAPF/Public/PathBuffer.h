@@ -0,0 +1,108 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SearchTypes.h"
+#include "Segments.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define PATH_BUFFER_SEGMENT_SIZE 4096
+#define PATH_BUFFER_MAX_SEGMENTS 256
+
+/**
+ * Point of a published path, reached at Time after a move of MoveDuration.
+ */
+struct PathBufferNode
+{
+  FPoint Point;
+  float Time;
+  float MoveDuration;
+};
+
+/**
+ * Position of the published path of an agent in the buffer.
+ * Version is incremented by every path published for the agent, zero means no path.
+ */
+struct PathHandle
+{
+  uint64_t Offset = 0;
+  uint32_t Length = 0;
+  uint32_t Version = 0;
+};
+
+/**
+ * Append-only storage of the current paths of agents, read by consumers on other threads.
+ *
+ * Paths are written once in forward order into fixed segments addressed by a growing offset.
+ * A segment is reused after PATH_BUFFER_MAX_SEGMENTS newer ones, paths still published in it
+ * are moved to the new segment with the next version.
+ *
+ * Reading is copy-on-read: handles are taken from the writer under its lock, then Read copies
+ * the nodes without locking and validates the copy. It fails if the segment was reused before
+ * or during the copy, the handle should be requested again then. Only the writer reads nodes in place.
+ *
+ * Publish, Remove, Clear and GetHandle are called by one writer thread.
+ */
+class PathBuffer
+{
+protected:
+  struct Segment
+  {
+    std::unique_ptr<PathBufferNode[]> Nodes;
+    // Offset / PATH_BUFFER_SEGMENT_SIZE of the nodes held by the segment
+    std::atomic<uint64_t> Number;
+    // Paths in the segment that aren't replaced or removed yet
+    int LivePaths = 0;
+
+    Segment();
+  };
+
+  Segment Segments[PATH_BUFFER_MAX_SEGMENTS];
+  uint64_t WriteOffset = 0;
+  MapType<int, PathHandle> Handles;
+
+  const Segment& GetSegment(uint64_t Offset) const;
+  Segment& GetSegment(uint64_t Offset);
+  void Release(const PathHandle& Handle);
+  // Returns false if live paths don't leave space for Length nodes
+  bool Reserve(uint32_t Length, uint64_t& OutOffset);
+  void StartSegment(uint64_t Number);
+
+public:
+  PathBuffer() = default;
+  PathBuffer(const PathBuffer&) = delete;
+  PathBuffer& operator=(const PathBuffer&) = delete;
+
+  /**
+   * Replaces the published path of the agent. Returns false if the path is too long,
+   * the agent has no published path then.
+   */
+  bool Publish(int AgentID, const std::vector<Node<Area>>& ReversedPath);
+
+  void Remove(int AgentID);
+
+  // Handles given before stay readable till their segments are reused
+  void Clear();
+
+  PathHandle GetHandle(int AgentID) const;
+
+  /**
+   * First node of the path, or nullptr if its segment is already reused.
+   * Nodes may be rewritten while they are read, other threads than the writer should use Read.
+   */
+  const PathBufferNode* Find(const PathHandle& Handle) const;
+
+  /**
+   * Should be checked after the nodes are read, they are intact only if it is still true.
+   */
+  bool IsValid(const PathHandle& Handle) const;
+
+  /**
+   * Copies the nodes of the path, on any thread.
+   * Returns false and leaves OutNodes empty if the segment was reused before or during the copy.
+   */
+  bool Read(const PathHandle& Handle, std::vector<PathBufferNode>& OutNodes) const;
+};
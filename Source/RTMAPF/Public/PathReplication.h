@@ -0,0 +1,105 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Moves.h"
+#include "PathBuffer.h"
+#include "SearchTypes.h"
+#include "SpaceWrapper.h"
+
+#include <cstdint>
+#include <vector>
+
+// Times of replicated paths are rounded to multiples of the quantum
+#define PATH_REPLICATION_TIME_QUANTUM 0.01f
+
+/**
+ * Binary stream of path changes from the pathfinder to one networked client.
+ *
+ * The stream consists of records:
+ *   agent: id, moves of the agent (grid delta and cost), sent before the first path of the agent
+ *   path: id, version, number of nodes dropped from the front of the previous path,
+ *         number of the following nodes kept, and the new nodes appended to them
+ *   remove: id
+ * New nodes are written as indices of the agent moves and waits before them in time quanta,
+ * moves which are not in the list are written with their grid delta and duration.
+ * Integers are variable-length, so a replan that keeps the rest of the previous path
+ * costs a few bytes per new node. The stream should be delivered reliably and in order,
+ * as every path record is a delta of the previous one of the agent.
+ */
+class PathReplicationEncoder
+{
+protected:
+  struct ReplicatedAgent
+  {
+    ArrayType<MoveDelta<FPoint>> Moves;
+    bool bMovesSent = false;
+    // Version of the path in the buffer and the path as it is decoded by the client
+    uint32_t Version = 0;
+    std::vector<PathBufferNode> Path;
+  };
+
+  MapType<int, ReplicatedAgent> Agents;
+  // Agents are visited in a round, the next Encode continues after the last encoded one
+  ArrayType<int> AgentOrder;
+  size_t NextAgentIndex = 0;
+  ArrayType<int> PendingRemovals;
+
+  void EncodeAgent(int AgentID, ReplicatedAgent& Agent, const PathHandle& Handle, const PathBufferNode* Nodes, std::vector<uint8_t>& OutData);
+
+public:
+  /**
+   * Moves should be scaled by the speed of the agent, as given by UAgent::GetPropertiesSafe.
+   */
+  void AddAgent(int AgentID, const ArrayType<MoveDelta<FPoint>>& Moves);
+
+  void RemoveAgent(int AgentID);
+
+  bool HasAgent(int AgentID) const;
+
+  void GetAgentIDs(ArrayType<int>& OutAgentIDs) const;
+
+  /**
+   * Appends records of the agents whose paths in the buffer changed since they were sent.
+   * Stops before MaxBytes are exceeded, the rest is sent by the next calls.
+   * A single record longer than MaxBytes is still sent if nothing else is.
+   * Should be called by the thread publishing the paths. Returns the number of appended bytes.
+   */
+  size_t Encode(const PathBuffer& Paths, size_t MaxBytes, std::vector<uint8_t>& OutData);
+};
+
+/**
+ * Client side of the replication stream, holds the latest paths of the agents.
+ */
+class PathReplicationDecoder
+{
+protected:
+  struct DecodedAgent
+  {
+    ArrayType<MoveDelta<FPoint>> Moves;
+    uint32_t Version = 0;
+    std::vector<PathBufferNode> Path;
+  };
+
+  MapType<int, DecodedAgent> Agents;
+
+public:
+  /**
+   * Applies records produced by one Encode call. Returns false if the data is broken,
+   * records before the broken one are applied.
+   */
+  bool Decode(const uint8_t* Data, size_t Size);
+
+  // Nodes of the path in forward order, or nullptr if the agent has no path
+  const std::vector<PathBufferNode>* FindPath(int AgentID) const;
+
+  // Version of the path in the buffer of the pathfinder, zero if the agent has no path
+  uint32_t GetVersion(int AgentID) const;
+
+  /**
+   * Interpolates the position of the agent at Time along its path, as the pathfinder does.
+   * Returns false if the agent has no path.
+   */
+  bool GetCurrentLocation(int AgentID, float Time, ASpace* SpaceWrapper, FVector& OutLocation) const;
+
+  int GetAgentsNum() const { return (int) Agents.size(); }
+};
@@ -3,19 +3,24 @@
 #include "Heuristic.h"
 #include "Moves.h"
 #include "NodesHeap.h"
+#include "SearchArena.h"
 #include "SearchTypes.h"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <iostream>
+#include <limits>
+#include <memory>
 
 template<typename CellType>
 class SearchResult
 {
 private:
-  std::chrono::steady_clock::time_point TimerStart = std::chrono::high_resolution_clock::now();
+  std::chrono::steady_clock::time_point TimerStart = std::chrono::steady_clock::now();
 
-  double Time = 0;
+  double SearchTime = 0;
+  double CollectTime = 0;
   size_t NodesCreated = 0;
   size_t NumberOfSteps = 0;
 
@@ -32,59 +37,115 @@ public:
 
   inline void StartTimer()
   {
-    TimerStart = std::chrono::high_resolution_clock::now();
+    TimerStart = std::chrono::steady_clock::now();
   }
 
-  inline void StopTimer()
+  inline void StopSearchTimer()
   {
     // TODO create timer object which incapsulates duration count like shared pointer
 
-    std::chrono::duration<double> Duration = std::chrono::high_resolution_clock::now() - TimerStart;
-    Time += Duration.count(); // in seconds
+    std::chrono::duration<double> Duration = std::chrono::steady_clock::now() - TimerStart;
+    SearchTime += Duration.count(); // in seconds
   }
+
+  inline void StopCollectTimer()
+  {
+    std::chrono::duration<double> Duration = std::chrono::steady_clock::now() - TimerStart;
+    CollectTime += Duration.count(); // in seconds
+  }
+
+  // In seconds
+  double GetSearchTime() const { return SearchTime; }
+  double GetCollectTime() const { return CollectTime; }
+
+  size_t GetNodesCount() const { return NodesCreated; }
+  size_t GetStepsCount() const { return NumberOfSteps; }
 };
 
-template<typename CellType>
+/**
+ * MovesType is a final move component to call it without virtual dispatch,
+ * the base component is used for moves that are known only at runtime.
+ * The same holds for HeuristicType.
+ */
+template<typename CellType, typename MovesType = MoveComponent<CellType>, typename HeuristicType = Heuristic<CellType>>
 class Pathfinder : public Heuristic<CellType>
 {
 protected:
   using NodeType = Node<CellType>;
   using StatType = SearchResult<CellType>;
+  using NodesAllocatorType = ArenaAllocator<std::pair<const CellType, NodeType>>;
+  using NodesMapType = MapType<CellType, NodeType, std::hash<CellType>, std::equal_to<CellType>, NodesAllocatorType>;
 
   mutable StatType Statistics;
 
   NodesBinaryHeap<CellType> OpenNodes;
-  MapType<CellType, NodeType> Nodes;
+  NodesMapType Nodes;
+  size_t ReservedNodesNum = 0;
+
+  std::shared_ptr<HeuristicType> HeuristicPtr;
+  std::shared_ptr<MovesType> Moves;
 
-  std::shared_ptr<Heuristic<CellType>> HeuristicPtr;
-  std::shared_ptr<MoveComponent<CellType>> Moves;
+  // Reused by every expansion, so heuristic of the neighbors is found without allocations
+  ArrayType<NodeType*> ExistingNodes;
+  ArrayType<CellType> BatchCells;
+  ArrayType<float> BatchCosts;
 
   virtual void TryToStopSearch(const NodeType& Node, CellType SearchDestination) {};
 
 protected:
-  void ExpandNode(NodeType& Node);
+  // Nodes created or improved by the expansion are added to OutReachedNodes if it is given
+  void ExpandNode(NodeType& Node, ArrayType<const NodeType*>* OutReachedNodes = nullptr);
+  void InsertOrigin(CellType Origin, float StartTime);
 
 public:
   Pathfinder(
-    std::shared_ptr<MoveComponent<CellType>> InMoves, 
+    std::shared_ptr<MovesType> InMoves, 
     CellType Origin,
-    std::shared_ptr<Heuristic<CellType>> InHeuristic,
+    std::shared_ptr<HeuristicType> InHeuristic,
     float StartTime = 0.f
   );
 
-  virtual bool IsCostFound(CellType To) const override;
-  virtual float GetCost(CellType To) const override;
-  virtual void FindCost(CellType To) override;
+  // Final, so the search calls them statically when it is a heuristic of another search
+  virtual bool IsCostFound(CellType To) const override final;
+  virtual float GetCost(CellType To) const override final;
+  virtual void FindCost(CellType To) override final;
+  virtual void FindCosts(const CellType* Cells, size_t Num, float* OutCosts) override final;
 
   StatType GetStats() const { return Statistics; }
 
   void CollectPath(CellType To, ArrayType<NodeType>& Path, bool Reverse = false) const;
 
-  void SetHeuristic(std::shared_ptr<Heuristic<CellType>> InHeuristic);
+  /**
+   * Expands one open node with the lowest full cost, for searches driven from outside.
+   * Returns false if there are no open nodes.
+   */
+  bool ExpandNext(ArrayType<const NodeType*>& OutReachedNodes);
+
+  // Lowest MinTime + heuristic of the open nodes, infinity if there are none
+  float GetMinOpenCost() const;
+
+  size_t GetOpenNodesNum() const { return OpenNodes.Size(); }
+
+  // Nullptr if the cell isn't reached, the node is closed if its HeursticToGoal < 0
+  const NodeType* FindNode(CellType Cell) const;
+
+  void SetHeuristic(std::shared_ptr<HeuristicType> InHeuristic);
+
+  /**
+   * Starts a new search with the same moves and heuristic, which should be reset before.
+   * Nodes are allocated from the arena if it is given, otherwise containers keep their memory,
+   * so a search reused by a worker thread doesn't grow them again.
+   */
+  void Reset(CellType Origin, float StartTime = 0.f, SearchArena* Arena = nullptr);
+
+  void Reserve(size_t NodesNum);
+
+  // Empties the nodes, so the arena they are allocated from may be released
+  void ReleaseNodes();
 };
 
-template<typename CellType>
-class WindowedPathfinder : public Pathfinder<CellType>
+template<typename CellType, typename MovesType = MoveComponent<CellType>, typename HeuristicType = Heuristic<CellType>>
+class WindowedPathfinder : public Pathfinder<CellType, MovesType, HeuristicType>
 {
 protected:
   float Depth;
@@ -100,30 +161,105 @@ protected:
 
 public:
   WindowedPathfinder(
-     std::shared_ptr<MoveComponent<CellType>> InMoves
+     std::shared_ptr<MovesType> InMoves
     , CellType Origin
-    , std::shared_ptr<Heuristic<CellType>> InHeuristic
+    , std::shared_ptr<HeuristicType> InHeuristic
     , float InDepth
     , float StartTime
   )
-    : Pathfinder(InMoves, Origin, InHeuristic, StartTime)
+    : Pathfinder<CellType, MovesType, HeuristicType>(InMoves, Origin, InHeuristic, StartTime)
     , Depth(InDepth)
   {
     assert(Depth > 0);
   }
+
+  void Reset(CellType Origin, float InDepth, float StartTime, SearchArena* Arena = nullptr)
+  {
+    assert(InDepth > 0);
+    Depth = InDepth;
+    Pathfinder<CellType, MovesType, HeuristicType>::Reset(Origin, StartTime, Arena);
+  }
 };
 
-template<typename CellType>
-Pathfinder<CellType>::Pathfinder(
-  std::shared_ptr<MoveComponent<CellType>> InMoves, 
+/**
+ * Plane distance to the goal for a search from one start, a replacement of Pathfinder<FPoint>
+ * rooted at the goal. The first query searches from the goal and from the start with the balanced
+ * Euclidean heuristic till the fronts meet at the exact distance between the start and the goal.
+ * It expands less than the search from the goal when the start is far in a cluttered space
+ * or behind obstacles, but more along long walls between the start and the goal.
+ *
+ * After the fronts meet, the search from the goal closes the cells with full costs below the distance,
+ * so costs are exact along the shortest paths. Other cells get the larger of the Euclidean cost
+ * and the lowest full cost of the open nodes from the goal minus the balanced heuristic of the cell.
+ * Both bounds are consistent, which the window search needs as it never reopens closed nodes,
+ * so costs from the start aren't used: they are known only for the cells closed from the start.
+ * If the start can't reach the goal, costs are found only for the cells reached from the goal.
+ */
+
+template<typename MovesType>
+class BidirectionalPathfinder final : public Heuristic<FPoint>
+{
+protected:
+  using SearchType = Pathfinder<FPoint, MovesType, BalancedEuclideanHeuristic>;
+  using NodeType = Node<FPoint>;
+
+  FPoint Goal;
+  // Lower bound of the costs that aren't found by the searches
+  EuclideanHeuristic ToGoal;
+  float StraightCost;
+  std::shared_ptr<BalancedEuclideanHeuristic> FromGoal;
+  std::shared_ptr<BalancedEuclideanHeuristic> FromStart;
+  SearchType GoalSearch;
+  SearchType StartSearch;
+
+  bool bMet = false;
+  // Cost between the start and the goal, HEURISTIC_COST_NOT_FOUND if they aren't connected
+  float Distance = HEURISTIC_COST_NOT_FOUND;
+  // Lowest full cost of the open nodes of the search from the goal when the fronts met
+  float GoalOpenCost = std::numeric_limits<float>::infinity();
+  ArrayType<const NodeType*> ReachedNodes;
+
+  void Meet();
+
+public:
+  BidirectionalPathfinder(std::shared_ptr<MovesType> InMoves, FPoint InGoal, FPoint Start, float Speed);
+
+  virtual bool IsCostFound(FPoint To) const override final;
+  virtual float GetCost(FPoint To) const override final;
+  virtual void FindCost(FPoint To) override final;
+  virtual void FindCosts(const FPoint* Cells, size_t Num, float* OutCosts) override final;
+
+  virtual FPoint GetOrigin() const override final { return Goal; }
+
+  // Expansions of both searches
+  size_t GetStepsCount() const { return GoalSearch.GetStats().GetStepsCount() + StartSearch.GetStats().GetStepsCount(); }
+  size_t GetNodesCount() const { return GoalSearch.GetStats().GetNodesCount() + StartSearch.GetStats().GetNodesCount(); }
+
+  // Starts a new query with the same moves, as Pathfinder::Reset
+  void Reset(FPoint InGoal, FPoint Start, float Speed, SearchArena* Arena = nullptr);
+
+  void Reserve(size_t NodesNum);
+
+  void ReleaseNodes();
+};
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+Pathfinder<CellType, MovesType, HeuristicType>::Pathfinder(
+  std::shared_ptr<MovesType> InMoves, 
   CellType Origin,
-  std::shared_ptr<Heuristic<CellType>> InHeuristic,
+  std::shared_ptr<HeuristicType> InHeuristic,
   float StartTime
 )
   : Heuristic(Origin)
   , OpenNodes(true)
   , HeuristicPtr(InHeuristic)
   , Moves(InMoves)
+{
+  InsertOrigin(Origin, StartTime);
+}
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::InsertOrigin(CellType Origin, float StartTime)
 {
   HeuristicPtr->FindCost(Origin);
   if (HeuristicPtr->IsCostFound(Origin))
@@ -133,19 +269,80 @@ Pathfinder<CellType>::Pathfinder(
   }
 }
 
-template<typename CellType>
-void Pathfinder<CellType>::ExpandNode(NodeType& Node)
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::Reset(CellType Origin, float StartTime, SearchArena* Arena)
 {
-  for (auto& ValidMove : Moves->FindValidMoves(Node))
+  Statistics = StatType();
+  OpenNodes.Clear();
+
+  const NodesAllocatorType Allocator(Arena);
+  if (Nodes.get_allocator() == Allocator)
   {
-    const CellType& Destination = ValidMove.Destination;
+    Nodes.clear();
+  }
+  else
+  {
+    Nodes = NodesMapType(ReservedNodesNum, std::hash<CellType>(), std::equal_to<CellType>(), Allocator);
+  }
+
+  InsertOrigin(Origin, StartTime);
+}
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::Reserve(size_t NodesNum)
+{
+  ReservedNodesNum = NodesNum;
+  OpenNodes.Reserve(NodesNum);
+  Nodes.reserve(NodesNum);
+}
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::ReleaseNodes()
+{
+  OpenNodes.Clear();
+  Nodes = NodesMapType();
+}
 
-    // Check if a potential Node exists
-    auto PotentialNode = Nodes.find(Destination);
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::ExpandNode(NodeType& Node, ArrayType<const NodeType*>* OutReachedNodes)
+{
+  const ArrayType<MoveDelta<CellType>> ValidMoves = Moves->FindValidMoves(Node);
+
+  // Heuristic of all new cells is found in one call
+  ExistingNodes.clear();
+  BatchCells.clear();
+  for (const auto& ValidMove : ValidMoves)
+  {
+    auto PotentialNode = Nodes.find(ValidMove.Destination);
     if (PotentialNode == Nodes.end())
     {
-      HeuristicPtr->FindCost(Destination);
-      if (!HeuristicPtr->IsCostFound(Destination))
+      ExistingNodes.push_back(nullptr);
+      BatchCells.push_back(ValidMove.Destination);
+    }
+    else
+    {
+      ExistingNodes.push_back(&PotentialNode->second);
+    }
+  }
+
+  BatchCosts.resize(BatchCells.size());
+  if (BatchCells.size())
+  {
+    HeuristicPtr->FindCosts(BatchCells.data(), BatchCells.size(), BatchCosts.data());
+  }
+
+  size_t BatchIndex = 0;
+  for (size_t MoveIndex = 0; MoveIndex < ValidMoves.size(); ++MoveIndex)
+  {
+    const auto& ValidMove = ValidMoves[MoveIndex];
+    const CellType& Destination = ValidMove.Destination;
+    const float NodeMinTime = Node.MinTime + ValidMove.WaitCost + ValidMove.MoveCost;
+
+    NodeType* PotentialNode = ExistingNodes[MoveIndex];
+    if (!PotentialNode)
+    {
+      const float HeuristicCost = BatchCosts[BatchIndex++];
+      if (HeuristicCost < 0)
       {
         continue;
       }
@@ -153,51 +350,59 @@ void Pathfinder<CellType>::ExpandNode(NodeType& Node)
       // Create a new Node.
       auto InsertResult = Nodes.insert({ 
           Destination
-        , NodeType(
-            Destination
-          , Node.MinTime + ValidMove.WaitCost + ValidMove.MoveCost
-          , HeuristicPtr->GetCost(Destination)
-          , ValidMove.MoveCost
-        )
+        , NodeType(Destination, NodeMinTime, HeuristicCost, ValidMove.MoveCost)
       });
 
-      NodeType& InsertedNode = InsertResult.first->second;
-      OpenNodes.Insert(InsertedNode);
+      if (InsertResult.second)
+      {
+        NodeType& InsertedNode = InsertResult.first->second;
+        OpenNodes.Insert(InsertedNode);
+
+        // Set the parential Node.
+        InsertedNode.Parent = &Node;
+        if (OutReachedNodes)
+        {
+          OutReachedNodes->push_back(&InsertedNode);
+        }
+        continue;
+      }
 
-      // Set the parential Node.
-      InsertedNode.Parent = &Node;
+      // The same destination is reached by another move of this expansion
+      PotentialNode = &InsertResult.first->second;
     }
-    else
+
+    if (PotentialNode->HeursticToGoal >= 0 && PotentialNode->MinTime > NodeMinTime)
     {
-      float NodeMinTime = Node.MinTime + ValidMove.WaitCost + ValidMove.MoveCost;
-      if (PotentialNode->second.HeursticToGoal >= 0 && PotentialNode->second.MinTime > NodeMinTime)
-      {
-        OpenNodes.ImproveTime(PotentialNode->second, NodeMinTime);
+      OpenNodes.ImproveTime(*PotentialNode, NodeMinTime);
 
-        // Change the parential Node to the one which is expanded.
-        PotentialNode->second.Parent = &Node;
+      // Change the parential Node to the one which is expanded, the move from it may take another time.
+      PotentialNode->Parent = &Node;
+      PotentialNode->ArrivalCost = ValidMove.MoveCost;
+      if (OutReachedNodes)
+      {
+        OutReachedNodes->push_back(PotentialNode);
       }
-      // If the potential Node is in the close list, we never reopen/reexpand it.
     }
+    // If the potential Node is in the close list, we never reopen/reexpand it.
   }
 }
 
-template<typename CellType>
-float Pathfinder<CellType>::GetCost(CellType To) const
+template<typename CellType, typename MovesType, typename HeuristicType>
+float Pathfinder<CellType, MovesType, HeuristicType>::GetCost(CellType To) const
 {
   assert(IsCostFound(To));
 
   return Nodes.at(To).MinTime;
 }
  
-template<typename CellType>
-bool Pathfinder<CellType>::IsCostFound(CellType To) const
+template<typename CellType, typename MovesType, typename HeuristicType>
+bool Pathfinder<CellType, MovesType, HeuristicType>::IsCostFound(CellType To) const
 {
   return Nodes.count(To) > 0;
 }
 
-template<typename CellType>
-void Pathfinder<CellType>::FindCost(CellType To)
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::FindCost(CellType To)
 {
   Statistics.StartTimer();
 
@@ -213,11 +418,60 @@ void Pathfinder<CellType>::FindCost(CellType To)
   }
 
   Statistics.SetNodesCount(Nodes.size());
-  Statistics.StopTimer();
+  Statistics.StopSearchTimer();
 }
 
-template<typename CellType>
-void Pathfinder<CellType>::CollectPath(CellType To, ArrayType<NodeType>& Path, bool Reverse) const
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::FindCosts(const CellType* Cells, size_t Num, float* OutCosts)
+{
+  for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+  {
+    // The search is continued only for cells that are not reached yet
+    auto FoundNode = Nodes.find(Cells[CellIndex]);
+    if (FoundNode == Nodes.end())
+    {
+      FindCost(Cells[CellIndex]);
+      FoundNode = Nodes.find(Cells[CellIndex]);
+    }
+
+    OutCosts[CellIndex] = FoundNode != Nodes.end() ? FoundNode->second.MinTime : HEURISTIC_COST_NOT_FOUND;
+  }
+}
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+bool Pathfinder<CellType, MovesType, HeuristicType>::ExpandNext(ArrayType<const NodeType*>& OutReachedNodes)
+{
+  if (!OpenNodes.Size())
+  {
+    return false;
+  }
+
+  Statistics.IncrementSteps();
+
+  NodeType& ExpandedNode = *OpenNodes.PopMin();
+  ExpandedNode.MarkClosed();
+  ExpandNode(ExpandedNode, &OutReachedNodes);
+
+  Statistics.SetNodesCount(Nodes.size());
+  return true;
+}
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+float Pathfinder<CellType, MovesType, HeuristicType>::GetMinOpenCost() const
+{
+  const NodeType* MinNode = OpenNodes.Top();
+  return MinNode ? MinNode->MinTime + MinNode->HeursticToGoal : std::numeric_limits<float>::infinity();
+}
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+const Node<CellType>* Pathfinder<CellType, MovesType, HeuristicType>::FindNode(CellType Cell) const
+{
+  const auto FoundNode = Nodes.find(Cell);
+  return FoundNode != Nodes.end() ? &FoundNode->second : nullptr;
+}
+
+template<typename CellType, typename MovesType, typename HeuristicType>
+void Pathfinder<CellType, MovesType, HeuristicType>::CollectPath(CellType To, ArrayType<NodeType>& Path, bool Reverse) const
 {
   Path.clear();
 
@@ -245,5 +499,140 @@ void Pathfinder<CellType>::CollectPath(CellType To, ArrayType<NodeType>& Path, b
     std::reverse(Path.begin(), Path.end());
   }
 
-  Statistics.StopTimer();
+  Statistics.StopCollectTimer();
+}
+
+template<typename MovesType>
+BidirectionalPathfinder<MovesType>::BidirectionalPathfinder(std::shared_ptr<MovesType> InMoves, FPoint InGoal, FPoint Start, float Speed)
+  : Heuristic(InGoal)
+  , Goal(InGoal)
+  , ToGoal(InGoal, Speed)
+  , StraightCost(ToGoal.GetCost(Start))
+  , FromGoal(std::make_shared<BalancedEuclideanHeuristic>(InGoal, Start, Speed))
+  , FromStart(std::make_shared<BalancedEuclideanHeuristic>(Start, InGoal, Speed))
+  , GoalSearch(InMoves, InGoal, FromGoal)
+  , StartSearch(InMoves, Start, FromStart)
+{ }
+
+template<typename MovesType>
+void BidirectionalPathfinder<MovesType>::Reset(FPoint InGoal, FPoint Start, float Speed, SearchArena* Arena)
+{
+  Goal = InGoal;
+  ToGoal = EuclideanHeuristic(InGoal, Speed);
+  StraightCost = ToGoal.GetCost(Start);
+  *FromGoal = BalancedEuclideanHeuristic(InGoal, Start, Speed);
+  *FromStart = BalancedEuclideanHeuristic(Start, InGoal, Speed);
+  GoalSearch.Reset(InGoal, 0.f, Arena);
+  StartSearch.Reset(Start, 0.f, Arena);
+  bMet = false;
+  Distance = HEURISTIC_COST_NOT_FOUND;
+  GoalOpenCost = std::numeric_limits<float>::infinity();
+}
+
+template<typename MovesType>
+void BidirectionalPathfinder<MovesType>::Reserve(size_t NodesNum)
+{
+  GoalSearch.Reserve(NodesNum);
+  StartSearch.Reserve(NodesNum);
+}
+
+template<typename MovesType>
+void BidirectionalPathfinder<MovesType>::ReleaseNodes()
+{
+  GoalSearch.ReleaseNodes();
+  StartSearch.ReleaseNodes();
+}
+
+template<typename MovesType>
+void BidirectionalPathfinder<MovesType>::Meet()
+{
+  bMet = true;
+
+  float BestCost = std::numeric_limits<float>::infinity();
+  if (const NodeType* GoalNode = StartSearch.FindNode(Goal))
+  {
+    BestCost = GoalNode->MinTime;
+  }
+
+  // Heuristics of the two searches sum to StraightCost, so a path through the open nodes of both
+  // costs at least the sum of their lowest full costs minus it. The search with fewer open nodes is expanded
+  while (true)
+  {
+    const float GoalMinCost = GoalSearch.GetMinOpenCost();
+    const float StartMinCost = StartSearch.GetMinOpenCost();
+    if (BestCost <= std::max(GoalMinCost, StartMinCost) || BestCost + StraightCost <= GoalMinCost + StartMinCost)
+    {
+      break;
+    }
+
+    const bool bFromGoal = GoalSearch.GetOpenNodesNum() <= StartSearch.GetOpenNodesNum();
+    SearchType& Expanded = bFromGoal ? GoalSearch : StartSearch;
+    const SearchType& Opposite = bFromGoal ? StartSearch : GoalSearch;
+
+    ReachedNodes.clear();
+    Expanded.ExpandNext(ReachedNodes);
+    for (const NodeType* Reached : ReachedNodes)
+    {
+      const NodeType* Met = Opposite.FindNode(Reached->Cell);
+      if (Met && Reached->MinTime + Met->MinTime < BestCost)
+      {
+        BestCost = Reached->MinTime + Met->MinTime;
+      }
+    }
+  }
+
+  // Full costs of the nodes closed from the goal don't decrease with the consistent heuristic,
+  // so every cell that isn't closed is at least as far as the lowest open one minus its heuristic
+  while (BestCost < std::numeric_limits<float>::infinity() && GoalSearch.GetMinOpenCost() < BestCost)
+  {
+    ReachedNodes.clear();
+    GoalSearch.ExpandNext(ReachedNodes);
+  }
+  GoalOpenCost = GoalSearch.GetMinOpenCost();
+  Distance = BestCost == std::numeric_limits<float>::infinity() ? HEURISTIC_COST_NOT_FOUND : BestCost;
+}
+
+template<typename MovesType>
+bool BidirectionalPathfinder<MovesType>::IsCostFound(FPoint To) const
+{
+  return bMet && (Distance >= 0 || GoalSearch.FindNode(To));
+}
+
+template<typename MovesType>
+float BidirectionalPathfinder<MovesType>::GetCost(FPoint To) const
+{
+  assert(IsCostFound(To));
+
+  const NodeType* GoalNode = GoalSearch.FindNode(To);
+  if (GoalNode && GoalNode->HeursticToGoal < 0)
+  {
+    return GoalNode->MinTime;
+  }
+
+  // Without open nodes the cells that aren't closed can't be reached from the goal
+  const float Cost = ToGoal.GetCost(To);
+  if (GoalOpenCost == std::numeric_limits<float>::infinity())
+  {
+    return Cost;
+  }
+  return std::max(Cost, GoalOpenCost - FromGoal->GetCost(To));
+}
+
+template<typename MovesType>
+void BidirectionalPathfinder<MovesType>::FindCost(FPoint To)
+{
+  if (!bMet)
+  {
+    Meet();
+  }
+}
+
+template<typename MovesType>
+void BidirectionalPathfinder<MovesType>::FindCosts(const FPoint* Cells, size_t Num, float* OutCosts)
+{
+  FindCost(Goal);
+  for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+  {
+    OutCosts[CellIndex] = IsCostFound(Cells[CellIndex]) ? GetCost(Cells[CellIndex]) : HEURISTIC_COST_NOT_FOUND;
+  }
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Moves.h"
+#include "SearchTypes.h"
+#include "Space.h"
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+
+struct FReplanInput;
+
+struct BenchmarkSettings
+{
+  // Every benchmark is repeated till it runs at least this time, in seconds
+  double MinTime = 0.5;
+
+  // Random reservations written into the map before the benchmarks
+  int ReservationsNum = 5000;
+  float MaxReservationLength = 3.f;
+
+  float Depth = 100.f;
+  uint32_t Seed = 42;
+};
+
+struct BenchmarkResult
+{
+  std::string Name;
+  uint64_t Iterations;
+  // Per operation, not per iteration
+  double NanosecondsPerOp;
+
+  // Allocations of SearchArena per operation, heap ones are made by the arena allocators without an arena
+  double ArenaAllocationsPerOp = 0;
+  double HeapAllocationsPerOp = 0;
+  double BlockAllocationsPerOp = 0;
+
+  // Mean cost and progress toward the goal of the windows of a window search, zero for other benchmarks
+  double WindowCost = 0;
+  double WindowProgress = 0;
+};
+
+/**
+ * Microbenchmarks of the search primitives on a real map with populated reservations.
+ *
+ * Inputs are generated from a fixed seed, so two runs with the same map and settings
+ * measure the same work. Results are written in the JSON format of Google Benchmark,
+ * so reports of two builds can be compared with its tools. Allocation counts are written
+ * as its user counters.
+ */
+class PlannerBenchmarks
+{
+protected:
+  BenchmarkSettings Settings;
+
+  std::shared_ptr<const RawSpace> Static;
+  std::shared_ptr<SpaceTime> Space;
+  ArrayType<FPoint> FreePoints;
+  ArrayType<MoveDelta<FPoint>> Moves;
+
+  std::mt19937 Random;
+  ArrayType<BenchmarkResult> Results;
+
+  FPoint GetRandomFreePoint();
+  Segment GetRandomSegment(float MaxLength);
+  void PopulateReservations();
+
+  /**
+   * Doubles iterations of Body till it runs longer than MinTime.
+   * Body returns a value that depends on the measured work, so it isn't optimized out.
+   * Allocations are counted over the iterations of the last run.
+   */
+  void Run(const std::string& Name, size_t OpsPerIteration, const std::function<size_t()>& Body);
+
+  void BenchmarkSegmentHolder();
+  void BenchmarkNodesHeap();
+  void BenchmarkTouchedSegments();
+  void BenchmarkUpdateShape();
+  void BenchmarkFindValidMoves();
+  void BenchmarkFindWindowPath();
+  /**
+   * Finds every window once with the plane search from the goal and once with the bidirectional one,
+   * logs their costs and progress and stores their means in the results of the two window benchmarks.
+   */
+  void CompareWindowHeuristics(const ArrayType<FReplanInput>& Inputs, BenchmarkResult& GoalResult, BenchmarkResult& BidirectionalResult);
+
+public:
+  PlannerBenchmarks(const RawSpace& Map, const BenchmarkSettings& InSettings);
+
+  void RunAll();
+
+  const ArrayType<BenchmarkResult>& GetResults() const { return Results; }
+
+  std::string ToJson() const;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "SearchTypes.h"
+
+#include <string>
+
+/**
+ * Behavioral checks of the planner primitives that don't need a map or the engine.
+ *
+ * Every check builds its own small space, so checks don't depend on each other.
+ * Failed expectations are collected with a description instead of stopping the run.
+ */
+class PlannerChecks
+{
+protected:
+  ArrayType<std::string> Failures;
+  int ExpectationsNum = 0;
+
+  void Expect(bool bCondition, const std::string& Description);
+
+  void CheckOverlappingReservations();
+  void CheckObstacleMoments();
+  void CheckObstaclesMovedToNewSpace();
+  void CheckUnitMovesTable();
+  void CheckArrivalCosts();
+  void CheckKinodynamicProfile();
+  void CheckKinodynamicHeadings();
+  void CheckDistanceTablesStaleness();
+  void CheckGoalAssignmentStaleness();
+  void CheckPathReplicationRoundTrip();
+  void CheckShardedReservations();
+  void CheckPathBufferSegmentReuse();
+  void CheckSegmentIntersectionKernel();
+  void CheckBidirectionalHeuristic();
+  void CheckPlannerStatsCapture();
+  void CheckTouchedSegmentsCache();
+  void CheckBenchmarksRun();
+  void CheckBatchedHeuristic();
+  void CheckPathExtension();
+  void CheckWorkerContextReuse();
+  void CheckSearchArenaReuse();
+  void CheckTileStreamingEviction();
+  void CheckNextGoalsContinuation();
+  void CheckShortcutReservations();
+
+public:
+  void RunAll();
+
+  int GetExpectationsNum() const { return ExpectationsNum; }
+  const ArrayType<std::string>& GetFailures() const { return Failures; }
+};
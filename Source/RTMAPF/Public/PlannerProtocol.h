@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SearchTypes.h"
+#include "Segments.h"
+#include "SessionRecord.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Longest event or update line, a peer sending longer lines is disconnected
+#define PLANNER_MAX_LINE_LENGTH (1 << 20)
+
+/**
+ * Protocol between the pathfinder subsystem and a planner service in another process.
+ *
+ * The subsystem sends the calls changing the state of the planner as session events,
+ * one event per line in the format of session files, all events of a frame followed by its Tick.
+ * The service answers with updates, one update per line. Updates of a Tick end with TickDone.
+ * Floats are written with enough digits to be read back exactly.
+ */
+enum class EPlannerUpdateType : uint8_t
+{
+  // New path of an agent
+  Path,
+  // A new agent can't enter the planner and is removed from it
+  Failed,
+  // All updates of the Tick are sent, Time is the planner clock after it
+  TickDone
+};
+
+struct PlannerUpdate
+{
+  EPlannerUpdateType Type = EPlannerUpdateType::TickDone;
+  int AgentID = -1;
+  float Time = 0;
+  std::vector<Node<Area>> ReversedPath;
+};
+
+void WritePlannerUpdate(std::ostream& Stream, const PlannerUpdate& Update);
+
+/**
+ * Reads one update written by WritePlannerUpdate. Returns false if the update is broken.
+ */
+bool ReadPlannerUpdate(std::istream& Stream, PlannerUpdate& OutUpdate);
+
+/**
+ * Splits bytes received from a stream socket into lines.
+ */
+class PlannerLineBuffer
+{
+protected:
+  std::string Received;
+  size_t LineStart = 0;
+  // Length of the last line which isn't complete yet
+  size_t PendingLineLength = 0;
+  size_t MaxLineLength;
+
+public:
+  explicit PlannerLineBuffer(size_t InMaxLineLength = PLANNER_MAX_LINE_LENGTH);
+
+  /**
+   * Returns false if a line is longer than MaxLineLength, the data isn't appended then.
+   */
+  bool Append(const char* Data, size_t Size);
+
+  /**
+   * Returns false if there is no complete line yet.
+   */
+  bool NextLine(std::string& OutLine);
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "AgentPlanner.h"
+#include "CoreMinimal.h"
+#include "DynamicObstacles.h"
+#include "LocalSocket.h"
+#include "PlannerProtocol.h"
+#include "ReplanScheduler.h"
+#include "ReservationIndex.h"
+#include "SearchTypes.h"
+#include "SessionRecord.h"
+#include "ShardedSpace.h"
+#include "Space.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PlannerServiceSettings
+{
+  // Limits of the planning windows, every replan chooses its window within them
+  FHorizonSettings Horizon;
+
+  // Part of the planning window after which an agent must be replanned
+  float WindowExpirationShare = 0.5f;
+
+  // Max delay of a replan caused by a reservation change in the neighbourhood
+  float ReservationChangeLatency = 2.f;
+
+  // Replans of scheduled agents in one Tick, new agents are always planned
+  int MaxReplansPerTick = 64;
+};
+
+/**
+ * Windowed planner of the agents of one client, driven by session events instead of UObjects.
+ *
+ * Agents are planned by FAdaptivePath like in the pathfinder subsystem, so they get the adaptive
+ * window, queued goals, path shortcuts and moving obstacles of the client. A Tick advances the clock
+ * to the time of the client, plans the added agents and then the agents whose windows expire,
+ * up to MaxReplansPerTick of them. Replans run in the thread pool one after another, the thread
+ * handling the events waits for each of them, so the updates of a Tick are sent with all its paths.
+ * The space isn't sharded, conflicts aren't resolved by groups and distance tables aren't built.
+ * Obstacles added by the client before it connected are not known to the service.
+ */
+class PlannerService
+{
+protected:
+  PlannerServiceSettings Settings;
+
+  std::shared_ptr<SpaceTime> Space;
+  // Paths are searched in the table of the only shard, which is Space
+  std::shared_ptr<ShardedSpace> Shards;
+  DynamicObstacleLayer Obstacles;
+  // Obstacles of the client by their identifiers in Obstacles
+  MapType<int, int> ObstacleIDs;
+
+  MapType<int, FAdaptivePath> Agents;
+  // Added agents in the order of arrival, they are planned at the next Tick
+  ArrayType<int> PendingAgents;
+  ReplanScheduler Scheduler;
+  ReservationIndex ReservationAgents;
+
+  bool bShortcuts = false;
+  bool bBidirectionalHeuristic = false;
+  float CurrentTime = 0;
+
+  // Returns false if no path is found, the previous one is kept then
+  bool Replan(FAdaptivePath& Path);
+  // Moves agents that reached their goals to their queued goals
+  void AdvanceGoals(int ID, FAdaptivePath& Path);
+  void CommitObstacles();
+  void PrioritizeNeighbours(int ID, float Deadline);
+  void RemoveAgent(int ID);
+  void Tick(float Time, ArrayType<PlannerUpdate>& OutUpdates);
+
+public:
+  PlannerService(std::shared_ptr<SpaceTime> InSpace, const PlannerServiceSettings& InSettings);
+
+  /**
+   * Applies one event of the client, updates produced by a Tick are appended to OutUpdates.
+   */
+  void Handle(const SessionEvent& Event, ArrayType<PlannerUpdate>& OutUpdates);
+
+  int GetAgentsNum() const { return (int) Agents.size(); }
+
+  float GetCurrentTime() const { return CurrentTime; }
+};
+
+/**
+ * Connection of the pathfinder subsystem to a planner service.
+ * Events are queued and sent together by Flush.
+ */
+class PlannerClient
+{
+protected:
+  LocalSocket Socket;
+  std::string QueuedEvents;
+  PlannerLineBuffer ReceivedLines;
+
+public:
+  bool Connect(const FString& SocketPath);
+
+  void Queue(const SessionEvent& Event);
+
+  // Returns false if the connection is broken
+  bool Flush();
+
+  /**
+   * Appends received updates to OutUpdates. If bUntilTickDone is set, waits till the end of updates of a Tick.
+   * Returns false if the connection is broken.
+   */
+  bool Receive(bool bUntilTickDone, ArrayType<PlannerUpdate>& OutUpdates);
+
+  bool IsConnected() const { return Socket.IsOpen(); }
+
+  void Disconnect();
+};
+
+/**
+ * Serves clients connecting to the socket one after another, each of them with a new planner of the map.
+ * If bOnce is set, returns after the first client disconnects.
+ * Returns false if the socket can't be opened.
+ */
+bool ServePlanner(const RawSpace& Map, const FString& SocketPath, const PlannerServiceSettings& Settings, bool bOnce);
+
+struct PlannerLoadTestSettings
+{
+  int AgentsNum = 100;
+  // Agents are added in batches at the first ticks
+  int AgentsPerTick = 10;
+  int TicksNum = 600;
+  float DeltaTime = 0.1f;
+  // Goal changes of random agents sent with every tick
+  int GoalChangesPerTick = 1;
+  uint32_t Seed = 42;
+};
+
+/**
+ * Stub client of a running planner service: adds agents with random tasks on the map,
+ * ticks the service and changes goals. The round trip of every Tick is written to OutReport.
+ * Returns false if the connection is broken.
+ */
+bool RunPlannerLoadTest(const RawSpace& Map, const FString& SocketPath, const PlannerLoadTestSettings& Settings, ReplayReport& OutReport);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "CoreMinimal.h"
+
+#include "PlannerServiceCommandlet.generated.h"
+
+/**
+ * Runs the planner service as a standalone process:
+ *   -run=PlannerService -map=<hog map> -socket=<socket path> [-depth=30] [-replans=64] [-once]
+ * or drives a running service with the stub client:
+ *   -run=PlannerService -stubclient -map=<hog map> -socket=<socket path> -report=<json> [-agents=100] [-ticks=600] [-seed=42]
+ */
+UCLASS()
+class UPlannerServiceCommandlet : public UCommandlet
+{
+  GENERATED_BODY()
+
+public:
+  UPlannerServiceCommandlet();
+
+  virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "SearchTypes.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Phase timers can be compiled out if their overhead is not acceptable
+#ifndef RTMAPF_STATS
+#define RTMAPF_STATS 1
+#endif
+
+#define PLANNER_MAX_TRACE_EVENTS 100000
+
+enum class EPlannerPhase : uint8_t
+{
+  // Static distance search behind the SIPP heuristic
+  HeuristicSearch = 0,
+  // Generation of safe interval successors (without heuristic)
+  SippExpansion,
+  TouchedSegments,
+  // Only shape cache misses are measured
+  UpdateShape,
+  ReservationClear,
+  ReservationFill,
+  // Whole replanning task of one agent
+  ReplanTask,
+  Count
+};
+
+const char* GetPhaseName(EPlannerPhase Phase);
+
+/**
+ * Time spent in phases is inclusive, e.g. SippExpansion includes TouchedSegments.
+ */
+struct PlannerCounters
+{
+  static constexpr size_t PhasesNum = (size_t) EPlannerPhase::Count;
+
+  double PhaseTime[PhasesNum] = {};
+  uint64_t PhaseCalls[PhasesNum] = {};
+
+  uint64_t SearchSteps = 0;
+  uint64_t NodesCreated = 0;
+
+  uint32_t Successes = 0;
+  uint32_t Failures = 0;
+  // Successful replans that kept the previous path and searched only the new tail of the window
+  uint32_t PathReuses = 0;
+  // Path nodes replaced by straight moves of the shortcut pass
+  uint32_t ShortcutNodes = 0;
+
+  // Time requests spent in the queue after their deadlines,
+  // in seconds of the pathfinder clock, not in real time
+  double QueueWait = 0;
+  uint32_t QueueWaits = 0;
+
+  // Goals the agents arrived to, in the lifelong mode every goal of the queue is counted
+  uint32_t GoalsReached = 0;
+
+  PlannerCounters& operator+=(const PlannerCounters& Other);
+  PlannerCounters operator-(const PlannerCounters& Other) const;
+};
+
+/**
+ * Complete event in terms of the Chrome trace format.
+ */
+struct TraceEvent
+{
+  EPlannerPhase Phase;
+  int AgentID;
+  uint32_t ThreadID;
+  // Microseconds since the first use of the statistics
+  double Start;
+  double Duration;
+};
+
+/**
+ * Adds time of a scope to the counters of the current thread.
+ * Events are traced only for coarse phases and only when tracing is enabled.
+ */
+class ScopedPhaseTimer
+{
+private:
+  EPlannerPhase Phase;
+  std::chrono::steady_clock::time_point TimerStart;
+
+public:
+  ScopedPhaseTimer(EPlannerPhase InPhase);
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+  ~ScopedPhaseTimer();
+};
+
+#if RTMAPF_STATS
+#define PLANNER_PHASE_SCOPE(Phase) ScopedPhaseTimer PlannerPhaseTimer(Phase)
+#else
+#define PLANNER_PHASE_SCOPE(Phase)
+#endif
+
+/**
+ * Collects counters of the current thread from construction till Finish.
+ * Counters are thread local, so they are updated without synchronisation.
+ */
+class PlannerStatsCapture
+{
+private:
+  PlannerCounters StartCounters;
+  size_t StartEvent;
+  int PreviousAgentID;
+
+public:
+  PlannerStatsCapture(int AgentID);
+  ~PlannerStatsCapture();
+
+  void Finish(PlannerCounters& OutCounters, ArrayType<TraceEvent>& OutEvents);
+};
+
+namespace PlannerStats
+{
+  void AddSearch(uint64_t Steps, uint64_t NodesCreated);
+
+  void SetTracing(bool bEnable);
+  bool IsTracing();
+}
+
+/**
+ * Aggregates counters per agent and globally. Not thread safe.
+ */
+class PlannerStatsCollector
+{
+protected:
+  PlannerCounters Global;
+  MapType<int, PlannerCounters> PerAgent;
+
+  ArrayType<TraceEvent> Events;
+  size_t DroppedEvents = 0;
+
+  // Pathfinder clock since the collection started, throughput is measured by it
+  double ClockTime = 0;
+
+public:
+  void Add(int AgentID, const PlannerCounters& Counters, const ArrayType<TraceEvent>& NewEvents);
+  void AddQueueWait(int AgentID, double Wait);
+  void AddGoalReached(int AgentID);
+  void AdvanceClock(double DeltaTime);
+
+  // Goals reached per minute of the pathfinder clock
+  double GetGoalsPerMinute() const;
+
+  const PlannerCounters& GetGlobal() const { return Global; }
+  const PlannerCounters* Find(int AgentID) const;
+
+  // Drops the counters of a removed agent, they stay in the global ones
+  void RemoveAgent(int AgentID);
+
+  std::string ToJson() const;
+  std::string ToChromeTrace() const;
+
+  void Clear();
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "SearchTypes.h"
+
+#include <cassert>
+#include <functional>
+
+/**
+ * Replanning request of one agent.
+ * Deadline is the time by which the agent must be replanned.
+ */
+struct ReplanRequest
+{
+  int AgentID;
+  float Deadline;
+};
+
+/**
+ * Earliest-deadline-first queue of agents waiting for a replan.
+ *
+ * Every urgency source is expressed as a deadline: expiration of the planned window,
+ * a pending goal change (deadline = now), a nearby reservation change (deadline = now + latency).
+ * Deadlines can only be moved earlier by Prioritize, so a boosted agent never pushes
+ * an agent with an earlier window expiration back in the queue and nobody starves.
+ *
+ * All operations except Contains and GetMostUrgent are O(log n).
+ */
+class ReplanScheduler
+{
+protected:
+  // Heap is 1-based, index 0 is unused (same layout as NodesBinaryHeap)
+  ArrayType<ReplanRequest> Requests;
+  MapType<int, size_t> AgentToIndex;
+
+  bool Compare(size_t First, size_t Second) const;
+  void Swap(size_t First, size_t Second);
+  void MoveUp(size_t Index);
+  void MoveDown(size_t Index);
+  void RemoveAt(size_t Index);
+
+public:
+  ReplanScheduler();
+
+  /**
+   * Adds an agent with the given deadline.
+   * If the agent is already scheduled its deadline is overwritten.
+   */
+  void Schedule(int AgentID, float Deadline);
+
+  /**
+   * Moves the agent's deadline earlier. Later deadlines are ignored.
+   * Returns false if the agent is not scheduled.
+   */
+  bool Prioritize(int AgentID, float Deadline);
+
+  void Remove(int AgentID);
+
+  bool Contains(int AgentID) const;
+
+  const ReplanRequest& GetMostUrgent() const;
+
+  ReplanRequest PopMostUrgent();
+
+  size_t Size() const;
+
+  void Clear();
+};
+
+/**
+ * Replan queues of the shards of a sharded space, an agent is queued in the shard of its path.
+ *
+ * The most urgent request is taken among the heads of the queues which can be started,
+ * so a shard whose block is busy doesn't hold back replans in other parts of the world.
+ * Scheduling an agent in another shard moves it there with the new deadline.
+ */
+class ShardedReplanScheduler
+{
+protected:
+  MapType<int, ReplanScheduler> ShardToScheduler;
+  MapType<int, int> AgentToShard;
+
+public:
+  void Schedule(int AgentID, int Shard, float Deadline);
+
+  bool Prioritize(int AgentID, float Deadline);
+
+  void Remove(int AgentID);
+
+  bool Contains(int AgentID) const;
+
+  /**
+   * Pops the request with the earliest deadline among the heads of the shard queues accepted by CanStart,
+   * ties are broken by the lower shard. Returns false if there is no such request.
+   */
+  bool PopMostUrgent(const std::function<bool(const ReplanRequest&)>& CanStart, ReplanRequest& OutRequest);
+
+  size_t Size() const;
+
+  void Clear();
+};
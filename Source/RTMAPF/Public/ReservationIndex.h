@@ -0,0 +1,45 @@
+#pragma once
+
+#include "SearchTypes.h"
+#include "Segments.h"
+
+#define RESERVATION_REGION_SIZE 8
+
+/**
+ * Spatial hash from square grid regions to agents whose reservations touch them.
+ * Time is ignored, so the index is conservative: it may report an agent
+ * whose reservation in the region doesn't intersect the change in time.
+ */
+class ReservationIndex
+{
+protected:
+  int RegionSize;
+
+  MapType<FPoint, SetType<int>> RegionToAgents;
+  MapType<int, ArrayType<FPoint>> AgentToRegions;
+
+  FPoint ToRegion(FPoint Point) const;
+
+public:
+  ReservationIndex(int InRegionSize = RESERVATION_REGION_SIZE);
+
+  /**
+   * Replaces regions of the agent with the ones touched by Areas.
+   */
+  void Update(int AgentID, const ArrayType<Area>& Areas);
+
+  void Remove(int AgentID);
+
+  /**
+   * Adds agents with reservations in the region of Point to Agents.
+   */
+  void FindAgents(FPoint Point, SetType<int>& Agents) const;
+
+  /**
+   * Adds agents sharing at least one region with the given agent to Agents.
+   * The agent itself is not added.
+   */
+  void FindNeighbours(int AgentID, SetType<int>& Agents) const;
+
+  void Clear();
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#define SEARCH_ARENA_BLOCK_SIZE (64 * 1024)
+
+/**
+ * Allocations of the arenas and of the arena allocators without an arena made by the current thread.
+ */
+struct SearchArenaCounters
+{
+  uint64_t ArenaAllocations = 0;
+  uint64_t HeapAllocations = 0;
+  uint64_t BlockAllocations = 0;
+
+  SearchArenaCounters operator-(const SearchArenaCounters& Other) const
+  {
+    return { ArenaAllocations - Other.ArenaAllocations, HeapAllocations - Other.HeapAllocations, BlockAllocations - Other.BlockAllocations };
+  }
+};
+
+SearchArenaCounters GetThreadArenaCounters();
+
+/**
+ * Monotonic memory of one search. Allocations are taken from blocks one after another
+ * and aren't freed one by one, Release makes the whole memory available again
+ * and keeps the blocks for the next search.
+ */
+class SearchArena
+{
+protected:
+  struct Block
+  {
+    std::unique_ptr<uint8_t[]> Data;
+    size_t Size;
+  };
+
+  std::vector<Block> Blocks;
+  size_t BlockIndex = 0;
+  size_t Offset = 0;
+
+  void* AllocateInNextBlock(size_t Size, size_t Alignment);
+
+public:
+  struct Mark
+  {
+    size_t BlockIndex;
+    size_t Offset;
+  };
+
+  SearchArena() = default;
+  SearchArena(const SearchArena&) = delete;
+  SearchArena& operator=(const SearchArena&) = delete;
+
+  void* Allocate(size_t Size, size_t Alignment);
+
+  /**
+   * Containers allocated from the arena should be destroyed or emptied before.
+   */
+  void Release();
+
+  Mark GetMark() const { return { BlockIndex, Offset }; }
+
+  // Memory allocated after the mark becomes available again
+  void Rewind(Mark InMark);
+
+  size_t GetReservedBytes() const;
+
+  // Used by the arena allocators without an arena
+  static void* AllocateFromHeap(size_t Size);
+  static void FreeToHeap(void* Pointer);
+};
+
+/**
+ * Rewinds the arena to the current mark at the end of the scope.
+ * Temporary containers should be declared after the scope, so they are destroyed before the rewind.
+ */
+class SearchArenaScope
+{
+private:
+  SearchArena* Arena;
+  SearchArena::Mark Mark;
+
+public:
+  explicit SearchArenaScope(SearchArena* InArena)
+    : Arena(InArena)
+    , Mark(InArena ? InArena->GetMark() : SearchArena::Mark{ 0, 0 })
+  {}
+
+  ~SearchArenaScope()
+  {
+    if (Arena)
+    {
+      Arena->Rewind(Mark);
+    }
+  }
+
+  SearchArenaScope(const SearchArenaScope&) = delete;
+  SearchArenaScope& operator=(const SearchArenaScope&) = delete;
+};
+
+/**
+ * Allocator of the container aliases of SearchTypes.h.
+ * Without an arena it allocates from the heap as std::allocator does.
+ * Containers moved or swapped take the arena with them, copies are always allocated from the heap,
+ * so a copy may outlive the search.
+ */
+template<typename T>
+class ArenaAllocator
+{
+private:
+  SearchArena* Arena = nullptr;
+
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() = default;
+
+  explicit ArenaAllocator(SearchArena* InArena)
+    : Arena(InArena)
+  {}
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& Other)
+    : Arena(Other.GetArena())
+  {}
+
+  SearchArena* GetArena() const { return Arena; }
+
+  T* allocate(size_t Num)
+  {
+    if (Arena)
+    {
+      return static_cast<T*>(Arena->Allocate(Num * sizeof(T), alignof(T)));
+    }
+    return static_cast<T*>(SearchArena::AllocateFromHeap(Num * sizeof(T)));
+  }
+
+  void deallocate(T* Pointer, size_t Num)
+  {
+    if (!Arena)
+    {
+      SearchArena::FreeToHeap(Pointer);
+    }
+  }
+
+  ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+  template<typename U>
+  bool operator==(const ArenaAllocator<U>& Other) const { return Arena == Other.GetArena(); }
+
+  template<typename U>
+  bool operator!=(const ArenaAllocator<U>& Other) const { return Arena != Other.GetArena(); }
+};
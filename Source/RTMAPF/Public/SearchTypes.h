@@ -8,6 +8,7 @@
 #include <inttypes.h>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "SearchTypes.generated.h"
@@ -22,6 +23,9 @@ using MapType = std::unordered_map<_Kty, _Ty, _Hasher, _Keyeq, _Alloc>;
 template <class _Kty, class _Pr = std::less<_Kty>, class _Alloc = std::allocator<_Kty>>
 using SetType = std::set<_Kty, _Pr, _Alloc>;
 
+template <class _Kty, class _Hasher = std::hash<_Kty>, class _Keyeq = std::equal_to<_Kty>, class _Alloc = std::allocator<_Kty>>
+using HashSetType = std::unordered_set<_Kty, _Hasher, _Keyeq, _Alloc>;
+
 // The difinitions of MAKE_HASHABLE and HashCombine are borrowed from:
 // https://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
 
@@ -103,6 +107,19 @@ struct FPoint
 
 MAKE_HASHABLE(FPoint, Type.X, Type.Y);
 
+/**
+ * Offset of a cell that can be written into constexpr tables, unlike FPoint.
+ */
+struct StaticDelta
+{
+  int X;
+  int Y;
+
+  FPoint ToPoint() const { return FPoint(X, Y); }
+
+  bool operator==(const FPoint& Point) const { return X == Point.X && Y == Point.Y; }
+};
+
 template<typename CellType>
 struct Node
 {
@@ -2,6 +2,9 @@
 
 #include "SearchTypes.h"
 
+#include <cstddef>
+#include <iterator>
+
 /**
  * Segment desribes time from the Start to the End including both points.
  * If Start <= End then segment is valid. 
@@ -45,13 +48,68 @@ struct Segment
 
 MAKE_HASHABLE(Segment, Type.Start, Type.End);
 
+/**
+ * Sorted disjoint segments stored as separate arrays of starts and ends (SoA),
+ * so that intersections run on packed floats with SIMD.
+ */
 class SegmentHolder
 {
 private:
-  SetType<Segment> Segments;
-  using const_iterator = SetType<Segment>::const_iterator;
+  // Both arrays are sorted, as segments don't intersect
+  ArrayType<float> Starts;
+  ArrayType<float> Ends;
+
+  size_t LowerBound(float Time) const;
+  size_t UpperBound(float Time) const;
+
+  // Appends a segment that doesn't end before the last one, touching segments are united
+  void Append(float Start, float End);
+
+  /**
+   * Merge intersection of two holders, where segments of Other are shifted by -Shift
+   * and their ends are lowered by Lowering. Result is written to Out.
+   */
+  void IntersectInto(const SegmentHolder& Other, float Shift, float Lowering, SegmentHolder& Out) const;
 
 public:
+  /**
+   * Iterates segments by value, as they are not stored as Segment.
+   */
+  class const_iterator
+  {
+  private:
+    const SegmentHolder* Holder = nullptr;
+    size_t Index = 0;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Segment;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Segment*;
+    using reference = Segment;
+
+    struct ArrowProxy
+    {
+      Segment Value;
+      const Segment* operator->() const { return &Value; }
+    };
+
+    const_iterator() = default;
+    const_iterator(const SegmentHolder* InHolder, size_t InIndex)
+      : Holder(InHolder)
+      , Index(InIndex)
+    { }
+
+    Segment operator*() const { return { Holder->Starts[Index], Holder->Ends[Index] }; }
+    ArrowProxy operator->() const { return { **this }; }
+
+    const_iterator& operator++() { ++Index; return *this; }
+    const_iterator operator++(int) { const_iterator Previous = *this; ++Index; return Previous; }
+
+    bool operator==(const const_iterator& Other) const { return Index == Other.Index && Holder == Other.Holder; }
+    bool operator!=(const const_iterator& Other) const { return !operator==(Other); }
+  };
+
   SegmentHolder();
   SegmentHolder(Segment StartSegment);
 
@@ -65,9 +123,17 @@ public:
 
   SegmentHolder operator&(const SegmentHolder& Other) const;
 
+  /**
+   * The same as intersection with a copy of Other after "-= Shift" and "LowerSegments(Lowering)",
+   * but without the copy. Used for every touched cell of a move.
+   */
+  void IntersectWithLowered(const SegmentHolder& Other, float Shift, float Lowering);
+
   const_iterator begin() const;
   const_iterator end() const;
 
+  size_t Num() const { return Ends.size(); }
+
   bool operator==(const SegmentHolder& Other) const;
   void operator-=(float DeltaTime);
 
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DynamicObstacles.h"
+#include "Misc/ScopeLock.h"
+#include "Moves.h"
+#include "SearchTypes.h"
+#include "Shapes.h"
+
+#include <fstream>
+#include <istream>
+#include <string>
+
+#define SESSION_FORMAT_VERSION 1
+
+enum class ESessionEventType : uint8_t
+{
+  Tick,
+  AddAgent,
+  RemoveAgent,
+  ChangeGoal,
+  ChangeSpace,
+  AddObstacle,
+  UpdateObstacle,
+  RemoveObstacle,
+  SetDepth,
+  SetMinDepth,
+  SetConflictResolution,
+  RegisterGoals,
+  SetSharding,
+  AddGoals,
+  SetPathShortcuts,
+  SetBidirectionalHeuristic
+};
+
+struct SessionSharding
+{
+  int TileSize = 0;
+  int Halo = 0;
+  int MaxConcurrentReplans = 0;
+};
+
+/**
+ * One call to the multiagent pathfinder that changes its state.
+ * Only fields used by the event type are written.
+ */
+struct SessionEvent
+{
+  ESessionEventType Type = ESessionEventType::Tick;
+
+  // Time of the pathfinder clock when the event happened
+  float Time = 0;
+
+  // Agent or obstacle
+  int ID = -1;
+
+  // Delta time, depth or agent speed
+  float Value = 0;
+
+  // Traversability of a changed cell or an enabled planner option
+  bool bFlag = false;
+
+  // Agent start or changed cell
+  FPoint Point;
+  FPoint Goal;
+  FShape Shape;
+  TArray<FPointMove> Moves;
+  // Registered goals of distance tables or goals queued for an agent
+  TArray<FPoint> Goals;
+
+  FObstacleTrajectory Trajectory;
+  SessionSharding Sharding;
+};
+
+/**
+ * Streams session events to a text file, one event per line.
+ * Events can be recorded from any thread, they are written in the order of recording.
+ */
+class SessionRecorder
+{
+protected:
+  std::ofstream SessionFile;
+
+  mutable FCriticalSection RecordSync;
+
+public:
+  /**
+   * Starts a new session file. StartTime is the pathfinder clock at the start,
+   * it is restored by the replay, so moving obstacles keep their timing.
+   */
+  bool Start(const TCHAR* FileName, float StartTime);
+
+  void Stop();
+
+  bool IsRecording() const;
+
+  void Record(const SessionEvent& Event);
+};
+
+/**
+ * Writes the event as one line of a session.
+ */
+void WriteSessionEvent(std::ostream& Stream, const SessionEvent& Event);
+
+/**
+ * Reads one event written by WriteSessionEvent. Returns false if the event is broken.
+ */
+bool ReadSessionEvent(std::istream& Stream, SessionEvent& OutEvent);
+
+/**
+ * Returns false if the stream is not a session of a supported version.
+ */
+bool ReadSession(std::istream& Stream, float& OutStartTime, ArrayType<SessionEvent>& OutEvents);
+
+/**
+ * Wall clock duration of every Tick of a replay.
+ */
+struct ReplayReport
+{
+  ArrayType<float> TickTime;
+  // In milliseconds
+  ArrayType<double> TickLatency;
+
+  void AddTick(float Time, double Latency);
+
+  double GetPercentile(double Percentile) const;
+
+  std::string ToJson() const;
+};
@@ -1,11 +1,11 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "SearchArena.h"
 #include "SearchTypes.h"
 #include "Space.h"
 
 #include <memory>
-#include <unordered_set>
 
 #include "Shapes.generated.h"
 
@@ -26,13 +26,49 @@ struct FShape
   ArrayType<FPoint> ApplyShapeTo(FPoint Point) const;
 };
 
+/**
+ * Shapes that are common enough to be joined from constexpr tables,
+ * order of points in the tables doesn't matter.
+ */
+enum class EStaticShape : uint8_t
+{
+  Custom,
+  Cell,
+  Plus,
+  Square
+};
+
+constexpr StaticDelta CellShapePoints[] = {
+  { 0, 0 }
+};
+
+// The default shape of FShape
+constexpr StaticDelta PlusShapePoints[] = {
+  { 0, -1 }, { -1, 0 }, { 0, 0 }, { 1, 0 }, { 0, 1 }
+};
+
+constexpr StaticDelta SquareShapePoints[] = {
+  { -1, -1 }, { 0, -1 }, { 1, -1 },
+  { -1, 0 }, { 0, 0 }, { 1, 0 },
+  { -1, 1 }, { 0, 1 }, { 1, 1 }
+};
+
+EStaticShape ClassifyShape(const FShape& Shape);
+
 class ShapeSpace : public SpaceTime
 {
 private:
   std::shared_ptr<SegmentSpace> OriginalSpace;
   FShape Shape;
+  EStaticShape StaticShape;
 
-  std::unordered_set<FPoint> PointCache;
+  using PointCacheType = HashSetType<FPoint, std::hash<FPoint>, std::equal_to<FPoint>, ArenaAllocator<FPoint>>;
+  PointCacheType PointCache;
+  // Cached cells of the previous search, the containers of the next one are sized for them
+  size_t PreviousCellsNum = 0;
+
+  template<typename PointsType>
+  void JoinShape(FPoint Point, const PointsType& ShapePoints);
 
 public:
   ShapeSpace() = delete;
@@ -40,6 +76,16 @@ public:
   ShapeSpace(float Depth, std::shared_ptr<SegmentSpace> InSpace, const FShape& InShape);
 
   void UpdateShape(FPoint Point);
+
+  /**
+   * Joins the shape over another space. Cached cells are cleared,
+   * they are allocated from the arena if it is given,
+   * otherwise the containers keep their memory for the next search.
+   */
+  void Reset(std::shared_ptr<SegmentSpace> InSpace, const FShape& InShape, SearchArena* Arena = nullptr);
+
+  // Drops the reference to the space and the cached cells till the next Reset, so their arena may be released
+  void ReleaseSpace();
 };
 
 void FromReversedPathToFilledAreas(const ArrayType<Node<Area>>& Path, const FShape& Shape, ArrayType<Area>& Areas);
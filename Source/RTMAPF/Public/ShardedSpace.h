@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SearchTypes.h"
+#include "Segments.h"
+#include "Shapes.h"
+#include "Space.h"
+
+#include <memory>
+
+/**
+ * Reservation tables of square tiles (shards) of the world.
+ *
+ * The table of a shard holds the cells of its tile and of a halo around it, windows of agents
+ * in the shard are searched only there. Reservations of the cells are written into the tables
+ * of every shard holding them, so a path crossing into the halo is seen by the neighbour shard.
+ * Halo is at most a half of the tile, so the cells of a shard are held only by the shards
+ * of its block, the shard and its eight neighbours. Replans whose blocks don't intersect
+ * may run at the same time.
+ *
+ * Tables are copied from the base space with static cells and obstacles when they are used first,
+ * the counted reservations of the obstacles are copied too, so paths and obstacles overlapping
+ * in a shard don't reopen each other.
+ * Tables are released when there are no agents and no reservations of paths in them.
+ * Without tiles the base space is the only shard.
+ */
+class ShardedSpace
+{
+protected:
+  struct Shard
+  {
+    std::shared_ptr<SpaceTime> Space;
+    // Areas of paths written into the table
+    int64_t ReservedAreasNum = 0;
+  };
+
+  std::shared_ptr<SpaceTime> Base;
+  int Width = 0;
+  int Height = 0;
+  int TileSize = 0;
+  int Halo = 0;
+  int TilesX = 1;
+  int TilesY = 1;
+
+  ArrayType<Shard> Shards;
+
+  FPoint GetTile(int ShardIndex) const { return { ShardIndex % TilesX, ShardIndex / TilesX }; }
+  int GetShardIndex(FPoint Tile) const { return Tile.X + Tile.Y * TilesX; }
+
+  // Appends shards whose tables hold the point, they are in the block of its tile
+  void FindShardsHolding(FPoint Point, ArrayType<int>& OutShards) const;
+
+  void WriteAreas(const ArrayType<Area>& Areas, bool bReserve);
+
+public:
+  explicit ShardedSpace(std::shared_ptr<SpaceTime> InBase);
+  ShardedSpace(std::shared_ptr<SpaceTime> InBase, int InWidth, int InHeight, int InTileSize, int InHalo);
+
+  bool IsSharded() const { return TileSize > 0; }
+
+  int GetTileSize() const { return TileSize; }
+  int GetHalo() const { return Halo; }
+
+  // Points outside the world belong to the nearest tile
+  int FindShard(FPoint Point) const;
+
+  /**
+   * Adds the shard and its neighbours, whose tables may hold the same cells, to OutShards.
+   * Negative shards are ignored.
+   */
+  void FindBlock(int ShardIndex, SetType<int>& OutShards) const;
+
+  bool IsInRegion(int ShardIndex, FPoint Point) const;
+
+  /**
+   * Creates the table of the shard if it was not used yet or was released.
+   * Should be called only by the owner of the block of the shard.
+   */
+  std::shared_ptr<SpaceTime> GetShardSpace(int ShardIndex);
+
+  /**
+   * Returns a free cell of the region of the shard nearest to the goal outside it,
+   * where the shape fits at the border, so a window can be searched towards it.
+   * Returns the goal itself if there is no such cell.
+   */
+  FPoint FindRegionGoal(int ShardIndex, FPoint Goal, const FShape& Shape);
+
+  // Reservations of paths, written into all shards holding their cells
+  void ReserveAreas(const ArrayType<Area>& Areas);
+  void ReleaseAreas(const ArrayType<Area>& Areas);
+
+  /**
+   * Obstacles and static cells are already changed in the base space.
+   * Only existing tables are updated, new ones are copied from the base space.
+   */
+  void ApplyObstacles(const ArrayType<Area>& ReleasedAreas, const ArrayType<Area>& ReservedAreas);
+  void UpdateCell(FPoint Point);
+
+  /**
+   * Drops tables without reservations of paths, except the tables of UsedShards.
+   * Should be called when no replan is running.
+   */
+  void ReleaseIdle(const SetType<int>& UsedShards);
+
+  int GetShardsNum() const { return (int) Shards.size(); }
+  int GetActiveShardsNum() const;
+};
@@ -1,10 +1,12 @@
 #pragma once
 
 #include "Misc/Optional.h"
+#include "SearchArena.h"
 #include "SearchTypes.h"
 #include "Segments.h"
 
 #include <iostream>
+#include <map>
 #include <stdexcept>
 
 template<typename CellType>
@@ -61,14 +63,45 @@ public:
 
 class SegmentSpace : public Space<Area>
 {
+public:
+  // Spaces of a search allocate the grid from its arena
+  using SegmentGridType = MapType<FPoint, SegmentHolder, std::hash<FPoint>, std::equal_to<FPoint>, ArenaAllocator<std::pair<const FPoint, SegmentHolder>>>;
+
 protected:
-  MapType<FPoint, SegmentHolder> SegmentGrid;
+  SegmentGridType SegmentGrid;
+
+  /**
+   * Numbers of writes of MakeAreasInaccessable covering the times of a cell that are not released yet.
+   * The count of a key lasts till the next key, the count of the last key is zero.
+   * Agents and obstacles may reserve overlapping segments of a cell,
+   * a released segment is reopened only where the count drops to zero.
+   * Counts are kept while the cell is inaccessable, so a cell made accessable again stays reserved.
+   */
+  using ReservationCounts = std::map<float, int>;
+  MapType<FPoint, ReservationCounts> Reservations;
+
+  // Starts a piece of the counts at Time if there is none
+  static ReservationCounts::iterator SplitCounts(ReservationCounts& Counts, float Time);
+  // Joins the piece with the previous one if they have the same count
+  static void MergeCounts(ReservationCounts& Counts, ReservationCounts::iterator Piece);
+
+  void ReserveSegment(FPoint Point, const Segment& Reserved);
+  void ReleaseSegment(FPoint Point, const Segment& Released);
 
 public:
   SegmentSpace();
   SegmentSpace(float Depth, const RawSpace& Base);
 
+  // Reservations of the cell are kept, they should stay out of NewAccess
   void SetSegments(FPoint Point, const SegmentHolder& NewAccess);
+
+  /**
+   * Copies the free segments of a cell of another space with its reservations,
+   * so a release in the copy reopens the same parts as in the source.
+   * The cell is removed if the source doesn't contain it, its reservations are copied still.
+   */
+  void CopyCellFrom(const SegmentSpace& Source, FPoint Point);
+
   const SegmentHolder& GetSegments(FPoint Point) const;
   bool ContainsSegmentsIn(FPoint Point) const;
   
@@ -76,11 +109,19 @@ public:
   virtual void SetAccess(Area Cell, Access Access) override;
   virtual bool Contains(Area Cell) const override;
 
+  // Areas of inaccessable cells are counted too and cut out when the cells are made accessable
   void MakeAreasInaccessable(const ArrayType<Area>& Areas);
+
+  /**
+   * Releases areas reserved by MakeAreasInaccessable. Parts of the areas that are
+   * still reserved by other writes stay inaccessable.
+   * Every area should be reserved before, releasing another one is an error.
+   */
   void MakeAreasAccessable(const std::vector<Area>& Areas);
 
   TOptional<Area> FindArea(FPoint Point, float Time) const;
 
+  // A cell made accessable is free in [0, Depth] except for its reservations
   void SetAccess(const FPoint& Point, Access Access, const float& Depth);
 };
 
@@ -110,4 +151,12 @@ public:
   SpaceReader();
 
   TOptional<RawSpace> FromHogFormat(std::istream& File);
+
+  /**
+   * Reads the header of a hog map and finds where its rows start and the distance between them,
+   * so a part of the map can be read without reading the rows above it.
+   */
+  bool FindHogLayout(std::istream& File, uint32_t& Width, uint32_t& Height, std::streamoff& RowsOffset, std::streamoff& RowStride);
+
+  Access FromSymbol(char Symbol) const;
 };
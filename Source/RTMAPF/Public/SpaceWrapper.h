@@ -1,12 +1,17 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "DynamicObstacles.h"
 #include "Space.h"
+#include "TileStreamer.h"
 
 #include <memory>
 
 #include "SpaceWrapper.generated.h"
 
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpaceChanged, FPoint);
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnObstacleChanged, EObstacleChange, int, const FObstacleTrajectory&);
+
 UCLASS(Blueprintable)
 class ASpace : public AActor
 {
@@ -14,6 +19,11 @@ class ASpace : public AActor
 
 protected:
   std::shared_ptr<SpaceTime> Space = std::make_shared<SpaceTime>(std::numeric_limits<float>::infinity());
+  std::shared_ptr<DynamicObstacleLayer> Obstacles = std::make_shared<DynamicObstacleLayer>(Space);
+  // Traversability of cells without reservations and obstacles, if the space is loaded from a file
+  std::shared_ptr<RawSpace> StaticSpace;
+  // Loads tiles of the space if it is streamed from a file
+  std::shared_ptr<TileStreamer> Streamer;
 
 public:
   UFUNCTION(BlueprintCallable)
@@ -22,11 +32,36 @@ public:
   UFUNCTION(BlueprintCallable)
   void InitFromFile(FString FileName);
 
+  /**
+   * Starts with an empty space, tiles of the map are loaded around agents by the multiagent pathfinder
+   * and evicted when more than MaxLoadedTiles are loaded. There is no static space then.
+   */
+  UFUNCTION(BlueprintCallable)
+  bool InitStreamingFromFile(FString FileName, int TileSize, int MaxLoadedTiles, int DemandRadius);
+
   std::shared_ptr<SpaceTime> GetSpace() const
   {
     return Space;
   }
 
+  std::shared_ptr<DynamicObstacleLayer> GetObstacles() const
+  {
+    return Obstacles;
+  }
+
+  std::shared_ptr<const RawSpace> GetStaticSpace() const
+  {
+    return StaticSpace;
+  }
+
+  std::shared_ptr<TileStreamer> GetStreamer() const
+  {
+    return Streamer;
+  }
+
+  // Returns false if the space is not loaded from a file
+  bool GetMapSize(uint32_t& OutWidth, uint32_t& OutHeight) const;
+
   UFUNCTION(BlueprintCallable)
   FVector Translate(FPoint Point) const;
 
@@ -35,4 +70,23 @@ public:
 
   UFUNCTION(BlueprintCallable)
   void ChangeSpaceUnsafe(FPoint Point, bool IsTraversable);
+
+  /**
+   * Moving obstacles are applied to the space by the multiagent pathfinder
+   * between replans, so these functions can be called at any moment.
+   */
+  UFUNCTION(BlueprintCallable)
+  int AddObstacle(const FObstacleTrajectory& Trajectory);
+
+  UFUNCTION(BlueprintCallable)
+  bool UpdateObstacle(int ObstacleID, const FObstacleTrajectory& Trajectory);
+
+  UFUNCTION(BlueprintCallable)
+  void RemoveObstacle(int ObstacleID);
+
+  // Broadcasted after a cell of the static space is changed
+  FOnSpaceChanged OnSpaceChanged;
+
+  // Broadcasted after a change of an obstacle is staged, removal passes an empty trajectory
+  FOnObstacleChanged OnObstacleChanged;
 };
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Heuristic.h"
+#include "Misc/ScopeLock.h"
+#include "Moves.h"
+#include "SearchTypes.h"
+#include "Shapes.h"
+#include "Space.h"
+
+#include <memory>
+
+#define DISTANCE_TABLES_FORMAT_VERSION 1
+
+/**
+ * Costs of the shortest paths from every cell of the static space to one goal
+ * for agents of one shape and move set at the speed of 1.
+ * Cells are stored row by row, unreachable cells hold HEURISTIC_COST_NOT_FOUND.
+ */
+class DistanceTable
+{
+protected:
+  FPoint Goal;
+  FShape Shape;
+  // Costs are for the speed of 1
+  ArrayType<MoveDelta<FPoint>> Moves;
+
+  uint32_t Width = 0;
+  uint32_t Height = 0;
+
+  // Either an owned array or a mapped file, which may be shared by several tables
+  std::shared_ptr<const void> Storage;
+  const float* Distances = nullptr;
+
+public:
+  DistanceTable(
+    FPoint InGoal,
+    const FShape& InShape,
+    const ArrayType<MoveDelta<FPoint>>& InMoves,
+    uint32_t InWidth,
+    uint32_t InHeight,
+    std::shared_ptr<const void> InStorage,
+    const float* InDistances
+  );
+
+  /**
+   * Runs Dijkstra from the goal over the whole static space.
+   * Moves are expected to be symmetric, as they are by the plane search of FindWindowPath.
+   */
+  static std::shared_ptr<DistanceTable> Build(const RawSpace& Static, FPoint Goal, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves);
+
+  float GetDistance(FPoint Point) const
+  {
+    if (Point.X < 0 || Point.Y < 0 || (uint32_t) Point.X >= Width || (uint32_t) Point.Y >= Height)
+    {
+      return HEURISTIC_COST_NOT_FOUND;
+    }
+
+    return Distances[Point.X + (size_t) Point.Y * Width];
+  }
+
+  /**
+   * Moves are the ones of the agent, which are divided by its speed.
+   */
+  bool IsFor(const FShape& InShape, const ArrayType<MoveDelta<FPoint>>& InMoves, float Speed) const;
+
+  /**
+   * Whether a change of the static cell may change the distances.
+   * Moves of the search start at reached cells, so only cells near a reached one are tested.
+   */
+  bool IsAffectedBy(FPoint Changed) const;
+
+  FPoint GetGoal() const { return Goal; }
+  const FShape& GetShape() const { return Shape; }
+  const ArrayType<MoveDelta<FPoint>>& GetMoves() const { return Moves; }
+  uint32_t GetWidth() const { return Width; }
+  uint32_t GetHeight() const { return Height; }
+  const float* GetDistances() const { return Distances; }
+};
+
+// Shapes with the same points in any order
+bool IsSameShape(const FShape& First, const FShape& Second);
+
+/**
+ * Plane heuristic of an agent read from a precomputed table.
+ */
+class DistanceTableHeuristic final : public Heuristic<FPoint>
+{
+private:
+  std::shared_ptr<const DistanceTable> Table;
+  float Speed;
+
+public:
+  DistanceTableHeuristic(std::shared_ptr<const DistanceTable> InTable, float InSpeed)
+    : Heuristic<FPoint>(InTable->GetGoal())
+    , Table(InTable)
+    , Speed(InSpeed)
+  {}
+
+  // The table may be reset to nullptr to release it, the heuristic isn't used then
+  void SetTable(std::shared_ptr<const DistanceTable> InTable, float InSpeed)
+  {
+    Table = InTable;
+    Speed = InSpeed;
+  }
+
+  virtual bool IsCostFound(FPoint To) const override { return Table->GetDistance(To) >= 0; }
+
+  virtual float GetCost(FPoint To) const override { return Table->GetDistance(To) / Speed; }
+
+  virtual void FindCost(FPoint To) override {}
+
+  virtual void FindCosts(const FPoint* Cells, size_t Num, float* OutCosts) override
+  {
+    for (size_t CellIndex = 0; CellIndex < Num; ++CellIndex)
+    {
+      const float Distance = Table->GetDistance(Cells[CellIndex]);
+      OutCosts[CellIndex] = Distance >= 0 ? Distance / Speed : HEURISTIC_COST_NOT_FOUND;
+    }
+  }
+
+  virtual FPoint GetOrigin() const override { return Table->GetGoal(); }
+};
+
+/**
+ * Distance tables of registered goals, shared read-only by all planning tasks.
+ *
+ * A change of a static cell makes the tables reaching it stale, they aren't found till they are
+ * rebuilt. Rebuilds run in the thread pool on a copy of the static space and are swapped in when done.
+ * Tables can be saved to a file and mapped into memory by other processes with the same map.
+ */
+class StaticDistanceTables
+{
+protected:
+  struct GoalSet
+  {
+    ArrayType<FPoint> Goals;
+    FShape Shape;
+    ArrayType<MoveDelta<FPoint>> Moves;
+  };
+
+  std::shared_ptr<const RawSpace> Static;
+  ArrayType<GoalSet> Registered;
+
+  MapType<FPoint, ArrayType<std::shared_ptr<const DistanceTable>>> GoalToTables;
+  // Tables with the number of the last change that made them stale
+  MapType<const DistanceTable*, uint64_t> StaleTables;
+  uint64_t ChangesNum = 0;
+
+  struct RebuiltTables
+  {
+    // Changes made after this one aren't seen by the rebuilt tables
+    uint64_t ChangesNum = 0;
+    ArrayType<std::shared_ptr<const DistanceTable>> Stale;
+    ArrayType<std::shared_ptr<const DistanceTable>> Rebuilt;
+  };
+  TFuture<RebuiltTables> Rebuild;
+
+  mutable FCriticalSection TablesSync;
+
+  void BuildTables(const GoalSet& Set, ArrayType<std::shared_ptr<const DistanceTable>>& OutTables) const;
+  // Expects TablesSync to be locked
+  void MarkAllStale();
+  // Returns false if there is nothing to rebuild
+  bool StartRebuild();
+  void FinishRebuild(bool bWait);
+
+public:
+  void SetStaticSpace(std::shared_ptr<const RawSpace> InStatic);
+
+  /**
+   * Builds tables of every goal for the shape and moves at the speed of 1.
+   * Returns false if there is no static space.
+   */
+  bool Register(const ArrayType<FPoint>& Goals, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves);
+
+  // Called after the cell of the static space is changed
+  void MarkStale(FPoint ChangedPoint);
+
+  /**
+   * Swaps in the tables of a finished rebuild and starts rebuilding the tables made stale since.
+   * With bWait the rebuild is finished before the call returns.
+   */
+  void RebuildIfStale(bool bWait);
+
+  /**
+   * Returns nullptr if there is no table for the goal and the class of the agent,
+   * or if the table is stale.
+   */
+  std::shared_ptr<const DistanceTable> Find(FPoint Goal, const FShape& Shape, const ArrayType<MoveDelta<FPoint>>& Moves, float Speed) const;
+
+  bool Save(const TCHAR* FileName) const;
+
+  /**
+   * Maps the tables of the file into memory, replacing the registered ones.
+   * Returns false if the file wasn't saved for the current static space.
+   */
+  bool Load(const TCHAR* FileName);
+
+  void Clear();
+
+  size_t Num() const;
+};
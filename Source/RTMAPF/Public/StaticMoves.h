@@ -0,0 +1,238 @@
+#pragma once
+
+#include "Agent.h"
+#include "PlannerStats.h"
+#include "SearchArena.h"
+#include "SearchTypes.h"
+#include "Shapes.h"
+
+#include <memory>
+#include <unordered_map>
+
+/**
+ * Move sets that are common enough to be tested from constexpr tables.
+ * Custom moves are tested by MovesTestSegment.
+ */
+enum class EStaticMoveSet : uint8_t
+{
+  Custom,
+  FourConnected,
+  EightConnected
+};
+
+/**
+ * Cell touched by a unit move with its time segment for the move cost of 1,
+ * as computed by GetTouchedSegments.
+ */
+struct StaticTouchedCell
+{
+  StaticDelta Delta;
+  float Start;
+  float End;
+};
+
+#define STATIC_MOVE_MAX_TOUCHED 4
+
+/**
+ * The origin and the destination are always the first two touched cells.
+ */
+struct StaticMove
+{
+  StaticDelta Delta;
+  int TouchedNum;
+  StaticTouchedCell Touched[STATIC_MOVE_MAX_TOUCHED];
+};
+
+// (2 - sqrt(2)) / 4, when the square of the agent enters the destination and the side cells of a diagonal move
+constexpr float DiagonalSideStart = 0.146446586f;
+// (2 + sqrt(2)) / 4, when the square of the agent leaves the origin and the side cells of a diagonal move
+constexpr float DiagonalSideEnd = 0.853553414f;
+
+// The same order as the default moves of UAgent, four connected moves are the first half
+constexpr StaticMove UnitMoves[] = {
+  { { 0, 1 }, 2, { { { 0, 0 }, 0, 1 }, { { 0, 1 }, 0, 1 } } },
+  { { 0, -1 }, 2, { { { 0, 0 }, 0, 1 }, { { 0, -1 }, 0, 1 } } },
+  { { 1, 0 }, 2, { { { 0, 0 }, 0, 1 }, { { 1, 0 }, 0, 1 } } },
+  { { -1, 0 }, 2, { { { 0, 0 }, 0, 1 }, { { -1, 0 }, 0, 1 } } },
+  { { 1, 1 }, 4, { { { 0, 0 }, 0, DiagonalSideEnd }, { { 1, 1 }, DiagonalSideStart, 1 }, { { 0, 1 }, DiagonalSideStart, DiagonalSideEnd }, { { 1, 0 }, DiagonalSideStart, DiagonalSideEnd } } },
+  { { -1, -1 }, 4, { { { 0, 0 }, 0, DiagonalSideEnd }, { { -1, -1 }, DiagonalSideStart, 1 }, { { 0, -1 }, DiagonalSideStart, DiagonalSideEnd }, { { -1, 0 }, DiagonalSideStart, DiagonalSideEnd } } },
+  { { 1, -1 }, 4, { { { 0, 0 }, 0, DiagonalSideEnd }, { { 1, -1 }, DiagonalSideStart, 1 }, { { 0, -1 }, DiagonalSideStart, DiagonalSideEnd }, { { 1, 0 }, DiagonalSideStart, DiagonalSideEnd } } },
+  { { -1, 1 }, 4, { { { 0, 0 }, 0, DiagonalSideEnd }, { { -1, 1 }, DiagonalSideStart, 1 }, { { 0, 1 }, DiagonalSideStart, DiagonalSideEnd }, { { -1, 0 }, DiagonalSideStart, DiagonalSideEnd } } },
+};
+
+template<EStaticMoveSet MoveSet>
+struct StaticMoveTable;
+
+template<>
+struct StaticMoveTable<EStaticMoveSet::FourConnected>
+{
+  enum { Num = 4 };
+};
+
+template<>
+struct StaticMoveTable<EStaticMoveSet::EightConnected>
+{
+  enum { Num = 8 };
+};
+
+/**
+ * Returns Custom if the moves are not a prefix of UnitMoves of a known size in the same order.
+ * Costs of the moves are not restricted.
+ */
+EStaticMoveSet ClassifyMoves(const ArrayType<MoveDelta<FPoint>>& Moves);
+
+/**
+ * MovesTestSegment for a move set known at compile time.
+ * Touched segments are read from UnitMoves instead of GetTouchedSegments, loops over moves
+ * have a constant length and the class is final, so Pathfinder calls it without virtual dispatch.
+ * Found moves are the same as the ones of MovesTestSegment in the same order.
+ */
+template<EStaticMoveSet MoveSet>
+class StaticMovesTestSegment final : public MoveComponent<Area>, public MoveComponent<FPoint>
+{
+protected:
+  using Table = StaticMoveTable<MoveSet>;
+
+  float Depth;
+  std::shared_ptr<ShapeSpace> Space;
+  float Costs[Table::Num];
+  SearchArena* ScratchArena = nullptr;
+
+public:
+  virtual ArrayType<MoveDelta<Area>> FindValidMoves(const Node<Area>& Node) override;
+
+  virtual ArrayType<MoveDelta<FPoint>> FindValidMoves(const Node<FPoint>& Node) override;
+
+  StaticMovesTestSegment(const ArrayType<MoveDelta<FPoint>>& InMoves, std::shared_ptr<ShapeSpace> InSpace, float InDepth)
+    : Space(InSpace)
+  {
+    Reset(InMoves, InDepth);
+  }
+
+  // Moves are tested in the same space for another agent
+  void Reset(const ArrayType<MoveDelta<FPoint>>& InMoves, float InDepth)
+  {
+    check(ClassifyMoves(InMoves) == MoveSet);
+    Depth = InDepth;
+    for (int MoveIndex = 0; MoveIndex < Table::Num; ++MoveIndex)
+    {
+      Costs[MoveIndex] = InMoves[MoveIndex].MoveCost;
+    }
+  }
+
+  // Temporary containers of a move are allocated from the arena, which is rewound after the move
+  void SetScratchArena(SearchArena* InScratchArena) { ScratchArena = InScratchArena; }
+};
+
+template<EStaticMoveSet MoveSet>
+ArrayType<MoveDelta<Area>> StaticMovesTestSegment<MoveSet>::FindValidMoves(const Node<Area>& Node)
+{
+  PLANNER_PHASE_SCOPE(EPlannerPhase::SippExpansion);
+
+  ArrayType<MoveDelta<Area>> Result;
+  const Area Origin = Node.Cell;
+
+  const Segment MoveAvailable{ Node.MinTime, Node.Cell.Interval.End };
+  if (Node.Cell.Interval.End >= Depth)
+  {
+    // Fictive node
+    Result.push_back({ 0, Area{Origin.Point, {Depth, Node.Cell.Interval.End }}, Depth - Node.MinTime });
+  }
+
+  for (int MoveIndex = 0; MoveIndex < Table::Num; ++MoveIndex)
+  {
+    const StaticMove& Move = UnitMoves[MoveIndex];
+    const float MoveCost = Costs[MoveIndex];
+
+    const FPoint DestinationPoint = Origin.Point + Move.Delta.ToPoint();
+    Space->UpdateShape(DestinationPoint);
+    if (!Space->ContainsSegmentsIn(DestinationPoint)) continue;
+
+    const Segment OriginMoveSegment{ Move.Touched[0].Start * MoveCost, Move.Touched[0].End * MoveCost };
+    const Segment DestinationMoveSegment{ Move.Touched[1].Start * MoveCost, Move.Touched[1].End * MoveCost };
+
+    SegmentHolder DestinationSegmentHolder = MoveAvailable;
+    DestinationSegmentHolder -= OriginMoveSegment.Start;
+    DestinationSegmentHolder.LowerSegments(OriginMoveSegment.GetLength());
+
+    for (int TouchedIndex = 0; TouchedIndex < Move.TouchedNum; ++TouchedIndex)
+    {
+      const StaticTouchedCell& Touched = Move.Touched[TouchedIndex];
+      const FPoint MovePoint = Origin.Point + Touched.Delta.ToPoint();
+      const Segment MovementSegment{ Touched.Start * MoveCost, Touched.End * MoveCost };
+
+      Space->UpdateShape(MovePoint);
+      if (!Space->ContainsSegmentsIn(MovePoint))
+      {
+        // Impossible Move
+        DestinationSegmentHolder = SegmentHolder();
+        break;
+      }
+
+      DestinationSegmentHolder.IntersectWithLowered(Space->GetSegments(MovePoint), MovementSegment.Start, MovementSegment.GetLength());
+    }
+
+    const SegmentHolder& OriginalDestinationSegments = Space->GetSegments(DestinationPoint);
+
+    SearchArenaScope ScratchScope(ScratchArena);
+    MapType<Segment, float, std::hash<Segment>, std::equal_to<Segment>, ArenaAllocator<std::pair<const Segment, float>>> DestinationSegmentToMinTime{
+      ArenaAllocator<std::pair<const Segment, float>>(ScratchArena)
+    };
+    for (const Segment DestinationSegment : DestinationSegmentHolder)
+    {
+      const float TimeOnDestination = DestinationSegment.Start + DestinationMoveSegment.Start;
+      Segment OriginalSegment = OriginalDestinationSegments.Find(TimeOnDestination);
+
+      if (OriginalSegment.IsValid() && !DestinationSegmentToMinTime.count(OriginalSegment))
+      {
+        DestinationSegmentToMinTime[OriginalSegment] = DestinationSegment.Start + OriginMoveSegment.Start;
+      }
+    }
+
+    for (auto& SegmentAndTime : DestinationSegmentToMinTime)
+    {
+      const float MovementStartTime = SegmentAndTime.second;
+      check(MovementStartTime >= Node.MinTime);
+      Result.push_back({ MoveCost, Area{DestinationPoint, SegmentAndTime.first}, MovementStartTime - Node.MinTime });
+    }
+  }
+
+  return Result;
+}
+
+template<EStaticMoveSet MoveSet>
+ArrayType<MoveDelta<FPoint>> StaticMovesTestSegment<MoveSet>::FindValidMoves(const Node<FPoint>& Node)
+{
+  ArrayType<MoveDelta<FPoint>> Result;
+  const FPoint Origin = Node.Cell;
+
+  for (int MoveIndex = 0; MoveIndex < Table::Num; ++MoveIndex)
+  {
+    const StaticMove& Move = UnitMoves[MoveIndex];
+
+    bool Error = false;
+    for (int TouchedIndex = 0; TouchedIndex < Move.TouchedNum; ++TouchedIndex)
+    {
+      const FPoint MovePoint = Origin + Move.Touched[TouchedIndex].Delta.ToPoint();
+      Space->UpdateShape(MovePoint);
+      if (!Space->ContainsSegmentsIn(MovePoint))
+      {
+        Error = true;
+        break;
+      }
+      const SegmentHolder& Segments = Space->GetSegments(MovePoint);
+      if (Segments.begin() == Segments.end())
+      {
+        Error = true;
+        break;
+      }
+    }
+
+    if (!Error)
+    {
+      Result.push_back({ Costs[MoveIndex], Origin + Move.Delta.ToPoint() });
+    }
+  }
+
+  return Result;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SearchTypes.h"
+#include "Segments.h"
+#include "Space.h"
+
+#include <istream>
+#include <memory>
+
+/**
+ * Free cells of one tile read from the map file.
+ */
+struct StreamedTile
+{
+  bool bRead = false;
+  ArrayType<FPoint> FreePoints;
+};
+
+/**
+ * Loads square tiles of a hog map into a SpaceTime on demand, so the whole map is never held in memory.
+ *
+ * Tiles around agents are requested by Demand and read by background tasks,
+ * each of them seeks only the rows of its tile. Read tiles are written into the space
+ * and tiles above MaxLoadedTiles are removed from it by Commit, the least recently demanded first.
+ * Tiles with agents or their paths are pinned and never removed.
+ * Runtime changes of cells are written again when their tile is reloaded. Holes of obstacles
+ * are counted by the space in removed cells too, so they are cut out of reloaded cells by the space.
+ */
+class TileStreamer
+{
+protected:
+  struct TileState
+  {
+    bool bLoaded = false;
+    int Pins = 0;
+    uint64_t LastDemand = 0;
+  };
+
+  std::shared_ptr<SpaceTime> Space;
+
+  FString FileName;
+  uint32_t Width = 0;
+  uint32_t Height = 0;
+  std::streamoff RowsOffset = 0;
+  std::streamoff RowStride = 0;
+
+  int TileSize = 0;
+  int TilesX = 0;
+  int TilesY = 0;
+  int MaxLoadedTiles = 0;
+  // Half size of the square around an agent whose tiles should be loaded
+  int DemandRadius = 0;
+
+  // Loaded, loading or pinned tiles
+  MapType<int, TileState> Tiles;
+  MapType<int, TFuture<StreamedTile>> Loads;
+  int LoadedTilesNum = 0;
+  uint64_t DemandClock = 0;
+
+  MapType<int, SetType<int>> AgentToTiles;
+  MapType<FPoint, bool> CellOverrides;
+
+  FPoint GetTileMin(int Tile) const { return { (Tile % TilesX) * TileSize, (Tile / TilesX) * TileSize }; }
+  FPoint GetTileMax(int Tile) const;
+
+  // Adds tiles of the square around the point to OutTiles
+  void FindTilesAround(FPoint Point, SetType<int>& OutTiles) const;
+
+  void RequestTiles(const SetType<int>& RequestedTiles);
+  void ApplyTile(int Tile, const StreamedTile& ReadTile, ArrayType<FPoint>& OutChangedPoints);
+  void EvictTile(int Tile, ArrayType<FPoint>& OutChangedPoints);
+
+public:
+  explicit TileStreamer(std::shared_ptr<SpaceTime> InSpace);
+
+  /**
+   * Reads only the header of the map. Returns false if the file can't be streamed.
+   */
+  bool Open(const FString& InFileName, int InTileSize, int InMaxLoadedTiles, int InDemandRadius);
+
+  uint32_t GetWidth() const { return Width; }
+  uint32_t GetHeight() const { return Height; }
+
+  int FindTile(FPoint Point) const;
+  bool IsTileLoaded(FPoint Point) const;
+
+  /**
+   * Requests tiles around the point. Returns true if they are all loaded.
+   */
+  bool Demand(FPoint Point);
+
+  /**
+   * Pins tiles around the point and tiles of the reserved areas of the agent, previous pins are released.
+   */
+  void PinAgent(int AgentID, FPoint Point, const ArrayType<Area>& FilledAreas);
+  void UnpinAgent(int AgentID);
+  void UnpinAll();
+
+  // Change of a cell made at runtime, applied to the space by the caller if the tile is loaded
+  void OverrideCell(FPoint Point, bool bTraversable);
+
+  /**
+   * Writes read tiles into the space and evicts tiles above the budget.
+   * Should not be called while the space is used by planning.
+   * Cells that were added or removed are appended to OutChangedPoints,
+   * agents pinning the loaded tiles are added to OutWaitingAgents.
+   * If bWait is set, running reads are finished first.
+   */
+  void Commit(bool bWait, ArrayType<FPoint>& OutChangedPoints, SetType<int>& OutWaitingAgents);
+
+  int GetLoadedTilesNum() const { return LoadedTilesNum; }
+};